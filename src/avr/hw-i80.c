@@ -24,6 +24,7 @@
 
 #include "hw-i80.h"
 
+#include "fonts.h"
 #include "mcode-config.h"
 
 #include <avr/io.h>
@@ -406,6 +407,54 @@ void hw_i80_write_bitmap(uint8_t cmd, uint16_t length, const uint8_t *pData, uin
   hw_i80_parts_end();
 }
 
+void hw_i80_write_text(uint8_t cmd, const char *text, uint8_t length, uint16_t offValue, uint16_t onValue)
+{
+  uint8_t i;
+  uint8_t row;
+  uint8_t bitMask;
+  uint8_t currentByte;
+
+  hw_i80_parts_begin();
+  hw_i80_parts_write_cmd(cmd);
+
+  /* write loop, the glyph rows are streamed across the whole run */
+  for (row = 0; row < 8; ++row) {
+    for (i = 0; i < length; ++i) {
+      currentByte = pgm_read_byte(mcode_fonts_get_char_bitmap(text[i]) + row);
+      for (bitMask = UINT8_C(0x01); bitMask; bitMask <<= 1) {
+        const uint16_t currentData = (currentByte & bitMask) ? onValue : offValue;
+        hw_i80_write_data_2(currentData);
+        hw_i80_activate_wr();
+        hw_i80_read_write_delay();
+        hw_i80_deactivate_wr();
+        hw_i80_read_write_delay();
+      }
+    }
+  }
+
+  hw_i80_parts_end();
+}
+
+void hw_i80_write_words(const uint16_t *data, uint16_t count)
+{
+  uint16_t i;
+
+  hw_i80_parts_begin();
+  hw_i80_activate_data();
+  hw_i80_set_double_data_port_out();
+
+  /* write loop */
+  for (i = 0; i < count; ++i) {
+    hw_i80_write_data_2(data[i]);
+    hw_i80_activate_wr();
+    hw_i80_read_write_delay();
+    hw_i80_deactivate_wr();
+    hw_i80_read_write_delay();
+  }
+
+  hw_i80_parts_end();
+}
+
 void lcd_write_cmd(uint8_t cmd)
 {
   hw_i80_parts_begin();
@@ -24,7 +24,7 @@
 
 #include "hw-rtc.h"
 
-#include "hw-twi.h"
+#include "twi-queue.h"
 #include "mstring.h"
 #include "hw-sound.h"
 #include "scheduler.h"
@@ -61,14 +61,8 @@ void rtc_alarm_tick(void)
     /* Now, check which alarm expired */
     uint8_t buffer;
     buffer = 0x0fu;
-    /* Write the address of the status register */
-    if (!twi_send_sync(0xd0u, 1, &buffer)) {
-      /* Cannot write, try next tick */
-      TheIsrRequest = true;
-      return;
-    }
-    /* Read the status */
-    if (!twi_recv_sync(0xd0u, 1, &buffer)) {
+    /* Write the address of the status register and read the status */
+    if (!twi_queue_transfer_sync(0xd0u, 1, &buffer, 1, &buffer)) {
       /* Cannot read, try next tick */
       TheIsrRequest = true;
       return;
@@ -107,7 +101,7 @@ bool rtc_alarm_check_status(uint8_t status)
     uint8_t buffer[2];
     buffer[0] = 0x0f;
     buffer[1] = 0x88;
-    if (!twi_send_sync(0xd0u, 2, buffer)) {
+    if (!twi_queue_transfer_sync(0xd0u, 2, buffer, 0, NULL)) {
       /* Cannot clear the status */
       return false;
     }
@@ -80,3 +80,25 @@ uint8_t spi_transfer(uint8_t data)
   data = SPDR;
   return data;
 }
+
+void spi_transfer_block(const uint8_t *data, uint16_t length)
+{
+  while (length--) {
+    /* Writing SPDR after reading SPSR clears SPIF, the received byte is dropped */
+    SPDR = *data++;
+    while(!(SPSR & (1<<SPIF)));
+  }
+}
+
+void spi_transfer_repeat(uint16_t word, uint16_t count)
+{
+  const uint8_t high = word >> 8;
+  const uint8_t low = word;
+
+  while (count--) {
+    SPDR = high;
+    while(!(SPSR & (1<<SPIF)));
+    SPDR = low;
+    while(!(SPSR & (1<<SPIF)));
+  }
+}
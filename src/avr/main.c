@@ -38,6 +38,7 @@
 #include "console.h"
 #include "hw-sound.h"
 #include "scheduler.h"
+#include "twi-queue.h"
 #include "cmd-engine.h"
 #include "line-editor-uart.h"
 
@@ -52,6 +53,7 @@ int main (void)
 
 #ifdef MCODE_TWI
   twi_init();
+  twi_queue_init();
 #endif /* MCODE_TWI */
 
 #ifdef MCODE_RTC
@@ -130,6 +132,7 @@ int main (void)
 #endif /* MCODE_RTC */
 
 #ifdef MCODE_TWI
+  twi_queue_deinit();
   twi_deinit();
 #endif /* MCODE_TWI */
 
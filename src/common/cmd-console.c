@@ -29,11 +29,21 @@
 #include "hw-lcd.h"
 #include "console.h"
 #include "mglobal.h"
+#include "mparser.h"
+#include "mstatus.h"
 #include "mstring.h"
 
 #include <string.h>
 
 CMD_IMPL("lcd-print", TheLcdPrint, "Print expression in LCD console", cmd_lcd_print, NULL, 0);
+#ifdef __linux__
+static bool cmd_lcd_stats(const TCmdData *data, const char *args, size_t args_len, bool *start_cmd);
+CMD_IMPL("lcd-stats", TheLcdStats, "Show and reset LCD counters", cmd_lcd_stats, NULL, 0);
+static bool cmd_lcd_crc(const TCmdData *data, const char *args, size_t args_len, bool *start_cmd);
+CMD_IMPL("lcd-crc", TheLcdCrc, "Show CRC-32 of LCD frame", cmd_lcd_crc, NULL, 0);
+static bool cmd_lcd_snap(const TCmdData *data, const char *args, size_t args_len, bool *start_cmd);
+CMD_IMPL("lcd-snap", TheLcdSnap, "Save LCD frame to raw RGB32 file", cmd_lcd_snap, NULL, 0);
+#endif /* __linux__ */
 
 static void cmd_engine_set_bg (const char *aParams);
 static void cmd_engine_set_color (const char *aParams);
@@ -201,6 +211,64 @@ bool cmd_lcd_print(const TCmdData *data, const char *args,
 {
   io_ostream_handler_push(console_write_byte);
   mprintexpr(args, -1);
+  console_flush();
   io_ostream_handler_pop();
   return true;
 }
+
+#ifdef __linux__
+bool cmd_lcd_stats(const TCmdData *data, const char *args, size_t args_len, bool *start_cmd)
+{
+  MLcdStats stats;
+  lcd_stats(&stats, true);
+  /* avoid division by 0 */
+  const uint64_t time = stats.time ? stats.time : 1;
+
+  mprintstr(PSTR("Commands: "));
+  mprint_uintd(stats.commands, 0);
+  mprintstr(PSTR(", data: "));
+  mprint_uintd(stats.data, 0);
+  mprint(MStringNewLine);
+  mprintstr(PSTR("Frames: "));
+  mprint_uintd(stats.frames, 0);
+  mprintstr(PSTR(" ("));
+  mprint_uintd(stats.frames * UINT64_C(1000) / time, 0);
+  mprintstr(PSTR(" per second), pixels: "));
+  mprint_uintd(stats.pixels, 0);
+  mprintstr(PSTR(" ("));
+  mprint_uintd(stats.pixels * UINT64_C(1000) / time, 0);
+  mprintstr(PSTR(" per second), time: "));
+  mprint_uintd(stats.time, 0);
+  mprintstrln(PSTR(" ms"));
+  return true;
+}
+
+bool cmd_lcd_crc(const TCmdData *data, const char *args, size_t args_len, bool *start_cmd)
+{
+  mprint_uint32(lcd_frame_crc(), false);
+  mprint(MStringNewLine);
+  return true;
+}
+
+bool cmd_lcd_snap(const TCmdData *data, const char *args, size_t args_len, bool *start_cmd)
+{
+  TokenType type;
+  uint32_t value;
+  const char *token;
+  char path[128];
+
+  /* Parse the input, should be a string */
+  type = next_token(&args, &args_len, &token, &value);
+  if (TokenString != type || value >= sizeof (path)) {
+    mcode_errno_set(EArgument);
+    return true;
+  }
+
+  memcpy(path, token, value);
+  path[value] = 0;
+  if (!lcd_snapshot(path)) {
+    mcode_errno_set(EGeneral);
+  }
+  return true;
+}
+#endif /* __linux__ */
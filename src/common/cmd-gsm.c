@@ -36,6 +36,7 @@
 #include <string.h>
 
 CMD_IMPL("sms-read", TheRd, "Read SMS to s0:1 (phone) and s1:2 (body)", cmd_gsm_read_sms, NULL, 0);
+CMD_IMPL("gsm-stats", TheGsmStats, "Show/<reset> AT command queue statistics of all GSM modules", cmd_gsm_stats, NULL, 0);
 
 #define MCODE_GSM_RSP_BUFFER_MAX_LENGTH (80)
 
@@ -44,6 +45,8 @@ static void cmd_gsm_send_sms(const char *body);
 static void cmd_engine_send_at_command(const char *args);
 static void cmd_engine_send_raw_at_command(const char *args);
 static void cmd_gsm_event_handler(MGsmEvent type, const char *from, const char *body);
+static void cmd_gsm_print_stats(const MGsmQueueStats *stats);
+static void cmd_gsm_print_hist(const char *name, const uint16_t *hist);
 
 void cmd_engine_gsm_init(void)
 {
@@ -119,6 +122,75 @@ bool cmd_gsm_read_sms(const TCmdData *data, const char *args,
   return true;
 }
 
+bool cmd_gsm_stats(const TCmdData *data, const char *args,
+                   size_t args_len, bool *start_cmd)
+{
+  uint8_t i;
+  bool reset;
+  TokenType type;
+  uint32_t value;
+  const char *token;
+  gsm_engine_t *engine;
+  const MGsmQueueStats *stats;
+
+  type = next_token(&args, &args_len, &token, &value);
+  reset = (TokenId == type && !mparser_strcmp_P(token, value, PSTR("reset")));
+  for (i = 0; i < MCODE_GSM_INSTANCES; ++i) {
+    engine = gsm_engine_at(i);
+    if (!engine) {
+      continue;
+    }
+    if (reset) {
+      gsm_engine_queue_stats_reset(engine);
+      continue;
+    }
+
+    stats = gsm_engine_queue_stats(engine);
+    mprintstr(PSTR("GSM #"));
+    mprint_uintd(i, 0);
+    mprint(MStringNewLine);
+    cmd_gsm_print_stats(stats);
+  }
+
+  return true;
+}
+
+void cmd_gsm_print_stats(const MGsmQueueStats *stats)
+{
+  mprintstr(PSTR("Depth: "));
+  mprint_uintd(stats->depth, 0);
+  mprintstr(PSTR(", max: "));
+  mprint_uintd(stats->maxDepth, 0);
+  mprintstr(PSTR(", queued: "));
+  mprint_uintd(stats->queued, 0);
+  mprintstr(PSTR(", rejected: "));
+  mprint_uintd(stats->rejected, 0);
+  mprintstr(PSTR(", timeouts: "));
+  mprint_uintd(stats->timeouts, 0);
+  mprint(MStringNewLine);
+  cmd_gsm_print_hist(PSTR("Wait"), stats->wait);
+  cmd_gsm_print_hist(PSTR("RTT"), stats->rtt);
+}
+
+void cmd_gsm_print_hist(const char *name, const uint16_t *hist)
+{
+  int i;
+
+  /* Bucket 'N' is printed with its upper limit: 2^N milli-seconds */
+  mprintstr(name);
+  mprintstr(PSTR(" (ms):"));
+  for (i = 0; i < MCODE_GSM_HIST_BUCKETS; ++i) {
+    if (hist[i]) {
+      mprintstr(PSTR(" <"));
+      mprint_uintd(1u << i, 0);
+      mprintstr(PSTR(":"));
+      mprint_uintd(hist[i], 0);
+    }
+  }
+  mprint(MStringNewLine);
+}
+
+
 void cmd_gsm_send_sms(const char *body)
 {
   if (!strlen(mcode_phone())) {
@@ -28,13 +28,16 @@
 #include "hw-lcd.h"
 #include "hw-i80.h"
 #include "hw-uart.h"
+#include "console.h"
 #include "mglobal.h"
 #include "mstring.h"
+#include "mcode-config.h"
 
 #include <string.h>
 
 static void cmd_engine_lcd_turn_lcd(const char *arguments);
 static void cmd_engine_lcd_set_backlight(const char *arguments);
+static void cmd_engine_lcd_reset(void);
 #ifdef MCODE_HW_I80_ENABLED
 static void cmd_engine_read(const char *args, bool *startCmd);
 static void cmd_engine_write(const char *args, bool *startCmd);
@@ -55,7 +58,7 @@ void cmd_engine_lcd_help(void)
 bool cmd_engine_lcd_command(const char *command, bool *startCmd)
 {
   if (!strcmp_P(command, PSTR("reset"))) {
-    lcd_reset();
+    cmd_engine_lcd_reset();
     return true;
   } else if (!strncmp_P(command, PSTR("lcd "), 4)) {
     cmd_engine_lcd_turn_lcd(command + 4);
@@ -90,12 +93,21 @@ void cmd_engine_lcd_turn_lcd(const char *arguments)
   } else if (!strcmp_P(arguments, PSTR("off"))) {
     lcd_turn(false);
   } else if (!strcmp_P(arguments, PSTR("reset"))) {
-    lcd_reset();
+    cmd_engine_lcd_reset();
   } else {
     merror(MStringWrongArgument);
   }
 }
 
+void cmd_engine_lcd_reset(void)
+{
+  lcd_reset();
+#ifdef MCODE_CONSOLE_SHADOW
+  /* the LCD content is lost with the reset */
+  console_invalidate();
+#endif /* MCODE_CONSOLE_SHADOW */
+}
+
 void cmd_engine_lcd_set_backlight(const char *arguments)
 {
   if (!strcmp_P(arguments, PSTR("on"))) {
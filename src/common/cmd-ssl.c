@@ -26,6 +26,7 @@
 #include "cmd-engine.h"
 
 #include "mtick.h"
+#include "mvars.h"
 #include "utils.h"
 #include "sha256.h"
 #include "hw-uart.h"
@@ -48,7 +49,29 @@ static void cmd_engine_on_pass(const char *string);
 static void cmd_engine_set_cmd_mode(const char *params, bool *startCmd);
 #endif /* MCODE_COMMAND_MODES */
 
-CMD_IMPL("sha", TheSha, "Print sha256 for <DATA>", cmd_ssl_sha256, NULL, 0);
+/** Ends the UART input of 'sha' and 'hmac' without the length */
+#define CMD_SSL_EOT ('\004')
+
+/**
+ * The UART input state of the 'sha' and 'hmac' commands
+ */
+typedef struct {
+  HMAC_SHA256_CTX ctx;                  /**< The plain hash uses 'ctx.inner' only */
+  uint32_t remaining;                   /**< The bytes to receive, 0 if ends with Ctrl-D */
+  bool hmac;
+  bool started;                         /**< Any data byte received */
+} TSslStream;
+
+static TSslStream TheStream;
+
+static bool cmd_ssl_feed(HMAC_SHA256_CTX *ctx, bool hmac, const char *args, size_t args_len,
+                         bool *start_cmd);
+static void cmd_ssl_stream_char(char ch);
+static void cmd_ssl_stream_done(void);
+static void cmd_ssl_print(const uint8_t *md);
+
+CMD_IMPL("sha", TheSha, "Print sha256 for <DATA>: [\"str\"|sN:M]... [uart [<len>]]", cmd_ssl_sha256, NULL, 0);
+CMD_IMPL("hmac", TheHmac, "Print HMAC-SHA256 with <KEY> for <DATA>, see 'sha'", cmd_ssl_hmac, NULL, 0);
 
 void cmd_engine_ssl_init(void)
 {
@@ -87,33 +110,167 @@ bool cmd_engine_ssl_command(const char *command, bool *startCmd)
 
 bool cmd_ssl_sha256(const TCmdData *data, const char *args, size_t args_len, bool *start_cmd)
 {
-  uint8_t i;
+  uint8_t md[MD_LENGTH_SHA256];
+  HMAC_SHA256_CTX *const ctx = &TheStream.ctx;
+
+  librock_SHA256_Init(&ctx->inner);
+  if (cmd_ssl_feed(ctx, false, args, args_len, start_cmd) && *start_cmd) {
+    librock_SHA256_StoreFinal(md, &ctx->inner);
+    cmd_ssl_print(md);
+  }
+  return true;
+}
+
+bool cmd_ssl_hmac(const TCmdData *data, const char *args, size_t args_len, bool *start_cmd)
+{
+  size_t length;
   TokenType type;
   uint32_t value;
+  const char *key;
   const char *token;
-  const uint8_t *ptr;
-  uint8_t byteResultHash[MD_LENGTH_SHA256];
+  uint8_t md[MD_LENGTH_SHA256];
+  HMAC_SHA256_CTX *const ctx = &TheStream.ctx;
 
-  /* Parse the input, should be a string */
+  /* The key, either a string or a string variable */
   type = next_token(&args, &args_len, &token, &value);
-  if (TokenString != type) {
+  if (TokenString == type) {
+    key = token;
+    length = value;
+  } else if (TokenVariable == type && VarTypeString == ((value >> 8) & 0xffu)) {
+    key = mvar_str((value >> 16) & 0xffu, (value >> 24) & 0xffu, &length);
+    length = key ? strnlen(key, length) : 0;
+  } else {
+    key = NULL;
+  }
+  if (!key) {
     mcode_errno_set(EArgument);
     return true;
   }
 
-  /* Calculate the SHA256 hash */
-  sha256((const unsigned char *)token, value, byteResultHash);
+  hmac_sha256_init(ctx, key, length);
+  if (cmd_ssl_feed(ctx, true, args, args_len, start_cmd) && *start_cmd) {
+    hmac_sha256_final(md, ctx);
+    cmd_ssl_print(md);
+  }
+  return true;
+}
+
+/**
+ * Add the data listed in \c args to \c ctx, each part is added as is, no copies
+ * @return The success status, if the UART input is started, \c start_cmd is reset
+ */
+bool cmd_ssl_feed(HMAC_SHA256_CTX *ctx, bool hmac, const char *args, size_t args_len,
+                  bool *start_cmd)
+{
+  size_t length;
+  TokenType type;
+  uint32_t value;
+  const char *token;
+  const char *str;
+  bool empty = true;
+
+  while (TokenEnd != (type = next_token(&args, &args_len, &token, &value))) {
+    if (TokenWhitespace == type) {
+      continue;
+    }
 
-  /* Print the result */
-  ptr = byteResultHash;
-  for (i = 0; i < MD_LENGTH_SHA256; i += 2, ptr += 2) {
-    uint16_t data = ((*ptr) << 8) | (*(ptr + 1) << 0);
-    mprint_uint16(data, false);
+    empty = false;
+    if (TokenString == type) {
+      librock_SHA256_Update(&ctx->inner, token, value);
+    } else if (TokenVariable == type && VarTypeString == ((value >> 8) & 0xffu)) {
+      /* The string variables, the stored programs as well, up to the terminating '\0' */
+      str = mvar_str((value >> 16) & 0xffu, (value >> 24) & 0xffu, &length);
+      if (!str) {
+        break;
+      }
+      librock_SHA256_Update(&ctx->inner, str, strnlen(str, length));
+    } else if (TokenId == type && !mparser_strcmp_P(token, value, PSTR("uart"))) {
+      /* The raw input, either the given number of bytes or till Ctrl-D, the last part */
+      TheStream.remaining = 0;
+      do {
+        type = next_token(&args, &args_len, &token, &value);
+      } while (TokenWhitespace == type);
+      if (TokenInt == type && value) {
+        TheStream.remaining = value;
+        do {
+          type = next_token(&args, &args_len, &token, &value);
+        } while (TokenWhitespace == type);
+      }
+      if (TokenEnd != type) {
+        break;
+      }
+
+      TheStream.hmac = hmac;
+      TheStream.started = false;
+      if (!TheStream.remaining) {
+        mprintstr(PSTR("Send data, Ctrl-D to finish"));
+        mprint(MStringNewLine);
+      }
+      line_editor_uart_deinit();
+      hw_uart_set_callback(cmd_ssl_stream_char);
+      *start_cmd = false;
+      return true;
+    } else {
+      break;
+    }
+  }
+
+  if (TokenEnd != type || empty) {
+    mcode_errno_set(EArgument);
+    return false;
   }
-  mprint(MStringNewLine);
   return true;
 }
 
+void cmd_ssl_stream_char(char ch)
+{
+  if (!TheStream.started) {
+    TheStream.started = true;
+    if ('\n' == ch) {
+      /* The end of the command line, "\r\n" */
+      return;
+    }
+  }
+
+  if (!TheStream.remaining && CMD_SSL_EOT == ch) {
+    cmd_ssl_stream_done();
+    return;
+  }
+
+  /* The hash context collects the full blocks, no other buffering */
+  librock_SHA256_Update(&TheStream.ctx.inner, &ch, 1);
+  if (TheStream.remaining && !(--TheStream.remaining)) {
+    cmd_ssl_stream_done();
+  }
+}
+
+void cmd_ssl_stream_done(void)
+{
+  uint8_t md[MD_LENGTH_SHA256];
+
+  if (TheStream.hmac) {
+    hmac_sha256_final(md, &TheStream.ctx);
+  } else {
+    librock_SHA256_StoreFinal(md, &TheStream.ctx.inner);
+  }
+  cmd_ssl_print(md);
+
+  /* Back to the command line */
+  hw_uart_set_callback(NULL);
+  line_editor_uart_init();
+  cmd_engine_start();
+}
+
+void cmd_ssl_print(const uint8_t *md)
+{
+  uint8_t i;
+
+  for (i = 0; i < MD_LENGTH_SHA256; i += 2, md += 2) {
+    mprint_uint16(((*md) << 8) | (*(md + 1) << 0), false);
+  }
+  mprint(MStringNewLine);
+}
+
 #ifdef MCODE_COMMAND_MODES
 void cmd_engine_set_mode(CmdMode mode)
 {
@@ -36,12 +36,14 @@
 #include "mstring.h"
 #include "scheduler.h"
 #include "cmd-engine.h"
+#include "line-editor-uart.h"
 
 CMD_IMPL("ut", TheUt, "Show uptime", cmd_system_ut, NULL, 0);
 CMD_IMPL("errno", TheErrno, "Print/reset error code", cmd_system_errno, NULL, 0);
 CMD_IMPL("sleep", TheSleep, "Sleep for <milli-seconds>", cmd_system_sleep, NULL, 0);
 CMD_IMPL("reboot", TheReboot, "Reboot system", cmd_system_reboot, NULL, 0);
 CMD_IMPL("poweroff", ThePoweroff, "Power off system", cmd_system_poweroff, NULL, 0);
+CMD_IMPL("paste", ThePaste, "Paste a script, end with Ctrl-D", cmd_system_paste, NULL, 0);
 #ifdef MCODE_ID
 CMD_IMPL("uid", TheId, "Show device ID", cmd_system_id, NULL, 0);
 #endif /* MCODE_ID */
@@ -129,6 +131,17 @@ bool cmd_system_poweroff(const TCmdData *data, const char *args, size_t args_len
   return true;
 }
 
+bool cmd_system_paste(const TCmdData *data, const char *args, size_t args_len, bool *start_cmd)
+{
+  /* The prompt is shown when the paste mode is left */
+  mprintstr(PSTR("Paste mode, Ctrl-D to finish"));
+  mprint(MStringNewLine);
+  line_editor_set_paste(true);
+
+  *start_cmd = false;
+  return true;
+}
+
 #ifdef MCODE_ID
 bool cmd_system_id(const TCmdData *data, const char *args, size_t args_len, bool *start_cmd)
 {
@@ -25,7 +25,9 @@
 #include "cmd-engine.h"
 
 #include "hw-lcd.h"
+#include "console.h"
 #include "mstring.h"
+#include "mcode-config.h"
 
 #include <string.h>
 
@@ -71,6 +73,10 @@ void cmd_test_image(void)
     lcd_set_window(0, width - 1, startY, endY);
     lcd_write_const_words(UINT8_C(0x2C), TestColors[i], pixelCount);
   }
+#ifdef MCODE_CONSOLE_SHADOW
+  /* the console content is overdrawn */
+  console_invalidate();
+#endif /* MCODE_CONSOLE_SHADOW */
 }
 
 void cmd_test_image_large(void)
@@ -93,4 +99,8 @@ void cmd_test_image_large(void)
     lcd_set_window(startX, endX, 0, height - 1);
     lcd_write_const_words(UINT8_C(0x2C), TestColors[i], pixelCount);
   }
+#ifdef MCODE_CONSOLE_SHADOW
+  /* the console content is overdrawn */
+  console_invalidate();
+#endif /* MCODE_CONSOLE_SHADOW */
 }
@@ -25,10 +25,12 @@
 #include "cmd-engine.h"
 
 #include "utils.h"
-#include "hw-twi.h"
+#include "twi-queue.h"
 #include "mglobal.h"
 #include "mstring.h"
 
+#include <string.h>
+
 static void cmd_engine_twi_read(const char *args);
 static void cmd_engine_twi_write(const char *args);
 
@@ -76,7 +78,7 @@ void cmd_engine_twi_read(const char *args)
   }
 
   uint8_t buffer[32];
-  if (!twi_recv_sync(twi_addr, twi_length, buffer)) {
+  if (!twi_queue_transfer_sync(twi_addr, 0, NULL, twi_length, buffer)) {
     merror(MStringInternalError);
     return;
   }
@@ -105,7 +107,7 @@ void cmd_engine_twi_write(const char *args)
     return;
   }
 
-  if (!twi_send_sync(twi_addr, bufferFilled, buffer)) {
+  if (!twi_queue_transfer_sync(twi_addr, bufferFilled, buffer, 0, NULL)) {
     merror(MStringInternalError);
     return;
   }
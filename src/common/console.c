@@ -25,14 +25,32 @@
 #include "console.h"
 
 #include "utils.h"
-#include "fonts.h"
 #include "hw-lcd.h"
 #include "mstring.h"
+#include "scheduler.h"
+#include "mcode-config.h"
 
 #include <string.h>
 
 #define CONSOLE_HTAB_SIZE (4)
 
+#ifndef MCODE_CONSOLE_RUN_LENGTH
+#ifdef __AVR__
+#define MCODE_CONSOLE_RUN_LENGTH (32)
+#else /* __AVR__ */
+#define MCODE_CONSOLE_RUN_LENGTH (64)
+#endif /* __AVR__ */
+#endif /* MCODE_CONSOLE_RUN_LENGTH */
+
+#ifdef MCODE_CONSOLE_SHADOW
+#ifndef MCODE_CONSOLE_SHADOW_COLUMNS
+#define MCODE_CONSOLE_SHADOW_COLUMNS (60)
+#endif /* MCODE_CONSOLE_SHADOW_COLUMNS */
+#ifndef MCODE_CONSOLE_SHADOW_LINES
+#define MCODE_CONSOLE_SHADOW_LINES (40)
+#endif /* MCODE_CONSOLE_SHADOW_LINES */
+#endif /* MCODE_CONSOLE_SHADOW */
+
 static int8_t TheSavedLinePos = 0;
 static int8_t TheSavedColumnPos = 0;
 static int8_t TheSavedScrollPos = 0;
@@ -51,11 +69,49 @@ static uint16_t TheDisplayHeight = 0;
  */
 static uint8_t TheCurrentScrollPos = 0;
 
+/**
+ * The printable characters not sent to the LCD yet, they are placed side by side
+ * in a single text line, starting at (TheRunColumn, TheRunLine)
+ */
+static char TheRun[MCODE_CONSOLE_RUN_LENGTH];
+static uint8_t TheRunLength = 0;
+static int8_t TheRunLine = 0;
+static int8_t TheRunColumn = 0;
+
+#ifdef MCODE_CONSOLE_SHADOW
+/**
+ * The character cell of the shadow buffer
+ */
+typedef struct {
+  char code;                            /**< The character, 0 if the LCD content is unknown */
+  bool dirty;                           /**< The cell is to be drawn */
+  uint16_t onColor;
+  uint16_t offColor;
+} TCell;
+
+/**
+ * The shadow buffer, the lines are in the LCD order, no scroll position applied
+ */
+static TCell TheCells[MCODE_CONSOLE_SHADOW_LINES][MCODE_CONSOLE_SHADOW_COLUMNS];
+/**
+ * The dirty cells range in each line, [from, to)
+ */
+static uint8_t TheDirtyFrom[MCODE_CONSOLE_SHADOW_LINES];
+static uint8_t TheDirtyTo[MCODE_CONSOLE_SHADOW_LINES];
+static bool TheShadowEnabled = false;
+
+static void console_shadow_flush (void);
+static void console_shadow_reset (char code);
+static void console_shadow_put (uint8_t line, uint8_t column, char code);
+#endif /* MCODE_CONSOLE_SHADOW */
+
+static void console_flush_run (void);
 static void console_roll_up (void);
+static uint8_t console_lcd_line (uint8_t line);
 static uint8_t console_handle_utf8 (uint8_t byte);
 static uint8_t console_handle_control_codes (uint8_t byte);
 static uint8_t console_handle_escape_sequence (uint8_t byte);
-static void console_config_lcd_for_pos (uint8_t column, uint8_t line);
+static void console_config_lcd_for_pos (uint8_t column, uint8_t line, uint8_t length);
 static const char *console_next_num_token (const char *pString, uint8_t *pValue);
 static void console_escape_clear_line (uint8_t line, int8_t startColumn, int8_t endColumn);
 
@@ -70,6 +126,11 @@ void console_init(void)
   TheDisplayHeight = lcd_get_height();
   TheLineCount = TheDisplayHeight>>3;
   TheColumnCount = TheDisplayWidth>>3;
+
+#ifdef MCODE_CONSOLE_SHADOW
+  console_set_shadow(true);
+  scheduler_add(console_flush);
+#endif /* MCODE_CONSOLE_SHADOW */
 }
 
 void console_deinit(void)
@@ -78,6 +139,9 @@ void console_deinit(void)
 
 void console_clear_screen(void)
 {
+  /* the pending characters are to be cleared anyway */
+  TheRunLength = 0;
+
   /* Reset the current scroll position */
   lcd_set_scroll_start(0);
   TheCurrentScrollPos = 0;
@@ -88,10 +152,43 @@ void console_clear_screen(void)
 
   /* clear the screen, fill the background color */
   lcd_cls(TheOffColor);
+#ifdef MCODE_CONSOLE_SHADOW
+  console_shadow_reset(' ');
+#endif /* MCODE_CONSOLE_SHADOW */
+}
+
+bool console_set_shadow(bool enabled)
+{
+  console_flush();
+
+#ifdef MCODE_CONSOLE_SHADOW
+  TheShadowEnabled = enabled &&
+    TheLineCount <= MCODE_CONSOLE_SHADOW_LINES && TheColumnCount <= MCODE_CONSOLE_SHADOW_COLUMNS;
+  /* nothing is known about the LCD content yet */
+  console_shadow_reset(0);
+  return TheShadowEnabled;
+#else /* MCODE_CONSOLE_SHADOW */
+  return false;
+#endif /* MCODE_CONSOLE_SHADOW */
+}
+
+void console_invalidate(void)
+{
+  /* the pending characters are drawn over the new LCD content, as they would be anyway */
+  console_flush();
+
+#ifdef MCODE_CONSOLE_SHADOW
+  console_shadow_reset(0);
+#endif /* MCODE_CONSOLE_SHADOW */
 }
 
 void console_write_byte(char byte)
 {
+  if ((uint8_t)byte < 32 || (uint8_t)byte > 127) {
+    /* the control codes and escape sequences might move the cursor */
+    console_flush_run();
+  }
+
   if (console_handle_escape_sequence(byte)) {
     return;
   }
@@ -104,6 +201,7 @@ void console_write_byte(char byte)
 
   /* check the current position */
   if (TheCurrentColumn >= TheColumnCount) {
+    console_flush_run();
     ++TheCurrentLine;
     if (TheCurrentLine >= TheLineCount) {
       /* roll 1 text line up */
@@ -114,13 +212,47 @@ void console_write_byte(char byte)
     TheCurrentColumn = 0;
   }
 
-  console_config_lcd_for_pos(TheCurrentColumn, TheCurrentLine);
+#ifdef MCODE_CONSOLE_SHADOW
+  if (TheShadowEnabled) {
+    /* the shadow buffer is sent to the LCD module in 'console_flush' */
+    console_shadow_put(console_lcd_line(TheCurrentLine), TheCurrentColumn, byte);
+    ++TheCurrentColumn;
+    return;
+  }
+#endif /* MCODE_CONSOLE_SHADOW */
+
+  /* append the char to the current run, it is sent to the LCD module in 'console_flush' */
+  if (TheRunLength >= MCODE_CONSOLE_RUN_LENGTH) {
+    console_flush_run();
+  }
+  if (!TheRunLength) {
+    TheRunLine = TheCurrentLine;
+    TheRunColumn = TheCurrentColumn;
+  }
+  TheRun[TheRunLength++] = byte;
+
   /* move to the next column */
   ++TheCurrentColumn;
+}
 
-  /* now we are ready to send the char bitmap to the LCD module */
-  const uint8_t *const pChar = mcode_fonts_get_char_bitmap(byte);
-  lcd_write_bitmap(UINT8_C(0x2C), 8, pChar, TheOffColor, TheOnColor);
+void console_flush(void)
+{
+  console_flush_run();
+#ifdef MCODE_CONSOLE_SHADOW
+  console_shadow_flush();
+#endif /* MCODE_CONSOLE_SHADOW */
+}
+
+void console_flush_run(void)
+{
+  if (!TheRunLength) {
+    return;
+  }
+
+  /* a single window for the whole run, the glyph rows are streamed across it */
+  console_config_lcd_for_pos(TheRunColumn, console_lcd_line(TheRunLine), TheRunLength);
+  lcd_write_text(UINT8_C(0x2C), TheRun, TheRunLength, TheOffColor, TheOnColor);
+  TheRunLength = 0;
 }
 
 void console_write_string(const char *pString)
@@ -129,6 +261,7 @@ void console_write_string(const char *pString)
   while ((ch = *pString++)) {
     console_write_byte(ch);
   }
+  console_flush_run();
 }
 
 void console_write_string_P(const char *pString)
@@ -138,6 +271,7 @@ void console_write_string_P(const char *pString)
   while ((ch = pgm_read_byte((const unsigned char *)(pString++)))) {
     console_write_byte (ch);
   }
+  console_flush_run();
 #else /* __AVR__ */
   console_write_string(pString);
 #endif /* __AVR__ */
@@ -188,11 +322,13 @@ void console_write_uint64(uint64_t value, bool skipZeros)
 
 void console_set_color (uint16_t color)
 {
+  console_flush_run();
   TheOnColor = color;
 }
 
 void console_set_bg_color (uint16_t color)
 {
+  console_flush_run();
   TheOffColor = color;
 }
 
@@ -212,7 +348,7 @@ void console_roll_up (void)
   lcd_set_scroll_start(TheCurrentScrollPos << 3);
 }
 
-void console_config_lcd_for_pos (uint8_t column, uint8_t line)
+uint8_t console_lcd_line (uint8_t line)
 {
   line += TheCurrentScrollPos;
   if (line >= TheLineCount)
@@ -220,8 +356,13 @@ void console_config_lcd_for_pos (uint8_t column, uint8_t line)
     line -= TheLineCount;
   }
 
+  return line;
+}
+
+void console_config_lcd_for_pos (uint8_t column, uint8_t line, uint8_t length)
+{
   const uint16_t sCol = (uint16_t)(column << 3);
-  const uint16_t eCol = sCol + 7;
+  const uint16_t eCol = sCol + (length << 3) - 1;
   const uint16_t sLine = (uint16_t)(line<<3);
   const uint16_t eLine = sLine + 7;
   lcd_set_window(sCol, eCol, sLine, eLine);
@@ -670,10 +811,16 @@ void console_escape_clear_line(uint8_t line, int8_t startColumn, int8_t endColum
   if (endColumn < 0) {
     endColumn = TheColumnCount;
   }
-  line += TheCurrentScrollPos;
-  if (line >= TheLineCount) {
-    line -= TheLineCount;
+  line = console_lcd_line(line);
+
+#ifdef MCODE_CONSOLE_SHADOW
+  if (TheShadowEnabled) {
+    for (; startColumn < endColumn; ++startColumn) {
+      console_shadow_put(line, startColumn, ' ');
+    }
+    return;
   }
+#endif /* MCODE_CONSOLE_SHADOW */
 
   const uint16_t sCol = (uint16_t)(startColumn << 3);
   const uint16_t eCol = (((uint16_t)endColumn) << 3) - 1;
@@ -682,3 +829,90 @@ void console_escape_clear_line(uint8_t line, int8_t startColumn, int8_t endColum
   lcd_set_window(sCol, eCol, sLine, eLine);
   lcd_write_const_words(UINT8_C(0x2C), TheOffColor, ((endColumn - startColumn) << 6));
 }
+
+#ifdef MCODE_CONSOLE_SHADOW
+void console_shadow_put(uint8_t line, uint8_t column, char code)
+{
+  TCell *const cell = &TheCells[line][column];
+
+  if (cell->code == code && cell->offColor == TheOffColor && (' ' == code || cell->onColor == TheOnColor)) {
+    /* nothing changes on the LCD, a space does not depend on the foreground color */
+    return;
+  }
+
+  cell->code = code;
+  cell->onColor = TheOnColor;
+  cell->offColor = TheOffColor;
+  if (!cell->dirty) {
+    cell->dirty = true;
+    if (TheDirtyFrom[line] >= TheDirtyTo[line]) {
+      TheDirtyFrom[line] = column;
+      TheDirtyTo[line] = column + 1;
+    } else if (column < TheDirtyFrom[line]) {
+      TheDirtyFrom[line] = column;
+    } else if (column >= TheDirtyTo[line]) {
+      TheDirtyTo[line] = column + 1;
+    }
+  }
+}
+
+void console_shadow_reset(char code)
+{
+  uint8_t line;
+  uint8_t column;
+
+  for (line = 0; line < MCODE_CONSOLE_SHADOW_LINES; ++line) {
+    for (column = 0; column < MCODE_CONSOLE_SHADOW_COLUMNS; ++column) {
+      TCell *const cell = &TheCells[line][column];
+      cell->code = code;
+      cell->dirty = false;
+      cell->onColor = TheOnColor;
+      cell->offColor = TheOffColor;
+    }
+    TheDirtyFrom[line] = 0;
+    TheDirtyTo[line] = 0;
+  }
+}
+
+void console_shadow_flush(void)
+{
+  uint8_t line;
+  uint8_t start;
+  uint8_t column;
+  uint8_t length;
+  uint16_t onColor;
+  uint16_t offColor;
+  const TCell *cell;
+
+  if (!TheShadowEnabled) {
+    return;
+  }
+
+  for (line = 0; line < TheLineCount; ++line) {
+    column = TheDirtyFrom[line];
+    while (column < TheDirtyTo[line]) {
+      cell = &TheCells[line][column];
+      if (!cell->dirty) {
+        ++column;
+        continue;
+      }
+
+      /* the adjacent dirty cells of the same colors are drawn in a single window */
+      start = column;
+      length = 0;
+      onColor = cell->onColor;
+      offColor = cell->offColor;
+      while (column < TheDirtyTo[line] && length < MCODE_CONSOLE_RUN_LENGTH && cell->dirty &&
+             cell->offColor == offColor && (cell->onColor == onColor || ' ' == cell->code)) {
+        TheRun[length++] = cell->code;
+        TheCells[line][column++].dirty = false;
+        ++cell;
+      }
+      console_config_lcd_for_pos(start, line, length);
+      lcd_write_text(UINT8_C(0x2C), TheRun, length, offColor, onColor);
+    }
+    TheDirtyFrom[line] = 0;
+    TheDirtyTo[line] = 0;
+  }
+}
+#endif /* MCODE_CONSOLE_SHADOW */
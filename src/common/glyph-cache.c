@@ -0,0 +1,211 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Alexander Chumakov
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "glyph-cache.h"
+
+#include "fonts.h"
+#include "hw-lcd.h"
+#include "mcode-config.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#ifdef __AVR__
+#include <avr/pgmspace.h>
+#endif /* __AVR__ */
+
+/* The font covers the codes 32..127 */
+#define GLYPH_CACHE_FIRST_CODE (32)
+#define GLYPH_CACHE_CODE_COUNT (96)
+
+typedef struct {
+  uint16_t words[64];                   /**< The expanded glyph, row by row */
+  uint32_t stamp;                       /**< The last use, the oldest glyph is evicted first */
+  uint8_t code;                         /**< The cached character */
+} TGlyph;
+
+static TGlyph TheGlyphs[MCODE_GLYPH_CACHE_SIZE];
+/** The glyph index plus 1 for each font character, 0 if the character is not cached */
+static uint8_t TheSlots[GLYPH_CACHE_CODE_COUNT];
+static uint8_t TheGlyphCount = 0;
+static uint32_t TheStamp = 0;
+static uint16_t TheOnColor = 0;
+static uint16_t TheOffColor = 0;
+static MGlyphCacheStats TheStats = {0, 0};
+
+static TGlyph *glyph_cache_evict(void);
+static uint8_t glyph_cache_code(uint8_t code);
+static void glyph_cache_set_colors(uint16_t offValue, uint16_t onValue);
+static void glyph_cache_expand(uint16_t *words, const uint8_t *pData, uint16_t offValue, uint16_t onValue);
+static void glyph_cache_expand_row(uint16_t *words, uint8_t bits, uint16_t offValue, uint16_t onValue);
+
+const uint16_t *glyph_cache_get(uint8_t code, uint16_t offValue, uint16_t onValue)
+{
+  TGlyph *glyph;
+  uint8_t slot;
+
+  code = glyph_cache_code(code);
+  glyph_cache_set_colors(offValue, onValue);
+
+  slot = TheSlots[code - GLYPH_CACHE_FIRST_CODE];
+  if (slot) {
+    ++TheStats.hits;
+    glyph = &TheGlyphs[slot - 1];
+  } else {
+    ++TheStats.misses;
+    glyph = (TheGlyphCount < MCODE_GLYPH_CACHE_SIZE) ? &TheGlyphs[TheGlyphCount++] : glyph_cache_evict();
+    glyph->code = code;
+    TheSlots[code - GLYPH_CACHE_FIRST_CODE] = (uint8_t)(glyph - TheGlyphs) + 1;
+    glyph_cache_expand(glyph->words, mcode_fonts_get_char_bitmap(code), offValue, onValue);
+  }
+
+  glyph->stamp = ++TheStamp;
+  return glyph->words;
+}
+
+const uint16_t *glyph_cache_find(uint8_t code, uint16_t offValue, uint16_t onValue)
+{
+  uint8_t slot;
+
+  if (offValue != TheOffColor || onValue != TheOnColor) {
+    return NULL;
+  }
+
+  /* the rows of the prefetched glyphs are looked up, the hits are counted by the prefetch */
+  slot = TheSlots[glyph_cache_code(code) - GLYPH_CACHE_FIRST_CODE];
+  return slot ? TheGlyphs[slot - 1].words : NULL;
+}
+
+void glyph_cache_prefetch(const char *text, uint8_t length, uint16_t offValue, uint16_t onValue)
+{
+  uint8_t i;
+  uint8_t slot;
+  uint8_t pinned;
+  uint32_t start;
+
+  glyph_cache_set_colors(offValue, onValue);
+
+  /* the glyphs stamped after 'start' are used by this run, they are never evicted by it */
+  start = TheStamp;
+  for (i = 0, pinned = 0; i < length && pinned < MCODE_GLYPH_CACHE_SIZE; ++i) {
+    slot = TheSlots[glyph_cache_code(text[i]) - GLYPH_CACHE_FIRST_CODE];
+    if (!slot || (uint32_t)(TheStamp - TheGlyphs[slot - 1].stamp) >= (uint32_t)(TheStamp - start)) {
+      ++pinned;
+    }
+    glyph_cache_get(text[i], offValue, onValue);
+  }
+}
+
+void glyph_cache_write_text(uint8_t cmd, const char *text, uint8_t length, uint16_t offValue, uint16_t onValue)
+{
+  uint8_t i;
+  uint8_t row;
+  uint16_t words[8];
+  const uint16_t *glyph;
+
+  glyph_cache_prefetch(text, length, offValue, onValue);
+
+  lcd_write_cmd(cmd);
+  /* the glyph rows are streamed across the whole run, the glyphs not fitting the cache come from the font */
+  for (row = 0; row < 8; ++row) {
+    for (i = 0; i < length; ++i) {
+      glyph = glyph_cache_find(text[i], offValue, onValue);
+      if (!glyph) {
+#ifdef __AVR__
+        glyph_cache_expand_row(words, pgm_read_byte(mcode_fonts_get_char_bitmap(text[i]) + row), offValue, onValue);
+#else /* __AVR__ */
+        glyph_cache_expand_row(words, mcode_fonts_get_char_bitmap(text[i])[row], offValue, onValue);
+#endif /* __AVR__ */
+        lcd_write_words(words, 8);
+      } else {
+        lcd_write_words(glyph + (row << 3), 8);
+      }
+    }
+  }
+}
+
+void glyph_cache_reset(void)
+{
+  TheGlyphCount = 0;
+  memset(TheSlots, 0, sizeof (TheSlots));
+}
+
+MGlyphCacheStats *glyph_cache_stats(void)
+{
+  return &TheStats;
+}
+
+TGlyph *glyph_cache_evict(void)
+{
+  uint8_t i;
+  TGlyph *oldest = &TheGlyphs[0];
+
+  for (i = 1; i < MCODE_GLYPH_CACHE_SIZE; ++i) {
+    /* the difference survives the stamp overflow */
+    if ((uint32_t)(TheStamp - TheGlyphs[i].stamp) > (uint32_t)(TheStamp - oldest->stamp)) {
+      oldest = &TheGlyphs[i];
+    }
+  }
+
+  TheSlots[oldest->code - GLYPH_CACHE_FIRST_CODE] = 0;
+  return oldest;
+}
+
+uint8_t glyph_cache_code(uint8_t code)
+{
+  return (code < GLYPH_CACHE_FIRST_CODE || code >= GLYPH_CACHE_FIRST_CODE + GLYPH_CACHE_CODE_COUNT) ? ' ' : code;
+}
+
+void glyph_cache_set_colors(uint16_t offValue, uint16_t onValue)
+{
+  if (offValue != TheOffColor || onValue != TheOnColor) {
+    /* the cached glyphs are of no use for the new color pair */
+    glyph_cache_reset();
+    TheOnColor = onValue;
+    TheOffColor = offValue;
+  }
+}
+
+void glyph_cache_expand(uint16_t *words, const uint8_t *pData, uint16_t offValue, uint16_t onValue)
+{
+  uint8_t i;
+
+  for (i = 0; i < 8; ++i, words += 8) {
+#ifdef __AVR__
+    glyph_cache_expand_row(words, pgm_read_byte(pData + i), offValue, onValue);
+#else /* __AVR__ */
+    glyph_cache_expand_row(words, pData[i], offValue, onValue);
+#endif /* __AVR__ */
+  }
+}
+
+void glyph_cache_expand_row(uint16_t *words, uint8_t bits, uint16_t offValue, uint16_t onValue)
+{
+  uint8_t bitMask;
+
+  for (bitMask = UINT8_C(0x01); bitMask; bitMask <<= 1) {
+    *words++ = (bits & bitMask) ? onValue : offValue;
+  }
+}
@@ -24,6 +24,7 @@
 
 #include "gsm-engine.h"
 
+#include "mtick.h"
 #include "mvars.h"
 #include "mtimer.h"
 #include "hw-uart.h"
@@ -32,22 +33,66 @@
 #include "mstatus.h"
 #include "mstring.h"
 #include "cmd-engine.h"
+#include "mcode-config.h"
 #include "line-editor-uart.h"
 
+#ifdef MCODE_PDU
+#include "mpdu.h"
+#endif /* MCODE_PDU */
+
 #include <stddef.h>
 #include <string.h>
 
-#define MCODE_SMS_MAX_LENGTH (140)
+/** Default timeout for AT commands, in milliseconds */
+#define MCODE_GSM_CMD_TIMEOUT (5000)
+/** Timeout for sending an SMS, the network may take quite some time, in milliseconds */
+#define MCODE_GSM_SMS_TIMEOUT (60000)
+/** The timeout for listing all unread SMS, in milli-seconds */
+#define MCODE_GSM_LIST_TIMEOUT (60000)
+/** The period for checking the AT command timeouts, in milli-seconds */
+#define MCODE_GSM_TIMEOUT_TICK (100)
+
+#ifndef MCODE_GSM_CONCAT_SLOTS
+/** The number of concatenated SMS being reassembled at once */
+#define MCODE_GSM_CONCAT_SLOTS (2)
+#endif /* MCODE_GSM_CONCAT_SLOTS */
+/** The length of the longest SMS program */
+#define MCODE_GSM_PROGRAM_LENGTH (MCODE_GSM_VAR_PROGRAM_COUNT * PROG_STRVAR_LENGTH - 1)
+#ifndef MCODE_GSM_CONCAT_PARTS
+/** The maximum number of parts of a reassembled SMS, the whole text fits the program variables */
+#define MCODE_GSM_CONCAT_PARTS (MCODE_GSM_PROGRAM_LENGTH / MCODE_PDU_CONCAT_SEPTETS)
+#endif /* MCODE_GSM_CONCAT_PARTS */
+/** The incomplete concatenated SMS are dropped after this timeout, in milli-seconds */
+#define MCODE_GSM_CONCAT_TIMEOUT (300000)
+
+#if MCODE_GSM_VAR_OUTPUT + MCODE_GSM_VAR_OUTPUT_COUNT > PROG_STRVARS_COUNT
+#error The SMS program and output variables do not fit the string variables
+#endif
 
 /*
  * States flow:
  * * Got new SMS notification: store the index in NVM (n0:2) (0-th bit for index '0');
  * * In IDLE state: check NVM (n0:2) for new SMS flags:
- *                  if yes - read SMS and store in s0:1, s1:2;
- * * When the SMS is read to s0:1, s1:2: configure the output to be stored in s3:1
+ *                  if yes - read SMS and store the address in s3:1, the program in s4:5;
+ * * When the SMS is read: configure the output to be stored in s9:5
  *   and execute it in Command Engine;
- * * Send s3:1 in SMS to the original address;
+ * * Send s9:5 in SMS to the owner phone;
  * * Go to IDLE for now, check if we need to delete the incoming SMS;
+ * The engine advances on events: '+CMTI' indication, '+CMGR'/'+CMGS' completions and
+ * the program execution completion, the periodic task is only a safety net.
+ * Batch mode, when more than one new SMS is pending:
+ * * List all unread SMS with a single '+CMGL' request, collecting the programs from
+ *   the owner phone, then execute them from the engine step, the output in s9:5;
+ * * Delete all read SMS with '+CMGD', send s9:5 in a single SMS to the owner phone.
+ * Several GSM modules can be driven, each by its own 'gsm_engine_t' instance; the SMS
+ * programs are only accepted by the default instance, as they share the variables and
+ * the NVM flags, outgoing SMS are spread over all the instances.
+ * With PDU support, the GSM module is switched to PDU mode on 'SMS Ready', so, the
+ * replies go in GSM 7-bit alphabet, 160 characters per SMS; the UCS2 text mode, 70
+ * characters per SMS, stays if the GSM module rejects 'AT+CMGF=0'.
+ * In PDU mode, the parts of a concatenated SMS are collected, keyed by the address and
+ * the reference, the program is handled when the last part arrives; the long replies
+ * are split into the linked parts, queued back to back.
  */
 
 typedef enum {
@@ -57,6 +102,7 @@ typedef enum {
   EGsmStateSendingSmsAddress,
   EGsmStateReadingSmsBody,
   EGsmStateReadingSmsHeader,
+  EGsmStateListingSms,
 } TGsmState;
 
 typedef enum {
@@ -95,83 +141,225 @@ typedef enum {
   EEngineExecSmsDone,
   EEngineSendSms,
   EEngineSendSmsDone,
+  EEngineListSms,
+  EEngineListSmsDone,
+  EEngineDeleteSms,
 } TEngineState;
 
+typedef enum {
+  EGsmCmdAt = 0,  /**< Generic AT command, completes on 'OK'/'ERROR' */
+  EGsmCmdPrompt,  /**< AT command that completes on the '> ' prompt */
+  EGsmCmdSms,     /**< Send SMS: '+CMGS' with the address, then the body, completes on 'OK' */
+  EGsmCmdReadSms, /**< Read SMS: '+CMGR' header and body, completes on 'OK' */
+  EGsmCmdListSms, /**< List SMS: '+CMGL' header and body pairs, completes on 'OK' */
+} TGsmCmdType;
+
 typedef struct {
   const char *rspBase;
+  uint8_t length;  /**< Precomputed length of \c rspBase */
+  bool partial;    /**< Also matches '<rspBase>: <args>' lines */
   TAtCmdId cmdId;
 } TGsmResponses;
 
-static const TGsmResponses TheGsmResponses[] = {
-  { "", EAtCmdIdEmpty },
-  { "OK", EAtCmdIdOk },
-  { "ERROR", EAtCmdIdError },
-  { "RDY", EAtCmdIdReady },
-  { "SMS Ready", EAtCmdIdSmsReady },
-  { "Call Ready", EAtCmdIdCallReady },
-  { "+CPIN: READY", EAtCmdIdPinReady },
-  { "+CPIN: NOT READY", EAtCmdIdPinNotReady},
-  { "+CFUN: 1", EAtCmdIdFullFunc },
-  { "+CBC", EAtCmdIdBatteryLevel },
-  { "+CMGS", EAtCmdIdSmsSent },
-  { "+CMTI", EAtCmdIdSmsIndication },
-  { "+CMGR", EAtCmdIdSmsRead },
-  { "> ", EAtCmdIdSmsReadyForBody },
-  { NULL, EAtCmdIdNull },
-};
-
-static uint32_t TheEngineIndex = 0;
-static uint32_t TheEngineState = 0;
-static gsm_callback TheGsmCallback = NULL;
-static TGsmState TheGsmState = EGsmStateNull;
-static char TheMsgBuffer[MCODE_SMS_MAX_LENGTH] = {0};
-static TGsmStateFlags TheGsmFlags = EGsmStateFlagNone;
+#define GSM_RSP(base, partial, id) { (base), sizeof (base) - 1, (partial), (id) }
 
+/*
+ * The known responses, the lookup is done in 'gsm_find_response' that dispatches
+ * on the first characters of a line, so, at most one candidate is compared per line
+ */
+static const TGsmResponses TheRspEmpty = GSM_RSP("", false, EAtCmdIdEmpty);
+static const TGsmResponses TheRspOk = GSM_RSP("OK", false, EAtCmdIdOk);
+static const TGsmResponses TheRspError = GSM_RSP("ERROR", false, EAtCmdIdError);
+static const TGsmResponses TheRspReady = GSM_RSP("RDY", false, EAtCmdIdReady);
+static const TGsmResponses TheRspSmsReady = GSM_RSP("SMS Ready", false, EAtCmdIdSmsReady);
+static const TGsmResponses TheRspCallReady = GSM_RSP("Call Ready", false, EAtCmdIdCallReady);
+static const TGsmResponses TheRspPinReady = GSM_RSP("+CPIN: READY", false, EAtCmdIdPinReady);
+static const TGsmResponses TheRspPinNotReady = GSM_RSP("+CPIN: NOT READY", false, EAtCmdIdPinNotReady);
+static const TGsmResponses TheRspFullFunc = GSM_RSP("+CFUN: 1", false, EAtCmdIdFullFunc);
+static const TGsmResponses TheRspBatteryLevel = GSM_RSP("+CBC", true, EAtCmdIdBatteryLevel);
+static const TGsmResponses TheRspSmsSent = GSM_RSP("+CMGS", true, EAtCmdIdSmsSent);
+static const TGsmResponses TheRspSmsIndication = GSM_RSP("+CMTI", true, EAtCmdIdSmsIndication);
+static const TGsmResponses TheRspSmsRead = GSM_RSP("+CMGR", true, EAtCmdIdSmsRead);
+static const TGsmResponses TheRspSmsReadyForBody = GSM_RSP("> ", false, EAtCmdIdSmsReadyForBody);
+
+static void gsm_uart2_write_char(void *ctx, char ch);
+
+static gsm_engine_t TheGsm = {0};
+static gsm_engine_t *TheGsmEngines[MCODE_GSM_INSTANCES] = {NULL};
+static gsm_engine_t *TheGsmOutput = NULL;
+static uint8_t TheGsmNextEngine = 0;
+static bool TheGsmKicked = false;
+static bool TheGsmCmdTimerArmed = false;
+static bool TheGsmPeriodicArmed = false;
+#ifdef MCODE_PDU
+/**
+ * The concatenated SMS being reassembled
+ */
+typedef struct {
+  bool used;
+  uint8_t total;                      /**< The number of parts */
+  uint8_t received;                   /**< Bit 'N' is set, if part 'N + 1' is received */
+  uint16_t ref;                       /**< The concatenated SMS reference */
+  uint64_t updatedAt;                 /**< The time the last part is received at */
+  char address[MCODE_PDU_ADDRESS_LENGTH];
+  char parts[MCODE_GSM_CONCAT_PARTS][MCODE_PDU_MAX_SEPTETS + 1];
+} TGsmConcat;
+
+static TGsmConcat TheGsmConcat[MCODE_GSM_CONCAT_SLOTS];
+/** The last reassembled SMS has been dropped, it does not fit the variables */
+static bool TheGsmConcatTooLong;
+static MPduSms TheGsmPduSms;
+static char TheGsmPdu[2 * MCODE_PDU_MAX_LENGTH + 1];
+#endif /* MCODE_PDU */
+
+/** The default GSM engine instance talks to its GSM module over UART2 */
+static const MGsmTransport TheUart2Transport = { gsm_uart2_write_char, NULL };
+
+static bool gsm_engine_task(void);
+static void gsm_engine_putch(char ch);
+static void gsm_engine_output_push(gsm_engine_t *engine);
+static void gsm_engine_step(gsm_engine_t *engine);
+static void gsm_engine_kick(gsm_engine_t *engine);
 static bool gsm_periodic_task(void);
-static void gsm_sms_send_body(void);
-static void gsm_sms_sent_task(void);
+static void gsm_engine_clear_flag(uint32_t index);
+static void gsm_engine_read_done(gsm_engine_t *engine, MGsmResult result);
+static void gsm_engine_send_done(gsm_engine_t *engine, MGsmResult result);
+static void gsm_engine_list_done(gsm_engine_t *engine, MGsmResult result);
+static void gsm_engine_delete_done(gsm_engine_t *engine, MGsmResult result);
+static void gsm_engine_list_start(gsm_engine_t *engine);
+static void gsm_exec_batch_task(gsm_engine_t *engine);
+static void gsm_engine_delete_task(gsm_engine_t *engine);
+static bool gsm_queue_list_sms(gsm_engine_t *engine, gsm_cmd_done done);
+static bool gsm_list_sms_handle_line(gsm_engine_t *engine, const char *data, size_t length);
+static void gsm_list_sms_handle_body(gsm_engine_t *engine, const char *data, size_t length);
+static bool gsm_list_sms_handle_header(gsm_engine_t *engine, const char *data, size_t length);
+static bool gsm_queue_read_sms(gsm_engine_t *engine, int index, gsm_cmd_done done);
+static bool gsm_queue_sms(gsm_engine_t *engine, const char *address, const char *body, gsm_cmd_done done);
+static void gsm_sms_send_body(gsm_engine_t *engine);
+static void gsm_sms_sent_task(gsm_engine_t *engine);
 static void gsm_prepare_response(void);
-static void gsm_exec_new_sms_task(void);
-static void gsm_check_new_sms_task(void);
-static void gsm_send_sms_response_task(void);
+static void gsm_exec_new_sms_task(gsm_engine_t *engine);
+static void gsm_check_new_sms_task(gsm_engine_t *engine);
+static void gsm_send_sms_response_task(gsm_engine_t *engine);
 static void gsm_uart2_handler(const char *data, size_t length);
-static void gsm_handle_new_sms(const char *args, size_t length);
-static void gsm_handle_sms_sent(const char *args, size_t length);
-static void gsm_read_sms_handle_body(const char *data, size_t length);
-static void gsm_read_sms_handle_header(const char *data, size_t length);
-static void gsm_read_sms_handle_response(const char *data, size_t length);
+static void gsm_handle_new_sms(gsm_engine_t *engine, const char *args, size_t length);
+static void gsm_handle_sms_sent(gsm_engine_t *engine, const char *args, size_t length);
+static void gsm_read_sms_handle_body(gsm_engine_t *engine, const char *data, size_t length);
+static void gsm_read_sms_handle_header(gsm_engine_t *engine, const char *data, size_t length);
+static void gsm_read_sms_handle_response(gsm_engine_t *engine, const char *data, size_t length);
 static const char *gsm_parse_response(const char *rsp, TAtCmdId *id, const char **args);
+static const TGsmResponses *gsm_find_response(const char *rsp, size_t length);
+static void gsm_queue_reset(gsm_engine_t *engine);
+static void gsm_queue_dispatch(gsm_engine_t *engine);
+static bool gsm_queue_timeout_task(void);
+static void gsm_queue_complete(gsm_engine_t *engine, MGsmResult result);
+static MGsmCmd *gsm_queue_push(gsm_engine_t *engine, TGsmCmdType type, uint32_t timeout, gsm_cmd_done done);
+static void gsm_queue_hist_add(uint16_t *hist, uint64_t value);
+#ifdef MCODE_PDU
+static size_t gsm_sms_pdu(const MGsmCmd *entry);
+static void gsm_engine_pdu_done(gsm_engine_t *engine, MGsmResult result);
+static bool gsm_pdu_store(const char *pdu, size_t length, uint8_t address, uint8_t text, uint8_t count);
+static bool gsm_concat_store(const MPduSms *sms, size_t capacity);
+static void gsm_engine_reply_too_long(void)
+{
+  mvar_putch_config_append(MCODE_GSM_VAR_OUTPUT, MCODE_GSM_VAR_OUTPUT_COUNT);
+  io_ostream_handler_push(mvar_putch);
+  mprintstrln(PSTR("SMS too long"));
+  io_ostream_handler_pop();
+}
+
+void gsm_concat_expire(uint64_t now);
+static void gsm_engine_reply_too_long(void);
+#endif /* MCODE_PDU */
+static uint8_t gsm_sms_split(gsm_engine_t *engine, const char *body, size_t length, size_t *lengths);
 
 void gsm_init(void)
 {
-  if (EGsmStateNull != TheGsmState) {
+  if (TheGsmEngines[0]) {
     /* Already initialized */
     return;
   }
 
   hw_gsm_init();
 
-  TheGsmState = EGsmStateNull;
-
-  /* Schedule the periodic task to start in 30 seconds and repeat each 20 seconds after that */
-  mtimer_add_periodic(gsm_periodic_task, 30000, 20000);
+  gsm_engine_init(&TheGsm, &TheUart2Transport);
   hw_uart2_set_callback(gsm_uart2_handler);
 }
 
 void gsm_deinit(void)
 {
-  if (EGsmStateNull == TheGsmState) {
+  if (!TheGsmEngines[0]) {
     /* Nothing to deinitialize */
     return;
   }
 
   hw_uart2_set_callback(NULL);
-  TheGsmState = EGsmStateNull;
+  gsm_engine_deinit(&TheGsm);
+  hw_gsm_deinit();
+}
+
+bool gsm_engine_init(gsm_engine_t *engine, const MGsmTransport *transport)
+{
+  uint8_t i;
+  gsm_callback callback;
+  gsm_engine_t **slot = NULL;
+
+  /* The first slot is reserved for the default instance */
+  for (i = (&TheGsm != engine); i < MCODE_GSM_INSTANCES; ++i) {
+    if (engine == TheGsmEngines[i]) {
+      /* Already initialized */
+      return true;
+    }
+    if (!slot && !TheGsmEngines[i]) {
+      slot = TheGsmEngines + i;
+    }
+    if (&TheGsm == engine) {
+      break;
+    }
+  }
+  if (!slot) {
+    /* No room for more instances */
+    return false;
+  }
+
+  /* The default instance callback may be set before initializing it */
+  callback = (&TheGsm == engine) ? engine->callback : NULL;
+  memset(engine, 0, sizeof (*engine));
+  engine->callback = callback;
+  engine->transport = transport;
+  engine->state = EGsmStateNull;
+  *slot = engine;
+
+  if (!TheGsmPeriodicArmed) {
+    /* Schedule the periodic task to start in 30 seconds and repeat each 20 seconds after that */
+    TheGsmPeriodicArmed = true;
+    mtimer_add_periodic(gsm_periodic_task, 30000, 20000);
+  }
+
+  return true;
+}
+
+void gsm_engine_deinit(gsm_engine_t *engine)
+{
+  uint8_t i;
+
+  for (i = 0; i < MCODE_GSM_INSTANCES; ++i) {
+    if (engine == TheGsmEngines[i]) {
+      TheGsmEngines[i] = NULL;
+      engine->state = EGsmStateNull;
+      gsm_queue_reset(engine);
+    }
+  }
+}
+
+gsm_engine_t *gsm_engine_at(uint8_t index)
+{
+  return (index < MCODE_GSM_INSTANCES) ? TheGsmEngines[index] : NULL;
 }
 
 void gsm_set_callback(gsm_callback callback)
 {
-  TheGsmCallback = callback;
+  TheGsm.callback = callback;
 }
 
 void gsm_power(bool on)
@@ -181,26 +369,45 @@ void gsm_power(bool on)
 
 bool gsm_send_cmd(const char *cmd)
 {
-  if (EGsmStateIdle != TheGsmState ||
-      0 == (TheGsmFlags & EGsmStateFlagAtReady)) {
+  return gsm_engine_queue_cmd(&TheGsm, cmd, MGsmExpectOk, MCODE_GSM_CMD_TIMEOUT, NULL);
+}
+
+bool gsm_queue_cmd(const char *cmd, MGsmExpect expect, uint32_t timeout, gsm_cmd_done done)
+{
+  return gsm_engine_queue_cmd(&TheGsm, cmd, expect, timeout, done);
+}
+
+bool gsm_engine_queue_cmd(gsm_engine_t *engine, const char *cmd, MGsmExpect expect,
+                          uint32_t timeout, gsm_cmd_done done)
+{
+  MGsmCmd *entry;
+
+  if (EGsmStateNull == engine->state ||
+      0 == (engine->flags & EGsmStateFlagAtReady)) {
     /* GSM engine is not ready */
     return false;
   }
 
-  TheGsmState = EGsmStateSendingAtCmd;
+  entry = gsm_queue_push(engine, (MGsmExpectPrompt == expect) ? EGsmCmdPrompt : EGsmCmdAt, timeout, done);
+  if (!entry) {
+    /* The queue is full */
+    return false;
+  }
 
-  io_ostream_handler_push(uart2_write_char);
+  /* Expand the command now, the variables may change while the command is in the queue */
+  mputch_str_config(entry->data, sizeof (entry->data) - 1);
+  io_ostream_handler_push(mputch_str);
   mprintexpr(cmd, -1);
-  mputch('\r');
   io_ostream_handler_pop();
 
+  gsm_queue_dispatch(engine);
   return true;
 }
 
 void gsm_send_cmd_raw(const char *cmd)
 {
   /* No state check for RAW variant */
-  io_ostream_handler_push(uart2_write_char);
+  gsm_engine_output_push(&TheGsm);
   mprintexpr(cmd, -1);
   mputch('\r');
   io_ostream_handler_pop();
@@ -208,44 +415,333 @@ void gsm_send_cmd_raw(const char *cmd)
 
 bool gsm_send_sms(const char *address, const char *body)
 {
-  if (EGsmStateIdle != TheGsmState ||
-      0 == (TheGsmFlags & EGsmStateFlagAtReady) ||
-      0 == (TheGsmFlags & EGsmStateFlagSmsReady) ||
-      0 == (TheGsmFlags & EGsmStateFlagPinReady)) {
+  uint8_t i;
+  uint8_t index;
+  gsm_engine_t *engine;
+
+  /* Round-robin over the instances, starting with the one after the last used */
+  for (i = 0; i < MCODE_GSM_INSTANCES; ++i) {
+    index = (TheGsmNextEngine + i) % MCODE_GSM_INSTANCES;
+    engine = TheGsmEngines[index];
+    if (engine && gsm_queue_sms(engine, address, body, NULL)) {
+      TheGsmNextEngine = (index + 1) % MCODE_GSM_INSTANCES;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+bool gsm_engine_send_sms(gsm_engine_t *engine, const char *address, const char *body)
+{
+  return gsm_queue_sms(engine, address, body, NULL);
+}
+
+bool gsm_queue_sms(gsm_engine_t *engine, const char *address, const char *body, gsm_cmd_done done)
+{
+  uint8_t part;
+  uint8_t parts;
+  size_t offset;
+  MGsmCmd *entry;
+  size_t address_length;
+  size_t lengths[MCODE_GSM_QUEUE_LENGTH];
+
+  if (EGsmStateNull == engine->state ||
+      0 == (engine->flags & EGsmStateFlagAtReady) ||
+      0 == (engine->flags & EGsmStateFlagSmsReady) ||
+      0 == (engine->flags & EGsmStateFlagPinReady)) {
     /* GSM engine is not ready */
     return false;
   }
 
-  /* Now, check/store the SMS body */
-  size_t length = strlen(body);
-  if (length > sizeof (TheMsgBuffer) - 1) {
-    length = sizeof (TheMsgBuffer) - 1;
+  address_length = strlen(address);
+  if (address_length > MCODE_GSM_ADDRESS_MAX_LENGTH - 1) {
+    /* Wrong address */
+    return false;
+  }
+
+  /* All the parts are queued or none of them */
+  parts = gsm_sms_split(engine, body, strlen(body), lengths);
+  if (parts > MCODE_GSM_QUEUE_LENGTH - engine->cmdCount) {
+    /* The queue is full */
+    ++engine->stats.rejected;
+    return false;
+  }
+  if (parts > 1) {
+    ++engine->smsRef;
+  }
+
+  /* Now, store the address and the SMS body, only the last part reports the completion */
+  for (part = 0, offset = 0; part < parts; offset += lengths[part], ++part) {
+    entry = gsm_queue_push(engine, EGsmCmdSms, MCODE_GSM_SMS_TIMEOUT, (part + 1 == parts) ? done : NULL);
+    if (parts > 1) {
+      entry->part = part + 1;
+      entry->parts = parts;
+      entry->ref = engine->smsRef;
+    }
+    memcpy(entry->data, address, address_length + 1);
+    memcpy(entry->data + address_length + 1, body + offset, lengths[part]);
+    entry->data[address_length + 1 + lengths[part]] = 0;
+  }
+
+  gsm_queue_dispatch(engine);
+  return true;
+}
+
+uint8_t gsm_sms_split(gsm_engine_t *engine, const char *body, size_t length, size_t *lengths)
+{
+#ifdef MCODE_PDU
+  uint8_t dcs;
+  uint8_t parts;
+
+  if (engine->pduMode) {
+    dcs = pdu_text_dcs(body, length);
+    if (pdu_text_fit(body, length, dcs, false) >= length) {
+      /* A single SMS, up to 160 characters in GSM 7-bit alphabet */
+      lengths[0] = (length > MCODE_SMS_MAX_LENGTH - 1) ? (MCODE_SMS_MAX_LENGTH - 1) : length;
+      return 1;
+    }
+    /* The linked parts carry the concatenation header, so, each of them holds less,
+     * the body not fitting the queue is truncated */
+    for (parts = 0; length && parts < MCODE_GSM_QUEUE_LENGTH; ++parts) {
+      lengths[parts] = pdu_text_fit(body, length, dcs, true);
+      body += lengths[parts];
+      length -= lengths[parts];
+    }
+    return parts;
+  }
+#endif /* MCODE_PDU */
+
+  /* A single SMS in UCS2 text mode, 2 octets per character, the body is truncated */
+  lengths[0] = (length > MCODE_SMS_UCS2_MAX_LENGTH - 1) ? (MCODE_SMS_UCS2_MAX_LENGTH - 1) : length;
+  return 1;
+}
+
+const MGsmQueueStats *gsm_queue_stats(void)
+{
+  return gsm_engine_queue_stats(&TheGsm);
+}
+
+void gsm_queue_stats_reset(void)
+{
+  gsm_engine_queue_stats_reset(&TheGsm);
+}
+
+const MGsmQueueStats *gsm_engine_queue_stats(gsm_engine_t *engine)
+{
+  engine->stats.depth = engine->cmdCount;
+  return &engine->stats;
+}
+
+void gsm_engine_queue_stats_reset(gsm_engine_t *engine)
+{
+  memset(&engine->stats, 0, sizeof (engine->stats));
+}
+
+void gsm_queue_reset(gsm_engine_t *engine)
+{
+  engine->cmdHead = 0;
+  engine->cmdCount = 0;
+  engine->cmdActive = false;
+}
+
+MGsmCmd *gsm_queue_push(gsm_engine_t *engine, TGsmCmdType type, uint32_t timeout, gsm_cmd_done done)
+{
+  MGsmCmd *entry;
+
+  if (engine->cmdCount >= MCODE_GSM_QUEUE_LENGTH) {
+    ++engine->stats.rejected;
+    return NULL;
+  }
+
+  entry = engine->cmds + (engine->cmdHead + engine->cmdCount) % MCODE_GSM_QUEUE_LENGTH;
+  ++engine->cmdCount;
+  if (engine->cmdCount > engine->stats.maxDepth) {
+    engine->stats.maxDepth = engine->cmdCount;
   }
-  memcpy(TheMsgBuffer, body, length);
-  TheMsgBuffer[length] = 0;
+  ++engine->stats.queued;
+
+  entry->type = type;
+  entry->part = 0;
+  entry->parts = 0;
+  entry->ref = 0;
+  entry->done = done;
+  entry->timeout = timeout;
+  entry->queued = mtick_count();
+  entry->data[0] = 0;
+
+  return entry;
+}
+
+void gsm_queue_dispatch(gsm_engine_t *engine)
+{
+  MGsmCmd *entry;
+  size_t length;
 
-  /* Send first line of '+CMGS' command */
-  io_ostream_handler_push(uart2_write_char);
-  mprintstr(PSTR("AT+CMGS=\""));
-  mprintstrhex16encoded(address, strlen(address));
-  mprintstr(PSTR("\""));
+  if (EGsmStateIdle != engine->state || engine->cmdActive || !engine->cmdCount) {
+    /* Busy or nothing to send */
+    return;
+  }
+
+  entry = engine->cmds + engine->cmdHead;
+  engine->cmdActive = true;
+  engine->cmdSentAt = mtick_count();
+  gsm_queue_hist_add(engine->stats.wait, engine->cmdSentAt - entry->queued);
+
+  gsm_engine_output_push(engine);
+  switch (entry->type) {
+  case EGsmCmdSms:
+    /* Send first line of '+CMGS' command, the body is sent on the '> ' prompt */
+#ifdef MCODE_PDU
+    if (engine->pduMode) {
+      /* The command takes the TPDU length, the PDU itself is encoded again on the prompt */
+      mprintstr(PSTR("AT+CMGS="));
+      mprint_uintd(gsm_sms_pdu(entry), 1);
+      engine->state = EGsmStateSendingSmsAddress;
+      break;
+    }
+#endif /* MCODE_PDU */
+    length = strlen(entry->data);
+    strcpy(engine->msg, entry->data + length + 1);
+    mprintstr(PSTR("AT+CMGS=\""));
+    mprintstrhex16encoded(entry->data, length);
+    mprintstr(PSTR("\""));
+    engine->state = EGsmStateSendingSmsAddress;
+    break;
+  case EGsmCmdPrompt:
+    mprintstr_R(entry->data);
+    engine->state = EGsmStateSendingSmsAddress;
+    break;
+  case EGsmCmdReadSms:
+    mprintstr_R(entry->data);
+    engine->state = EGsmStateReadingSmsHeader;
+    break;
+  case EGsmCmdListSms:
+    mprintstr_R(entry->data);
+    engine->state = EGsmStateListingSms;
+    engine->listBody = false;
+    break;
+  case EGsmCmdAt:
+  default:
+    mprintstr_R(entry->data);
+    engine->state = EGsmStateSendingAtCmd;
+    break;
+  }
   mputch('\r');
   io_ostream_handler_pop();
-  TheGsmState = EGsmStateSendingSmsAddress;
 
-  return true;
+  /* A single periodic timer checks the deadlines of all the instances */
+  engine->cmdDeadline = engine->cmdSentAt + entry->timeout;
+  if (!TheGsmCmdTimerArmed) {
+    TheGsmCmdTimerArmed = true;
+    mtimer_add_periodic(gsm_queue_timeout_task, MCODE_GSM_TIMEOUT_TICK, MCODE_GSM_TIMEOUT_TICK);
+  }
+}
+
+void gsm_queue_complete(gsm_engine_t *engine, MGsmResult result)
+{
+  gsm_cmd_done done;
+
+  engine->state = EGsmStateIdle;
+  if (!engine->cmdActive) {
+    /* No command is sent via the queue */
+    gsm_queue_dispatch(engine);
+    return;
+  }
+
+  done = engine->cmds[engine->cmdHead].done;
+  gsm_queue_hist_add(engine->stats.rtt, mtick_count() - engine->cmdSentAt);
+  if (MGsmResultTimeout == result) {
+    ++engine->stats.timeouts;
+  }
+
+  engine->cmdHead = (engine->cmdHead + 1) % MCODE_GSM_QUEUE_LENGTH;
+  --engine->cmdCount;
+  engine->cmdActive = false;
+
+  if (done) {
+    (*done)(engine, result);
+  }
+
+  /* Send the next command straight away */
+  gsm_queue_dispatch(engine);
+}
+
+bool gsm_queue_timeout_task(void)
+{
+  uint8_t i;
+  bool active = false;
+  gsm_engine_t *engine;
+  const uint64_t now = mtick_count();
+
+  for (i = 0; i < MCODE_GSM_INSTANCES; ++i) {
+    engine = TheGsmEngines[i];
+    if (!engine || !engine->cmdActive) {
+      continue;
+    }
+
+    if (now >= engine->cmdDeadline) {
+      mprintstrln(PSTR("\r- AT command timeout"));
+      gsm_queue_complete(engine, MGsmResultTimeout);
+    }
+    active = active || engine->cmdActive;
+  }
+
+  /* Stop checking when no command is waiting for the final result */
+  TheGsmCmdTimerArmed = active;
+  return active;
+}
+
+void gsm_queue_hist_add(uint16_t *hist, uint64_t value)
+{
+  uint8_t index;
+
+  /* Bucket 'N' collects values in [2^(N-1), 2^N) milli-seconds, the last one - the rest */
+  index = value ? (64 - __builtin_clzll(value)) : 0;
+  if (index >= MCODE_GSM_HIST_BUCKETS) {
+    index = MCODE_GSM_HIST_BUCKETS - 1;
+  }
+  if (hist[index] != UINT16_MAX) {
+    ++hist[index];
+  }
 }
 
 void gsm_uart2_handler(const char *data, size_t length)
+{
+  gsm_engine_input(&TheGsm, data, length);
+}
+
+void gsm_uart2_write_char(void *ctx, char ch)
+{
+  uart2_write_char(ch);
+}
+
+void gsm_engine_output_push(gsm_engine_t *engine)
+{
+  /* The output blocks are never nested, so, a single current instance is enough */
+  TheGsmOutput = engine;
+  io_ostream_handler_push(gsm_engine_putch);
+}
+
+void gsm_engine_putch(char ch)
+{
+  (*TheGsmOutput->transport->write_char)(TheGsmOutput->transport->ctx, ch);
+}
+
+void gsm_engine_input(gsm_engine_t *engine, const char *data, size_t length)
 {
   TAtCmdId id;
   const char *args = NULL;
   const char *next = data;
   const char *curr = data;
 
-  if (EGsmStateReadingSmsBody == TheGsmState ||
-      EGsmStateReadingSmsHeader == TheGsmState) {
-    gsm_read_sms_handle_response(data, length);
+  if (EGsmStateReadingSmsBody == engine->state ||
+      EGsmStateReadingSmsHeader == engine->state) {
+    gsm_read_sms_handle_response(engine, data, length);
+    return;
+  }
+  if (EGsmStateListingSms == engine->state && gsm_list_sms_handle_line(engine, data, length)) {
+    /* The listed SMS line is handled, other lines, like 'OK', are handled below */
     return;
   }
   while (next) {
@@ -256,37 +752,45 @@ void gsm_uart2_handler(const char *data, size_t length)
       break;
     case EAtCmdIdOk:
       mprintstrln(PSTR("\r- OK event"));
-      if (EGsmStateSendingAtCmd == TheGsmState) {
-        TheGsmState = EGsmStateIdle;
+      if (EGsmStateSendingAtCmd == engine->state ||
+          EGsmStateListingSms == engine->state) {
+        gsm_queue_complete(engine, MGsmResultOk);
       }
       break;
     case EAtCmdIdError:
       mprintstrln(PSTR("\r- ERROR event"));
-      if (EGsmStateSendingAtCmd == TheGsmState) {
-        TheGsmState = EGsmStateIdle;
+      if (EGsmStateSendingAtCmd == engine->state ||
+          EGsmStateSendingSmsAddress == engine->state ||
+          EGsmStateListingSms == engine->state) {
+        gsm_queue_complete(engine, MGsmResultError);
       }
       break;
     case EAtCmdIdReady:
-      TheGsmFlags |= EGsmStateFlagAtReady;
+      engine->flags |= EGsmStateFlagAtReady;
+      engine->pduMode = false;
       mprintstrln(PSTR("\r- READY event"));
-      if (EGsmStateNull == TheGsmState) {
-        TheGsmState = EGsmStateIdle;
+      if (EGsmStateNull == engine->state) {
+        engine->state = EGsmStateIdle;
       }
       break;
     case EAtCmdIdSmsReady:
-      TheGsmFlags |= EGsmStateFlagSmsReady;
+      engine->flags |= EGsmStateFlagSmsReady;
       mprintstrln(PSTR("\r- SMS-READY event"));
+#ifdef MCODE_PDU
+      /* Switch the GSM module to PDU mode, the text mode stays if it fails */
+      gsm_engine_queue_cmd(engine, "AT+CMGF=0", MGsmExpectOk, MCODE_GSM_CMD_TIMEOUT, gsm_engine_pdu_done);
+#endif /* MCODE_PDU */
       break;
     case EAtCmdIdCallReady:
-      TheGsmFlags |= EGsmStateFlagCallReady;
+      engine->flags |= EGsmStateFlagCallReady;
       mprintstrln(PSTR("\r- Call-READY event"));
       break;
     case EAtCmdIdPinReady:
-      TheGsmFlags |= EGsmStateFlagPinReady;
+      engine->flags |= EGsmStateFlagPinReady;
       mprintstrln(PSTR("\r- PIN-READY event"));
       break;
     case EAtCmdIdPinNotReady:
-      TheGsmFlags = EGsmStateFlagAtReady;
+      engine->flags = EGsmStateFlagAtReady;
       mprintstrln(PSTR("\r- PIN-NOT-READY event"));
       break;
     case EAtCmdIdFullFunc:
@@ -303,19 +807,22 @@ void gsm_uart2_handler(const char *data, size_t length)
       }
       break;
     case EAtCmdIdSmsSent:
-      gsm_handle_sms_sent(args, next - args - 1);
+      gsm_handle_sms_sent(engine, args, next - args - 1);
       break;
     case EAtCmdIdSmsReadyForBody:
-      if (EGsmStateSendingSmsAddress == TheGsmState) {
+      if (EGsmStateSendingSmsAddress == engine->state &&
+          engine->cmdActive && EGsmCmdPrompt == engine->cmds[engine->cmdHead].type) {
+        gsm_queue_complete(engine, MGsmResultOk);
+      } else if (EGsmStateSendingSmsAddress == engine->state) {
         mprintstrln(PSTR("\r- SMS: ready for body event"));
-        gsm_sms_send_body();
-        TheGsmState = EGsmStateSendingAtCmd;
+        gsm_sms_send_body(engine);
+        engine->state = EGsmStateSendingAtCmd;
       } else {
         mprintstrln(PSTR("\r- Error: unexpected ready for body event"));
       }
       break;
     case EAtCmdIdSmsIndication:
-      gsm_handle_new_sms(args, next - args - 1);
+      gsm_handle_new_sms(engine, args, next - args - 1);
       break;
     default:
     case EAtCmdIdUnknown:
@@ -331,64 +838,64 @@ void gsm_uart2_handler(const char *data, size_t length)
   line_editor_uart_start();
 }
 
-void gsm_sms_send_body(void)
+void gsm_sms_send_body(gsm_engine_t *engine)
 {
-  io_ostream_handler_push(uart2_write_char);
-  mprintstrhex16encoded(TheMsgBuffer, strlen(TheMsgBuffer));
+  gsm_engine_output_push(engine);
+#ifdef MCODE_PDU
+  if (engine->pduMode) {
+    gsm_sms_pdu(engine->cmds + engine->cmdHead);
+    mprintstr_R(TheGsmPdu);
+  } else
+#endif /* MCODE_PDU */
+  {
+    mprintstrhex16encoded(engine->msg, strlen(engine->msg));
+  }
   mputch('\x1a');
   mputch('\r');
   io_ostream_handler_pop();
 
-  memset(TheMsgBuffer, 0, sizeof (TheMsgBuffer));
+  memset(engine->msg, 0, sizeof (engine->msg));
 }
 
 const char *gsm_parse_response(const char *rsp, TAtCmdId *id, const char **args)
 {
+  char ch;
+  const char *marker;
+  const char *nextLine;
+  const TGsmResponses *response;
+
   if (!rsp) {
     *id = EAtCmdIdNull;
     return NULL;
   }
 
-  const char *nextLine = rsp;
-  do {
-    const char ch = *nextLine++;
-    if (!ch) {
-      nextLine = NULL;
-      break;
-    }
-    if ('\n' == ch || '\r' == ch) {
-      break;
+  /* Find the end of the line and the first ':' marker in a single pass */
+  marker = NULL;
+  nextLine = rsp;
+  while ((ch = *nextLine) && '\n' != ch && '\r' != ch) {
+    if (':' == ch && !marker) {
+      marker = nextLine;
     }
-  } while (true);
+    ++nextLine;
+  }
 
-  const size_t lineLength = nextLine ? (nextLine - rsp - 1) : strlen(rsp);
+  const size_t lineLength = nextLine - rsp;
+  nextLine = ch ? (nextLine + 1) : NULL;
 
   const char *itemArgs = NULL;
   TAtCmdId itemId = EAtCmdIdUnknown;
-  const TGsmResponses *response = TheGsmResponses;
-  while (response->rspBase) {
-    /* First, try the full match */
-    const size_t itemLength = strlen(response->rspBase);
-    if (lineLength == itemLength && !strncmp(response->rspBase, rsp, lineLength)) {
+  response = gsm_find_response(rsp, lineLength);
+  if (response) {
+    const size_t itemLength = response->length;
+    if (lineLength == itemLength && !memcmp(response->rspBase, rsp, itemLength)) {
+      /* The full match */
       itemId = response->cmdId;
-      break;
-    }
-
-    /* Now, try partial match, like '+CMGS: <any>', @todo implement */
-    if ('+' == *response->rspBase && !strchr(response->rspBase, ':')) {
-      const char *marker = (const char *)memchr(rsp, ':', lineLength);
-      if (marker) {
-        const size_t tokenLength = marker - rsp;
-        if (tokenLength == itemLength && !strncmp(response->rspBase, rsp, itemLength)) {
-          itemId = response->cmdId;
-          itemArgs = rsp + tokenLength + 2;
-          break;
-        }
-      }
+    } else if (response->partial && marker && (size_t)(marker - rsp) == itemLength &&
+               !memcmp(response->rspBase, rsp, itemLength)) {
+      /* The partial match, like '+CMGS: <any>' */
+      itemId = response->cmdId;
+      itemArgs = marker + 2;
     }
-
-    /* Try the next item */
-    ++response;
   }
 
   *args = itemArgs;
@@ -396,7 +903,60 @@ const char *gsm_parse_response(const char *rsp, TAtCmdId *id, const char **args)
   return nextLine;
 }
 
-void gsm_handle_new_sms(const char *args, size_t length)
+const TGsmResponses *gsm_find_response(const char *rsp, size_t length)
+{
+  if (!length) {
+    return &TheRspEmpty;
+  }
+
+  switch (*rsp) {
+  case 'O':
+    return &TheRspOk;
+  case 'E':
+    return &TheRspError;
+  case 'R':
+    return &TheRspReady;
+  case 'S':
+    return &TheRspSmsReady;
+  case 'C':
+    return &TheRspCallReady;
+  case '>':
+    return &TheRspSmsReadyForBody;
+  case '+':
+    break;
+  default:
+    return NULL;
+  }
+
+  /* The '+C<XXX>' responses, dispatch on the characters after "+C" */
+  if (length < 4 || 'C' != rsp[1]) {
+    return NULL;
+  }
+  switch (rsp[2]) {
+  case 'P':
+    return (length == TheRspPinReady.length) ? &TheRspPinReady : &TheRspPinNotReady;
+  case 'F':
+    return &TheRspFullFunc;
+  case 'B':
+    return &TheRspBatteryLevel;
+  case 'M':
+    if (length < 5) {
+      return NULL;
+    }
+    if ('T' == rsp[3]) {
+      return &TheRspSmsIndication;
+    } else if ('G' == rsp[3]) {
+      return ('S' == rsp[4]) ? &TheRspSmsSent : &TheRspSmsRead;
+    }
+    break;
+  default:
+    break;
+  }
+
+  return NULL;
+}
+
+void gsm_handle_new_sms(gsm_engine_t *engine, const char *args, size_t length)
 {
   uint32_t value;
   TokenType type;
@@ -432,42 +992,214 @@ void gsm_handle_new_sms(const char *args, size_t length)
   mprintstr(PSTR("- New SMS, index: "));
   mprint_uintd(value, 1);
   mprint(MStringNewLine);
+  if (&TheGsm != engine) {
+    /* Only the default instance accepts the SMS programs */
+    return;
+  }
   if (value < 32) {
     uint16_t flags;
     const int n = value / 16;
     flags = mvar_nvm_get(n);
     flags |= (1u << (value % 16));
     mvar_nvm_set(n, flags);
+  } else {
+    /* No room for the flag, pick it up by listing all unread SMS */
+    engine->listRequest = true;
   }
+
+  /* Start handling the new SMS straight away, if the engine is idle */
+  gsm_engine_kick(engine);
 }
 
 bool gsm_read_sms(int index)
 {
-  if (EGsmStateIdle != TheGsmState) {
+  return gsm_queue_read_sms(&TheGsm, index, NULL);
+}
+
+bool gsm_queue_read_sms(gsm_engine_t *engine, int index, gsm_cmd_done done)
+{
+  MGsmCmd *entry;
+
+  if (EGsmStateNull == engine->state) {
     /* GSM engine is not ready */
     return false;
   }
 
-  TheGsmState = EGsmStateReadingSmsHeader;
-  io_ostream_handler_push(uart2_write_char);
+  entry = gsm_queue_push(engine, EGsmCmdReadSms, MCODE_GSM_CMD_TIMEOUT, done);
+  if (!entry) {
+    /* The queue is full */
+    return false;
+  }
+
+  mputch_str_config(entry->data, sizeof (entry->data) - 1);
+  io_ostream_handler_push(mputch_str);
   mprintstr(PSTR("AT+CMGR="));
   mprint_uintd(index, 1);
-  mputch('\r');
   io_ostream_handler_pop();
 
+  gsm_queue_dispatch(engine);
   return true;
 }
 
-void gsm_read_sms_handle_response(const char *data, size_t length)
+bool gsm_queue_list_sms(gsm_engine_t *engine, gsm_cmd_done done)
 {
-  if (EGsmStateReadingSmsHeader == TheGsmState) {
-    gsm_read_sms_handle_header(data, length);
-  } else if (EGsmStateReadingSmsBody == TheGsmState) {
-    gsm_read_sms_handle_body(data, length);
+  MGsmCmd *entry;
+
+  if (EGsmStateNull == engine->state) {
+    /* GSM engine is not ready */
+    return false;
   }
+
+  entry = gsm_queue_push(engine, EGsmCmdListSms, MCODE_GSM_LIST_TIMEOUT, done);
+  if (!entry) {
+    /* The queue is full */
+    return false;
+  }
+
+#ifdef MCODE_PDU
+  if (engine->pduMode) {
+    /* Status '0' is "REC UNREAD" in PDU mode */
+    strcpy(entry->data, "AT+CMGL=0");
+  } else
+#endif /* MCODE_PDU */
+  {
+    strcpy(entry->data, "AT+CMGL=\"REC UNREAD\"");
+  }
+  gsm_queue_dispatch(engine);
+  return true;
 }
 
-void gsm_read_sms_handle_header(const char *data, size_t length)
+bool gsm_list_sms_handle_line(gsm_engine_t *engine, const char *data, size_t length)
+{
+  if (engine->listBody) {
+    engine->listBody = false;
+    gsm_list_sms_handle_body(engine, data, length);
+    return true;
+  }
+
+  return gsm_list_sms_handle_header(engine, data, length);
+}
+
+bool gsm_list_sms_handle_header(gsm_engine_t *engine, const char *data, size_t length)
+{
+  uint32_t value;
+  TokenType type;
+  const char *token;
+  /*
+   * Example response:
+   * > +CMGL: 2,"REC UNREAD","002B00390038003800370035003300310030003100320033","","20/01/08,10:25:13+12"
+   */
+
+  /* Parse '+' */
+  type = next_token(&data, &length, &token, &value);
+  if (TokenPunct != type || '+' != value) {
+    return false;
+  }
+  /* Parse "CMGL:" */
+  type = next_token(&data, &length, &token, &value);
+  if (TokenId != type || mparser_strcmp(token, value, "CMGL:")) {
+    return false;
+  }
+  /* Parse whitespace after ':' */
+  type = next_token(&data, &length, &token, &value);
+  if (TokenWhitespace != type || ' ' != value) {
+    return false;
+  }
+  /* Parse the SMS index */
+  type = next_token(&data, &length, &token, &value);
+  if (TokenInt != type) {
+    return false;
+  }
+#ifdef MCODE_PDU
+  if (engine->pduMode) {
+    /* The rest is '<stat>,[<alpha>],<length>', the address comes in the PDU */
+    engine->listBody = true;
+    return true;
+  }
+#endif /* MCODE_PDU */
+  /* Parse ',' */
+  type = next_token(&data, &length, &token, &value);
+  if (TokenPunct != type || ',' != value) {
+    return false;
+  }
+  /* Parse "REC UNREAD" */
+  type = next_token(&data, &length, &token, &value);
+  if (TokenString != type) {
+    return false;
+  }
+  /* Parse ',' */
+  type = next_token(&data, &length, &token, &value);
+  if (TokenPunct != type || ',' != value) {
+    return false;
+  }
+  /* Parse the phone number field */
+  type = next_token(&data, &length, &token, &value);
+  if (TokenString != type) {
+    return false;
+  }
+
+  mvar_putch_config(MCODE_GSM_VAR_ADDRESS, 1);
+  io_ostream_handler_push(mvar_putch);
+  mprinthexencodedstr16(token, value);
+  io_ostream_handler_pop();
+
+  /* The next line is the SMS body */
+  engine->listBody = true;
+  return true;
+}
+
+void gsm_list_sms_handle_body(gsm_engine_t *engine, const char *data, size_t length)
+{
+  const char *prog;
+  size_t prog_length;
+
+#ifdef MCODE_PDU
+  if (engine->pduMode) {
+    if (!gsm_pdu_store(data, length, MCODE_GSM_VAR_ADDRESS, MCODE_GSM_VAR_PROGRAM, MCODE_GSM_VAR_PROGRAM_COUNT)) {
+      /* Broken SMS or a part of a concatenated SMS, nothing to execute yet */
+      if (TheGsmConcatTooLong && EEngineListSms == engine->engineState &&
+          !strcmp(mcode_phone(), mvar_str(MCODE_GSM_VAR_ADDRESS, 1, NULL))) {
+        /* The program is dropped, report it in the batch reply */
+        ++engine->batchSkipped;
+        gsm_engine_reply_too_long();
+      }
+      return;
+    }
+  } else
+#endif /* MCODE_PDU */
+  {
+    mvar_putch_config(MCODE_GSM_VAR_PROGRAM, MCODE_GSM_VAR_PROGRAM_COUNT);
+    io_ostream_handler_push(mvar_putch);
+    mprinthexencodedstr16(data, length);
+    io_ostream_handler_pop();
+  }
+
+  if (EEngineListSms != engine->engineState || strcmp(mcode_phone(), mvar_str(MCODE_GSM_VAR_ADDRESS, 1, NULL))) {
+    /* Not requested by the engine or phones do not match, skip the SMS */
+    return;
+  }
+
+  /* Collect the program, it is executed from the engine step when the listing completes */
+  prog = mvar_str(MCODE_GSM_VAR_PROGRAM, MCODE_GSM_VAR_PROGRAM_COUNT, NULL);
+  prog_length = strlen(prog) + 1;
+  if (engine->batchLength + prog_length > sizeof (engine->batch)) {
+    ++engine->batchSkipped;
+    return;
+  }
+  memcpy(engine->batch + engine->batchLength, prog, prog_length);
+  engine->batchLength += prog_length;
+}
+
+void gsm_read_sms_handle_response(gsm_engine_t *engine, const char *data, size_t length)
+{
+  if (EGsmStateReadingSmsHeader == engine->state) {
+    gsm_read_sms_handle_header(engine, data, length);
+  } else if (EGsmStateReadingSmsBody == engine->state) {
+    gsm_read_sms_handle_body(engine, data, length);
+  }
+}
+
+void gsm_read_sms_handle_header(gsm_engine_t *engine, const char *data, size_t length)
 {
   uint32_t value;
   TokenType type;
@@ -497,6 +1229,13 @@ void gsm_read_sms_handle_header(const char *data, size_t length)
     if (TokenWhitespace != type || ' ' != value) {
       break;
     }
+#ifdef MCODE_PDU
+    if (engine->pduMode) {
+      /* The rest is '<stat>,[<alpha>],<length>', the address comes in the PDU */
+      engine->state = EGsmStateReadingSmsBody;
+      return;
+    }
+#endif /* MCODE_PDU */
     /* Parse "REC READ" */
     type = next_token(&data, &length, &token, &value);
     if (TokenString != type) {
@@ -514,37 +1253,52 @@ void gsm_read_sms_handle_header(const char *data, size_t length)
     }
     /* At this point we have the phone number UCS2-encoded in 'token'/'value'(length)
      * Need to check the phone number at this point */
-    mvar_putch_config(0 + 3*(TheEngineState == EEngineReadSms), 1);
+    mvar_putch_config((EEngineReadSms == engine->engineState) ? MCODE_GSM_VAR_ADDRESS : 0, 1);
     io_ostream_handler_push(mvar_putch);
     mprinthexencodedstr16(token, value);
     io_ostream_handler_pop();
 
     /* Wait for the SMS body */
-    TheGsmState = EGsmStateReadingSmsBody;
+    engine->state = EGsmStateReadingSmsBody;
     return;
   } while (false);
-  TheGsmState = EGsmStateIdle;
+  gsm_queue_complete(engine, MGsmResultError);
 }
 
-void gsm_read_sms_handle_body(const char *data, size_t length)
+void gsm_read_sms_handle_body(gsm_engine_t *engine, const char *data, size_t length)
 {
   /*
    * Example body:
    * > 005400650073007400200053004D0053003A00200061006200630064
    */
-  mvar_putch_config(1 + 3*(TheEngineState == EEngineReadSms), 2);
-  io_ostream_handler_push(mvar_putch);
-  mprinthexencodedstr16(data, length);
-  io_ostream_handler_pop();
+#ifdef MCODE_PDU
+  TheGsmConcatTooLong = false;
+  if (EEngineReadSms == engine->engineState && engine->pduMode) {
+    gsm_pdu_store(data, length, MCODE_GSM_VAR_ADDRESS, MCODE_GSM_VAR_PROGRAM, MCODE_GSM_VAR_PROGRAM_COUNT);
+  } else if (engine->pduMode) {
+    gsm_pdu_store(data, length, 0, 1, 2);
+  } else
+#endif /* MCODE_PDU */
+  if (EEngineReadSms == engine->engineState) {
+    mvar_putch_config(MCODE_GSM_VAR_PROGRAM, MCODE_GSM_VAR_PROGRAM_COUNT);
+    io_ostream_handler_push(mvar_putch);
+    mprinthexencodedstr16(data, length);
+    io_ostream_handler_pop();
+  } else {
+    mvar_putch_config(1, 2);
+    io_ostream_handler_push(mvar_putch);
+    mprinthexencodedstr16(data, length);
+    io_ostream_handler_pop();
+  }
 
-  /* Finished handling the SMS */
-  TheGsmState = EGsmStateIdle;
-  if (TheEngineState == EEngineReadSms) {
-    TheEngineState = EEngineReadSmsDone;
+  /* Finished handling the SMS, wait for the final 'OK' */
+  engine->state = EGsmStateSendingAtCmd;
+  if (engine->engineState == EEngineReadSms) {
+    engine->engineState = EEngineReadSmsDone;
   }
 }
 
-void gsm_handle_sms_sent(const char *args, size_t length)
+void gsm_handle_sms_sent(gsm_engine_t *engine, const char *args, size_t length)
 {
   mprintstr(PSTR("\r- SMS sent event, args: "));
   if (args) {
@@ -555,27 +1309,75 @@ void gsm_handle_sms_sent(const char *args, size_t length)
     mprintstrln(PSTR("<null>"));
   }
 
-  TheGsmState = EGsmStateIdle;
-
-  if (EEngineSendSms == TheEngineState) {
-    TheEngineState = EEngineSendSmsDone;
+  /* The command itself completes on the final 'OK' */
+  if (EEngineSendSms == engine->engineState) {
+    engine->engineState = EEngineSendSmsDone;
   }
 }
 
 bool gsm_periodic_task(void)
 {
-  switch (TheEngineState) {
+  uint8_t i;
+
+  /* Safety net only, the engines normally advance on events */
+  for (i = 0; i < MCODE_GSM_INSTANCES; ++i) {
+    if (TheGsmEngines[i]) {
+      gsm_engine_step(TheGsmEngines[i]);
+    }
+  }
+#ifdef MCODE_PDU
+  /* Drop the concatenated SMS with the parts missing for too long */
+  gsm_concat_expire(mtick_count());
+#endif /* MCODE_PDU */
+  return true;
+}
+
+void gsm_engine_kick(gsm_engine_t *engine)
+{
+  /* Defer the engine step to the main loop, it is not safe to run it from the UART handler */
+  engine->kicked = true;
+  if (!TheGsmKicked) {
+    TheGsmKicked = true;
+    mtimer_add(gsm_engine_task, 0);
+  }
+}
+
+bool gsm_engine_task(void)
+{
+  uint8_t i;
+  gsm_engine_t *engine;
+
+  TheGsmKicked = false;
+  for (i = 0; i < MCODE_GSM_INSTANCES; ++i) {
+    engine = TheGsmEngines[i];
+    if (engine) {
+      engine->kicked = false;
+      gsm_engine_step(engine);
+    }
+  }
+  return false;
+}
+
+void gsm_engine_step(gsm_engine_t *engine)
+{
+  switch (engine->engineState) {
   case EEngineIdle:
-    gsm_check_new_sms_task();
+    gsm_check_new_sms_task(engine);
     break;
   case EEngineReadSmsDone:
-    gsm_exec_new_sms_task();
+    gsm_exec_new_sms_task(engine);
     break;
   case EEngineExecSmsDone:
-    gsm_send_sms_response_task();
+    gsm_send_sms_response_task(engine);
     break;
   case EEngineSendSmsDone:
-    gsm_sms_sent_task();
+    gsm_sms_sent_task(engine);
+    break;
+  case EEngineListSmsDone:
+    gsm_exec_batch_task(engine);
+    break;
+  case EEngineListSms:
+  case EEngineDeleteSms:
     break;
   default:
   case EEngineSendSms:
@@ -585,96 +1387,233 @@ bool gsm_periodic_task(void)
   case EEngineReadSms:
     break;
   }
-
-  return true;
 }
 
-void gsm_check_new_sms_task(void)
+void gsm_check_new_sms_task(gsm_engine_t *engine)
 {
   bool res;
   int index;
   uint32_t value;
 
-  value = mvar_nvm_get(0);
+  if (&TheGsm != engine) {
+    /* The new SMS flags in NVM belong to the default instance */
+    return;
+  }
+
+  value = mvar_nvm_get(0) | ((uint32_t)mvar_nvm_get(1) << 16);
+  if (engine->listRequest || __builtin_popcount(value) > 1) {
+    /* More than one new SMS, handle all of them in a single batch */
+    gsm_engine_list_start(engine);
+    return;
+  }
   if (!value) {
-    value |= ((mvar_nvm_get(1))<<16);
-    if (!value) {
-      /* No new SMS detected */
-      return;
-    }
+    /* No new SMS detected */
+    return;
   }
   index = __builtin_ffs(value) - 1;
-  res = gsm_read_sms(index);
+  res = gsm_queue_read_sms(engine, index, gsm_engine_read_done);
   if (res) {
-    TheEngineIndex = index;
-    TheEngineState = EEngineReadSms;
+    engine->engineIndex = index;
+    engine->engineState = EEngineReadSms;
+    engine->startedAt = mtick_count();
   }
 }
 
-void gsm_exec_new_sms_task(void)
+void gsm_engine_read_done(gsm_engine_t *engine, MGsmResult result)
+{
+  if (EEngineReadSmsDone == engine->engineState) {
+    /* The SMS is read, execute it */
+    gsm_engine_kick(engine);
+  } else if (EEngineReadSms == engine->engineState) {
+    /* Failed reading the SMS */
+    if (MGsmResultError == result) {
+      /* No such SMS, forget it and check the next one */
+      gsm_engine_clear_flag(engine->engineIndex);
+      gsm_engine_kick(engine);
+    }
+    /* On timeout, the periodic task retries reading it */
+    engine->engineState = EEngineIdle;
+  }
+}
+
+void gsm_engine_list_start(gsm_engine_t *engine)
+{
+  char *str;
+  size_t length;
+
+  if (!gsm_queue_list_sms(engine, gsm_engine_list_done)) {
+    return;
+  }
+
+  /* All unread SMS get listed, new indications set the flags again */
+  mvar_nvm_set(0, 0);
+  mvar_nvm_set(1, 0);
+  engine->listRequest = false;
+  engine->batchCount = 0;
+  engine->batchSkipped = 0;
+  engine->batchLength = 0;
+  engine->engineState = EEngineListSms;
+  engine->startedAt = mtick_count();
+
+  /* The output of all programs in the batch is collected in s9:5 */
+  str = mvar_str(MCODE_GSM_VAR_OUTPUT, MCODE_GSM_VAR_OUTPUT_COUNT, &length);
+  memset(str, 0, length);
+}
+
+void gsm_engine_list_done(gsm_engine_t *engine, MGsmResult result)
+{
+  if (EEngineListSms != engine->engineState) {
+    return;
+  }
+
+  if (MGsmResultOk == result) {
+    engine->engineState = EEngineListSmsDone;
+    gsm_engine_kick(engine);
+  } else {
+    /* Retry listing with the periodic task */
+    engine->listRequest = true;
+    engine->engineState = EEngineIdle;
+  }
+}
+
+void gsm_exec_batch_task(gsm_engine_t *engine)
+{
+  bool start_cmd;
+  const char *prog;
+  size_t prog_length;
+  uint16_t offset;
+
+  /* Execute the collected programs, append the output to s9:5 */
+  for (offset = 0; offset < engine->batchLength; offset += prog_length + 1) {
+    prog = engine->batch + offset;
+    prog_length = strlen(prog);
+    mvar_putch_config_append(MCODE_GSM_VAR_OUTPUT, MCODE_GSM_VAR_OUTPUT_COUNT);
+    io_ostream_handler_push(mvar_putch);
+    cmd_engine_exec_prog(prog, prog_length, &start_cmd);
+    io_ostream_handler_pop();
+    ++engine->batchCount;
+  }
+  /* The programs are executed once, even if deleting the SMS is retried */
+  engine->batchLength = 0;
+
+  mprintstr(PSTR("\r- SMS batch: "));
+  mprint_uintd(engine->batchCount, 0);
+  mprintstr(PSTR(" executed, "));
+  mprint_uintd(engine->batchSkipped, 0);
+  mprintstrln(PSTR(" skipped"));
+
+  gsm_engine_delete_task(engine);
+}
+
+void gsm_engine_delete_task(gsm_engine_t *engine)
+{
+  /* Delete all read SMS, including the ones just listed */
+  if (gsm_engine_queue_cmd(engine, "AT+CMGD=1,1", MGsmExpectOk, MCODE_GSM_CMD_TIMEOUT, gsm_engine_delete_done)) {
+    engine->engineState = EEngineDeleteSms;
+  }
+}
+
+void gsm_engine_delete_done(gsm_engine_t *engine, MGsmResult result)
+{
+  if (EEngineDeleteSms == engine->engineState) {
+    /* Send the collected output, if any */
+    engine->engineState = EEngineExecSmsDone;
+    gsm_engine_kick(engine);
+  }
+}
+
+void gsm_exec_new_sms_task(gsm_engine_t *engine)
 {
-  uint16_t value;
   bool start_cmd;
   const char *prog;
   size_t prog_length;
 
-  if (strcmp(mcode_phone(), mvar_str(3, 1, NULL))) {
+  if (strcmp(mcode_phone(), mvar_str(MCODE_GSM_VAR_ADDRESS, 1, NULL))) {
     /* Phones do not match, move to IDLE state */
-    if (TheEngineIndex < 32) {
-      value = mvar_nvm_get(TheEngineIndex >= 16);
-      value = value & ~(1u << (TheEngineIndex % 16));
-      mvar_nvm_set(TheEngineIndex >= 16, value);
-    }
-    TheEngineState = EEngineIdle;
+    gsm_engine_clear_flag(engine->engineIndex);
+    engine->engineState = EEngineIdle;
+    gsm_engine_kick(engine);
     return;
   }
 
-  TheEngineState = EEngineExecSms;
+  engine->engineState = EEngineExecSms;
 
   /* Get the program to execute */
-  prog = mvar_str(4, 2, NULL);
+  prog = mvar_str(MCODE_GSM_VAR_PROGRAM, MCODE_GSM_VAR_PROGRAM_COUNT, NULL);
   prog_length = strlen(prog);
 
-  /* Execute the program, collect the output in s6:2 */
-  mvar_putch_config(6, 2);
+  /* Execute the program, collect the output in s9:5 */
+  mvar_putch_config(MCODE_GSM_VAR_OUTPUT, MCODE_GSM_VAR_OUTPUT_COUNT);
   io_ostream_handler_push(mvar_putch);
   cmd_engine_exec_prog(prog, prog_length, &start_cmd);
   io_ostream_handler_pop();
+#ifdef MCODE_PDU
+  if (TheGsmConcatTooLong) {
+    /* The program is dropped, reply with the error */
+    gsm_engine_reply_too_long();
+  }
+#endif /* MCODE_PDU */
 
-  TheEngineState = EEngineExecSmsDone;
+  engine->engineState = EEngineExecSmsDone;
 
   /* As soon as we have executed the commands, reset the flag in NVM */
-  if (TheEngineIndex < 32) {
-    value = mvar_nvm_get(TheEngineIndex >= 16);
-    value = value & ~(1u << (TheEngineIndex % 16));
-    mvar_nvm_set(TheEngineIndex >= 16, value);
+  gsm_engine_clear_flag(engine->engineIndex);
+
+  /* Send the response */
+  gsm_engine_kick(engine);
+}
+
+void gsm_engine_clear_flag(uint32_t index)
+{
+  uint16_t value;
+
+  if (index < 32) {
+    value = mvar_nvm_get(index >= 16);
+    value = value & ~(1u << (index % 16));
+    mvar_nvm_set(index >= 16, value);
   }
 }
 
-void gsm_send_sms_response_task(void)
+void gsm_send_sms_response_task(gsm_engine_t *engine)
 {
   bool res;
   const char *resp;
   size_t resp_length;
 
   gsm_prepare_response();
-  resp = mvar_str(6, 2, NULL);
+  resp = mvar_str(MCODE_GSM_VAR_OUTPUT, MCODE_GSM_VAR_OUTPUT_COUNT, NULL);
   resp_length = strlen(resp);
   if (!resp_length) {
     /* Nothing to send, move to IDLE */
-    TheEngineState = EEngineIdle;
+    engine->engineState = EEngineIdle;
+    gsm_engine_kick(engine);
     return;
   }
 
-  res = gsm_send_sms(mvar_str(3, 1, NULL), resp);
+  /* Reply to the owner only, s3:1 holds the last listed sender after a batch */
+  res = gsm_queue_sms(engine, mcode_phone(), resp, gsm_engine_send_done);
   if (res) {
-    TheEngineState = EEngineSendSms;
+    engine->engineState = EEngineSendSms;
+  }
+}
+
+void gsm_engine_send_done(gsm_engine_t *engine, MGsmResult result)
+{
+  if (EEngineSendSms == engine->engineState || EEngineSendSmsDone == engine->engineState) {
+    engine->engineState = EEngineSendSmsDone;
+    gsm_engine_kick(engine);
   }
 }
 
-void gsm_sms_sent_task(void)
+void gsm_sms_sent_task(gsm_engine_t *engine)
 {
-  TheEngineState = EEngineIdle;
+  mprintstr(PSTR("\r- SMS handled in: "));
+  mprint_uintd(mtick_count() - engine->startedAt, 0);
+  mprintstrln(PSTR(" ms"));
+
+  /* Check for more new SMS */
+  engine->engineState = EEngineIdle;
+  gsm_engine_kick(engine);
 }
 
 void gsm_prepare_response(void)
@@ -684,7 +1623,7 @@ void gsm_prepare_response(void)
   char *str;
   size_t length;
 
-  str = mvar_str(6, 2, NULL);
+  str = mvar_str(MCODE_GSM_VAR_OUTPUT, MCODE_GSM_VAR_OUTPUT_COUNT, NULL);
   length = strlen(str);
   do {
     ch = *str;
@@ -699,3 +1638,136 @@ void gsm_prepare_response(void)
     --length;
   } while (true);
 }
+
+#ifdef MCODE_PDU
+size_t gsm_sms_pdu(const MGsmCmd *entry)
+{
+  const size_t address_length = strlen(entry->data);
+  const char *const body = entry->data + address_length + 1;
+
+  memset(&TheGsmPduSms, 0, sizeof (TheGsmPduSms));
+  TheGsmPduSms.type = MPduTypeSubmit;
+  TheGsmPduSms.concatRef = entry->ref;
+  TheGsmPduSms.concatSeq = entry->part;
+  TheGsmPduSms.concatTotal = entry->parts;
+  TheGsmPduSms.length = strlen(body);
+  TheGsmPduSms.dcs = pdu_text_dcs(body, TheGsmPduSms.length);
+  memcpy(TheGsmPduSms.address, entry->data, address_length + 1);
+  memcpy(TheGsmPduSms.text, body, TheGsmPduSms.length + 1);
+
+  return pdu_encode(&TheGsmPduSms, TheGsmPdu, sizeof (TheGsmPdu));
+}
+
+void gsm_engine_pdu_done(gsm_engine_t *engine, MGsmResult result)
+{
+  engine->pduMode = (MGsmResultOk == result);
+  if (engine->pduMode) {
+    mprintstrln(PSTR("\r- PDU mode"));
+  }
+}
+
+bool gsm_pdu_store(const char *pdu, size_t length, uint8_t address, uint8_t text, uint8_t count)
+{
+  /* If the PDU cannot be decoded, the variables are left empty, so, the SMS is skipped */
+  bool complete = pdu_decode(pdu, length, &TheGsmPduSms);
+
+  TheGsmConcatTooLong = false;
+
+  mvar_putch_config(address, 1);
+  io_ostream_handler_push(mvar_putch);
+  if (complete) {
+    mprintstr_R(TheGsmPduSms.address);
+  }
+  io_ostream_handler_pop();
+
+  /* The text of a concatenated SMS is stored, when its last part arrives */
+  mvar_putch_config(text, count);
+  io_ostream_handler_push(mvar_putch);
+  if (complete && TheGsmPduSms.concatTotal > 1) {
+    complete = gsm_concat_store(&TheGsmPduSms, count * PROG_STRVAR_LENGTH - 1);
+  } else if (complete) {
+    mprintbytes_R(TheGsmPduSms.text, TheGsmPduSms.length);
+  }
+  io_ostream_handler_pop();
+
+  if (TheGsmConcatTooLong) {
+    mprintstrln(PSTR("\r- SMS too long"));
+  }
+
+  return complete;
+}
+
+bool gsm_concat_store(const MPduSms *sms, size_t capacity)
+{
+  uint8_t i;
+  size_t length;
+  TGsmConcat *slot;
+  TGsmConcat *found = NULL;
+  TGsmConcat *oldest = TheGsmConcat;
+
+  if (!sms->concatSeq || sms->concatSeq > sms->concatTotal) {
+    /* Cannot be reassembled, drop it */
+    return false;
+  }
+  if (sms->concatTotal > MCODE_GSM_CONCAT_PARTS) {
+    /* Does not fit the variables, drop it, report it once for the first part */
+    TheGsmConcatTooLong = (1 == sms->concatSeq);
+    return false;
+  }
+
+  /* Find the SMS by the address and the reference, or take a free or the oldest slot */
+  for (i = 0; i < MCODE_GSM_CONCAT_SLOTS; ++i) {
+    slot = TheGsmConcat + i;
+    if (slot->used && slot->ref == sms->concatRef && slot->total == sms->concatTotal &&
+        !strcmp(slot->address, sms->address)) {
+      found = slot;
+      break;
+    } else if (!slot->used) {
+      oldest = slot;
+    } else if (oldest->used && slot->updatedAt < oldest->updatedAt) {
+      oldest = slot;
+    }
+  }
+  if (!found) {
+    found = oldest;
+    memset(found, 0, sizeof (*found));
+    found->used = true;
+    found->ref = sms->concatRef;
+    found->total = sms->concatTotal;
+    strcpy(found->address, sms->address);
+  }
+
+  memcpy(found->parts[sms->concatSeq - 1], sms->text, sms->length + 1);
+  found->received |= 1u << (sms->concatSeq - 1);
+  found->updatedAt = mtick_count();
+  if (found->received != (1u << found->total) - 1) {
+    /* Wait for more parts */
+    return false;
+  }
+
+  /* All the parts are received, output the whole text, if it fits */
+  found->used = false;
+  for (i = 0, length = 0; i < found->total; ++i) {
+    length += strlen(found->parts[i]);
+  }
+  if (length > capacity) {
+    TheGsmConcatTooLong = true;
+    return false;
+  }
+  for (i = 0; i < found->total; ++i) {
+    mprintstr_R(found->parts[i]);
+  }
+  return true;
+}
+
+void gsm_concat_expire(uint64_t now)
+{
+  uint8_t i;
+
+  for (i = 0; i < MCODE_GSM_CONCAT_SLOTS; ++i) {
+    if (TheGsmConcat[i].used && now - TheGsmConcat[i].updatedAt >= MCODE_GSM_CONCAT_TIMEOUT) {
+      TheGsmConcat[i].used = false;
+    }
+  }
+}
+#endif /* MCODE_PDU */
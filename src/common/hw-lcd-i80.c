@@ -25,6 +25,8 @@
 #include "hw-lcd.h"
 
 #include "hw-i80.h"
+#include "glyph-cache.h"
+#include "mcode-config.h"
 
 void lcd_reset(void)
 {
@@ -37,6 +39,11 @@ void lcd_reset(void)
   lcd_device_init();
 }
 
+void lcd_write_data(uint8_t cmd, uint8_t length, const uint8_t *data)
+{
+  hw_i80_write(cmd, length, data);
+}
+
 void lcd_write_const_words(uint8_t cmd, uint16_t word, uint32_t count)
 {
   hw_i80_write_const_long(cmd, word, count);
@@ -46,3 +53,17 @@ void lcd_write_bitmap(uint8_t cmd, uint16_t length, const uint8_t *pData, uint16
 {
   hw_i80_write_bitmap(cmd, length, pData, offValue, onValue);
 }
+
+void lcd_write_text(uint8_t cmd, const char *text, uint8_t length, uint16_t offValue, uint16_t onValue)
+{
+#ifdef MCODE_GLYPH_CACHE
+  glyph_cache_write_text(cmd, text, length, offValue, onValue);
+#else /* MCODE_GLYPH_CACHE */
+  hw_i80_write_text(cmd, text, length, offValue, onValue);
+#endif /* MCODE_GLYPH_CACHE */
+}
+
+void lcd_write_words(const uint16_t *data, uint16_t count)
+{
+  hw_i80_write_words(data, count);
+}
@@ -24,14 +24,26 @@
 
 #include "hw-lcd.h"
 
+#include "fonts.h"
 #include "hw-spi.h"
 #include "hw-wdt.h"
+#include "glyph-cache.h"
 #include "mcode-config.h"
 
 #ifdef __AVR__
 #include <avr/pgmspace.h>
 #endif /* __AVR__ */
 
+/** The bytes expanded from a bitmap and sent to SPI at once, 8 pixels */
+#define LCD_SPI_BLOCK_SIZE (16)
+/** The words of a fill sent between the watchdog notifications */
+#define LCD_SPI_FILL_CHUNK UINT16_C(4096)
+
+static void lcd_spi_begin(uint8_t cmd);
+static void lcd_spi_end(void);
+static void lcd_spi_write_words(const uint16_t *data, uint16_t count);
+static void lcd_spi_write_bits(uint8_t bits, uint16_t offValue, uint16_t onValue);
+
 void lcd_write_cmd(uint8_t cmd)
 {
   lcd_set_address(false);
@@ -54,6 +66,18 @@ void lcd_write_byte(uint8_t data)
 #endif /* MCODE_WDT */
 }
 
+void lcd_write_data(uint8_t cmd, uint8_t length, const uint8_t *data)
+{
+  lcd_set_address(false);
+  spi_set_cs(true);
+  spi_transfer(cmd);
+  if (length) {
+    lcd_set_address(true);
+    spi_transfer_block(data, length);
+  }
+  lcd_spi_end();
+}
+
 uint8_t lcd_read_byte(uint8_t cmd)
 {
   uint8_t data;
@@ -71,46 +95,121 @@ uint8_t lcd_read_byte(uint8_t cmd)
 
 void lcd_write_const_words(uint8_t cmd, uint16_t word, uint32_t count)
 {
-  uint32_t i;
-  const uint8_t byte1 = word>>8;
-  const uint8_t byte2 = word;
-  lcd_write_cmd(cmd);
-  for (i = 0; i < count; ++i) {
-    lcd_write_byte(byte1);
-    lcd_write_byte(byte2);
+  uint16_t chunk;
+
+  lcd_spi_begin(cmd);
+  while (count) {
+    chunk = (count < LCD_SPI_FILL_CHUNK) ? count : LCD_SPI_FILL_CHUNK;
+    spi_transfer_repeat(word, chunk);
+    count -= chunk;
+#ifdef MCODE_WDT
+    wdt_notify();
+#endif /* MCODE_WDT */
   }
+  lcd_spi_end();
 }
 
 void lcd_write_bitmap(uint8_t cmd, uint16_t length, const uint8_t *pData, uint16_t offValue, uint16_t onValue)
 {
-  uint8_t bitMask;
-  uint8_t currentByte;
   const uint8_t *const pDataEnd = pData + length;
 
-  lcd_write_cmd(cmd);
-  /* write loop */
+  lcd_spi_begin(cmd);
+  /* write loop, at least 1 byte, as before */
+  do {
 #ifdef __AVR__
-  currentByte = pgm_read_byte(pData++);
+    lcd_spi_write_bits(pgm_read_byte(pData++), offValue, onValue);
 #else /* __AVR__ */
-  currentByte = *pData++;
+    lcd_spi_write_bits(*pData++, offValue, onValue);
 #endif /* __AVR__ */
-  for (bitMask = UINT8_C(0x01); ; ) {
-    const uint16_t currentData = (currentByte & bitMask) ? onValue : offValue;
-    lcd_write_byte(currentData>>8);
-    lcd_write_byte(currentData);
-    bitMask = (bitMask << 1);
-    if (!bitMask) {
-      if (pData < pDataEnd) {
-        bitMask = UINT8_C(0x01);
+  } while (pData < pDataEnd);
+  lcd_spi_end();
+}
+
+void lcd_write_text(uint8_t cmd, const char *text, uint8_t length, uint16_t offValue, uint16_t onValue)
+{
+  uint8_t i;
+  uint8_t row;
+#ifdef MCODE_GLYPH_CACHE
+  const uint16_t *glyph;
+
+  /* the glyphs are loaded once, the run does not evict its own glyphs row by row */
+  glyph_cache_prefetch(text, length, offValue, onValue);
+#endif /* MCODE_GLYPH_CACHE */
+
+  lcd_spi_begin(cmd);
+  /* the glyph rows are streamed across the whole run */
+  for (row = 0; row < 8; ++row) {
+    for (i = 0; i < length; ++i) {
+#ifdef MCODE_GLYPH_CACHE
+      glyph = glyph_cache_find(text[i], offValue, onValue);
+      if (glyph) {
+        lcd_spi_write_words(glyph + (row << 3), 8);
+        continue;
+      }
+#endif /* MCODE_GLYPH_CACHE */
+      const uint8_t *const pChar = mcode_fonts_get_char_bitmap(text[i]) + row;
 #ifdef __AVR__
-        currentByte = pgm_read_byte(pData++);
+      lcd_spi_write_bits(pgm_read_byte(pChar), offValue, onValue);
 #else /* __AVR__ */
-        currentByte = *pData++;
+      lcd_spi_write_bits(*pChar, offValue, onValue);
 #endif /* __AVR__ */
-      }
-      else {
-        break;
-      }
     }
   }
+  lcd_spi_end();
+}
+
+void lcd_write_words(const uint16_t *data, uint16_t count)
+{
+  /* a single transaction for the whole block */
+  lcd_set_address(true);
+  spi_set_cs(true);
+  lcd_spi_write_words(data, count);
+  lcd_spi_end();
+}
+
+/**
+ * Start a transaction: select the LCD, send the command and switch to the data
+ * @note The chip select is kept till \c lcd_spi_end
+ */
+void lcd_spi_begin(uint8_t cmd)
+{
+  lcd_set_address(false);
+  spi_set_cs(true);
+  spi_transfer(cmd);
+  lcd_set_address(true);
+}
+
+void lcd_spi_end(void)
+{
+  spi_set_cs(false);
+#ifdef MCODE_WDT
+    wdt_notify();
+#endif /* MCODE_WDT */
+}
+
+void lcd_spi_write_words(const uint16_t *data, uint16_t count)
+{
+  uint8_t i;
+  uint8_t block[LCD_SPI_BLOCK_SIZE];
+
+  while (count) {
+    for (i = 0; i < LCD_SPI_BLOCK_SIZE && count; i += 2, --count) {
+      block[i] = (*data)>>8;
+      block[i + 1] = *data++;
+    }
+    spi_transfer_block(block, i);
+  }
+}
+
+void lcd_spi_write_bits(uint8_t bits, uint16_t offValue, uint16_t onValue)
+{
+  uint8_t i;
+  uint8_t block[LCD_SPI_BLOCK_SIZE];
+
+  for (i = 0; i < LCD_SPI_BLOCK_SIZE; i += 2, bits >>= 1) {
+    const uint16_t currentData = (bits & 1) ? onValue : offValue;
+    block[i] = currentData>>8;
+    block[i + 1] = currentData;
+  }
+  spi_transfer_block(block, LCD_SPI_BLOCK_SIZE);
 }
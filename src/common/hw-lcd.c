@@ -26,6 +26,9 @@
 
 #include <stdarg.h>
 
+/** The maximum number of the command parameters in \c lcd_write */
+#define LCD_MAX_PARAMS (16)
+
 void lcd_cls(uint16_t color)
 {
   const uint32_t width = lcd_get_width();
@@ -49,10 +52,14 @@ void lcd_write(int len, ...)
 {
   int i;
   va_list vl;
+  uint8_t cmd;
+  uint8_t params[LCD_MAX_PARAMS];
+
   va_start(vl, len);
-  lcd_write_cmd(va_arg(vl, unsigned int));
-  for (i = 1; i < len; ++i) {
-    lcd_write_byte(va_arg(vl, unsigned int));
+  cmd = va_arg(vl, unsigned int);
+  for (i = 1; i < len && i <= LCD_MAX_PARAMS; ++i) {
+    params[i - 1] = va_arg(vl, unsigned int);
   }
   va_end(vl);
+  lcd_write_data(cmd, i - 1, params);
 }
@@ -24,37 +24,52 @@
 
 #include "hw-rtc.h"
 
-#include "hw-twi.h"
 #include "mglobal.h"
 #include "mstring.h"
+#include "twi-queue.h"
 
+/** The DS3231 TWI address */
+#define RTC_ADDRESS (0xd0u)
+
+/**
+ * The requests in progress, one of each kind, the requests of different kinds
+ * are queued to the TWI bus together
+ */
 typedef enum {
-  RtcStateNull = 0,
-  RtcStateIdle,
-  RtcStateReadTime,
-  RtcStateReadDate,
-  RtcStateSetAddressForTime,
-  RtcStateSetAddressForDate,
-  RtcStateSetTime,
-  RtcStateSetDate,
-  RtcStateSetAlarm,
-  RtcStateSetNewDayAlarm,
-} RtcState;
+  RtcBusyGetTime = 1,
+  RtcBusyGetDate = 2,
+  RtcBusySetTime = 4,
+  RtcBusySetDate = 8,
+  RtcBusySetAlarm = 16,
+} RtcBusy;
 
-static uint8_t TheState;
-static uint8_t TheBuffer[5];
-static mcode_done TheWriteCallback;
+static uint8_t TheBusy;
+/** The register addresses to read from */
+static const uint8_t TheTimeAddress = 0x00u;
+static const uint8_t TheDateAddress = 0x03u;
+/** The register address and the values to write */
+static uint8_t TheTimeBuffer[4];
+static uint8_t TheDateBuffer[5];
+static uint8_t TheAlarmBuffer[5];
+static mcode_done TheSetTimeCallback;
+static mcode_done TheSetDateCallback;
+static mcode_done TheSetAlarmCallback;
 static mtime_time_ready TheTimeCallback;
 static mtime_date_ready TheDateCallback;
 
-static void mtime_write_ready(bool success);
+static bool mtime_submit(uint8_t busy, const uint8_t *data, uint8_t length, uint8_t readLength,
+                         mcode_read_ready callback);
+static void mtime_time_read(bool success, uint8_t length, const uint8_t *data);
+static void mtime_date_read(bool success, uint8_t length, const uint8_t *data);
+static void mtime_time_written(bool success, uint8_t length, const uint8_t *data);
+static void mtime_date_written(bool success, uint8_t length, const uint8_t *data);
+static void mtime_alarm_written(bool success, uint8_t length, const uint8_t *data);
 static void mtime_parse_time(const uint8_t *data);
 static void mtime_parse_date(const uint8_t *data);
-static void mtime_read_ready(bool success, uint8_t length, const uint8_t *data);
 
 void mtime_init(void)
 {
-  TheState = RtcStateIdle;
+  TheBusy = 0;
 }
 
 void mtime_deinit(void)
@@ -63,246 +78,243 @@ void mtime_deinit(void)
 
 void mtime_get_time(mtime_time_ready callback)
 {
-  if (RtcStateIdle == TheState) {
-    TheBuffer[0] = 0;
-    TheTimeCallback = callback;
-    TheState = RtcStateSetAddressForTime;
-    twi_send(0xd0u, 1, TheBuffer, mtime_write_ready);
-  } else {
+  if (TheBusy & RtcBusyGetTime) {
     /* Already in progress */
     (*callback)(false, NULL);
+    return;
+  }
+
+  TheTimeCallback = callback;
+  if (!mtime_submit(RtcBusyGetTime, &TheTimeAddress, 1, 3, mtime_time_read)) {
+    (*callback)(false, NULL);
   }
 }
 
 void mtime_set_time(uint8_t hours, uint8_t minutes, uint8_t seconds, mcode_done callback)
 {
-  if (RtcStateIdle == TheState) {
-    if (hours > 23) {
-      mprint(MStringWrongArgument);
-      (*callback)(false);
-      return;
-    }
-    if (minutes > 59) {
-      mprint(MStringWrongArgument);
-      (*callback)(false);
-      return;
-    }
-    if (seconds > 59) {
-      mprint(MStringWrongArgument);
-      (*callback)(false);
-      return;
-    }
-    /* Set address: 0x00 */
-    TheBuffer[0] = 0;
-    /* Set seconds */
-    TheBuffer[1] = (seconds % 10) | ((seconds/10)*0x10);
-    /* Set minutes */
-    TheBuffer[2] = (minutes % 10) | ((minutes/10)*0x10);
-    /* Set hours */
-    TheBuffer[3] = (hours % 10) | ((hours/10)*0x10);
-    TheState = RtcStateSetTime;
-    TheWriteCallback = callback;
-    twi_send(0xd0u, 4, TheBuffer, mtime_write_ready);
-  } else {
+  if (TheBusy & RtcBusySetTime) {
+    (*callback)(false);
+    return;
+  }
+  if (hours > 23) {
+    mprint(MStringWrongArgument);
+    (*callback)(false);
+    return;
+  }
+  if (minutes > 59) {
+    mprint(MStringWrongArgument);
+    (*callback)(false);
+    return;
+  }
+  if (seconds > 59) {
+    mprint(MStringWrongArgument);
+    (*callback)(false);
+    return;
+  }
+  /* Set address: 0x00 */
+  TheTimeBuffer[0] = 0;
+  /* Set seconds */
+  TheTimeBuffer[1] = (seconds % 10) | ((seconds/10)*0x10);
+  /* Set minutes */
+  TheTimeBuffer[2] = (minutes % 10) | ((minutes/10)*0x10);
+  /* Set hours */
+  TheTimeBuffer[3] = (hours % 10) | ((hours/10)*0x10);
+  TheSetTimeCallback = callback;
+  if (!mtime_submit(RtcBusySetTime, TheTimeBuffer, 4, 0, mtime_time_written)) {
     (*callback)(false);
   }
 }
 
 void mtime_get_date(mtime_date_ready callback)
 {
-  if (RtcStateIdle == TheState) {
-    TheBuffer[0] = 3;
-    TheDateCallback = callback;
-    TheState = RtcStateSetAddressForDate;
-    twi_send(0xd0u, 1, TheBuffer, mtime_write_ready);
-  } else {
+  if (TheBusy & RtcBusyGetDate) {
     /* Already in progress */
     (*callback)(false, NULL);
+    return;
+  }
+
+  TheDateCallback = callback;
+  if (!mtime_submit(RtcBusyGetDate, &TheDateAddress, 1, 4, mtime_date_read)) {
+    (*callback)(false, NULL);
   }
 }
 
 void mtime_set_date(int16_t year, uint8_t month, uint8_t day, uint8_t dayOfWeek, mcode_done callback)
 {
-  if (RtcStateIdle == TheState) {
-    if (year < 1900 || year > 2099) {
-      mprint(MStringWrongArgument);
-      (*callback)(false);
-      return;
-    }
-    if (month < 1 || month > 31) {
-      mprint(MStringWrongArgument);
-      (*callback)(false);
-      return;
-    }
-    if (day < 1 || day > 31) {
-      mprint(MStringWrongArgument);
-      (*callback)(false);
-      return;
-    }
-    if (dayOfWeek < 1 || dayOfWeek > 7) {
-      mprint(MStringWrongArgument);
-      (*callback)(false);
-      return;
-    }
-    /* Set address: 0x03 */
-    TheBuffer[0] = 3;
-    /* Set day-of-week */
-    TheBuffer[1] = dayOfWeek;
-    /* Set day */
-    TheBuffer[2] = (day % 10) | ((day/10)*0x10);
-    /* Set month/century */
-    TheBuffer[3] = (month % 10) | ((month/10)*0x10) | ((year < 2000) ? 0x80u : 0x00u);
-    TheBuffer[4] = (year % 10) | (((year/10) % 10)*0x10);
-    TheState = RtcStateSetDate;
-    TheWriteCallback = callback;
-    twi_send(0xd0u, 5, TheBuffer, mtime_write_ready);
-  } else {
+  if (TheBusy & RtcBusySetDate) {
+    (*callback)(false);
+    return;
+  }
+  if (year < 1900 || year > 2099) {
+    mprint(MStringWrongArgument);
+    (*callback)(false);
+    return;
+  }
+  if (month < 1 || month > 31) {
+    mprint(MStringWrongArgument);
+    (*callback)(false);
+    return;
+  }
+  if (day < 1 || day > 31) {
+    mprint(MStringWrongArgument);
+    (*callback)(false);
+    return;
+  }
+  if (dayOfWeek < 1 || dayOfWeek > 7) {
+    mprint(MStringWrongArgument);
+    (*callback)(false);
+    return;
+  }
+  /* Set address: 0x03 */
+  TheDateBuffer[0] = 3;
+  /* Set day-of-week */
+  TheDateBuffer[1] = dayOfWeek;
+  /* Set day */
+  TheDateBuffer[2] = (day % 10) | ((day/10)*0x10);
+  /* Set month/century */
+  TheDateBuffer[3] = (month % 10) | ((month/10)*0x10) | ((year < 2000) ? 0x80u : 0x00u);
+  TheDateBuffer[4] = (year % 10) | (((year/10) % 10)*0x10);
+  TheSetDateCallback = callback;
+  if (!mtime_submit(RtcBusySetDate, TheDateBuffer, 5, 0, mtime_date_written)) {
     (*callback)(false);
   }
 }
 
 void mtime_set_alarm(uint8_t hours, uint8_t minutes, uint8_t seconds, mcode_done callback)
 {
-  if (RtcStateIdle == TheState) {
-    if (hours > 23) {
-      mprint(MStringWrongArgument);
-      (*callback)(false);
-      return;
-    }
-    if (minutes > 59) {
-      mprint(MStringWrongArgument);
-      (*callback)(false);
-      return;
-    }
-    if (seconds > 59) {
-      mprint(MStringWrongArgument);
-      (*callback)(false);
-      return;
-    }
-    /* Set address: 0x07 (Alarm1) */
-    TheBuffer[0] = 0x07;
-    /* Set seconds */
-    TheBuffer[1] = (seconds % 10) | ((seconds/10)*0x10);
-    /* Set minutes */
-    TheBuffer[2] = (minutes % 10) | ((minutes/10)*0x10);
-    /* Set hours */
-    TheBuffer[3] = (hours % 10) | ((hours/10)*0x10);
-    /* No day/date match */
-    TheBuffer[4] = 0x80;
-    TheState = RtcStateSetAlarm;
-    TheWriteCallback = callback;
-    twi_send(0xd0u, 5, TheBuffer, mtime_write_ready);
-  } else {
+  if (TheBusy & RtcBusySetAlarm) {
+    (*callback)(false);
+    return;
+  }
+  if (hours > 23) {
+    mprint(MStringWrongArgument);
+    (*callback)(false);
+    return;
+  }
+  if (minutes > 59) {
+    mprint(MStringWrongArgument);
+    (*callback)(false);
+    return;
+  }
+  if (seconds > 59) {
+    mprint(MStringWrongArgument);
+    (*callback)(false);
+    return;
+  }
+  /* Set address: 0x07 (Alarm1) */
+  TheAlarmBuffer[0] = 0x07;
+  /* Set seconds */
+  TheAlarmBuffer[1] = (seconds % 10) | ((seconds/10)*0x10);
+  /* Set minutes */
+  TheAlarmBuffer[2] = (minutes % 10) | ((minutes/10)*0x10);
+  /* Set hours */
+  TheAlarmBuffer[3] = (hours % 10) | ((hours/10)*0x10);
+  /* No day/date match */
+  TheAlarmBuffer[4] = 0x80;
+  TheSetAlarmCallback = callback;
+  if (!mtime_submit(RtcBusySetAlarm, TheAlarmBuffer, 5, 0, mtime_alarm_written)) {
     (*callback)(false);
   }
 }
 
 void mtime_set_new_day_alarm(uint8_t hours, uint8_t minutes, uint8_t seconds, mcode_done callback)
 {
-  if (RtcStateIdle == TheState) {
-    if (hours > 23) {
-      mprint(MStringWrongArgument);
-      (*callback)(false);
-      return;
-    }
-    if (minutes > 59) {
-      mprint(MStringWrongArgument);
-      (*callback)(false);
-      return;
-    }
-    /* Set address: 0x07 (Alarm1) */
-    TheBuffer[0] = 0x0b;
-    /* Set minutes */
-    TheBuffer[1] = (minutes % 10) | ((minutes/10)*0x10);
-    /* Set hours */
-    TheBuffer[2] = (hours % 10) | ((hours/10)*0x10);
-    /* No day/date match */
-    TheBuffer[3] = 0x80;
-    TheState = RtcStateSetNewDayAlarm;
-    TheWriteCallback = callback;
-    twi_send(0xd0u, 4, TheBuffer, mtime_write_ready);
-  } else {
+  if (TheBusy & RtcBusySetAlarm) {
+    (*callback)(false);
+    return;
+  }
+  if (hours > 23) {
+    mprint(MStringWrongArgument);
+    (*callback)(false);
+    return;
+  }
+  if (minutes > 59) {
+    mprint(MStringWrongArgument);
+    (*callback)(false);
+    return;
+  }
+  /* Set address: 0x0b (Alarm2) */
+  TheAlarmBuffer[0] = 0x0b;
+  /* Set minutes */
+  TheAlarmBuffer[1] = (minutes % 10) | ((minutes/10)*0x10);
+  /* Set hours */
+  TheAlarmBuffer[2] = (hours % 10) | ((hours/10)*0x10);
+  /* No day/date match */
+  TheAlarmBuffer[3] = 0x80;
+  TheSetAlarmCallback = callback;
+  if (!mtime_submit(RtcBusySetAlarm, TheAlarmBuffer, 4, 0, mtime_alarm_written)) {
     (*callback)(false);
   }
 }
 
-void mtime_write_ready(bool success)
+bool mtime_submit(uint8_t busy, const uint8_t *data, uint8_t length, uint8_t readLength,
+                  mcode_read_ready callback)
 {
-  if (!success) {
+  MTwiTransaction transaction;
+
+  transaction.addr = RTC_ADDRESS;
+  transaction.writeLength = length;
+  transaction.readLength = readLength;
+  transaction.retries = MCODE_TWI_RETRIES;
+  transaction.writeData = data;
+  transaction.callback = callback;
+
+  TheBusy |= busy;
+  if (!twi_queue_submit(&transaction)) {
+    /* The queue is full */
+    TheBusy &= ~busy;
+    return false;
+  }
+  return true;
+}
+
+void mtime_time_read(bool success, uint8_t length, const uint8_t *data)
+{
+  TheBusy &= ~RtcBusyGetTime;
+  if (!success || 3 != length) {
     merror(MStringInternalError);
-    TheState = RtcStateIdle;
-    if (TheWriteCallback) {
-      (*TheWriteCallback)(false);
-    }
+    (*TheTimeCallback)(false, NULL);
     return;
   }
+  mtime_parse_time(data);
+}
 
-  switch (TheState) {
-  case RtcStateSetAddressForTime:
-    TheState = RtcStateReadTime;
-    twi_recv(0xd0u, 3, mtime_read_ready);
-    break;
-  case RtcStateSetAddressForDate:
-    TheState = RtcStateReadDate;
-    twi_recv(0xd0u, 4, mtime_read_ready);
-    break;
-  case RtcStateSetTime:
-  case RtcStateSetDate:
-  case RtcStateSetAlarm:
-  case RtcStateSetNewDayAlarm:
-    TheState = RtcStateIdle;
-    if (TheWriteCallback) {
-      (*TheWriteCallback)(true);
-    }
-    break;
-  default:
+void mtime_date_read(bool success, uint8_t length, const uint8_t *data)
+{
+  TheBusy &= ~RtcBusyGetDate;
+  if (!success || 4 != length) {
     merror(MStringInternalError);
-    break;
+    (*TheDateCallback)(false, NULL);
+    return;
   }
+  mtime_parse_date(data);
 }
 
-void mtime_read_ready(bool success, uint8_t length, const uint8_t *data)
+void mtime_time_written(bool success, uint8_t length, const uint8_t *data)
 {
+  TheBusy &= ~RtcBusySetTime;
   if (!success) {
     merror(MStringInternalError);
-    TheState = RtcStateIdle;
-    if (TheDateCallback) {
-      (*TheDateCallback)(false, NULL);
-    }
-    return;
   }
+  (*TheSetTimeCallback)(success);
+}
 
-  switch (TheState) {
-  case RtcStateReadTime:
-    if (3 == length) {
-      mtime_parse_time(data);
-    } else {
-      merror(MStringInternalError);
-      TheState = RtcStateIdle;
-      if (TheDateCallback) {
-        (*TheDateCallback)(false, NULL);
-      }
-    }
-    break;
-  case RtcStateReadDate:
-    if (4 == length) {
-      mtime_parse_date(data);
-    } else {
-      merror(MStringInternalError);
-      TheState = RtcStateIdle;
-      if (TheDateCallback) {
-        (*TheDateCallback)(false, NULL);
-      }
-    }
-    break;
-  default:
+void mtime_date_written(bool success, uint8_t length, const uint8_t *data)
+{
+  TheBusy &= ~RtcBusySetDate;
+  if (!success) {
+    merror(MStringInternalError);
+  }
+  (*TheSetDateCallback)(success);
+}
+
+void mtime_alarm_written(bool success, uint8_t length, const uint8_t *data)
+{
+  TheBusy &= ~RtcBusySetAlarm;
+  if (!success) {
     merror(MStringInternalError);
-    TheState = RtcStateIdle;
-    if (TheDateCallback) {
-      (*TheDateCallback)(false, NULL);
-    }
-    break;
   }
+  (*TheSetAlarmCallback)(success);
 }
 
 void mtime_parse_time(const uint8_t *data)
@@ -314,10 +326,7 @@ void mtime_parse_time(const uint8_t *data)
   time.minutes = 10*((minutes>>4)&0x07u) + (0x0fu&minutes);
   const uint8_t hours = *data;
   time.hours = 10*((hours>>4)&0x03u) + (0x0fu&hours);
-  TheState = RtcStateIdle;
-  if (TheTimeCallback) {
-    (*TheTimeCallback)(true, &time);
-  }
+  (*TheTimeCallback)(true, &time);
 }
 
 void mtime_parse_date(const uint8_t *data)
@@ -336,9 +345,6 @@ void mtime_parse_date(const uint8_t *data)
   } else {
     date.year += 2000;
   }
-
-  TheState = RtcStateIdle;
-  if (TheDateCallback) {
-    (*TheDateCallback)(true, &date);
-  }
+  date.dayOfYear = rtc_day_of_year(date.year, date.month, date.day);
+  (*TheDateCallback)(true, &date);
 }
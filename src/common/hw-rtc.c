@@ -30,9 +30,20 @@
 #define MCODE_DAYS_IN_A_WEEK (7)
 #define MCODE_DAYS_IN_A_YEAR (365)
 #define MCODE_DAYS_IN_4_YEARS (1461)
+#define MCODE_DAYS_IN_100_YEARS (36524)
+#define MCODE_DAYS_IN_400_YEARS (146097)
 #define MCODE_SECONDS_IN_A_DAY (86400)
+/**
+ * The conversions count the years from 1-Mar, so, the leap day is the last day
+ * of a year; the base is 1-Mar-2000, the start of a 400-year period, 306 days
+ * before the initial date
+ */
+#define MCODE_BASE_YEAR (2000)
+#define MCODE_BASE_DAYS (306)
 
-static int rtc_days_in_month(uint32_t month, bool leapYear);
+/** The last converted day, the date changes once a day, the time - every second */
+static uint32_t TheCachedDays = UINT32_MAX;
+static MDate TheCachedDate;
 
 const char *mtime_get_day_of_week_name(uint8_t dayOfWeek)
 {
@@ -100,102 +111,84 @@ void rtc_get_time(uint32_t mtime, MTime *time)
 void rtc_get_date(uint32_t mtime, MDate *date)
 {
   /* Leave out time info, keep the number of days size initial date */
-  mtime /= MCODE_SECONDS_IN_A_DAY;
-
-  /* Calculate the week-day */
-  date->dayOfWeek = (mtime % MCODE_DAYS_IN_A_WEEK) + 1;
+  const uint32_t days = mtime / MCODE_SECONDS_IN_A_DAY;
 
-  /*  */
-  const uint32_t qyears = mtime / MCODE_DAYS_IN_4_YEARS;
-  /* 'mtime' now is the number of days since 4-year period */
-  mtime -= qyears * MCODE_DAYS_IN_4_YEARS;
-
-  /* 'year1' will be 0..3 */
-  uint32_t year1 = mtime / MCODE_DAYS_IN_A_YEAR;
-  if (year1 > 3) {
-    /* Correction for 31-Dec of leap years */
-    year1 = 3;
-  }
-  const bool leapYear = (3 == year1);
-  /* Now, 'mtime' is the number of days since 1-Jan of the calculated year */
-  mtime -= year1 * MCODE_DAYS_IN_A_YEAR;
-
-  /* Now, we know the year */
-  date->year = MCODE_INITIAL_YEAR + 4*qyears + year1;
-
-  /* Calculate the month */
-  uint32_t month;
-  for (month = 1; month <= 12; ++month) {
-    const uint32_t days = rtc_days_in_month(month, leapYear);
-    if (mtime > days) {
-      mtime -= days;
-    } else {
-      date->month = month;
-      break;
-    }
+  if (days != TheCachedDays) {
+    rtc_civil_from_days(days, &TheCachedDate);
+    TheCachedDays = days;
   }
-
-  date->day = mtime + 1;
+  *date = TheCachedDate;
 }
 
 uint32_t rtc_to_mtime(const MDate *date, const MTime *time)
 {
-  int i;
+  uint32_t days;
 
   if (date->year < MCODE_INITIAL_YEAR || date->year > 2136) {
     /* No support for years before 'MCODE_INITIAL_YEAR' and after 2136 for now */
     return 0;
   }
 
-  /* Time part */
-  uint32_t mtime = time->seconds + time->minutes * 60 + time->hours * 3600;
-  /* Adding date-of-month part */
-  mtime +=  (date->day - 1) * MCODE_SECONDS_IN_A_DAY;
-
-  uint32_t year = date->year - MCODE_INITIAL_YEAR;
-  uint32_t qyear = year / 4;
-  year -= qyear * 4;
-  const bool leapYear = (year == 3);
+  if (TheCachedDays != UINT32_MAX && date->day == TheCachedDate.day &&
+      date->month == TheCachedDate.month && date->year == TheCachedDate.year) {
+    days = TheCachedDays;
+  } else {
+    days = rtc_days_from_civil(date->year, date->month, date->day);
+  }
 
-  mtime += qyear * (MCODE_DAYS_IN_4_YEARS*MCODE_SECONDS_IN_A_DAY);
-  mtime += year * (MCODE_DAYS_IN_A_YEAR*MCODE_SECONDS_IN_A_DAY);
+  return days * MCODE_SECONDS_IN_A_DAY +
+         time->seconds + time->minutes * 60 + time->hours * 3600UL;
+}
 
-  /* Finally, add the month info */
-  for (i = 1; i < date->month; ++i) {
-    mtime += MCODE_SECONDS_IN_A_DAY*rtc_days_in_month(i, leapYear);
-  }
+uint32_t rtc_days_from_civil(int16_t year, uint8_t month, uint8_t day)
+{
+  uint32_t era;
+  uint32_t yoe;
+  uint32_t doy;
+
+  /* The year starts in March, January and February belong to the previous one */
+  year -= (month <= 2);
+  era = (uint32_t)(year - MCODE_BASE_YEAR) / 400;
+  yoe = (uint32_t)(year - MCODE_BASE_YEAR) - era * 400;
+  doy = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+
+  return era * MCODE_DAYS_IN_400_YEARS +
+         yoe * MCODE_DAYS_IN_A_YEAR + yoe / 4 - yoe / 100 + doy - MCODE_BASE_DAYS;
+}
 
-  return mtime;
+void rtc_civil_from_days(uint32_t days, MDate *date)
+{
+  uint32_t doe;
+  uint32_t era;
+  uint32_t yoe;
+  uint16_t doy;
+  uint8_t mp;
+
+  /* The initial date is Monday */
+  date->dayOfWeek = (days % MCODE_DAYS_IN_A_WEEK) + 1;
+
+  days += MCODE_BASE_DAYS;
+  era = days / MCODE_DAYS_IN_400_YEARS;
+  doe = days - era * MCODE_DAYS_IN_400_YEARS;
+  /* The 4-, 100- and 400-year leap days are taken off to get the year of the era */
+  yoe = (doe - doe / (MCODE_DAYS_IN_4_YEARS - 1) + doe / MCODE_DAYS_IN_100_YEARS -
+         doe / (MCODE_DAYS_IN_400_YEARS - 1)) / MCODE_DAYS_IN_A_YEAR;
+  doy = doe - (yoe * MCODE_DAYS_IN_A_YEAR + yoe / 4 - yoe / 100);
+  /* The months from March, 153 days in each 5 months */
+  mp = (5 * doy + 2) / 153;
+
+  date->day = doy - (153 * mp + 2) / 5 + 1;
+  date->month = (mp < 10) ? (mp + 3) : (mp - 9);
+  date->year = MCODE_BASE_YEAR + era * 400 + yoe + (date->month <= 2);
+  date->dayOfYear = rtc_day_of_year(date->year, date->month, date->day);
 }
 
-int rtc_days_in_month(uint32_t month, bool leapYear)
+uint16_t rtc_day_of_year(int16_t year, uint8_t month, uint8_t day)
 {
-  switch (month) {
-  case 1:
-    return 31;
-  case 2:
-    return leapYear ? 29 : 28;
-  case 3:
-    return 31;
-  case 4:
-    return 30;
-  case 5:
-    return 31;
-  case 6:
-    return 30;
-  case 7:
-    return 31;
-  case 8:
-    return 31;
-  case 9:
-    return 30;
-  case 10:
-    return 31;
-  case 11:
-    return 30;
-  case 12:
-    return 31;
-  default:
-    return 0;
+  const bool leapYear = !(year % 4) && ((year % 100) || !(year % 400));
+
+  if (month <= 2) {
+    return (1 == month) ? day : (31 + day);
   }
+  return (153 * (month - 3) + 2) / 5 + 59 + leapYear + day;
 }
@@ -28,31 +28,58 @@
 #include <stdbool.h>
 
 #ifdef MCODE_UART2
-#define UART2_READ_BUFFERS_COUNT (4)
-#define MCODE_UART2_READ_BUFFER_LENGTH (512)
+/** The received bytes ring size, should be a power of 2 */
+#define MCODE_UART2_RING_LENGTH (1024)
+/** The longest line, including the end-of-string marker, the longer lines are truncated */
+#define MCODE_UART2_LINE_LENGTH (512)
+/** The number of the line descriptors, should be a power of 2 */
+#define MCODE_UART2_LINES_COUNT (4)
 
 typedef enum {
   ELineReaderStateIdle,
   ELineReaderStateReadingLine,
   ELineReaderStateWaitingN,
   ELineReaderStateWaitingSpace,
-  ELineReaderStateError,
 } TReaderState;
 
-typedef struct _TLineReaderState {
-  uint16_t lineBufferLength[UART2_READ_BUFFERS_COUNT];
-  char lineBuffer[UART2_READ_BUFFERS_COUNT][MCODE_UART2_READ_BUFFER_LENGTH];
-  /**< The \c readIndex and \c writeIndex size must be enough
-       for holding value of \c UART2_READ_BUFFERS_COUNT minus \c 1 */
-  uint32_t readIndex : 2;
-  uint32_t writeIndex : 2;
-  uint32_t state : 4; /**< TReaderState */
-  uint32_t ready : 4; /**< Ready indications for each read buffer */
+/**
+ * The received line, a slice of the ring
+ */
+typedef struct {
+  uint16_t offset;                      /**< The line start in the ring */
+  uint16_t length;                      /**< The line length, not including the end-of-string marker */
+  uint8_t flags;                        /**< MUartLineFlags */
+} TLineDesc;
+
+/**
+ * The UART2 line reader, the ISR fills the ring and queues the line descriptors,
+ * the main loop reports the lines straight from the ring.
+ * Each index has a single writer and fits a single byte, so, no read-modify-write
+ * is ever shared between the ISR and the main loop.
+ */
+typedef struct {
+  /** The ring, the first \c MCODE_UART2_LINE_LENGTH bytes are mirrored after its end,
+      so, any line is contiguous */
+  char data[MCODE_UART2_RING_LENGTH + MCODE_UART2_LINE_LENGTH];
+  TLineDesc lines[MCODE_UART2_LINES_COUNT];
+  uint8_t lineHead;                     /**< The next descriptor to fill, owned by the ISR */
+  uint8_t lineTail;                     /**< The next descriptor to report, owned by the main loop */
+  /* The rest is owned by the ISR */
+  uint16_t head;                        /**< The next byte position in the ring */
+  uint16_t lineStart;                   /**< The current line start position */
+  uint16_t lineLength;                  /**< The current line length */
+  uint8_t state;                        /**< TReaderState */
+  uint8_t flags;                        /**< The current line flags, MUartLineFlags */
+  bool discard;                         /**< No room for the current line, it is dropped */
 } TLineReaderState;
 
-volatile static TLineReaderState TheUart2State = {{0}};
+volatile static TLineReaderState TheUart2State;
+static uint8_t TheUart2LineFlags = 0;
 
 static hw_uart_handler TheUart2Callback = NULL;
+
+static void uart2_store_char(char ch);
+static void uart2_finalize_line(void);
 #endif /* MCODE_UART2 */
 
 #ifndef __linux__
@@ -67,41 +94,40 @@ void hw_uart2_set_callback(hw_uart_handler cb)
   TheUart2Callback = cb;
 }
 
+uint8_t uart2_line_flags(void)
+{
+  return TheUart2LineFlags;
+}
+
 void uart2_report_new_sample(void)
 {
-  const uint8_t ready_flag = (1u << TheUart2State.readIndex);
-  if (!(TheUart2State.ready & ready_flag)) {
+  const uint8_t tail = TheUart2State.lineTail;
+  volatile const TLineDesc *line;
+
+  if (tail == TheUart2State.lineHead) {
     /* No ready data to report */
     return;
   }
 
-  /* Report the currently read line */
-  (*TheUart2Callback)((const char *)TheUart2State.lineBuffer[TheUart2State.readIndex],
-    TheUart2State.lineBufferLength[TheUart2State.readIndex]);
-
-  /* Reset the reported buffer */
-  memset((char *)TheUart2State.lineBuffer[TheUart2State.readIndex], 0, MCODE_UART2_READ_BUFFER_LENGTH);
-  TheUart2State.lineBufferLength[TheUart2State.readIndex] = 0;
+  /* Report the line straight from the ring, the ISR does not reuse its bytes
+     and its descriptor till the tail moves */
+  line = TheUart2State.lines + (tail & (MCODE_UART2_LINES_COUNT - 1));
+  TheUart2LineFlags = line->flags;
+  (*TheUart2Callback)((const char *)TheUart2State.data + line->offset, line->length);
+  TheUart2LineFlags = 0;
 
-  /* Ready to read a line in the next buffer,
-     reset the 'ready' flag for the current buffer and move to the next buffer */
-  ++TheUart2State.readIndex;
-  TheUart2State.ready &= ~ready_flag;
-
-  /* Check if the are in an ERROR state, reset it, as we have an empty buffer */
-  if (ELineReaderStateError == TheUart2State.state) {
-    TheUart2State.state = ELineReaderStateIdle;
-  }
+  /* Release the line */
+  TheUart2State.lineTail = tail + 1;
 }
 
 void uart2_handle_new_sample(uint16_t data)
 {
   bool finalize;
   bool skip_char;
-  unsigned int flag;
+  uint8_t tail;
 
   /* Input filter */
-  if (data >= 128 || !data || TheUart2State.state == ELineReaderStateError) {
+  if (data >= 128 || !data) {
     return;
   }
 
@@ -109,11 +135,12 @@ void uart2_handle_new_sample(uint16_t data)
   skip_char = false;
   switch (TheUart2State.state) {
   case ELineReaderStateIdle:
-    flag = (1u << TheUart2State.writeIndex);
-    if ((TheUart2State.ready & flag) != 0) {
-      /* The current buffer is not ready, cannot exit the IDLE state, move to ERROR state */
-      TheUart2State.state = ELineReaderStateError;
-      return;
+    /* A new line starts, check if there is a free descriptor for it */
+    tail = TheUart2State.lineTail;
+    TheUart2State.discard = ((uint8_t)(TheUart2State.lineHead - tail) >= MCODE_UART2_LINES_COUNT);
+    if (TheUart2State.discard) {
+      /* The line is lost, report it with the next line */
+      TheUart2State.flags |= MUartLineOverrun;
     }
     if ('>' == data) {
       TheUart2State.state = ELineReaderStateWaitingSpace;
@@ -148,25 +175,80 @@ void uart2_handle_new_sample(uint16_t data)
     break;
   }
 
-  if (!skip_char) {
-    volatile uint16_t *const buffer_length = TheUart2State.lineBufferLength + TheUart2State.writeIndex;
-    if (*buffer_length < MCODE_UART2_READ_BUFFER_LENGTH - 1) {
-      TheUart2State.lineBuffer[TheUart2State.writeIndex][*buffer_length] = data;
-      ++*buffer_length;
-    }
+  if (!skip_char && !TheUart2State.discard) {
+    uart2_store_char(data);
   }
   if (finalize) {
-    /* Check if the next-to-the-last character is '\r', remove it if it is */
-    volatile uint16_t *const buffer_length = TheUart2State.lineBufferLength + TheUart2State.writeIndex;
-    if ('\r' == TheUart2State.lineBuffer[TheUart2State.writeIndex][*buffer_length - 1]) {
-      TheUart2State.lineBuffer[TheUart2State.writeIndex][*buffer_length - 1] = 0;
-      --*buffer_length;
+    if (!TheUart2State.discard) {
+      uart2_finalize_line();
     }
-
-    flag = (1u << TheUart2State.writeIndex);
-    TheUart2State.ready |= flag;
-    ++TheUart2State.writeIndex;
     TheUart2State.state = ELineReaderStateIdle;
   }
 }
+
+void uart2_store_char(char ch)
+{
+  uint16_t used;
+  uint8_t tail;
+  uint16_t oldest;
+  uint16_t offset;
+
+  if (TheUart2State.lineLength >= MCODE_UART2_LINE_LENGTH - 1) {
+    /* Too long line, keep the beginning */
+    TheUart2State.flags |= MUartLineTruncated;
+    return;
+  }
+
+  /* The oldest byte in use belongs to the oldest unreported line, or to the current line,
+     one byte is kept for the end-of-string marker */
+  tail = TheUart2State.lineTail;
+  oldest = (tail != TheUart2State.lineHead) ?
+    TheUart2State.lines[tail & (MCODE_UART2_LINES_COUNT - 1)].offset : TheUart2State.lineStart;
+  used = (TheUart2State.head - oldest) & (MCODE_UART2_RING_LENGTH - 1);
+  if (used >= MCODE_UART2_RING_LENGTH - 2) {
+    /* The ring is full, the rest of the line is lost */
+    TheUart2State.flags |= MUartLineOverrun | MUartLineTruncated;
+    return;
+  }
+
+  offset = TheUart2State.head;
+  TheUart2State.data[offset] = ch;
+  if (offset < MCODE_UART2_LINE_LENGTH) {
+    TheUart2State.data[MCODE_UART2_RING_LENGTH + offset] = ch;
+  }
+  TheUart2State.head = (offset + 1) & (MCODE_UART2_RING_LENGTH - 1);
+  ++TheUart2State.lineLength;
+}
+
+void uart2_finalize_line(void)
+{
+  uint16_t end;
+  const uint8_t head = TheUart2State.lineHead;
+  volatile TLineDesc *const line = TheUart2State.lines + (head & (MCODE_UART2_LINES_COUNT - 1));
+
+  /* Check if the last character is '\r', remove it if it is */
+  if (TheUart2State.lineLength &&
+      '\r' == TheUart2State.data[TheUart2State.lineStart + TheUart2State.lineLength - 1]) {
+    --TheUart2State.lineLength;
+  }
+
+  /* Terminate the line in place, the byte is reserved by 'uart2_store_char' */
+  end = (TheUart2State.lineStart + TheUart2State.lineLength) & (MCODE_UART2_RING_LENGTH - 1);
+  TheUart2State.data[end] = 0;
+  if (end < MCODE_UART2_LINE_LENGTH) {
+    TheUart2State.data[MCODE_UART2_RING_LENGTH + end] = 0;
+  }
+  TheUart2State.head = (end + 1) & (MCODE_UART2_RING_LENGTH - 1);
+
+  /* Publish the line */
+  line->offset = TheUart2State.lineStart;
+  line->length = TheUart2State.lineLength;
+  line->flags = TheUart2State.flags;
+  TheUart2State.lineHead = head + 1;
+
+  /* The next line starts after the end-of-string marker */
+  TheUart2State.lineStart = TheUart2State.head;
+  TheUart2State.lineLength = 0;
+  TheUart2State.flags = 0;
+}
 #endif /* MCODE_UART2 */
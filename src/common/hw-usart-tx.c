@@ -0,0 +1,148 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Alexander Chumakov
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "hw-usart-tx.h"
+
+static void usart_tx_poll(MUsartTx *tx);
+static void usart_tx_dma_next(MUsartTx *tx);
+
+bool usart_tx_init(MUsartTx *tx, const MUsartRegs *regs, char *buffer, size_t capacity)
+{
+  tx->regs = regs;
+  tx->dmaLength = 0;
+  tx->stalls = 0;
+  return mring_init(&tx->ring, buffer, capacity);
+}
+
+void usart_tx_write(MUsartTx *tx, const char *data, size_t length)
+{
+  size_t room;
+  const MUsartRegs *const regs = tx->regs;
+
+  while (length) {
+    room = mring_room(&tx->ring);
+    if (!room) {
+      /* The ring is full, take the transmitter over from the interrupt and drain
+         the ring by polling the USART till there is some room */
+      ++tx->stalls;
+      (*regs->tx_irq)(regs->ctx, false);
+      do {
+        usart_tx_poll(tx);
+      } while (!mring_room(&tx->ring));
+      (*regs->tx_irq)(regs->ctx, true);
+      continue;
+    }
+
+    if (room > length) {
+      room = length;
+    }
+    mring_push(&tx->ring, data, room, NULL);
+    data += room;
+    length -= room;
+
+    /* Let the interrupt send the new data, the DMA transfer is started here if idle */
+    (*regs->tx_irq)(regs->ctx, false);
+    if (regs->dma_start && !tx->dmaLength) {
+      usart_tx_dma_next(tx);
+    }
+    (*regs->tx_irq)(regs->ctx, true);
+  }
+}
+
+void usart_tx_write_char(MUsartTx *tx, char ch)
+{
+  usart_tx_write(tx, &ch, 1);
+}
+
+void usart_tx_flush(MUsartTx *tx)
+{
+  const MUsartRegs *const regs = tx->regs;
+
+  (*regs->tx_irq)(regs->ctx, false);
+  while (mring_count(&tx->ring)) {
+    usart_tx_poll(tx);
+  }
+  (*regs->tx_irq)(regs->ctx, true);
+}
+
+void usart_tx_isr(MUsartTx *tx)
+{
+  const char *data;
+  const MUsartRegs *const regs = tx->regs;
+
+  if (regs->dma_start) {
+    if (tx->dmaLength && (*regs->dma_done)(regs->ctx)) {
+      mring_consume(&tx->ring, tx->dmaLength);
+      usart_tx_dma_next(tx);
+    }
+    return;
+  }
+
+  while ((*regs->tx_ready)(regs->ctx)) {
+    if (!mring_peek(&tx->ring, &data)) {
+      /* Nothing to send, the writer enables the interrupt for the new data */
+      (*regs->tx_irq)(regs->ctx, false);
+      break;
+    }
+    (*regs->tx_write)(regs->ctx, *data);
+    mring_consume(&tx->ring, 1);
+  }
+}
+
+/**
+ * Send the data with the TX interrupt disabled
+ */
+void usart_tx_poll(MUsartTx *tx)
+{
+  const char *data;
+  const MUsartRegs *const regs = tx->regs;
+
+  if (regs->dma_start) {
+    if (!tx->dmaLength) {
+      usart_tx_dma_next(tx);
+    } else if ((*regs->dma_done)(regs->ctx)) {
+      mring_consume(&tx->ring, tx->dmaLength);
+      usart_tx_dma_next(tx);
+    }
+  } else if ((*regs->tx_ready)(regs->ctx) && mring_peek(&tx->ring, &data)) {
+    (*regs->tx_write)(regs->ctx, *data);
+    mring_consume(&tx->ring, 1);
+  }
+}
+
+/**
+ * Start the DMA transfer for the contiguous part of the queued data
+ */
+void usart_tx_dma_next(MUsartTx *tx)
+{
+  const char *data;
+  const MUsartRegs *const regs = tx->regs;
+  const size_t length = mring_peek(&tx->ring, &data);
+
+  tx->dmaLength = length;
+  if (length) {
+    (*regs->dma_start)(regs->ctx, data, length);
+  }
+}
@@ -34,13 +34,53 @@
 #include <string.h>
 
 #define LINE_EDITOR_UART_BUFFER_LENGTH (64)
+#ifndef MCODE_LINE_EDITOR_BATCH_LENGTH
+/** The paste mode line queue size, the lines are delivered when it is full */
+#ifdef __AVR__
+#define MCODE_LINE_EDITOR_BATCH_LENGTH (128)
+#else /* __AVR__ */
+#define MCODE_LINE_EDITOR_BATCH_LENGTH (512)
+#endif /* __AVR__ */
+#endif /* MCODE_LINE_EDITOR_BATCH_LENGTH */
+
+/** The bracketed paste markers: "ESC [ 200 ~" and "ESC [ 201 ~" */
+#define LINE_EDITOR_PASTE_START (200)
+#define LINE_EDITOR_PASTE_END (201)
+/** Ends the explicitly started paste mode */
+#define LINE_EDITOR_EOT ('\004')
+
+typedef enum {
+  ELineEditorEscNone,
+  ELineEditorEscStarted,                /**< 'ESC' received */
+  ELineEditorEscCsi,                    /**< 'ESC [' received, collecting the parameter */
+} TEscState;
+
 static char line_editor_buffer[LINE_EDITOR_UART_BUFFER_LENGTH] = {0};
 static bool TheEchoEnabled;
 static int line_editor_cursor = 0;
 static int line_editor_initialized = 0;
 static line_editor_uart_ready TheCallback = 0;
 
+static uint8_t TheEscState = ELineEditorEscNone;
+static uint16_t TheEscParam = 0;
+
+/** The paste mode line queue, the complete lines are separated with '\0' */
+static char TheBatch[MCODE_LINE_EDITOR_BATCH_LENGTH];
+static bool TheBatchMode = false;
+static bool TheBatchDelivery = false;   /**< The queued lines are being delivered */
+static bool TheBatchPrompt = false;     /**< The last delivered line has requested the prompt */
+static bool TheBatchDropping = false;   /**< The current line is too long, it is dropped */
+static bool TheBatchCr = false;         /**< The last character is '\r' */
+static size_t TheBatchLength = 0;       /**< The queued bytes */
+static size_t TheBatchLineStart = 0;    /**< The start of the incomplete line */
+static uint16_t TheBatchLines = 0;      /**< The number of the delivered lines */
+static uint16_t TheBatchDropped = 0;    /**< The number of the dropped lines */
+
 static void line_editor_uart_callback(char aChar);
+static bool line_editor_escape(char aChar);
+static void line_editor_batch_start(bool keepTyped);
+static void line_editor_batch_char(char aChar);
+static void line_editor_batch_flush(void);
 
 void line_editor_uart_init(void)
 {
@@ -66,6 +106,12 @@ void line_editor_uart_set_callback(line_editor_uart_ready aCallback)
 
 void line_editor_uart_start(void)
 {
+  if (TheBatchDelivery) {
+    /* Only one prompt after all the queued lines */
+    TheBatchPrompt = true;
+    return;
+  }
+
 #ifdef MCODE_COMMAND_MODES
   const char *prompt = PSTR("$ ");
   switch (cmd_engine_get_mode()) {
@@ -87,6 +133,20 @@ void line_editor_uart_start(void)
 
 void line_editor_uart_callback(char aChar)
 {
+  if (line_editor_escape(aChar)) {
+    /* Part of an escape sequence */
+    return;
+  }
+
+  if (TheBatchMode) {
+    if (LINE_EDITOR_EOT == aChar) {
+      line_editor_set_paste(false);
+    } else {
+      line_editor_batch_char(aChar);
+    }
+    return;
+  }
+
   /* there is enough space for appending another character */
   if (10 != aChar && 13 != aChar) {
     /* non-enter character, check if it is printable and append to the buffer */
@@ -132,3 +192,177 @@ void line_editor_set_echo(bool enabled)
 {
   TheEchoEnabled = enabled;
 }
+
+void line_editor_set_paste(bool enabled)
+{
+  if (enabled == TheBatchMode) {
+    return;
+  }
+
+  if (enabled) {
+    /* The 'paste' command is still in the line buffer, it is not a part of the script */
+    line_editor_batch_start(false);
+    return;
+  }
+
+  TheBatchMode = false;
+
+  /* The last line might have no new-line at the end */
+  if (TheBatchLength > TheBatchLineStart || TheBatchDropping) {
+    line_editor_batch_char('\n');
+  }
+  line_editor_batch_flush();
+  if (TheBatchDropped) {
+    mprintstr(PSTR("Too long lines dropped: "));
+    mprint_uintd(TheBatchDropped, 0);
+    mprint(MStringNewLine);
+  }
+  /* A command still running prints the prompt when it is done */
+  if (TheBatchPrompt || !TheBatchLines) {
+    line_editor_uart_start();
+  }
+}
+
+bool line_editor_paste(void)
+{
+  return TheBatchMode;
+}
+
+/**
+ * Handle the escape sequences, only the bracketed paste markers are recognized,
+ * the rest of the sequences are ignored
+ * @return \\c true if the character is consumed
+ */
+bool line_editor_escape(char aChar)
+{
+  switch (TheEscState) {
+  case ELineEditorEscNone:
+    if (27 != aChar) {
+      return false;
+    }
+    TheEscState = ELineEditorEscStarted;
+    break;
+  case ELineEditorEscStarted:
+    TheEscParam = 0;
+    TheEscState = ('[' == aChar) ? ELineEditorEscCsi : ELineEditorEscNone;
+    break;
+  case ELineEditorEscCsi:
+    if (aChar >= '0' && aChar <= '9') {
+      TheEscParam = 10 * TheEscParam + (aChar - '0');
+    } else if (aChar < '@' || aChar > '~') {
+      /* Intermediate bytes and parameter separators */
+    } else {
+      /* The final byte */
+      TheEscState = ELineEditorEscNone;
+      if ('~' == aChar && LINE_EDITOR_PASTE_START == TheEscParam) {
+        if (!TheBatchMode) {
+          /* Keep the already typed text as the first line start */
+          line_editor_batch_start(true);
+        }
+      } else if ('~' == aChar && LINE_EDITOR_PASTE_END == TheEscParam) {
+        line_editor_set_paste(false);
+      }
+    }
+    break;
+  }
+
+  return true;
+}
+
+/**
+ * Enter the paste mode with the empty queue
+ * @param[in] keepTyped Move the already typed text to the queue
+ */
+void line_editor_batch_start(bool keepTyped)
+{
+  TheBatchMode = true;
+  TheBatchLength = 0;
+  TheBatchLineStart = 0;
+  TheBatchLines = 0;
+  TheBatchDropped = 0;
+  TheBatchDropping = false;
+  TheBatchCr = false;
+  if (keepTyped) {
+    for (; TheBatchLength < (size_t)line_editor_cursor; ++TheBatchLength) {
+      TheBatch[TheBatchLength] = line_editor_buffer[TheBatchLength];
+    }
+  }
+  line_editor_reset();
+}
+
+/**
+ * Queue a character in the paste mode, no echo
+ */
+void line_editor_batch_char(char aChar)
+{
+  const bool cr = TheBatchCr;
+
+  TheBatchCr = (13 == aChar);
+  if (10 == aChar || 13 == aChar) {
+    if (10 == aChar && cr) {
+      /* The second half of "\r\n" */
+      return;
+    }
+    if (TheBatchDropping) {
+      TheBatchDropping = false;
+      ++TheBatchDropped;
+      return;
+    }
+    /* Complete the line, the room for the separator is always kept */
+    TheBatch[TheBatchLength++] = 0;
+    TheBatchLineStart = TheBatchLength;
+    return;
+  } else if (127 == aChar || 8 == aChar) {
+    if (TheBatchLength > TheBatchLineStart) {
+      --TheBatchLength;
+    }
+    return;
+  } else if (!isprint((int)aChar) || TheBatchDropping) {
+    return;
+  }
+
+  if (TheBatchLength >= MCODE_LINE_EDITOR_BATCH_LENGTH - 1) {
+    /* The queue is full, deliver the complete lines to make room */
+    line_editor_batch_flush();
+    if (TheBatchLength >= MCODE_LINE_EDITOR_BATCH_LENGTH - 1) {
+      /* A single line fills all the queue, drop it, it is reported at the end */
+      TheBatchDropping = true;
+      TheBatchLength = 0;
+      TheBatchLineStart = 0;
+      return;
+    }
+  }
+
+  TheBatch[TheBatchLength++] = aChar;
+}
+
+/**
+ * Deliver the complete queued lines, keep the incomplete one
+ */
+void line_editor_batch_flush(void)
+{
+  size_t length;
+  size_t offset = 0;
+
+  TheBatchDelivery = true;
+  while (offset < TheBatchLineStart) {
+    length = strlen(TheBatch + offset);
+    if (TheEchoEnabled) {
+      /* One echo per line instead of one per character */
+      mprintstr_R(TheBatch + offset);
+      mprint(MStringNewLine);
+    }
+    TheBatchPrompt = false;
+    if (TheCallback) {
+      (*TheCallback)(TheBatch + offset);
+    }
+    ++TheBatchLines;
+    offset += length + 1;
+  }
+  TheBatchDelivery = false;
+
+  /* Move the incomplete line to the queue start */
+  memmove(TheBatch, TheBatch + TheBatchLineStart, TheBatchLength - TheBatchLineStart);
+  TheBatchLength -= TheBatchLineStart;
+  TheBatchLineStart = 0;
+}
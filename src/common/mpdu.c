@@ -0,0 +1,614 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Alexander Chumakov
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "mpdu.h"
+
+#include "utils.h"
+
+#include <string.h>
+
+/** The escape to the extension table of the GSM 7-bit alphabet */
+#define PDU_GSM_ESCAPE (0x1B)
+/** The ASCII character has no GSM 7-bit equivalent */
+#define PDU_GSM_NONE (0xFF)
+/** The ASCII character is in the extension table of the GSM 7-bit alphabet */
+#define PDU_GSM_EXT (0x80)
+
+/** TP-UDHI: the user data starts with the header */
+#define PDU_FLAG_UDHI (0x40)
+/** TP-MMS: no more messages are waiting, SMS-DELIVER only */
+#define PDU_FLAG_MMS (0x04)
+
+/** The GSM 7-bit default alphabet to ASCII, '?' for the characters without ASCII equivalents */
+static const char TheGsmToAscii[128] = {
+  '@', '?', '$', '?', '?', '?', '?', '?', '?', '?', '\n', '?', '?', '\r', '?', '?',
+  '?', '_', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?',
+  ' ', '!', '"', '#', '?', '%', '&', '\'', '(', ')', '*', '+', ',', '-', '.', '/',
+  '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', ':', ';', '<', '=', '>', '?',
+  '?', 'A', 'B', 'C', 'D', 'E', 'F', 'G', 'H', 'I', 'J', 'K', 'L', 'M', 'N', 'O',
+  'P', 'Q', 'R', 'S', 'T', 'U', 'V', 'W', 'X', 'Y', 'Z', '?', '?', '?', '?', '?',
+  '?', 'a', 'b', 'c', 'd', 'e', 'f', 'g', 'h', 'i', 'j', 'k', 'l', 'm', 'n', 'o',
+  'p', 'q', 'r', 's', 't', 'u', 'v', 'w', 'x', 'y', 'z', '?', '?', '?', '?', '?',
+};
+
+/** ASCII to the GSM 7-bit alphabet, \c PDU_GSM_EXT marks the extension table characters */
+static const uint8_t TheAsciiToGsm[128] = {
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x0A, 0xFF, 0x8A, 0x0D, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0x20, 0x21, 0x22, 0x23, 0x02, 0x25, 0x26, 0x27, 0x28, 0x29, 0x2A, 0x2B, 0x2C, 0x2D, 0x2E, 0x2F,
+  0x30, 0x31, 0x32, 0x33, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3A, 0x3B, 0x3C, 0x3D, 0x3E, 0x3F,
+  0x00, 0x41, 0x42, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49, 0x4A, 0x4B, 0x4C, 0x4D, 0x4E, 0x4F,
+  0x50, 0x51, 0x52, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5A, 0xBC, 0xAF, 0xBE, 0x94, 0x11,
+  0xFF, 0x61, 0x62, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6A, 0x6B, 0x6C, 0x6D, 0x6E, 0x6F,
+  0x70, 0x71, 0x72, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7A, 0xA8, 0xC0, 0xA9, 0xBD, 0xFF,
+};
+
+static size_t pdu_hex_to_bytes(const char *hex, size_t length, uint8_t *out, size_t outMaxLength);
+static size_t pdu_put_address(uint8_t *out, const char *address, bool smsc);
+static bool pdu_get_address(const uint8_t *in, size_t digits, uint8_t type, char *out);
+static void pdu_get_udh(const uint8_t *in, size_t length, MPduSms *sms);
+static uint8_t pdu_get_alphabet(uint8_t dcs);
+static char pdu_gsm_ext_to_ascii(uint8_t septet);
+static size_t pdu_gsm_to_ascii(const uint8_t *septets, size_t count, char *out, size_t outMaxLength);
+
+size_t pdu_pack_7bit(const uint8_t *septets, size_t count, uint8_t *out)
+{
+  size_t i;
+  size_t octets;
+  uint64_t block;
+  const size_t blocks = count / 8;
+
+  /* Every 8 septets fill exactly 7 octets */
+  for (i = 0; i < blocks; ++i, septets += 8, out += 7) {
+    block =
+      ((uint64_t)(septets[0] & 0x7FU) <<  0) | ((uint64_t)(septets[1] & 0x7FU) <<  7) |
+      ((uint64_t)(septets[2] & 0x7FU) << 14) | ((uint64_t)(septets[3] & 0x7FU) << 21) |
+      ((uint64_t)(septets[4] & 0x7FU) << 28) | ((uint64_t)(septets[5] & 0x7FU) << 35) |
+      ((uint64_t)(septets[6] & 0x7FU) << 42) | ((uint64_t)(septets[7] & 0x7FU) << 49);
+    out[0] = block;
+    out[1] = block >> 8;
+    out[2] = block >> 16;
+    out[3] = block >> 24;
+    out[4] = block >> 32;
+    out[5] = block >> 40;
+    out[6] = block >> 48;
+  }
+
+  /* The last incomplete block */
+  count = count % 8;
+  octets = (count * 7 + 7) / 8;
+  for (block = 0, i = 0; i < count; ++i) {
+    block |= (uint64_t)(septets[i] & 0x7FU) << (7 * i);
+  }
+  for (i = 0; i < octets; ++i) {
+    out[i] = block >> (8 * i);
+  }
+
+  return blocks * 7 + octets;
+}
+
+void pdu_unpack_7bit(const uint8_t *in, size_t count, uint8_t *septets)
+{
+  size_t i;
+  size_t octets;
+  uint64_t block;
+  const size_t blocks = count / 8;
+
+  /* Every 7 octets hold exactly 8 septets */
+  for (i = 0; i < blocks; ++i, in += 7, septets += 8) {
+    block =
+      ((uint64_t)in[0] <<  0) | ((uint64_t)in[1] <<  8) | ((uint64_t)in[2] << 16) |
+      ((uint64_t)in[3] << 24) | ((uint64_t)in[4] << 32) | ((uint64_t)in[5] << 40) |
+      ((uint64_t)in[6] << 48);
+    septets[0] = (block >>  0) & 0x7FU;
+    septets[1] = (block >>  7) & 0x7FU;
+    septets[2] = (block >> 14) & 0x7FU;
+    septets[3] = (block >> 21) & 0x7FU;
+    septets[4] = (block >> 28) & 0x7FU;
+    septets[5] = (block >> 35) & 0x7FU;
+    septets[6] = (block >> 42) & 0x7FU;
+    septets[7] = (block >> 49) & 0x7FU;
+  }
+
+  /* The last incomplete block */
+  count = count % 8;
+  octets = (count * 7 + 7) / 8;
+  for (block = 0, i = 0; i < octets; ++i) {
+    block |= (uint64_t)in[i] << (8 * i);
+  }
+  for (i = 0; i < count; ++i) {
+    septets[i] = (block >> (7 * i)) & 0x7FU;
+  }
+}
+
+uint8_t pdu_text_dcs(const char *text, size_t length)
+{
+  uint8_t ch;
+
+  while (length--) {
+    ch = *text++;
+    if (ch >= 128 || PDU_GSM_NONE == TheAsciiToGsm[ch]) {
+      return MPduDcsUcs2;
+    }
+  }
+
+  return MPduDcs7bit;
+}
+
+size_t pdu_text_fit(const char *text, size_t length, uint8_t dcs, bool concat)
+{
+  size_t i;
+  size_t room;
+  size_t septets;
+  const size_t udh = concat ? MCODE_PDU_CONCAT_UDH_LENGTH : 0;
+
+  switch (dcs) {
+  case MPduDcs7bit:
+    /* The extension table characters take 2 septets, the header is aligned to septets */
+    room = MCODE_PDU_MAX_SEPTETS - (udh * 8 + 6) / 7;
+    for (i = 0; i < length; ++i) {
+      const uint8_t ch = text[i];
+      septets = (ch < 128 && (TheAsciiToGsm[ch] & PDU_GSM_EXT) && PDU_GSM_NONE != TheAsciiToGsm[ch]) ? 2 : 1;
+      if (septets > room) {
+        break;
+      }
+      room -= septets;
+    }
+    return i;
+  case MPduDcsUcs2:
+    room = (MCODE_PDU_MAX_OCTETS - udh) / 2;
+    break;
+  case MPduDcs8bit:
+  default:
+    room = MCODE_PDU_MAX_OCTETS - udh;
+    break;
+  }
+
+  return (length < room) ? length : room;
+}
+
+size_t pdu_encode(const MPduSms *sms, char *out, size_t outMaxLength)
+{
+  uint8_t ch;
+  uint8_t gsm;
+  size_t i;
+  size_t pos;
+  size_t count;
+  size_t length;
+  size_t smscLength;
+  uint8_t udh[MCODE_PDU_CONCAT_UDH_LENGTH];
+  uint8_t data[MCODE_PDU_MAX_LENGTH];
+  uint8_t septets[MCODE_PDU_MAX_SEPTETS];
+  const bool concat = (0 != sms->concatTotal);
+  const size_t udhLength = concat ? MCODE_PDU_CONCAT_UDH_LENGTH : 0;
+
+  /* The SMSC address, the empty one selects the default SMSC */
+  if (*sms->smsc) {
+    pos = pdu_put_address(data, sms->smsc, true);
+    if (!pos) {
+      return 0;
+    }
+  } else {
+    data[0] = 0;
+    pos = 1;
+  }
+  smscLength = pos;
+
+  /* The first octet, the message reference is assigned by the mobile station */
+  if (MPduTypeSubmit == sms->type) {
+    data[pos++] = MPduTypeSubmit | (concat ? PDU_FLAG_UDHI : 0);
+    data[pos++] = 0;
+  } else {
+    data[pos++] = MPduTypeDeliver | PDU_FLAG_MMS | (concat ? PDU_FLAG_UDHI : 0);
+  }
+
+  /* The destination or the originating address */
+  i = pdu_put_address(data + pos, sms->address, false);
+  if (!i) {
+    return 0;
+  }
+  pos += i;
+
+  /* TP-PID, TP-DCS and the time stamp */
+  data[pos++] = 0;
+  data[pos++] = sms->dcs;
+  if (MPduTypeDeliver == sms->type) {
+    memcpy(data + pos, sms->timestamp, sizeof (sms->timestamp));
+    pos += sizeof (sms->timestamp);
+  }
+
+  /* The concatenated SMS header with 8-bit reference */
+  udh[0] = MCODE_PDU_CONCAT_UDH_LENGTH - 1;
+  udh[1] = 0x00;
+  udh[2] = 0x03;
+  udh[3] = sms->concatRef;
+  udh[4] = sms->concatTotal;
+  udh[5] = sms->concatSeq;
+
+  length = pdu_text_fit(sms->text, sms->length, sms->dcs, concat);
+  switch (sms->dcs) {
+  case MPduDcs7bit:
+    /* The header is padded to the septet boundary, the text starts with the next septet */
+    count = (udhLength * 8 + 6) / 7;
+    memset(septets, 0, count);
+    for (i = 0; i < length; ++i) {
+      ch = sms->text[i];
+      gsm = (ch < 128) ? TheAsciiToGsm[ch] : PDU_GSM_NONE;
+      if (PDU_GSM_NONE == gsm) {
+        septets[count++] = '?';
+      } else if (gsm & PDU_GSM_EXT) {
+        septets[count++] = PDU_GSM_ESCAPE;
+        septets[count++] = gsm & ~PDU_GSM_EXT;
+      } else {
+        septets[count++] = gsm;
+      }
+    }
+    data[pos++] = count;
+    i = pdu_pack_7bit(septets, count, data + pos);
+    memcpy(data + pos, udh, udhLength);
+    pos += i;
+    break;
+  case MPduDcsUcs2:
+    data[pos++] = udhLength + 2 * length;
+    memcpy(data + pos, udh, udhLength);
+    pos += udhLength;
+    for (i = 0; i < length; ++i) {
+      ch = sms->text[i];
+      data[pos++] = 0;
+      data[pos++] = (ch < 128) ? ch : '?';
+    }
+    break;
+  case MPduDcs8bit:
+  default:
+    data[pos++] = udhLength + length;
+    memcpy(data + pos, udh, udhLength);
+    pos += udhLength;
+    memcpy(data + pos, sms->text, length);
+    pos += length;
+    break;
+  }
+
+  if (2 * pos + 1 > outMaxLength) {
+    /* Not enough room for the hex-encoded PDU */
+    return 0;
+  }
+  for (i = 0; i < pos; ++i) {
+    *out++ = nibble_to_char(data[i] >> 4);
+    *out++ = nibble_to_char(data[i]);
+  }
+  *out = 0;
+
+  return pos - smscLength;
+}
+
+bool pdu_decode(const char *pdu, size_t length, MPduSms *sms)
+{
+  size_t i;
+  size_t n;
+  size_t pos;
+  size_t udl;
+  size_t octets;
+  size_t udhLength;
+  uint8_t first;
+  const uint8_t *ud;
+  uint8_t data[MCODE_PDU_MAX_LENGTH];
+  uint8_t septets[MCODE_PDU_MAX_SEPTETS];
+
+  memset(sms, 0, sizeof (*sms));
+  n = pdu_hex_to_bytes(pdu, length, data, sizeof (data));
+  if (!n) {
+    return false;
+  }
+
+  /* The SMSC address, its length is in octets, including the type */
+  octets = data[0];
+  pos = 1 + octets;
+  if (pos >= n || (octets && !pdu_get_address(data + 2, 2 * (octets - 1), data[1], sms->smsc))) {
+    return false;
+  }
+
+  /* The first octet, skip the message reference of SMS-SUBMIT */
+  first = data[pos++];
+  sms->type = first & 0x03U;
+  if (MPduTypeSubmit == sms->type) {
+    ++pos;
+  } else if (MPduTypeDeliver != sms->type) {
+    return false;
+  }
+
+  /* The address, its length is in semi-octets, not including the type */
+  if (pos + 2 > n) {
+    return false;
+  }
+  octets = (data[pos] + 1) / 2;
+  if (pos + 2 + octets > n || !pdu_get_address(data + pos + 2, data[pos], data[pos + 1], sms->address)) {
+    return false;
+  }
+  pos += 2 + octets;
+
+  /* TP-PID and TP-DCS */
+  if (pos + 2 > n) {
+    return false;
+  }
+  sms->dcs = pdu_get_alphabet(data[pos + 1]);
+  pos += 2;
+
+  /* The time stamp of SMS-DELIVER or the validity period of SMS-SUBMIT */
+  if (MPduTypeDeliver == sms->type) {
+    if (pos + sizeof (sms->timestamp) > n) {
+      return false;
+    }
+    memcpy(sms->timestamp, data + pos, sizeof (sms->timestamp));
+    pos += sizeof (sms->timestamp);
+  } else {
+    switch ((first >> 3) & 0x03U) {
+    case 0:
+      /* No validity period */
+      break;
+    case 2:
+      /* Relative validity period */
+      pos += 1;
+      break;
+    default:
+      /* Enhanced or absolute validity period */
+      pos += 7;
+      break;
+    }
+  }
+
+  /* The user data, its length is in septets for 7-bit alphabet, in octets otherwise */
+  if (pos >= n) {
+    return false;
+  }
+  udl = data[pos++];
+  octets = (MPduDcs7bit == sms->dcs) ? (udl * 7 + 7) / 8 : udl;
+  if (pos + octets > n || (MPduDcs7bit == sms->dcs && udl > MCODE_PDU_MAX_SEPTETS)) {
+    return false;
+  }
+  ud = data + pos;
+
+  udhLength = 0;
+  if (first & PDU_FLAG_UDHI) {
+    udhLength = octets ? ud[0] + 1 : 0;
+    if (!udhLength || udhLength > octets) {
+      return false;
+    }
+    pdu_get_udh(ud + 1, udhLength - 1, sms);
+  }
+
+  switch (sms->dcs) {
+  case MPduDcs7bit:
+    /* The text starts with the septet following the header */
+    i = (udhLength * 8 + 6) / 7;
+    if (i > udl) {
+      return false;
+    }
+    pdu_unpack_7bit(ud, udl, septets);
+    sms->length = pdu_gsm_to_ascii(septets + i, udl - i, sms->text, MCODE_PDU_MAX_SEPTETS);
+    break;
+  case MPduDcsUcs2:
+    for (i = udhLength; i + 1 < udl && sms->length < MCODE_PDU_MAX_SEPTETS; i += 2) {
+      sms->text[sms->length++] = (!ud[i] && ud[i + 1] < 128) ? ud[i + 1] : '?';
+    }
+    break;
+  case MPduDcs8bit:
+  default:
+    for (i = udhLength; i < udl && sms->length < MCODE_PDU_MAX_SEPTETS; ++i) {
+      sms->text[sms->length++] = (ud[i] < 128) ? ud[i] : '?';
+    }
+    break;
+  }
+  sms->text[sms->length] = 0;
+
+  return true;
+}
+
+size_t pdu_hex_to_bytes(const char *hex, size_t length, uint8_t *out, size_t outMaxLength)
+{
+  size_t i;
+
+  if ((length & 1) || length / 2 > outMaxLength) {
+    return 0;
+  }
+
+  for (i = 0; i < length / 2; ++i, hex += 2) {
+    if (!char_is_hex(hex[0]) || !char_is_hex(hex[1])) {
+      return 0;
+    }
+    out[i] = glob_get_byte(hex);
+  }
+
+  return i;
+}
+
+size_t pdu_put_address(uint8_t *out, const char *address, bool smsc)
+{
+  char ch;
+  size_t i;
+  size_t digits;
+  uint8_t nibble;
+  uint8_t type = 0x81;
+
+  /* The international numbers start with '+' */
+  if ('+' == *address) {
+    type = 0x91;
+    ++address;
+  }
+  digits = strlen(address);
+  if (!digits || digits > 2 * (MCODE_PDU_ADDRESS_LENGTH / 2 - 2)) {
+    return 0;
+  }
+
+  /* The length is in octets for the SMSC address, in semi-octets for the others */
+  out[0] = smsc ? (digits + 1) / 2 + 1 : digits;
+  out[1] = type;
+  for (i = 0; i < digits; ++i) {
+    ch = address[i];
+    if (char_is_digit(ch)) {
+      nibble = ch - '0';
+    } else if ('*' == ch) {
+      nibble = 0x0AU;
+    } else if ('#' == ch) {
+      nibble = 0x0BU;
+    } else {
+      return 0;
+    }
+    /* The semi-octets are swapped, the odd number of digits is padded with 'F' */
+    if (i & 1) {
+      out[2 + i / 2] = (out[2 + i / 2] & 0x0FU) | (nibble << 4);
+    } else {
+      out[2 + i / 2] = 0xF0U | nibble;
+    }
+  }
+
+  return 2 + (digits + 1) / 2;
+}
+
+bool pdu_get_address(const uint8_t *in, size_t digits, uint8_t type, char *out)
+{
+  size_t i;
+  size_t length;
+  uint8_t nibble;
+  uint8_t septets[MCODE_PDU_ADDRESS_LENGTH];
+
+  if (0x50U == (type & 0x70U)) {
+    /* The alphanumeric address, GSM 7-bit packed */
+    length = digits * 4 / 7;
+    if (length > sizeof (septets)) {
+      length = sizeof (septets);
+    }
+    pdu_unpack_7bit(in, length, septets);
+    pdu_gsm_to_ascii(septets, length, out, MCODE_PDU_ADDRESS_LENGTH - 1);
+    return true;
+  }
+
+  length = 0;
+  if (0x10U == (type & 0x70U)) {
+    out[length++] = '+';
+  }
+  for (i = 0; i < digits && length < MCODE_PDU_ADDRESS_LENGTH - 1; ++i) {
+    nibble = (i & 1) ? (in[i / 2] >> 4) : (in[i / 2] & 0x0FU);
+    if (nibble < 10) {
+      out[length++] = '0' + nibble;
+    } else if (0x0FU == nibble) {
+      /* The padding */
+      break;
+    } else {
+      out[length++] = "*#abc"[nibble - 10];
+    }
+  }
+  out[length] = 0;
+
+  return true;
+}
+
+void pdu_get_udh(const uint8_t *in, size_t length, MPduSms *sms)
+{
+  uint8_t iei;
+  uint8_t iel;
+
+  while (length >= 2) {
+    iei = in[0];
+    iel = in[1];
+    if (2U + iel > length) {
+      break;
+    }
+    if (0x00U == iei && 3 == iel) {
+      /* Concatenated SMS, 8-bit reference */
+      sms->concatRef = in[2];
+      sms->concatTotal = in[3];
+      sms->concatSeq = in[4];
+    } else if (0x08U == iei && 4 == iel) {
+      /* Concatenated SMS, 16-bit reference */
+      sms->concatRef = ((uint16_t)in[2] << 8) | in[3];
+      sms->concatTotal = in[4];
+      sms->concatSeq = in[5];
+    }
+    in += 2 + iel;
+    length -= 2 + iel;
+  }
+}
+
+uint8_t pdu_get_alphabet(uint8_t dcs)
+{
+  switch (dcs >> 4) {
+  case 0x0: case 0x1: case 0x2: case 0x3:
+  case 0x4: case 0x5: case 0x6: case 0x7:
+    /* General data coding, the reserved alphabet is handled as 8-bit data */
+    return ((dcs & 0x0CU) == 0x0CU) ? MPduDcs8bit : (dcs & 0x0CU);
+  case 0xC: case 0xD:
+    /* Message waiting indication */
+    return MPduDcs7bit;
+  case 0xE:
+    return MPduDcsUcs2;
+  case 0xF:
+    /* Data coding/message class */
+    return (dcs & 0x04U) ? MPduDcs8bit : MPduDcs7bit;
+  default:
+    return MPduDcs8bit;
+  }
+}
+
+char pdu_gsm_ext_to_ascii(uint8_t septet)
+{
+  switch (septet) {
+  case 0x0A:
+    return '\f';
+  case 0x14:
+    return '^';
+  case 0x28:
+    return '{';
+  case 0x29:
+    return '}';
+  case 0x2F:
+    return '\\';
+  case 0x3C:
+    return '[';
+  case 0x3D:
+    return '~';
+  case 0x3E:
+    return ']';
+  case 0x40:
+    return '|';
+  default:
+    return '?';
+  }
+}
+
+size_t pdu_gsm_to_ascii(const uint8_t *septets, size_t count, char *out, size_t outMaxLength)
+{
+  size_t i;
+  size_t length = 0;
+
+  for (i = 0; i < count && length < outMaxLength; ++i) {
+    if (PDU_GSM_ESCAPE == septets[i] && i + 1 < count) {
+      out[length++] = pdu_gsm_ext_to_ascii(septets[++i]);
+    } else {
+      out[length++] = TheGsmToAscii[septets[i]];
+    }
+  }
+  out[length] = 0;
+
+  return length;
+}
@@ -0,0 +1,128 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Alexander Chumakov
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "mring.h"
+
+#include <string.h>
+
+bool mring_init(MRing *ring, char *buffer, size_t capacity)
+{
+  if (!capacity || (capacity & (capacity - 1))) {
+    /* Not a power of 2 */
+    return false;
+  }
+
+  atomic_init(&ring->head, 0);
+  atomic_init(&ring->tail, 0);
+  ring->mask = capacity - 1;
+  ring->dropped = 0;
+  ring->data = buffer;
+  return true;
+}
+
+size_t mring_count(MRing *ring)
+{
+  const size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+  const size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+  return head - tail;
+}
+
+size_t mring_room(MRing *ring)
+{
+  return ring->mask + 1 - mring_count(ring);
+}
+
+size_t mring_push(MRing *ring, const char *data, size_t length, bool *drained)
+{
+  size_t part;
+  const size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  const size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+  const size_t room = ring->mask + 1 - (head - tail);
+  const size_t offset = head & ring->mask;
+
+  if (length > room) {
+    ring->dropped += length - room;
+    length = room;
+  }
+
+  /* Copy in up to 2 parts, the second one wraps to the ring start */
+  part = ring->mask + 1 - offset;
+  if (part > length) {
+    part = length;
+  }
+  memcpy(ring->data + offset, data, part);
+  memcpy(ring->data, data + part, length - part);
+  atomic_store_explicit(&ring->head, head + length, memory_order_release);
+
+  if (drained) {
+    /* Pairs with the fence in 'mring_consume': either the consumer sees the new data,
+       or the producer sees the ring drained, so, the consumer is never left waiting */
+    atomic_thread_fence(memory_order_seq_cst);
+    *drained = length && atomic_load_explicit(&ring->tail, memory_order_relaxed) == head;
+  }
+  return length;
+}
+
+bool mring_put(MRing *ring, char ch)
+{
+  return 1 == mring_push(ring, &ch, 1, NULL);
+}
+
+size_t mring_pop(MRing *ring, char *data, size_t maxLength)
+{
+  size_t part;
+  size_t length;
+  const char *chunk;
+  size_t count = 0;
+
+  /* At most 2 contiguous parts */
+  while (count < maxLength && (length = mring_peek(ring, &chunk))) {
+    part = (length < maxLength - count) ? length : (maxLength - count);
+    memcpy(data + count, chunk, part);
+    mring_consume(ring, part);
+    count += part;
+  }
+
+  return count;
+}
+
+size_t mring_peek(MRing *ring, const char **data)
+{
+  const size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+  const size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+  const size_t offset = tail & ring->mask;
+  const size_t length = head - tail;
+
+  *data = ring->data + offset;
+  return (length < ring->mask + 1 - offset) ? length : (ring->mask + 1 - offset);
+}
+
+void mring_consume(MRing *ring, size_t length)
+{
+  const size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+
+  atomic_store_explicit(&ring->tail, tail + length, memory_order_release);
+  atomic_thread_fence(memory_order_seq_cst);
+}
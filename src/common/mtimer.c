@@ -107,14 +107,14 @@ void mtimer_add_handler(mcode_exec task, uint64_t next, uint32_t period)
 {
   TimerNode *ptr = TheTimerNodes;
   const TimerNode *const end = TheTimerNodes + MCODE_TIMER_HANDLERS;
-  while (ptr->next && ptr->next < next) {
-    if (ptr == end) {
-      /* No more room for handlers */
-      return;
-    }
-
+  /* Handlers with the same time are invoked in the order they are added */
+  while (ptr != end && ptr->next && ptr->next <= next) {
     ++ptr;
   }
+  if (ptr == end) {
+    /* No more room for handlers */
+    return;
+  }
 
   const size_t n = ptr - TheTimerNodes; /*< Item index */
   memmove(ptr + 1, ptr, (MCODE_TIMER_HANDLERS - n - 1)*sizeof (TimerNode));
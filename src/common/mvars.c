@@ -389,6 +389,19 @@ void mvar_putch_config(int index, int count)
   }
 }
 
+void mvar_putch_config_append(int index, int count)
+{
+  size_t length = 0;
+  TheStringPutchPointer = mvar_str(index, count, &length);
+  if (TheStringPutchPointer && length) {
+    /* Continue after the current string, reserve 1 byte for end-of-string marker \0 */
+    TheStringPutchPointerEnd = TheStringPutchPointer + length - 1;
+    TheStringPutchPointer += strnlen(TheStringPutchPointer, length - 1);
+  } else {
+    TheStringPutchPointerEnd = TheStringPutchPointer;
+  }
+}
+
 #ifdef MCODE_RANDOM_DATA
 const uint8_t *mcode_rand(void)
 {
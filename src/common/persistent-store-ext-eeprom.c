@@ -25,7 +25,7 @@
 #include "persistent-store.h"
 
 #include "sha256.h"
-#include "hw-twi.h"
+#include "twi-queue.h"
 #include "mstring.h"
 
 #include <string.h>
@@ -59,12 +59,7 @@ void persist_store_load(uint8_t id, void *data, uint8_t length)
   uint8_t buffer[2];
   buffer[0] = 0x00u;
   buffer[1] = 0x00u;
-  if (!twi_send_sync(0xaeu, 2, buffer)) {
-    merror(MStringInternalError);
-    return;
-  }
-
-  if (!twi_recv_sync(0xaeu, length, data)) {
+  if (!twi_queue_transfer_sync(0xaeu, 2, buffer, length, data)) {
     merror(MStringInternalError);
     return;
   }
@@ -81,7 +76,7 @@ void persist_store_save(uint8_t id, const void *data, uint8_t length)
   buffer[1] = 0x00u;
   memcpy(buffer + 2, data, length);
 
-  if (!twi_send_sync(0xaeu, length + 2, buffer)) {
+  if (!twi_queue_transfer_sync(0xaeu, length + 2, buffer, 0, NULL)) {
     merror(MStringInternalError);
     return;
   }
@@ -98,11 +93,7 @@ uint16_t persist_store_get_value(void)
     /* Send address */
     u.buffer[0] = 0x00u;
     u.buffer[1] = 0x20u + (i<<1);
-    if (!twi_send_sync(0xaeu, 2, u.buffer)) {
-      return 0;
-    }
-    /* Read the value at index 'i' */
-    if (!twi_recv_sync(0xaeu, 2, u.buffer)) {
+    if (!twi_queue_transfer_sync(0xaeu, 2, u.buffer, 2, u.buffer)) {
       return 0;
     }
     if (u.value != 0xffffu) {
@@ -132,18 +123,14 @@ void persist_store_set_value(uint16_t value)
     /* Send address */
     u.buffer[0] = 0x00u;
     u.buffer[1] = 0x20u + (i<<1);
-    if (!twi_send_sync(0xaeu, 2, u.buffer)) {
-      return;
-    }
-    /* Read the value at index 'i' */
-    if (!twi_recv_sync(0xaeu, 2, u.buffer)) {
+    if (!twi_queue_transfer_sync(0xaeu, 2, u.buffer, 2, u.buffer)) {
       return;
     }
     if (u.value == 0xffffu) {
       u.buffer[0] = 0x00u;
       u.buffer[1] = 0x20u + (i<<1);
       u.value2 = value;
-      if (!twi_send_sync(0xaeu, 4, u.buffer)) {
+      if (!twi_queue_transfer_sync(0xaeu, 4, u.buffer, 0, NULL)) {
         return;
       }
       written = true;
@@ -157,7 +144,7 @@ void persist_store_set_value(uint16_t value)
       u.buffer[0] = 0x00u;
       u.buffer[1] = 0x20u + (i<<1);
       u.value2 = i ? 0xffffu : value;
-      if (!twi_send_sync(0xaeu, 4, u.buffer)) {
+      if (!twi_queue_transfer_sync(0xaeu, 4, u.buffer, 0, NULL)) {
         return;
       }
     }
@@ -172,12 +159,7 @@ uint16_t persist_store_get_initial_value(void)
   } u;
   u.buffer[0] = 0x00u;
   u.buffer[1] = 0x60u;
-  if (!twi_send_sync(0xaeu, 2, u.buffer)) {
-    merror(MStringInternalError);
-    return 0;
-  }
-
-  if (!twi_recv_sync(0xaeu, 2, u.buffer)) {
+  if (!twi_queue_transfer_sync(0xaeu, 2, u.buffer, 2, u.buffer)) {
     merror(MStringInternalError);
     return 0;
   }
@@ -192,7 +174,7 @@ void persist_store_set_initial_value(uint16_t value)
   buffer[1] = 0x60u;
   memcpy(buffer + 2, &value, 2);
 
-  if (!twi_send_sync(0xaeu, 4, buffer)) {
+  if (!twi_queue_transfer_sync(0xaeu, 4, buffer, 0, NULL)) {
     merror(MStringInternalError);
     return;
   }
@@ -25,7 +25,7 @@
 #include "persistent-store.h"
 
 #include "sha.h"
-#include "hw-twi.h"
+#include "twi-queue.h"
 #include "mstring.h"
 #include "scheduler.h"
 
@@ -59,11 +59,7 @@ void persist_store_load(uint8_t id, uint8_t *data, uint8_t length)
   }
 
   const uint8_t buffer = 0x10u;
-  if (!twi_send_sync(0xd0u, 1, &buffer)) {
-    merror(MStringInternalError);
-    return;
-  }
-  if (!twi_recv_sync(0xd0u, length, data)) {
+  if (!twi_queue_transfer_sync(0xd0u, 1, &buffer, length, data)) {
     merror(MStringInternalError);
     return;
   }
@@ -79,7 +75,7 @@ void persist_store_save(uint8_t id, const uint8_t *data, uint8_t length)
   uint8_t buffer[SHA256_DIGEST_LENGTH + 1];
   buffer[0] = 0x10u;
   memcpy(buffer + 1, data, length);
-  if (!twi_send_sync(0xd0u, SHA256_DIGEST_LENGTH + 1, buffer)) {
+  if (!twi_queue_transfer_sync(0xd0u, SHA256_DIGEST_LENGTH + 1, buffer, 0, NULL)) {
     merror(MStringInternalError);
     return;
   }
@@ -92,12 +88,7 @@ uint16_t persist_store_get_value(void)
     uint16_t value;
   } u;
   u.buffer[0] = 0x08u;
-  if (!twi_send_sync(0xd0u, 1, u.buffer)) {
-    merror(MStringInternalError);
-    return 0;
-  }
-
-  if (!twi_recv_sync(0xd0u, 2, u.buffer)) {
+  if (!twi_queue_transfer_sync(0xd0u, 1, u.buffer, 2, u.buffer)) {
     merror(MStringInternalError);
     return 0;
   }
@@ -110,7 +101,7 @@ void persist_store_set_value(uint16_t value)
   uint8_t buffer[3];
   buffer[0] = 0x08u;
   memcpy(buffer + 1, &value, 2);
-  if (!twi_send_sync(0xd0u, 3, buffer)) {
+  if (!twi_queue_transfer_sync(0xd0u, 3, buffer, 0, NULL)) {
     merror(MStringInternalError);
     return;
   }
@@ -123,12 +114,7 @@ uint16_t persist_store_get_initial_value(void)
     uint16_t value;
   } u;
   u.buffer[0] = 0x0au;
-  if (!twi_send_sync(0xd0u, 1, u.buffer)) {
-    merror(MStringInternalError);
-    return 0;
-  }
-
-  if (!twi_recv_sync(0xd0u, 2, u.buffer)) {
+  if (!twi_queue_transfer_sync(0xd0u, 1, u.buffer, 2, u.buffer)) {
     merror(MStringInternalError);
     return 0;
   }
@@ -141,7 +127,7 @@ void persist_store_set_initial_value(uint16_t value)
   uint8_t buffer[3];
   buffer[0] = 0x0au;
   memcpy(buffer + 1, &value, 2);
-  if (!twi_send_sync(0xd0u, 3, buffer)) {
+  if (!twi_queue_transfer_sync(0xd0u, 3, buffer, 0, NULL)) {
     merror(MStringInternalError);
     return;
   }
@@ -0,0 +1,219 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Alexander Chumakov
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "twi-queue.h"
+
+#include "hw-twi.h"
+#include "mtimer.h"
+#include "scheduler.h"
+
+#include <string.h>
+
+static MTwiTransaction TheQueue[MCODE_TWI_QUEUE_LENGTH];
+static uint8_t TheHead;                 /**< The active or the next transaction */
+static uint8_t TheCount;
+static uint8_t TheAttempts;             /**< The retries of the active transaction */
+static bool TheActive;
+static bool TheRetryPending;            /**< The active transaction waits for the retry timer */
+static MTwiQueueStats TheStats;
+
+/** The state of the synchronous transfer */
+static bool TheSyncActive;
+static bool TheSyncWaiting;
+static bool TheSyncSuccess;
+static uint8_t *TheSyncData;
+
+static void twi_queue_start(void);
+static void twi_queue_failed(void);
+static bool twi_queue_retry(void);
+static void twi_queue_written(bool success);
+static void twi_queue_read(bool success, uint8_t length, const uint8_t *data);
+static void twi_queue_complete(bool success, uint8_t length, const uint8_t *data);
+static void twi_queue_sync_done(bool success, uint8_t length, const uint8_t *data);
+
+void twi_queue_init(void)
+{
+  TheHead = 0;
+  TheCount = 0;
+  TheAttempts = 0;
+  TheActive = false;
+  TheRetryPending = false;
+  TheSyncActive = false;
+  memset(&TheStats, 0, sizeof (TheStats));
+}
+
+void twi_queue_deinit(void)
+{
+}
+
+bool twi_queue_submit(const MTwiTransaction *transaction)
+{
+  if (TheCount >= MCODE_TWI_QUEUE_LENGTH || (!transaction->writeLength && !transaction->readLength)) {
+    ++TheStats.rejected;
+    return false;
+  }
+
+  TheQueue[(TheHead + TheCount) % MCODE_TWI_QUEUE_LENGTH] = *transaction;
+  ++TheCount;
+  if (!TheActive) {
+    twi_queue_start();
+  }
+  return true;
+}
+
+bool twi_queue_transfer_sync(uint8_t addr, uint8_t writeLength, const uint8_t *writeData,
+                             uint8_t readLength, uint8_t *readData)
+{
+  MTwiTransaction transaction;
+
+  if (TheSyncActive) {
+    /* Nested synchronous transfers are not supported */
+    return false;
+  }
+
+  transaction.addr = addr;
+  transaction.writeLength = writeLength;
+  transaction.readLength = readLength;
+  transaction.retries = MCODE_TWI_RETRIES;
+  transaction.writeData = writeData;
+  transaction.callback = twi_queue_sync_done;
+
+  TheSyncActive = true;
+  TheSyncWaiting = false;
+  TheSyncSuccess = false;
+  TheSyncData = readData;
+  if (twi_queue_submit(&transaction) && TheSyncActive) {
+    /* Not completed in place, wait for it */
+    TheSyncWaiting = true;
+    scheduler_start();
+  }
+  TheSyncActive = false;
+  TheSyncData = NULL;
+
+  return TheSyncSuccess;
+}
+
+bool twi_queue_busy(void)
+{
+  return TheCount;
+}
+
+const MTwiQueueStats *twi_queue_stats(void)
+{
+  return &TheStats;
+}
+
+void twi_queue_start(void)
+{
+  const MTwiTransaction *const transaction = &TheQueue[TheHead];
+
+  TheActive = true;
+  if (transaction->writeLength) {
+    twi_send(transaction->addr, transaction->writeLength, transaction->writeData, twi_queue_written);
+  } else {
+    twi_recv(transaction->addr, transaction->readLength, twi_queue_read);
+  }
+}
+
+void twi_queue_written(bool success)
+{
+  const MTwiTransaction *const transaction = &TheQueue[TheHead];
+
+  if (!success) {
+    twi_queue_failed();
+  } else if (transaction->readLength) {
+    twi_recv(transaction->addr, transaction->readLength, twi_queue_read);
+  } else {
+    twi_queue_complete(true, 0, NULL);
+  }
+}
+
+void twi_queue_read(bool success, uint8_t length, const uint8_t *data)
+{
+  if (!success) {
+    twi_queue_failed();
+  } else {
+    twi_queue_complete(true, length, data);
+  }
+}
+
+void twi_queue_failed(void)
+{
+  if (TheAttempts < TheQueue[TheHead].retries) {
+    /* The whole transaction is repeated, the write sets the device address pointer;
+     * the retry is delayed, so, a busy EEPROM completes its write cycle meanwhile */
+    ++TheAttempts;
+    ++TheStats.retries;
+    TheRetryPending = true;
+    mtimer_add(twi_queue_retry, MCODE_TWI_RETRY_DELAY);
+  } else {
+    twi_queue_complete(false, 0, NULL);
+  }
+}
+
+bool twi_queue_retry(void)
+{
+  if (TheRetryPending) {
+    TheRetryPending = false;
+    twi_queue_start();
+  }
+  return false;
+}
+
+void twi_queue_complete(bool success, uint8_t length, const uint8_t *data)
+{
+  const mcode_read_ready callback = TheQueue[TheHead].callback;
+
+  if (success) {
+    ++TheStats.completed;
+  } else {
+    ++TheStats.failed;
+  }
+
+  /* Release the slot first, the callback may queue the next transaction */
+  TheHead = (TheHead + 1) % MCODE_TWI_QUEUE_LENGTH;
+  --TheCount;
+  TheAttempts = 0;
+  TheActive = false;
+  if (callback) {
+    (*callback)(success, length, data);
+  }
+
+  if (!TheActive && TheCount) {
+    twi_queue_start();
+  }
+}
+
+void twi_queue_sync_done(bool success, uint8_t length, const uint8_t *data)
+{
+  TheSyncSuccess = success;
+  if (success && length && TheSyncData) {
+    memcpy(TheSyncData, data, length);
+  }
+  TheSyncActive = false;
+  if (TheSyncWaiting) {
+    scheduler_stop();
+  }
+}
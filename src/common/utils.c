@@ -24,6 +24,10 @@
 
 #include "utils.h"
 
+#ifdef MCODE_PDU
+#include "mpdu.h"
+#endif /* MCODE_PDU */
+
 #include <string.h>
 
 uint16_t glob_str_to_uint16(const char *pHexString)
@@ -268,6 +272,14 @@ const char *string_to_buffer(const char *str,
 #ifdef MCODE_PDU
 bool from_pdu_7bit(const char *pdu, size_t pduLength, char *out, size_t outMaxLength, size_t *outLength)
 {
+  size_t i;
+  size_t count;
+  size_t length;
+  size_t octets;
+  bool result = true;
+  uint8_t block[7];
+  uint8_t septets[8];
+
   if (!pdu || !out || !outLength || !outMaxLength) {
     /* Wrong arguments */
     return false;
@@ -278,70 +290,43 @@ bool from_pdu_7bit(const char *pdu, size_t pduLength, char *out, size_t outMaxLe
     pduLength = strlen(pdu);
   }
 
-  char ch;
-  uint16_t temp = 0;
-  bool result = true;
-  uint8_t currentByte;
-  size_t inBufferIndex;
-  size_t outBufferIndex;
-  for (inBufferIndex = 0, outBufferIndex = 0; pduLength; ++pdu, --pduLength) {
-    ch = *pdu;
-    if (!char_is_hex(ch)) {
+  /* Collect 7 octets of the input and unpack them to 8 septets at once */
+  length = 0;
+  count = 0;
+  octets = 0;
+  while (length < outMaxLength) {
+    if (pduLength >= 2 && char_is_hex(pdu[0]) && char_is_hex(pdu[1])) {
+      block[octets++] = glob_get_byte(pdu);
+      pdu += 2;
+      pduLength -= 2;
+      if (octets < sizeof (block)) {
+        continue;
+      }
+    } else if (pduLength >= 2 || (1 == pduLength && !char_is_hex(*pdu))) {
       /* Detected invalid character, finish processing */
       result = false;
-      break;
     }
 
-    const uint8_t current = glob_ch_to_val(ch);
-    currentByte = currentByte << 4;
-    currentByte = currentByte | current;
-    ++inBufferIndex;
-    if (inBufferIndex & 1) {
-      /* We are in the middle of parsing another byte, continue */
-      continue;
+    /* The last incomplete block holds only the complete septets */
+    count = octets * 8 / 7;
+    pdu_unpack_7bit(block, count, septets);
+    for (i = 0; i < count && length < outMaxLength; ++i) {
+      out[length++] = septets[i];
     }
-
-    /* For each 2nd item we get the whole byte of input data */
-    temp = temp >> 8;
-    temp = temp | ((uint16_t)currentByte << 8);
-
-    /* Check if the output buffer has enough space for another character */
-    if (outBufferIndex + 1 >= outMaxLength) {
-      /* We reached the end of output buffer, convertion done */
+    if (octets < sizeof (block) || !pduLength || !result) {
       break;
     }
+    octets = 0;
+  }
 
-    switch (outBufferIndex % 8) {
-    case 0:
-      out[outBufferIndex++] = ((temp >> 8) & 0x7FU);
-      break;
-    case 1:
-      out[outBufferIndex++] = ((temp >> 7) & 0x7FU);
-      break;
-    case 2:
-      out[outBufferIndex++] = ((temp >> 6) & 0x7FU);
-      break;
-    case 3:
-      out[outBufferIndex++] = ((temp >> 5) & 0x7FU);
-      break;
-    case 4:
-      out[outBufferIndex++] = ((temp >> 4) & 0x7FU);
-      break;
-    case 5:
-      out[outBufferIndex++] = ((temp >> 3) & 0x7FU);
-      break;
-    case 6:
-      out[outBufferIndex++] = ((temp >> 2) & 0x7FU);
-      if (outBufferIndex + 1 < outMaxLength) {
-        out[outBufferIndex++] = ((temp >> 9) & 0x7FU);
-      }
-      break;
-    case 7:
-    default:
-      /* We must not appear here */
-      break;
-    }
+  /* The 8th septet of the last complete block is the padding, if it is empty */
+  if (8 == count && length && !out[length - 1]) {
+    --length;
+  }
+  if (length < outMaxLength) {
+    out[length] = 0;
   }
+  *outLength = length;
 
   return result;
 }
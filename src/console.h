@@ -37,10 +37,36 @@ void console_deinit (void);
 
 void console_clear_screen (void);
 
+/**
+ * Write a byte to the console
+ * @note The printable characters are collected in a run and sent to the LCD together,
+ *       call \c console_flush to show the characters written so far
+ */
 void console_write_byte(char byte);
 void console_write_string (const char *pString);
 void console_write_string_P (const char *pString);
 
+/**
+ * Send the pending characters to the LCD
+ */
+void console_flush(void);
+
+/**
+ * Enable or disable the shadow buffer
+ * @return \c true if the shadow buffer is in use, it needs \c MCODE_CONSOLE_SHADOW and
+ *         enough cells for the display size
+ * @note With the shadow buffer, the console tracks the content of each character cell,
+ *       only the changed cells are drawn by \c console_flush, it is called by the scheduler
+ */
+bool console_set_shadow(bool enabled);
+
+/**
+ * Forget the LCD content tracked by the shadow buffer
+ * @note To be called after drawing on the LCD bypassing the console, the next
+ *       characters written to the console are drawn even if they are unchanged
+ */
+void console_invalidate(void);
+
 void console_write_uint16(uint16_t value, bool skipZeros);
 void console_write_uint32(uint32_t value, bool skipZeros);
 void console_write_uint64(uint64_t value, bool skipZeros);
@@ -24,9 +24,12 @@
 
 #include "customwidget.h"
 
-#include <QTimer>
 #include <QDebug>
 #include <QPainter>
+#include <QMutexLocker>
+
+/** The default repaint rate */
+static const uint KDefaultFrameRate = 60;
 
 AcCustomWidget::AcCustomWidget(uint width, uint height, QWidget *pParent) :
   QWidget(pParent),
@@ -34,45 +37,51 @@ AcCustomWidget::AcCustomWidget(uint width, uint height, QWidget *pParent) :
   m_width(width),
   m_height(height),
   m_scrollPosition(0),
-  nOutstandingRequestToUpdate(false)
+  m_fullUpdate(true),
+  m_frames(0),
+  m_pixels(0)
 {
   qDebug() << "AcCustomWidget::AcCustomWidget: " << (const void *)this;
-  m_pScreenData = (quint32 *)malloc (4*width*height);
+  createImages();
   resize(width, height);
+  // Qt paints the whole widget, there is no need to clear the background
+  setAttribute(Qt::WA_OpaquePaintEvent);
 
-  connect(this, SIGNAL(updateSignal()), this, SLOT(xupdate()), Qt::QueuedConnection);
+  connect(&m_frameTimer, SIGNAL(timeout()), this, SLOT(frameTimeout()));
+  setFrameRate(KDefaultFrameRate);
 }
 
 AcCustomWidget::~AcCustomWidget()
 {
   qDebug() << "AcCustomWidget::~AcCustomWidget: " << (const void *)this;
-  free(m_pScreenData);
 }
 
 void AcCustomWidget::reset()
 {
   turn(false);
 
-  memset(m_pScreenData, 0, sizeof(quint32)*m_width*m_height);
-  requestUpdate();
+  QMutexLocker locker(&m_dirtyLock);
+  m_image.fill(0xff000000u);
+  m_fullUpdate = true;
 }
 
 void AcCustomWidget::turn(bool on)
 {
   m_on = on;
-  requestUpdate();
+  requestFullUpdate();
 }
 
-void AcCustomWidget::setPixel (uint x, uint y, QRgb color)
+QRgb *AcCustomWidget::pixels(uint &stride)
 {
-  if (x >= 0 && x < m_width && y >= 0 && y < m_height) {
-    m_pScreenData[m_width*y+x] = color;
-    if (m_on) {
-      requestUpdate();
-    }
-  } else {
-    printf("AcCustomWidget::setPixel: wrong request: at (%u, %u), color: %u\r\n", x, y, color);
-  }
+  stride = m_image.bytesPerLine()/sizeof (QRgb);
+  return reinterpret_cast<QRgb *>(m_image.bits());
+}
+
+void AcCustomWidget::pixelsChanged(const QRect &area, quint32 count)
+{
+  QMutexLocker locker(&m_dirtyLock);
+  m_dirty |= area;
+  m_pixels += count;
 }
 
 QRgb AcCustomWidget::getPixel(uint x, uint y) const
@@ -81,7 +90,7 @@ QRgb AcCustomWidget::getPixel(uint x, uint y) const
   if (y >= m_height) {
     y -= m_height;
   }
-  return m_pScreenData[m_width*y+x];
+  return m_image.pixel(x, y);
 }
 
 uint AcCustomWidget::width() const
@@ -96,8 +105,14 @@ uint AcCustomWidget::height() const
 
 void AcCustomWidget::setSize(uint width, uint height)
 {
-  m_width = width;
-  m_height = height;
+  {
+    QMutexLocker locker(&m_dirtyLock);
+    m_width = width;
+    m_height = height;
+    m_scrollPosition = 0;
+    createImages();
+    m_fullUpdate = true;
+  }
   resize(width, height);
   updateGeometry();
 }
@@ -105,49 +120,100 @@ void AcCustomWidget::setSize(uint width, uint height)
 void AcCustomWidget::setScrollPosition(uint scrollPosition)
 {
   m_scrollPosition = (scrollPosition % m_height);
-  requestUpdate();
+  requestFullUpdate();
+}
+
+void AcCustomWidget::setFrameRate(uint framesPerSecond)
+{
+  if (!framesPerSecond) {
+    framesPerSecond = KDefaultFrameRate;
+  }
+  m_frameTimer.start(1000/framesPerSecond);
+}
+
+void AcCustomWidget::takeCounters(quint32 &frames, quint32 &pixels)
+{
+  QMutexLocker locker(&m_dirtyLock);
+  frames = m_frames;
+  pixels = m_pixels;
+  m_frames = 0;
+  m_pixels = 0;
 }
 
 void AcCustomWidget::paintEvent(QPaintEvent *pEvent)
 {
   QPainter qp(this);
 
+  QMutexLocker locker(&m_dirtyLock);
   if (m_on) {
-    for (uint x = 0; x < m_width; x++) {
-      for (uint y = 0; y < m_height; y++) {
-        qp.setPen(getPixel(x, y));
-        qp.drawPoint(x, y);
-      }
+    // The LCD RAM rows starting at the scroll position are shown on top
+    const int split = m_height - m_scrollPosition;
+    qp.drawImage(0, 0, m_image, 0, m_scrollPosition, m_width, split);
+    if (m_scrollPosition) {
+      qp.drawImage(0, split, m_image, 0, 0, m_width, m_scrollPosition);
     }
   } else {
-    const QColor colors[] = {
-      QColor(255, 0, 0),
-      QColor(0, 255, 0),
-      QColor(0, 0, 255),
-      QColor(255, 255, 0)
-    };
-
-    for (uint x = 0; x < m_width; x++) {
-      for (uint y = 0; y < m_height; y++) {
-        qp.setPen(colors[(x + y)%4].rgb());
-        qp.drawPoint(x, y);
-      }
-    }
+    qp.drawImage(0, 0, m_offImage);
   }
+  ++m_frames;
+  locker.unlock();
 
   QWidget::paintEvent(pEvent);
 }
 
-void AcCustomWidget::requestUpdate()
+void AcCustomWidget::frameTimeout()
 {
-  if (!nOutstandingRequestToUpdate) {
-    nOutstandingRequestToUpdate = true;
-    emit updateSignal();
+  QMutexLocker locker(&m_dirtyLock);
+  if (m_fullUpdate) {
+    m_fullUpdate = false;
+    m_dirty = QRect();
+    locker.unlock();
+    update();
+    return;
+  }
+  if (m_dirty.isEmpty()) {
+    return;
+  }
+  const QRect dirty = m_dirty;
+  m_dirty = QRect();
+  locker.unlock();
+
+  if (!m_on) {
+    return;
+  }
+  // Map the LCD RAM rows to the widget rows, the area might wrap around the bottom
+  const int top = (dirty.top() + m_height - m_scrollPosition) % m_height;
+  const int split = m_height - top;
+  if (dirty.height() <= split) {
+    update(dirty.left(), top, dirty.width(), dirty.height());
+  } else {
+    update(dirty.left(), top, dirty.width(), split);
+    update(dirty.left(), 0, dirty.width(), dirty.height() - split);
+  }
+}
+
+void AcCustomWidget::createImages()
+{
+  const QRgb colors[] = {
+    qRgb(255, 0, 0),
+    qRgb(0, 255, 0),
+    qRgb(0, 0, 255),
+    qRgb(255, 255, 0)
+  };
+
+  m_image = QImage(m_width, m_height, QImage::Format_RGB32);
+  m_image.fill(0xff000000u);
+  m_offImage = QImage(m_width, m_height, QImage::Format_RGB32);
+  for (uint y = 0; y < m_height; y++) {
+    QRgb *const line = reinterpret_cast<QRgb *>(m_offImage.scanLine(y));
+    for (uint x = 0; x < m_width; x++) {
+      line[x] = colors[(x + y)%4];
+    }
   }
 }
 
-void AcCustomWidget::xupdate()
+void AcCustomWidget::requestFullUpdate()
 {
-  update();
-  nOutstandingRequestToUpdate = false;
+  QMutexLocker locker(&m_dirtyLock);
+  m_fullUpdate = true;
 }
@@ -25,8 +25,16 @@
 #ifndef AC_CUSTOM_WIDGET_H
 #define AC_CUSTOM_WIDGET_H
 
+#include <QRect>
+#include <QImage>
+#include <QMutex>
+#include <QTimer>
 #include <QWidget>
 
+/**
+ * The LCD surface, the pixels are written to the image directly, the changed area
+ * is repainted by a timer, at most once per frame
+ */
 class AcCustomWidget : public QWidget
 {
   Q_OBJECT
@@ -37,31 +45,61 @@ public:
   void reset();
   void turn(bool on);
 
-  void setPixel(uint x, uint y, QRgb color);
   QRgb getPixel(uint x, uint y) const;
+  /**
+   * Get the LCD RAM for writing, valid until the size changes
+   * @param[out] stride The distance between the rows, in pixels
+   * @note The writer reports the changed area with \c pixelsChanged
+   */
+  QRgb *pixels(uint &stride);
+  /**
+   * Schedule the repaint of the changed LCD RAM area
+   * @param[in] area The changed area, in LCD RAM coordinates
+   * @param[in] count The number of the written pixels, for the statistics
+   */
+  void pixelsChanged(const QRect &area, quint32 count);
 
   uint width() const;
   uint height() const;
   void setSize(uint width, uint height);
   void setScrollPosition(uint scrollPosition);
 
+  /**
+   * Set the maximum number of the repaints per second
+   */
+  void setFrameRate(uint framesPerSecond);
+  /**
+   * Get the number of the repaints and the written pixels since the last call
+   */
+  void takeCounters(quint32 &frames, quint32 &pixels);
+
 protected:
-  void requestUpdate();
   void paintEvent(QPaintEvent *pEvent);
 
 protected slots:
-  void xupdate();
+  void frameTimeout();
 
-signals:
-  void updateSignal();
+private:
+  void createImages();
+  void requestFullUpdate();
 
 private:
   bool m_on;
   uint m_width;
   uint m_height;
   uint m_scrollPosition;
-  quint32 *m_pScreenData;
-  bool nOutstandingRequestToUpdate;
+  /** The LCD RAM, the scroll position is applied on painting */
+  QImage m_image;
+  /** The test pattern shown while the LCD is off */
+  QImage m_offImage;
+  QTimer m_frameTimer;
+  /** Protects the dirty area, the pixels are written from the core thread */
+  QMutex m_dirtyLock;
+  /** The changed area of the LCD RAM, not repainted yet */
+  QRect m_dirty;
+  bool m_fullUpdate;
+  quint32 m_frames;
+  quint32 m_pixels;
 };
 
 #endif /* AC_CUSTOM_WIDGET_H */
@@ -25,16 +25,186 @@
 
 #include "gsm-engine.h"
 
+#include "hw-uart.h"
+#include "scheduler.h"
+
+#include <stdio.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#define MCODE_GSM_EMU_LINE_LENGTH (512)
+
+/**
+ * Extra emulated GSM modem, talks to 'mcode-simulator -p <N>' via
+ * the '/var/tmp/sim-to-mcode-<N>' and '/var/tmp/mcode-to-sim-<N>' FIFOs
+ */
+typedef struct {
+  gsm_engine_t engine;
+  MGsmTransport transport;
+  int inPipe;
+  int outPipe;
+  int number;
+  size_t lineLength;
+  size_t outLength;
+  char line[MCODE_GSM_EMU_LINE_LENGTH];
+  char out[1024];
+  MUartStats stats;
+} TGsmEmuPort;
+
+static int TheGsmEmuPortCount = 0;
+static TGsmEmuPort TheGsmEmuPorts[MCODE_GSM_INSTANCES - 1];
+
+static void gsm_emu_ports_tick(void);
+static void gsm_emu_port_flush(TGsmEmuPort *port);
+static void gsm_emu_port_write_char(void *ctx, char ch);
+static void gsm_emu_port_handle_char(TGsmEmuPort *port, char ch);
+
 void hw_gsm_init(void)
 {
+  int i;
+  int res;
+  char name[64];
+  const char *const ports = getenv("MCODE_GSM_PORTS");
+
   /* Turn GSM power ON on default */
   hw_gsm_power(true);
+
+  /* 'MCODE_GSM_PORTS=<N>' adds <N> extra modems next to the one on UART2 */
+  TheGsmEmuPortCount = ports ? atoi(ports) : 0;
+  if (TheGsmEmuPortCount <= 0) {
+    TheGsmEmuPortCount = 0;
+    return;
+  } else if (TheGsmEmuPortCount > MCODE_GSM_INSTANCES - 1) {
+    TheGsmEmuPortCount = MCODE_GSM_INSTANCES - 1;
+  }
+
+  for (i = 0; i < TheGsmEmuPortCount; ++i) {
+    TGsmEmuPort *const port = TheGsmEmuPorts + i;
+
+    memset(port, 0, sizeof (*port));
+    port->number = i + 1;
+    port->outPipe = -1;
+    port->transport.write_char = gsm_emu_port_write_char;
+    port->transport.ctx = port;
+
+    snprintf(name, sizeof (name), "/var/tmp/sim-to-mcode-%d", port->number);
+    res = mkfifo(name, S_IRUSR | S_IWUSR);
+    if (-1 == res && EEXIST != errno) exit(1);
+    port->inPipe = open(name, O_RDONLY | O_NONBLOCK);
+    if (-1 == port->inPipe) exit(1);
+
+    snprintf(name, sizeof (name), "/var/tmp/mcode-to-sim-%d", port->number);
+    res = mkfifo(name, S_IRUSR | S_IWUSR);
+    if (-1 == res && EEXIST != errno) exit(1);
+
+    gsm_engine_init(&port->engine, &port->transport);
+  }
+
+  scheduler_add(gsm_emu_ports_tick);
 }
 
 void hw_gsm_deinit(void)
 {
+  int i;
+
+  for (i = 0; i < TheGsmEmuPortCount; ++i) {
+    TGsmEmuPort *const port = TheGsmEmuPorts + i;
+
+    gsm_engine_deinit(&port->engine);
+    close(port->inPipe);
+    if (-1 != port->outPipe) {
+      close(port->outPipe);
+    }
+  }
+  TheGsmEmuPortCount = 0;
 }
 
 void hw_gsm_power(bool on)
 {
 }
+
+void gsm_emu_ports_tick(void)
+{
+  int i;
+  ssize_t j;
+  ssize_t res;
+  char buffer[128];
+
+  for (i = 0; i < TheGsmEmuPortCount; ++i) {
+    TGsmEmuPort *const port = TheGsmEmuPorts + i;
+
+    gsm_emu_port_flush(port);
+
+    res = read(port->inPipe, buffer, sizeof (buffer));
+    for (j = 0; j < res; ++j) {
+      gsm_emu_port_handle_char(port, buffer[j]);
+    }
+  }
+}
+
+void gsm_emu_port_flush(TGsmEmuPort *port)
+{
+  ssize_t res;
+  char name[64];
+
+  /* The write side can only be opened when the simulator is reading */
+  if (-1 == port->outPipe) {
+    snprintf(name, sizeof (name), "/var/tmp/mcode-to-sim-%d", port->number);
+    port->outPipe = open(name, O_WRONLY | O_NONBLOCK);
+  }
+  if (-1 != port->outPipe && port->outLength) {
+    res = write(port->outPipe, port->out, port->outLength);
+    if (res > 0) {
+      port->outLength -= res;
+      port->stats.txBytes += res;
+      memmove(port->out, port->out + res, port->outLength);
+    }
+  }
+}
+
+void gsm_emu_port_write_char(void *ctx, char ch)
+{
+  TGsmEmuPort *const port = (TGsmEmuPort *)ctx;
+
+  if (port->outLength >= sizeof (port->out)) {
+    /* The buffer is full, pass it to the simulator straight away */
+    gsm_emu_port_flush(port);
+  }
+  if (port->outLength < sizeof (port->out)) {
+    port->out[port->outLength++] = ch;
+  } else {
+    /* The simulator does not read, the character is lost */
+    ++port->stats.txOverruns;
+  }
+}
+
+void gsm_emu_port_handle_char(TGsmEmuPort *port, char ch)
+{
+  if (ch <= 0) {
+    return;
+  }
+
+  if ('\n' == ch && port->lineLength && '\r' == port->line[port->lineLength - 1]) {
+    /* Complete line, report it without the '\r\n' terminator */
+    --port->lineLength;
+  } else if (port->lineLength < sizeof (port->line) - 1) {
+    port->line[port->lineLength++] = ch;
+    /* The '> ' prompt is not followed by '\r\n' */
+    if (2 != port->lineLength || '>' != port->line[0] || ' ' != port->line[1]) {
+      return;
+    }
+  } else {
+    /* Too long line, drop it */
+    port->lineLength = 0;
+    return;
+  }
+
+  port->line[port->lineLength] = 0;
+  gsm_engine_input(&port->engine, port->line, port->lineLength);
+  port->lineLength = 0;
+}
@@ -25,58 +25,27 @@
 #include "hw-lcd.h"
 
 #include "main.h"
+#include "fonts.h"
 #include "mtick.h"
 #include "hw-i80.h"
 #include "hw-lcd.h"
 #include "mstring.h"
 #include "console.h"
+#include "lcd-s95513.h"
+#include "lcd-headless.h"
 #include "customwidget.h"
 
-#define LCD_SET_SCROLL_START UINT8_C(0x37)
-#define LCD_S95513_WR_RAM_START UINT8_C(0x2C)
-#define LCD_S95513_WR_RAM_CONT UINT8_C(0x3C)
-#define LCD_S95513_SET_COLUMN_ADDR UINT8_C(0x2A)
-#define LCD_S95513_SET_PAGE_ADDR UINT8_C(0x2B)
-
-enum EmuState {
-  EmuStateIdle,
-  EmuStateUnbuffered,
-  EmuStateInProg,
-  EmuStateFinished,
-  EmuStateError
-};
-
-// Command data buffer management
-static const uint32_t KBufferSize = 24;
-static uint32_t TheBufferIndex = 0;
-static uint8_t TheBuffer[KBufferSize];
-static EmuState TheEmuState = EmuStateIdle;
-
-static uint16_t ThePageEnd = 0;
-static uint16_t TheNextPage = 0;
-static uint16_t ThePageStart = 0;
-static uint16_t TheColumnEnd = 0;
-static uint8_t TheNormalFlag = 1;
-static uint16_t TheNextColumn = 0;
-static uint16_t TheColumnStart = 0;
-static uint8_t TheCurrentCommand = 0;
+#include <string.h>
+#include <QElapsedTimer>
 
+static MLcdStats TheStats = {0, 0, 0, 0, 0};
+static QElapsedTimer TheStatsTimer;
+/** The LCD widget, \c NULL if the LCD is headless */
 static AcCustomWidget *TheWidget = NULL;
 
-static uint32_t emu_hw_lcd_s95513_to_color(quint32 data);
-static void emu_hw_lcd_s95513_set_pixel(int x, int y, quint32 color);
-
-/**
- * Commands
- */
-static void emu_hw_lcd_set_scroll_pos();
-static void emu_hw_lcd_s95513_handle_data_write_ram(uint16_t word);
-static void emu_hw_lcd_s95513_handle_data_set_page_addr(uint8_t byte);
-static void emu_hw_lcd_s95513_handle_data_set_column_addr(uint8_t byte);
-
-static void emu_hw_lcd_s95513_handle_cmd(uint8_t cmd);
-static void emu_hw_lcd_s95513_handle_data_byte(uint8_t byte);
-static void emu_hw_lcd_s95513_handle_data_word(uint16_t word);
+static void emu_hw_lcd_s95513_set_surface();
+static void emu_hw_lcd_s95513_scroll(uint16_t position);
+static void emu_hw_lcd_s95513_changed(uint16_t x, uint16_t y, uint16_t width, uint16_t height, uint32_t count);
 
 void hw_i80_read(uint8_t cmd, uint8_t length, uint8_t *data)
 {
@@ -85,9 +54,9 @@ void hw_i80_read(uint8_t cmd, uint8_t length, uint8_t *data)
 void hw_i80_write(uint8_t cmd, uint8_t length, const uint8_t *data)
 {
   uint8_t i;
-  emu_hw_lcd_s95513_handle_cmd(cmd);
+  s95513_cmd(cmd);
   for (i = 0; i < length; ++i) {
-    emu_hw_lcd_s95513_handle_data_byte(*data++);
+    s95513_data_byte(*data++);
   }
 }
 
@@ -97,26 +66,28 @@ void lcd_device_init(void)
 
 void lcd_write_cmd(uint8_t cmd)
 {
-  emu_hw_lcd_s95513_handle_cmd(cmd);
+  s95513_cmd(cmd);
 }
 
 void lcd_write_byte(uint8_t data)
 {
-  emu_hw_lcd_s95513_handle_data_byte(data);
+  s95513_data_byte(data);
 }
 
 void emu_hw_lcd_s95513_write_words(uint8_t cmd, uint8_t length, const uint16_t *data)
 {
-  uint8_t i;
-  emu_hw_lcd_s95513_handle_cmd(cmd);
-  for (i = 0; i < length; ++i) {
-    emu_hw_lcd_s95513_handle_data_word(*data++);
-  }
+  s95513_cmd(cmd);
+  s95513_data_words(data, length);
 }
 
 void hw_i80_reset(void)
 {
-  TheWidget->reset();
+  if (TheWidget) {
+    TheWidget->reset();
+  } else {
+    lcd_headless_reset();
+  }
+  s95513_reset();
 
   console_set_color(UINT16_C(0xFFFF));
   console_set_bg_color(UINT16_C(0x0000));
@@ -124,226 +95,104 @@ void hw_i80_reset(void)
   console_clear_screen();
 }
 
-void emu_hw_lcd_s95513_set_pixel(int x, int y, quint32 color)
+void hw_i80_write_bitmap(uint8_t cmd, uint16_t length, const uint8_t *pData, uint16_t offValue, uint16_t onValue)
 {
-  TheWidget->setPixel(x, y, color);
+  s95513_cmd(cmd);
+  s95513_data_bitmap(pData, 8u*length, offValue, onValue);
 }
 
-void hw_i80_write_bitmap(uint8_t cmd, uint16_t length, const uint8_t *pData, uint16_t offValue, uint16_t onValue)
+void hw_i80_write_text(uint8_t cmd, const char *text, uint8_t length, uint16_t offValue, uint16_t onValue)
 {
-  uint8_t bitMask;
-  uint8_t currentByte;
-  const uint8_t *const pDataEnd = pData + length;
-
-  emu_hw_lcd_s95513_handle_cmd (cmd);
-  /* write loop */
-  currentByte = *pData++;
-  for (bitMask = UINT8_C (0x01); ; ) {
-    emu_hw_lcd_s95513_handle_data_word ((currentByte & bitMask) ? onValue : offValue);
-    bitMask = (bitMask << 1);
-    if (!bitMask) {
-      if (pData < pDataEnd) {
-        bitMask = UINT8_C (0x01);
-        currentByte = *pData++;
-      } else {
-        break;
-      }
+  uint8_t i;
+  uint8_t row;
+  uint8_t bitmap[UINT8_MAX];
+
+  s95513_cmd(cmd);
+  /* the glyph rows are streamed across the whole run, 1 byte per glyph row */
+  for (row = 0; row < 8; ++row) {
+    for (i = 0; i < length; ++i) {
+      bitmap[i] = mcode_fonts_get_char_bitmap(text[i])[row];
     }
+    s95513_data_bitmap(bitmap, 8u*length, offValue, onValue);
   }
 }
 
-uint32_t emu_hw_lcd_s95513_to_color(uint32_t data)
+void hw_i80_write_words(const uint16_t *data, uint16_t count)
 {
-  const uint8_t red =   (0xffu&((0xf800U&data)>>8));
-  const uint8_t green = (0xffu&((0x07E0U&data)>>3));
-  const uint8_t blue =  (0xffu&((0x001FU&data)<<3));
-  return 0xff000000u|(red << 16)|(green << 8)| blue;
+  s95513_data_words(data, count);
 }
 
-void emu_hw_lcd_s95513_handle_cmd(uint8_t cmd)
+void lcd_stats(MLcdStats *stats, bool reset)
 {
-  TheNormalFlag = 1;
-  TheBufferIndex = 0;
-  TheCurrentCommand = cmd;
-
-  switch (cmd)
-  {
-  case LCD_S95513_WR_RAM_START:
-    TheNextPage = ThePageStart;
-    TheNextColumn = TheColumnStart;
-    TheEmuState = EmuStateUnbuffered;
-    break;
-  default:
-    TheEmuState = EmuStateIdle;
-    break;
-  }
-}
+  quint32 frames = 0;
+  quint32 pixels = 0;
+  MS95513Stats *const decoder = s95513_stats();
 
-void emu_hw_lcd_s95513_handle_data_byte(uint8_t byte)
-{
-  if (EmuStateIdle == TheEmuState) {
-    TheEmuState = EmuStateInProg;
-  } else if (EmuStateFinished == TheEmuState || EmuStateError == TheEmuState) {
-    if (EmuStateFinished == TheEmuState) {
-      mprintstrln("emu_hw_lcd_s95513_handle_data_byte: finished");
-    } else {
-      mprintstrln("emu_hw_lcd_s95513_handle_data_byte: error");
-    }
-    return;
-  }
-
-  if (EmuStateInProg == TheEmuState) {
-    if (TheBufferIndex < KBufferSize) {
-      TheBuffer[TheBufferIndex++] = byte;
-    } else {
-      mprintstrln("emu_hw_lcd_s95513_handle_data_byte: data buffer overflow");
-      return;
-    }
+  if (TheWidget) {
+    TheWidget->takeCounters(frames, pixels);
+  } else {
+    pixels = lcd_headless_take_pixels();
   }
-
-  switch (TheCurrentCommand)
-  {
-  case LCD_SET_SCROLL_START:
-    if (2 == TheBufferIndex) {
-      emu_hw_lcd_set_scroll_pos();
-      TheEmuState = EmuStateFinished;
-    }
-    break;
-  case LCD_S95513_WR_RAM_CONT:
-  case LCD_S95513_WR_RAM_START:
-    emu_hw_lcd_s95513_handle_data_write_ram (byte);
-  case LCD_S95513_SET_COLUMN_ADDR:
-    if (4 == TheBufferIndex) {
-      emu_hw_lcd_s95513_handle_data_set_column_addr (byte);
-      TheEmuState = EmuStateFinished;
-    }
-    break;
-  case LCD_S95513_SET_PAGE_ADDR:
-    if (4 == TheBufferIndex) {
-      emu_hw_lcd_s95513_handle_data_set_page_addr (byte);
-      TheEmuState = EmuStateFinished;
-    }
-    break;
-  default:
-    mprintstr(PSTR("EMU: emu_hw_lcd_s95513_handle_data_byte (cmd: "));
-    mprint_uintd(TheCurrentCommand, 0);
-    mprintstr(", byte: ");
-    mprint_uintd(byte, 0);
-    mprint(MStringNewLine);
-    break;
+  TheStats.commands += decoder->commands;
+  TheStats.data += decoder->data;
+  memset(decoder, 0, sizeof (*decoder));
+  TheStats.frames += frames;
+  TheStats.pixels += pixels;
+  TheStats.time = TheStatsTimer.isValid() ? TheStatsTimer.elapsed() : 0;
+  *stats = TheStats;
+
+  if (reset) {
+    memset(&TheStats, 0, sizeof (TheStats));
+    TheStatsTimer.start();
   }
 }
 
-void emu_hw_lcd_s95513_handle_data_word(uint16_t word)
+uint16_t lcd_get_width(void)
 {
-  if (EmuStateIdle == TheEmuState) {
-    TheEmuState = EmuStateInProg;
-  } else if (EmuStateFinished == TheEmuState || EmuStateError == TheEmuState) {
-    if (EmuStateFinished == TheEmuState) {
-      mprintstrln(PSTR("emu_hw_lcd_s95513_handle_data_word: finished"));
-    } else {
-      mprintstrln(PSTR("emu_hw_lcd_s95513_handle_data_word: error"));
-    }
-    return;
-  }
-
-  if (EmuStateInProg == TheEmuState) {
-    if (TheBufferIndex < KBufferSize) {
-      TheBuffer[TheBufferIndex++] = static_cast<uint8_t>(word);
-    } else {
-      mprintstrln(PSTR("emu_hw_lcd_s95513_handle_data_word: data buffer overflow"));
-      return;
-    }
-  }
-
-  switch (TheCurrentCommand)
-  {
-  case LCD_SET_SCROLL_START:
-    if (2 == TheBufferIndex) {
-      emu_hw_lcd_set_scroll_pos();
-      TheEmuState = EmuStateFinished;
-    }
-    break;
-  case LCD_S95513_WR_RAM_CONT:
-  case LCD_S95513_WR_RAM_START:
-    emu_hw_lcd_s95513_handle_data_write_ram (word);
-    break;
-  case LCD_S95513_SET_COLUMN_ADDR:
-    if (4 == TheBufferIndex) {
-      emu_hw_lcd_s95513_handle_data_set_column_addr ((uint8_t) word);
-      TheEmuState = EmuStateFinished;
-    }
-    break;
-  case LCD_S95513_SET_PAGE_ADDR:
-    if (4 == TheBufferIndex) {
-      emu_hw_lcd_s95513_handle_data_set_page_addr ((uint8_t) word);
-      TheEmuState = EmuStateFinished;
-    }
-    break;
-  default:
-    mprintstr(PSTR("EMU: emu_hw_lcd_s95513_handle_data_word (cmd: "));
-    mprint_uintd(TheCurrentCommand, 0);
-    mprintstr(PSTR(", word: "));
-    mprint_uintd(word, 0);
-    mprint(MStringNewLine);
-    break;
+  if (TheWidget) {
+    return TheWidget->width();
   }
+  return lcd_headless_header() ? lcd_headless_header()->width : 0;
 }
 
-void emu_hw_lcd_s95513_handle_data_set_page_addr(uint8_t byte)
-{
-  Q_ASSERT(4 == TheBufferIndex);
-
-  ThePageStart = (TheBuffer[0] << 8) | TheBuffer[1];
-  ThePageEnd = (TheBuffer[2] << 8) | TheBuffer[3];
-}
-
-void emu_hw_lcd_s95513_handle_data_set_column_addr(uint8_t byte)
-{
-  Q_ASSERT(4 == TheBufferIndex);
-
-  TheColumnStart = (TheBuffer[0] << 8) | TheBuffer[1];
-  TheColumnEnd = (TheBuffer[2] << 8) | TheBuffer[3];
-}
-
-void emu_hw_lcd_s95513_handle_data_write_ram(uint16_t word)
+uint16_t lcd_get_height(void)
 {
-  if (TheNormalFlag) {
-    /* got next color sample, put it to the surface */
-    const uint32_t color = emu_hw_lcd_s95513_to_color (word);
-    emu_hw_lcd_s95513_set_pixel (TheNextColumn, TheNextPage, color);
-
-    TheNextColumn++;
-    if (TheNextColumn > TheColumnEnd) {
-      TheNextColumn = TheColumnStart;
-      TheNextPage++;
-      if (TheNextPage > ThePageEnd) {
-        TheNormalFlag = 0;
-      }
-    }
+  if (TheWidget) {
+    return TheWidget->height();
   }
+  return lcd_headless_header() ? lcd_headless_header()->height : 0;
 }
 
-uint16_t lcd_get_width(void)
+void lcd_set_size(uint16_t width, uint16_t height)
 {
-  return TheWidget->width();
+  /* the LCD RAM is reallocated */
+  if (TheWidget) {
+    TheWidget->setSize(width, height);
+    emu_hw_lcd_s95513_set_surface();
+  } else {
+    lcd_headless_init(width, height);
+  }
+  console_init();
+  console_clear_screen();
 }
 
-uint16_t lcd_get_height(void)
+void lcd_turn(bool on)
 {
-  return TheWidget->height();
+  if (TheWidget) {
+    TheWidget->turn(on);
+  } else {
+    lcd_headless_turn(on);
+  }
 }
 
-void lcd_set_size(uint16_t width, uint16_t height)
+uint32_t lcd_frame_crc(void)
 {
-  TheWidget->setSize(width, height);
-  console_init();
-  console_clear_screen();
+  return s95513_frame_crc();
 }
 
-void lcd_turn(bool on)
+bool lcd_snapshot(const char *path)
 {
-  TheWidget->turn(on);
+  return s95513_snapshot(path);
 }
 
 void lcd_set_bl(bool on)
@@ -367,35 +216,55 @@ void hw_i80_write_const(uint8_t cmd, uint16_t constValue, uint16_t length)
 
 void hw_i80_write_const_long(uint8_t cmd, uint16_t constValue, uint32_t length)
 {
-  uint32_t i;
-  emu_hw_lcd_s95513_handle_cmd(cmd);
-  for (i = 0; i < length; ++i) {
-    emu_hw_lcd_s95513_handle_data_word(constValue);
-  }
+  s95513_cmd(cmd);
+  s95513_data_const(constValue, length);
 }
 
 void lcd_init(uint16_t width, uint16_t height)
 {
-  if (!TheWidget) {
+  if (main_headless()) {
+    if (!lcd_headless_header() && lcd_headless_init(width, height)) {
+      mprintstr(PSTR("LCD: "));
+      mprintstrln(lcd_headless_name());
+      TheStatsTimer.start();
+    }
+  } else if (!TheWidget) {
     TheWidget = new AcCustomWidget(width, height);
+    TheWidget->setFrameRate(main_frame_rate());
+    emu_hw_lcd_s95513_set_surface();
     TheWidget->show();
+    TheStatsTimer.start();
   }
 }
 
 void lcd_deinit(void)
 {
+  lcd_headless_deinit();
+  s95513_set_surface(NULL);
   delete TheWidget;
   TheWidget = NULL;
 }
 
-void emu_hw_lcd_set_scroll_pos()
+void emu_hw_lcd_s95513_set_surface()
 {
-  Q_ASSERT(2 == TheBufferIndex);
+  uint stride = 0;
+  MS95513Surface surface;
+
+  surface.pixels = TheWidget->pixels(stride);
+  surface.stride = stride;
+  surface.width = TheWidget->width();
+  surface.height = TheWidget->height();
+  surface.changed = emu_hw_lcd_s95513_changed;
+  surface.scroll = emu_hw_lcd_s95513_scroll;
+  s95513_set_surface(&surface);
+}
 
-  if (TheWidget) {
-    const uint scrollPos = (static_cast<uint>(TheBuffer[0]) << 8) | (TheBuffer[1]);
-    TheWidget->setScrollPosition(scrollPos);
-  } else {
-    mprintstrln(PSTR("lcd_set_scroll_start: no widget"));
-  }
+void emu_hw_lcd_s95513_scroll(uint16_t position)
+{
+  TheWidget->setScrollPosition(position);
+}
+
+void emu_hw_lcd_s95513_changed(uint16_t x, uint16_t y, uint16_t width, uint16_t height, uint32_t count)
+{
+  TheWidget->pixelsChanged(QRect(x, y, width, height), count);
 }
@@ -0,0 +1,90 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Alexander Chumakov
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "hw-rtc.h"
+
+#include "mstring.h"
+#include "scheduler.h"
+#include "twi-queue.h"
+#include "twi-ds3231.h"
+
+static bool TheAlarmEnabled = false;
+
+static void rtc_alarm_tick(void);
+static bool rtc_alarm_check_status(uint8_t status);
+
+void rtc_alarm_init(void)
+{
+  TheAlarmEnabled = true;
+  scheduler_add(rtc_alarm_tick);
+}
+
+void rtc_alarm_deinit(void)
+{
+  TheAlarmEnabled = false;
+}
+
+void rtc_first_time_init(void)
+{
+  /* Control: INTCN, A2IE, A1IE; status: clear OSF and the alarm flags */
+  static const uint8_t buffer[] = { 0x0eu, 0x07u, 0x08u };
+
+  if (!twi_queue_transfer_sync(TWI_DS3231_ADDRESS, sizeof (buffer), buffer, 0, NULL)) {
+    merror(MStringInternalError);
+  }
+}
+
+void rtc_alarm_tick(void)
+{
+  uint8_t buffer;
+
+  /* The INT pin of the model instead of INT1 on AVR */
+  twi_ds3231_update();
+  if (!TheAlarmEnabled || !twi_ds3231_interrupt() || twi_queue_busy()) {
+    return;
+  }
+
+  buffer = 0x0fu;
+  if (twi_queue_transfer_sync(TWI_DS3231_ADDRESS, 1, &buffer, 1, &buffer)) {
+    rtc_alarm_check_status(buffer);
+  }
+}
+
+bool rtc_alarm_check_status(uint8_t status)
+{
+  uint8_t buffer[2];
+
+  if (status & 0x01u) {
+    mprintstrln(PSTR("Alarm1: triggered."));
+  }
+  if (status & 0x02u) {
+    mprintstrln(PSTR("Alarm2: triggered."));
+  }
+
+  /* Clear the alarm flags, the INT pin is released */
+  buffer[0] = 0x0fu;
+  buffer[1] = status & ~0x03u;
+  return twi_queue_transfer_sync(TWI_DS3231_ADDRESS, 2, buffer, 0, NULL);
+}
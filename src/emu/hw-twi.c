@@ -0,0 +1,243 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Alexander Chumakov
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "hw-twi.h"
+
+#include "mparser.h"
+#include "mstring.h"
+#include "twi-bus.h"
+#include "cmd-iface.h"
+#include "scheduler.h"
+#include "twi-24cxx.h"
+#include "twi-ds3231.h"
+
+#include <string.h>
+
+/** The emulated EEPROM: 24C32, as on the DS3231 modules */
+#define TWI_EMU_EEPROM_SIZE (4096u)
+#define TWI_EMU_EEPROM_PAGE (32u)
+
+typedef enum {
+  ETwiEmuIdle = 0,
+  ETwiEmuWriting,
+  ETwiEmuReading,
+} TTwiEmuState;
+
+CMD_IMPL("twi-stats", TheTwiStats, "Show/<reset> the emulated TWI bus statistics", cmd_twi_emu_stats, NULL, 0);
+
+static uint8_t TheState = ETwiEmuIdle;
+static bool TheAck;
+static uint8_t TheLength;
+static uint64_t TheDoneAt;              /**< The end of the transfer, the bus time */
+static uint8_t TheReadBuffer[256];
+static mcode_done TheWriteCallback;
+static mcode_read_ready TheReadCallback;
+static MTwi24cxx TheEeprom;
+
+static bool TheSuccess;
+static uint8_t *TheBuffer;
+
+static void twi_emu_tick(void);
+static void twi_emu_start(uint8_t state, uint8_t length);
+static void twi_write_done(bool success);
+static void twi_read_ready(bool success, uint8_t length, const uint8_t *data);
+
+void twi_init(void)
+{
+  TheState = ETwiEmuIdle;
+  twi_bus_init();
+  twi_bus_attach(twi_ds3231_init());
+  if (twi_24cxx_init(&TheEeprom, TWI_24CXX_ADDRESS, TWI_EMU_EEPROM_SIZE, TWI_EMU_EEPROM_PAGE)) {
+    twi_bus_attach(&TheEeprom.device);
+  }
+  scheduler_add(twi_emu_tick);
+}
+
+void twi_deinit(void)
+{
+  twi_bus_deinit();
+  twi_24cxx_deinit(&TheEeprom);
+}
+
+void twi_recv(uint8_t addr, uint8_t length, mcode_read_ready callback)
+{
+  if (ETwiEmuIdle != TheState) {
+    /* Busy, cannot handle request */
+    if (callback) {
+      (*callback)(false, 0, NULL);
+    }
+    return;
+  }
+
+  TheReadCallback = callback;
+  TheAck = twi_bus_read(addr, length, TheReadBuffer);
+  twi_emu_start(ETwiEmuReading, length);
+}
+
+void twi_send(uint8_t addr, uint8_t length, const uint8_t *data, mcode_done callback)
+{
+  if (ETwiEmuIdle != TheState) {
+    if (callback) {
+      (*callback)(false);
+    }
+    return;
+  }
+
+  TheWriteCallback = callback;
+  TheAck = twi_bus_write(addr, length, data);
+  twi_emu_start(ETwiEmuWriting, length);
+}
+
+bool twi_recv_sync(uint8_t addr, uint8_t length, uint8_t *data)
+{
+  if (ETwiEmuIdle != TheState) {
+    return false;
+  }
+
+  TheSuccess = false;
+  TheBuffer = data;
+  twi_recv(addr, length, twi_read_ready);
+  scheduler_start();
+
+  return TheSuccess;
+}
+
+bool twi_send_sync(uint8_t addr, uint8_t length, const uint8_t *data)
+{
+  if (ETwiEmuIdle != TheState) {
+    return false;
+  }
+
+  TheSuccess = false;
+  twi_send(addr, length, data, twi_write_done);
+  scheduler_start();
+
+  return TheSuccess;
+}
+
+void twi_emu_start(uint8_t state, uint8_t length)
+{
+  /* The data is exchanged at once, the completion is reported after the bus time */
+  TheState = state;
+  TheLength = TheAck ? length : 0;
+  TheDoneAt = twi_bus_now() + twi_bus_transfer_time(TheAck ? length : 0);
+}
+
+void twi_emu_tick(void)
+{
+  const uint8_t state = TheState;
+
+  if (ETwiEmuIdle == state || twi_bus_now() < TheDoneAt) {
+    return;
+  }
+
+  TheState = ETwiEmuIdle;
+  if (ETwiEmuWriting == state) {
+    if (TheWriteCallback) {
+      (*TheWriteCallback)(TheAck);
+    }
+  } else if (TheReadCallback) {
+    (*TheReadCallback)(TheAck, TheLength, TheAck ? TheReadBuffer : NULL);
+  }
+}
+
+void twi_write_done(bool success)
+{
+  TheSuccess = success;
+  scheduler_stop();
+}
+
+void twi_read_ready(bool success, uint8_t length, const uint8_t *data)
+{
+  TheSuccess = success;
+  if (success) {
+    memcpy(TheBuffer, data, length);
+  }
+  TheBuffer = NULL;
+  scheduler_stop();
+}
+
+bool cmd_twi_emu_stats(const TCmdData *data, const char *args,
+                       size_t args_len, bool *start_cmd)
+{
+  uint8_t i;
+  TokenType type;
+  uint32_t value;
+  const char *token;
+  MTwiDevice *device;
+  const MTwiBusStats *const stats = twi_bus_stats();
+  const uint64_t elapsed = twi_bus_now() - stats->since;
+
+  type = next_token(&args, &args_len, &token, &value);
+  if (TokenId == type && !mparser_strcmp_P(token, value, PSTR("reset"))) {
+    twi_bus_stats_reset();
+    if (TheEeprom.data) {
+      twi_24cxx_stats_reset(&TheEeprom);
+    }
+    return true;
+  }
+
+  for (i = 0; i < TWI_BUS_DEVICES; ++i) {
+    device = twi_bus_device(i);
+    if (!device) {
+      continue;
+    }
+    mprintstr(device->name);
+    mprintstr(PSTR(" 0x"));
+    mprint_uint8(device->addr, false);
+    mprintstr(PSTR(": writes: "));
+    mprint_uintd(device->stats.writes, 0);
+    mprintstr(PSTR(", reads: "));
+    mprint_uintd(device->stats.reads, 0);
+    mprintstr(PSTR(", NACKs: "));
+    mprint_uintd(device->stats.nacks, 0);
+    mprintstr(PSTR(", bytes written: "));
+    mprint_uintd((uint32_t)device->stats.bytesWritten, 0);
+    mprintstr(PSTR(", bytes read: "));
+    mprint_uintd((uint32_t)device->stats.bytesRead, 0);
+    mprintstr(PSTR(", bus time, us: "));
+    mprint_uintd((uint32_t)device->stats.busTime, 0);
+    mprint(MStringNewLine);
+  }
+
+  mprintstr(PSTR("24Cxx wear: write cycles: "));
+  mprint_uintd(TheEeprom.stats.writeCycles, 0);
+  mprintstr(PSTR(", max page cycles: "));
+  mprint_uintd(TheEeprom.stats.maxWear, 0);
+  mprintstr(PSTR(", wrapped bytes: "));
+  mprint_uintd(TheEeprom.stats.wrapped, 0);
+  mprintstr(PSTR(", busy NACKs: "));
+  mprint_uintd(TheEeprom.stats.busyNacks, 0);
+  mprint(MStringNewLine);
+
+  mprintstr(PSTR("Bus: transfers: "));
+  mprint_uintd(stats->transfers, 0);
+  mprintstr(PSTR(", unrouted: "));
+  mprint_uintd(stats->unrouted, 0);
+  mprintstr(PSTR(", utilisation, 0.01%: "));
+  mprint_uintd(elapsed ? (uint32_t)(stats->busTime*10000u/elapsed) : 0, 0);
+  mprint(MStringNewLine);
+  return true;
+}
@@ -24,10 +24,12 @@
 
 #include "hw-uart.h"
 
+#include "mring.h"
 #include "mglobal.h"
 #include "mstring.h"
 #include "scheduler.h"
 
+#include <poll.h>
 #include <stdio.h>
 #include <assert.h>
 #include <stdlib.h>
@@ -37,25 +39,30 @@
 #include <pthread.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/eventfd.h>
 
 #include <fcntl.h>
 #include <errno.h>
 
 static bool TheQuitRequest = false;
-static char TheBuffer[128] = {0};
-static size_t TheBufferWrIndex = 0;
-static size_t TheBufferRdIndex = 0;
+static MRing TheRing;                   /**< The key-event thread to the scheduler tick */
+static char TheBuffer[1024] = {0};
+static MUartStats TheStats;
 static int running_request = 0;
 static pthread_t TheKeyEventThread = 0;
 static struct termios TheStoredTermIos;
 
 #ifdef MCODE_UART2
-static int TheInPipe = 0;
-static int TheOutPipe = 0;
+static int TheInPipe = -1;
+static int TheOutPipe = -1;
 static bool TheOutPipeOpened = false;
-static char TheUart2OutBuffer[256] = {0};
-static size_t TheUart2OutBufferRdIndex = 0;
-static size_t TheUart2OutBufferWrIndex = 0;
+static int TheUart2TxEvent = -1;        /**< Wakes the write thread up, TX ring is not empty */
+static int TheUart2QuitEvent = -1;      /**< Wakes both UART2 threads up on exit */
+static MRing TheUart2RxRing;            /**< The read thread to the scheduler tick */
+static MRing TheUart2TxRing;            /**< 'uart2_write_char' to the write thread */
+static char TheUart2RxBuffer[4096] = {0};
+static char TheUart2TxBuffer[4096] = {0};
+static MUartStats TheUart2Stats;
 static pthread_t TheUart2ReadThreadId = 0;
 static pthread_t TheUart2WriteThreadId = 0;
 
@@ -76,6 +83,7 @@ void hw_uart_init(void)
     tcgetattr(STDIN_FILENO, &TheStoredTermIos);
 
     long t = 0;
+    mring_init(&TheRing, TheBuffer, sizeof (TheBuffer));
     running_request = 1;
     res = pthread_create(&TheKeyEventThread, NULL, emu_hw_uart_thread, (void *)t);
     if (res) {
@@ -90,13 +98,22 @@ void hw_uart_init(void)
   }
 
 #ifdef MCODE_UART2
+  if (-1 == TheUart2QuitEvent) {
+    TheUart2TxEvent = eventfd(0, EFD_NONBLOCK);
+    TheUart2QuitEvent = eventfd(0, EFD_NONBLOCK);
+    if (-1 == TheUart2TxEvent || -1 == TheUart2QuitEvent) {
+      exit(-1);
+    }
+  }
   if (!TheUart2ReadThreadId) {
+    mring_init(&TheUart2RxRing, TheUart2RxBuffer, sizeof (TheUart2RxBuffer));
     res = pthread_create(&TheUart2ReadThreadId, NULL, emu_hw_uart2_read_thread, NULL);
     if (res) {
       exit(-1);
     }
   }
   if (!TheUart2WriteThreadId) {
+    mring_init(&TheUart2TxRing, TheUart2TxBuffer, sizeof (TheUart2TxBuffer));
     res = pthread_create(&TheUart2WriteThreadId, NULL, emu_hw_uart2_write_thread, NULL);
     if (res) {
       exit(-1);
@@ -127,18 +144,35 @@ void hw_uart_deinit(void)
 
     /* restore the original termios attributes */
     tcsetattr( STDIN_FILENO, TCSANOW, &TheStoredTermIos);
+    if (isatty(STDOUT_FILENO)) {
+      fputs("\033[?2004l", stdout);
+      fflush(stdout);
+    }
     TheKeyEventThread = 0;
   }
 
 #ifdef MCODE_UART2
+  /* Wake both threads up, the counter is never read, so, it stays signalled */
+  if (-1 != TheUart2QuitEvent) {
+    eventfd_write(TheUart2QuitEvent, 1);
+  }
   if (TheUart2ReadThreadId) {
     pthread_join(TheUart2ReadThreadId, NULL);
+    TheUart2ReadThreadId = 0;
   }
   if (TheUart2WriteThreadId) {
     if (!TheOutPipeOpened) {
+      /* Still blocked in 'open', waiting for the simulator */
       pthread_cancel(TheUart2WriteThreadId);
     }
     pthread_join(TheUart2WriteThreadId, NULL);
+    TheUart2WriteThreadId = 0;
+  }
+  if (-1 != TheUart2QuitEvent) {
+    close(TheUart2TxEvent);
+    close(TheUart2QuitEvent);
+    TheUart2TxEvent = -1;
+    TheUart2QuitEvent = -1;
   }
 #endif /* MCODE_UART2 */
 }
@@ -155,40 +189,34 @@ void uart_write_char(char ch)
   fflush(stdout);
 }
 
-void *emu_hw_uart_thread(void *threadid)
+const MUartStats *hw_uart_stats(void)
 {
-  int escIndex = 0;
-  unsigned int escChar = 0;
+  TheStats.rxOverruns = TheRing.dropped;
+  return &TheStats;
+}
 
+void *emu_hw_uart_thread(void *threadid)
+{
   /* upate termios attributes, so, we receive getchar on each character entered, no echo */
   static struct termios newt;
   newt = TheStoredTermIos;
   newt.c_lflag &= ~(ICANON | ECHO);
   tcsetattr(STDIN_FILENO, TCSANOW, &newt);
+  if (isatty(STDOUT_FILENO)) {
+    /* Let the terminal mark the pasted text, the line editor switches to the paste mode */
+    fputs("\033[?2004h", stdout);
+    fflush(stdout);
+  }
 
   while (running_request) {
     const unsigned int ch = getchar ();
-    if (escIndex) {
-      escChar = escChar | (ch << (8 * escIndex));
-      ++escIndex;
-    }
-    if (27 == ch) {
-      escChar = ch;
-      escIndex = 1;
-    }
-
-    if (TheCallback && (escIndex == 3 || (!escIndex))) {
-      if (TheBufferWrIndex == sizeof (TheBuffer)) {
-        TheBufferWrIndex = 0;
+    /* The escape sequences are passed as-is, the line editor handles them */
+    if (TheCallback) {
+      /* If the tick falls behind, wait for it, a long paste stays in the terminal buffer */
+      while (!mring_room(&TheRing) && running_request) {
+        usleep(1000);
       }
-      if (escIndex) {
-        TheBuffer[TheBufferWrIndex] = escChar;
-        escIndex = 0;
-      } else {
-        TheBuffer[TheBufferWrIndex] = ch;
-      }
-
-      ++TheBufferWrIndex;
+      mring_put(&TheRing, ch);
     }
   }
 
@@ -202,18 +230,32 @@ void *emu_hw_uart_thread(void *threadid)
 
 void emu_hw_uart_tick(void)
 {
-  if (TheBufferWrIndex != TheBufferRdIndex) {
-    if (TheBufferRdIndex == sizeof (TheBuffer)) {
-      TheBufferRdIndex = 0;
+  size_t i;
+  size_t length;
+  const char *data;
+
+  /* Deliver all the pending input in one pass */
+  while ((length = mring_peek(&TheRing, &data))) {
+    for (i = 0; i < length; ++i) {
+      TheCallback(data[i]);
     }
-    const char ch = TheBuffer[TheBufferRdIndex];
-    TheBuffer[TheBufferRdIndex] = 0;
-    ++TheBufferRdIndex;
-    TheCallback(ch);
+    mring_consume(&TheRing, length);
+    TheStats.rxBytes += length;
   }
 
 #ifdef MCODE_UART2
-  /* Handle the input data */
+  /* Handle all the received data, report each line as soon as it is complete,
+     so, the line reader buffers never overflow */
+  while ((length = mring_peek(&TheUart2RxRing, &data))) {
+    for (i = 0; i < length; ++i) {
+      uart2_handle_new_sample((uint8_t)data[i]);
+      if ('\n' == data[i] || ' ' == data[i]) {
+        uart2_report_new_sample();
+      }
+    }
+    mring_consume(&TheUart2RxRing, length);
+    TheUart2Stats.rxBytes += length;
+  }
   uart2_report_new_sample();
 #endif /* MCODE_UART2 */
 }
@@ -221,30 +263,57 @@ void emu_hw_uart_tick(void)
 #ifdef MCODE_UART2
 void uart2_write_char(char ch)
 {
-  if (TheUart2OutBufferWrIndex >= sizeof (TheUart2OutBuffer)) {
-    TheUart2OutBufferWrIndex = 0;
+  bool wake;
+
+  if (!mring_push(&TheUart2TxRing, &ch, 1, &wake)) {
+    return;
   }
-  TheUart2OutBuffer[TheUart2OutBufferWrIndex++] = ch;
+  if (wake) {
+    /* The write thread might be waiting for data */
+    eventfd_write(TheUart2TxEvent, 1);
+  }
+}
+
+const MUartStats *hw_uart2_stats(void)
+{
+  TheUart2Stats.rxOverruns = TheUart2RxRing.dropped;
+  TheUart2Stats.txOverruns = TheUart2TxRing.dropped;
+  return &TheUart2Stats;
 }
 
 void *emu_hw_uart2_read_thread(void *arg)
 {
   int res;
+  char buffer[1024];
+  struct pollfd fds[2];
 
   nice(-10);
   res = mkfifo("/var/tmp/sim-to-mcode", S_IRUSR | S_IWUSR);
   if (-1 == res && EEXIST != errno) exit(1);
 
-  TheInPipe = open("/var/tmp/sim-to-mcode", O_RDONLY | O_NONBLOCK);
+  /* Opened for writing as well, so, 'poll' blocks instead of reporting
+     the hang-up while the simulator is not running */
+  TheInPipe = open("/var/tmp/sim-to-mcode", O_RDWR | O_NONBLOCK);
   if (-1 == TheInPipe) {
     exit(1);
   }
 
-  char buf;
+  fds[0].fd = TheInPipe;
+  fds[0].events = POLLIN;
+  fds[1].fd = TheUart2QuitEvent;
+  fds[1].events = POLLIN;
   while (!TheQuitRequest) {
-    res = read(TheInPipe, &buf, 1);
-    if (1 == res) {
-      uart2_handle_new_sample(buf);
+    res = poll(fds, 2, -1);
+    if (res < 0 || (fds[1].revents & POLLIN)) {
+      if (res < 0 && EINTR == errno) {
+        continue;
+      }
+      break;
+    }
+
+    res = read(TheInPipe, buffer, sizeof (buffer));
+    if (res > 0) {
+      mring_push(&TheUart2RxRing, buffer, res, NULL);
     }
   }
 
@@ -255,6 +324,10 @@ void *emu_hw_uart2_read_thread(void *arg)
 void *emu_hw_uart2_write_thread(void *args)
 {
   int res;
+  size_t length;
+  eventfd_t value;
+  const char *data;
+  struct pollfd fds[2];
 
   res = mkfifo("/var/tmp/mcode-to-sim", S_IRUSR | S_IWUSR);
   if (-1 == res && EEXIST != errno) exit(1);
@@ -264,14 +337,31 @@ void *emu_hw_uart2_write_thread(void *args)
     exit(1);
   }
   TheOutPipeOpened = true;
+  fcntl(TheOutPipe, F_SETFL, fcntl(TheOutPipe, F_GETFL) | O_NONBLOCK);
+
+  fds[1].fd = TheUart2QuitEvent;
+  fds[1].events = POLLIN;
   while (!TheQuitRequest) {
-    char ch;
-    if (TheUart2OutBufferWrIndex != TheUart2OutBufferRdIndex) {
-      if (TheUart2OutBufferRdIndex >= sizeof (TheUart2OutBuffer)) {
-        TheUart2OutBufferWrIndex = 0;
+    /* Wait for the data to send or for the pipe to have room for it */
+    length = mring_peek(&TheUart2TxRing, &data);
+    fds[0].fd = length ? TheOutPipe : TheUart2TxEvent;
+    fds[0].events = length ? POLLOUT : POLLIN;
+    res = poll(fds, 2, -1);
+    if (res < 0 || (fds[1].revents & POLLIN)) {
+      if (res < 0 && EINTR == errno) {
+        continue;
       }
-      ch = TheUart2OutBuffer[TheUart2OutBufferRdIndex++];
-      write(TheOutPipe, &ch, 1);
+      break;
+    }
+
+    if (!length) {
+      eventfd_read(TheUart2TxEvent, &value);
+      continue;
+    }
+    res = write(TheOutPipe, data, length);
+    if (res > 0) {
+      mring_consume(&TheUart2TxRing, res);
+      TheUart2Stats.txBytes += res;
     }
   }
 
@@ -0,0 +1,158 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Alexander Chumakov
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "lcd-headless.h"
+
+#include "mglobal.h"
+#include "mstring.h"
+#include "lcd-s95513.h"
+
+#include <stdio.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+static char TheName[32];
+static size_t TheSize = 0;
+static uint32_t ThePixels = 0;
+static MLcdHeadlessHeader *TheHeader = NULL;
+
+static void lcd_headless_scroll(uint16_t position);
+static void lcd_headless_changed(uint16_t x, uint16_t y, uint16_t width, uint16_t height, uint32_t count);
+
+bool lcd_headless_init(uint16_t width, uint16_t height)
+{
+  int fd;
+  void *memory;
+  MS95513Surface surface;
+  /* The rows are 64-byte aligned */
+  const uint32_t stride = (width + 15u) & ~15u;
+  const size_t size = sizeof (MLcdHeadlessHeader) + (size_t)stride*height*sizeof (uint32_t);
+
+  lcd_headless_deinit();
+
+  snprintf(TheName, sizeof (TheName), "/mcode-lcd-%ld", (long)getpid());
+  fd = shm_open(TheName, O_RDWR | O_CREAT | O_TRUNC, 0600);
+  if (fd < 0) {
+    mprintstrln(PSTR("lcd_headless_init: cannot create the segment"));
+    return false;
+  }
+  if (ftruncate(fd, size)) {
+    close(fd);
+    shm_unlink(TheName);
+    mprintstrln(PSTR("lcd_headless_init: cannot resize the segment"));
+    return false;
+  }
+  memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (MAP_FAILED == memory) {
+    shm_unlink(TheName);
+    mprintstrln(PSTR("lcd_headless_init: cannot map the segment"));
+    return false;
+  }
+
+  /* The new segment is zero-filled */
+  TheSize = size;
+  TheHeader = (MLcdHeadlessHeader *)memory;
+  TheHeader->width = width;
+  TheHeader->height = height;
+  TheHeader->stride = stride;
+  TheHeader->magic = LCD_HEADLESS_MAGIC;
+  lcd_headless_reset();
+
+  surface.pixels = (uint32_t *)(TheHeader + 1);
+  surface.stride = stride;
+  surface.width = width;
+  surface.height = height;
+  surface.changed = lcd_headless_changed;
+  surface.scroll = lcd_headless_scroll;
+  s95513_set_surface(&surface);
+  return true;
+}
+
+void lcd_headless_deinit(void)
+{
+  if (TheHeader) {
+    s95513_set_surface(NULL);
+    munmap(TheHeader, TheSize);
+    shm_unlink(TheName);
+    TheHeader = NULL;
+    TheSize = 0;
+  }
+}
+
+const char *lcd_headless_name(void)
+{
+  return TheName;
+}
+
+MLcdHeadlessHeader *lcd_headless_header(void)
+{
+  return TheHeader;
+}
+
+void lcd_headless_reset(void)
+{
+  uint32_t i;
+  uint32_t *pixels;
+
+  if (TheHeader) {
+    pixels = (uint32_t *)(TheHeader + 1);
+    TheHeader->on = false;
+    /* Same as the widget: opaque black */
+    for (i = 0; i < TheHeader->stride*TheHeader->height; ++i) {
+      pixels[i] = UINT32_C(0xFF000000);
+    }
+    ++TheHeader->sequence;
+  }
+}
+
+void lcd_headless_turn(bool on)
+{
+  if (TheHeader) {
+    TheHeader->on = on;
+    ++TheHeader->sequence;
+  }
+}
+
+uint32_t lcd_headless_take_pixels(void)
+{
+  const uint32_t pixels = ThePixels;
+  ThePixels = 0;
+  return pixels;
+}
+
+void lcd_headless_scroll(uint16_t position)
+{
+  TheHeader->scroll = position % TheHeader->height;
+  ++TheHeader->sequence;
+}
+
+void lcd_headless_changed(uint16_t x, uint16_t y, uint16_t width, uint16_t height, uint32_t count)
+{
+  ThePixels += count;
+  ++TheHeader->sequence;
+}
@@ -0,0 +1,92 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Alexander Chumakov
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef MCODE_LCD_HEADLESS_H
+#define MCODE_LCD_HEADLESS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** The value of \c MLcdHeadlessHeader::magic, "MLCD" */
+#define LCD_HEADLESS_MAGIC UINT32_C(0x44434C4D)
+
+/**
+ * The start of the shared memory segment, the RGB32 LCD RAM follows
+ */
+typedef struct {
+  uint32_t magic;                       /**< \c LCD_HEADLESS_MAGIC */
+  uint16_t width;
+  uint16_t height;
+  uint32_t stride;                      /**< The distance between the rows, in pixels */
+  uint16_t scroll;                      /**< The LCD RAM row shown on top */
+  uint16_t on;                          /**< The display is turned on */
+  uint32_t sequence;                    /**< Incremented on every LCD RAM change */
+  uint32_t reserved[3];
+} MLcdHeadlessHeader;
+
+/**
+ * Create the LCD RAM in a POSIX shared memory segment and draw the S95513 output there
+ * @param[in] width The LCD width
+ * @param[in] height The LCD height
+ * @return The success status
+ * @note Any previous segment is removed; the segment name is \c lcd_headless_name
+ */
+bool lcd_headless_init(uint16_t width, uint16_t height);
+/**
+ * Remove the shared memory segment
+ */
+void lcd_headless_deinit(void);
+
+/**
+ * Get the name of the shared memory segment, "/mcode-lcd-<pid>"
+ */
+const char *lcd_headless_name(void);
+/**
+ * Get the header of the shared memory segment, \c NULL if there is none
+ */
+MLcdHeadlessHeader *lcd_headless_header(void);
+
+/**
+ * Clear the LCD RAM and turn the display off
+ */
+void lcd_headless_reset(void);
+/**
+ * Turn the display on or off
+ */
+void lcd_headless_turn(bool on);
+/**
+ * Get the number of the written pixels since the last call
+ */
+uint32_t lcd_headless_take_pixels(void);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* MCODE_LCD_HEADLESS_H */
@@ -0,0 +1,557 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Alexander Chumakov
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "lcd-s95513.h"
+
+#include "mglobal.h"
+#include "mstring.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define LCD_SET_SCROLL_START UINT8_C(0x37)
+#define LCD_S95513_WR_RAM_START UINT8_C(0x2C)
+#define LCD_S95513_WR_RAM_CONT UINT8_C(0x3C)
+#define LCD_S95513_SET_COLUMN_ADDR UINT8_C(0x2A)
+#define LCD_S95513_SET_PAGE_ADDR UINT8_C(0x2B)
+
+typedef enum {
+  EmuStateIdle,
+  EmuStateUnbuffered,
+  EmuStateInProg,
+  EmuStateFinished,
+  EmuStateError
+} TEmuState;
+
+/**
+ * Writes \c count pixels of a bulk transfer, starting from the \c first one
+ */
+typedef void (*TRowWriter)(uint32_t *pixels, uint32_t first, uint32_t count, void *context);
+
+/** The bulk transfer of a constant word */
+typedef struct {
+  uint32_t color;
+  uint32_t *row;                        /**< The last written row, copied to the next ones */
+  uint32_t count;
+} TConstContext;
+
+/** The bulk transfer of a 1bpp bitmap */
+typedef struct {
+  const uint8_t *data;
+  uint32_t offColor;
+  uint32_t onColor;
+} TBitmapContext;
+
+// Command data buffer management
+#define KBufferSize (24)
+static uint32_t TheBufferIndex = 0;
+static uint8_t TheBuffer[KBufferSize];
+static TEmuState TheEmuState = EmuStateIdle;
+
+static uint16_t ThePageEnd = 0;
+static uint16_t TheNextPage = 0;
+static uint16_t ThePageStart = 0;
+static uint16_t TheColumnEnd = 0;
+static uint8_t TheNormalFlag = 1;
+static uint16_t TheNextColumn = 0;
+static uint16_t TheColumnStart = 0;
+static uint8_t TheCurrentCommand = 0;
+
+static bool TheFast = true;
+static uint16_t TheScroll = 0;
+static uint32_t TheCrcTable[256];
+static MS95513Stats TheStats = {0, 0, 0};
+static MS95513Surface TheSurface = {NULL, 0, 0, 0, NULL, NULL};
+
+static uint32_t s95513_to_color(uint16_t data);
+static void s95513_set_pixel(uint16_t x, uint16_t y, uint32_t color);
+static const uint32_t *s95513_shown_row(uint16_t row);
+
+/**
+ * Commands
+ */
+static void s95513_set_scroll_pos(void);
+static void s95513_handle_data_write_ram(uint16_t word);
+static void s95513_handle_data_set_page_addr(void);
+static void s95513_handle_data_set_column_addr(void);
+
+/**
+ * The fast path
+ */
+static bool s95513_fast_ready(void);
+static void s95513_write_ram(uint32_t count, TRowWriter writer, void *context);
+static void s95513_write_words(uint32_t *pixels, uint32_t first, uint32_t count, void *context);
+static void s95513_write_const(uint32_t *pixels, uint32_t first, uint32_t count, void *context);
+static void s95513_write_bitmap(uint32_t *pixels, uint32_t first, uint32_t count, void *context);
+
+void s95513_set_surface(const MS95513Surface *surface)
+{
+  if (surface) {
+    TheSurface = *surface;
+  } else {
+    memset(&TheSurface, 0, sizeof (TheSurface));
+  }
+  /* The new LCD RAM is not scrolled */
+  TheScroll = 0;
+}
+
+void s95513_set_fast(bool enabled)
+{
+  TheFast = enabled;
+}
+
+void s95513_reset(void)
+{
+  TheBufferIndex = 0;
+  TheEmuState = EmuStateIdle;
+  ThePageEnd = 0;
+  TheNextPage = 0;
+  ThePageStart = 0;
+  TheColumnEnd = 0;
+  TheNormalFlag = 1;
+  TheNextColumn = 0;
+  TheColumnStart = 0;
+  TheCurrentCommand = 0;
+}
+
+MS95513Stats *s95513_stats(void)
+{
+  return &TheStats;
+}
+
+uint32_t s95513_frame_crc(void)
+{
+  uint16_t row;
+  uint32_t i;
+  uint32_t bit;
+  uint32_t value;
+  uint32_t crc = UINT32_MAX;
+
+  if (!TheCrcTable[1]) {
+    /* CRC-32, reflected, as in zlib */
+    for (i = 0; i < 256; ++i) {
+      value = i;
+      for (bit = 0; bit < 8; ++bit) {
+        value = (value & 1) ? ((value >> 1) ^ UINT32_C(0xEDB88320)) : (value >> 1);
+      }
+      TheCrcTable[i] = value;
+    }
+  }
+
+  for (row = 0; row < TheSurface.height; ++row) {
+    const uint8_t *const data = (const uint8_t *)s95513_shown_row(row);
+    for (i = 0; i < TheSurface.width*sizeof (uint32_t); ++i) {
+      crc = TheCrcTable[(crc ^ data[i]) & 0xFFu] ^ (crc >> 8);
+    }
+  }
+
+  return ~crc;
+}
+
+bool s95513_snapshot(const char *path)
+{
+  uint16_t row;
+  bool success = true;
+  FILE *const file = fopen(path, "wb");
+
+  if (!file) {
+    return false;
+  }
+  for (row = 0; row < TheSurface.height && success; ++row) {
+    success = (TheSurface.width == fwrite(s95513_shown_row(row), sizeof (uint32_t), TheSurface.width, file));
+  }
+  return !fclose(file) && success;
+}
+
+void s95513_cmd(uint8_t cmd)
+{
+  ++TheStats.commands;
+  TheNormalFlag = 1;
+  TheBufferIndex = 0;
+  TheCurrentCommand = cmd;
+
+  switch (cmd)
+  {
+  case LCD_S95513_WR_RAM_START:
+    TheNextPage = ThePageStart;
+    TheNextColumn = TheColumnStart;
+    TheEmuState = EmuStateUnbuffered;
+    break;
+  default:
+    TheEmuState = EmuStateIdle;
+    break;
+  }
+}
+
+void s95513_data_byte(uint8_t byte)
+{
+  ++TheStats.data;
+  if (EmuStateIdle == TheEmuState) {
+    TheEmuState = EmuStateInProg;
+  } else if (EmuStateFinished == TheEmuState || EmuStateError == TheEmuState) {
+    if (EmuStateFinished == TheEmuState) {
+      mprintstrln(PSTR("s95513_data_byte: finished"));
+    } else {
+      mprintstrln(PSTR("s95513_data_byte: error"));
+    }
+    return;
+  }
+
+  if (EmuStateInProg == TheEmuState) {
+    if (TheBufferIndex < KBufferSize) {
+      TheBuffer[TheBufferIndex++] = byte;
+    } else {
+      mprintstrln(PSTR("s95513_data_byte: data buffer overflow"));
+      return;
+    }
+  }
+
+  switch (TheCurrentCommand)
+  {
+  case LCD_SET_SCROLL_START:
+    if (2 == TheBufferIndex) {
+      s95513_set_scroll_pos();
+      TheEmuState = EmuStateFinished;
+    }
+    break;
+  case LCD_S95513_WR_RAM_CONT:
+  case LCD_S95513_WR_RAM_START:
+    s95513_handle_data_write_ram(byte);
+  case LCD_S95513_SET_COLUMN_ADDR:
+    if (4 == TheBufferIndex) {
+      s95513_handle_data_set_column_addr();
+      TheEmuState = EmuStateFinished;
+    }
+    break;
+  case LCD_S95513_SET_PAGE_ADDR:
+    if (4 == TheBufferIndex) {
+      s95513_handle_data_set_page_addr();
+      TheEmuState = EmuStateFinished;
+    }
+    break;
+  default:
+    mprintstr(PSTR("EMU: s95513_data_byte (cmd: "));
+    mprint_uintd(TheCurrentCommand, 0);
+    mprintstr(PSTR(", byte: "));
+    mprint_uintd(byte, 0);
+    mprint(MStringNewLine);
+    break;
+  }
+}
+
+void s95513_data_word(uint16_t word)
+{
+  ++TheStats.data;
+  if (EmuStateIdle == TheEmuState) {
+    TheEmuState = EmuStateInProg;
+  } else if (EmuStateFinished == TheEmuState || EmuStateError == TheEmuState) {
+    if (EmuStateFinished == TheEmuState) {
+      mprintstrln(PSTR("s95513_data_word: finished"));
+    } else {
+      mprintstrln(PSTR("s95513_data_word: error"));
+    }
+    return;
+  }
+
+  if (EmuStateInProg == TheEmuState) {
+    if (TheBufferIndex < KBufferSize) {
+      TheBuffer[TheBufferIndex++] = (uint8_t)word;
+    } else {
+      mprintstrln(PSTR("s95513_data_word: data buffer overflow"));
+      return;
+    }
+  }
+
+  switch (TheCurrentCommand)
+  {
+  case LCD_SET_SCROLL_START:
+    if (2 == TheBufferIndex) {
+      s95513_set_scroll_pos();
+      TheEmuState = EmuStateFinished;
+    }
+    break;
+  case LCD_S95513_WR_RAM_CONT:
+  case LCD_S95513_WR_RAM_START:
+    s95513_handle_data_write_ram(word);
+    break;
+  case LCD_S95513_SET_COLUMN_ADDR:
+    if (4 == TheBufferIndex) {
+      s95513_handle_data_set_column_addr();
+      TheEmuState = EmuStateFinished;
+    }
+    break;
+  case LCD_S95513_SET_PAGE_ADDR:
+    if (4 == TheBufferIndex) {
+      s95513_handle_data_set_page_addr();
+      TheEmuState = EmuStateFinished;
+    }
+    break;
+  default:
+    mprintstr(PSTR("EMU: s95513_data_word (cmd: "));
+    mprint_uintd(TheCurrentCommand, 0);
+    mprintstr(PSTR(", word: "));
+    mprint_uintd(word, 0);
+    mprint(MStringNewLine);
+    break;
+  }
+}
+
+void s95513_data_words(const uint16_t *data, uint32_t count)
+{
+  uint32_t i;
+
+  if (s95513_fast_ready()) {
+    s95513_write_ram(count, s95513_write_words, (void *)data);
+  } else {
+    for (i = 0; i < count; ++i) {
+      s95513_data_word(data[i]);
+    }
+  }
+}
+
+void s95513_data_const(uint16_t word, uint32_t count)
+{
+  uint32_t i;
+  TConstContext context;
+
+  if (s95513_fast_ready()) {
+    context.color = s95513_to_color(word);
+    context.row = NULL;
+    context.count = 0;
+    s95513_write_ram(count, s95513_write_const, &context);
+  } else {
+    for (i = 0; i < count; ++i) {
+      s95513_data_word(word);
+    }
+  }
+}
+
+void s95513_data_bitmap(const uint8_t *data, uint32_t count, uint16_t offValue, uint16_t onValue)
+{
+  uint32_t i;
+  TBitmapContext context;
+
+  if (s95513_fast_ready()) {
+    context.data = data;
+    context.offColor = s95513_to_color(offValue);
+    context.onColor = s95513_to_color(onValue);
+    s95513_write_ram(count, s95513_write_bitmap, &context);
+  } else {
+    for (i = 0; i < count; ++i) {
+      s95513_data_word((data[i >> 3] & (1u << (i & 7))) ? onValue : offValue);
+    }
+  }
+}
+
+uint32_t s95513_to_color(uint16_t data)
+{
+  const uint8_t red =   (0xffu&((0xf800U&data)>>8));
+  const uint8_t green = (0xffu&((0x07E0U&data)>>3));
+  const uint8_t blue =  (0xffu&((0x001FU&data)<<3));
+  return 0xff000000u|(red << 16)|(green << 8)| blue;
+}
+
+void s95513_set_pixel(uint16_t x, uint16_t y, uint32_t color)
+{
+  if (x < TheSurface.width && y < TheSurface.height) {
+    TheSurface.pixels[y*TheSurface.stride + x] = color;
+    if (TheSurface.changed) {
+      (*TheSurface.changed)(x, y, 1, 1, 1);
+    }
+  } else {
+    mprintstr(PSTR("EMU: wrong pixel: ("));
+    mprint_uintd(x, 0);
+    mprintstr(PSTR(", "));
+    mprint_uintd(y, 0);
+    mprintstr(PSTR(")"));
+    mprint(MStringNewLine);
+  }
+}
+
+void s95513_handle_data_set_page_addr(void)
+{
+  ThePageStart = (TheBuffer[0] << 8) | TheBuffer[1];
+  ThePageEnd = (TheBuffer[2] << 8) | TheBuffer[3];
+}
+
+void s95513_handle_data_set_column_addr(void)
+{
+  TheColumnStart = (TheBuffer[0] << 8) | TheBuffer[1];
+  TheColumnEnd = (TheBuffer[2] << 8) | TheBuffer[3];
+}
+
+void s95513_handle_data_write_ram(uint16_t word)
+{
+  if (TheNormalFlag) {
+    /* got next color sample, put it to the surface */
+    s95513_set_pixel(TheNextColumn, TheNextPage, s95513_to_color(word));
+
+    TheNextColumn++;
+    if (TheNextColumn > TheColumnEnd) {
+      TheNextColumn = TheColumnStart;
+      TheNextPage++;
+      if (TheNextPage > ThePageEnd) {
+        TheNormalFlag = 0;
+      }
+    }
+  }
+}
+
+const uint32_t *s95513_shown_row(uint16_t row)
+{
+  /* Same as the panel: the scroll position row is shown on top */
+  return TheSurface.pixels + ((TheScroll + row) % TheSurface.height)*TheSurface.stride;
+}
+
+void s95513_set_scroll_pos(void)
+{
+  TheScroll = (TheBuffer[0] << 8) | TheBuffer[1];
+  if (TheSurface.scroll) {
+    (*TheSurface.scroll)(TheScroll);
+  } else {
+    mprintstrln(PSTR("s95513_set_scroll_pos: no surface"));
+  }
+}
+
+bool s95513_fast_ready(void)
+{
+  /* Only the data of 'WR_RAM_START' goes to the LCD RAM unbuffered; the column or page
+     address wraps around at the maximum window end, this case is left to the slow path */
+  return TheFast && EmuStateUnbuffered == TheEmuState &&
+    UINT16_MAX != TheColumnEnd && UINT16_MAX != ThePageEnd;
+}
+
+void s95513_write_ram(uint32_t count, TRowWriter writer, void *context)
+{
+  uint32_t n;
+  uint32_t left;
+  uint32_t visible;
+  uint32_t done = 0;
+  uint32_t written = 0;
+  uint32_t clipped = 0;
+  uint16_t top = UINT16_MAX;
+  uint16_t left_x = UINT16_MAX;
+  uint16_t bottom = 0;
+  uint16_t right = 0;
+
+  TheStats.data += count;
+  /* Same stepping as 's95513_handle_data_write_ram', a row segment at a time */
+  while (done < count && TheNormalFlag) {
+    left = (TheColumnEnd >= TheNextColumn) ? (TheColumnEnd - TheNextColumn + 1u) : 1u;
+    n = (count - done < left) ? (count - done) : left;
+
+    visible = 0;
+    if (TheNextPage < TheSurface.height && TheNextColumn < TheSurface.width) {
+      visible = TheSurface.width - TheNextColumn;
+      if (visible > n) {
+        visible = n;
+      }
+      (*writer)(TheSurface.pixels + TheNextPage*TheSurface.stride + TheNextColumn, done, visible, context);
+      if (TheNextPage < top) {
+        top = TheNextPage;
+      }
+      if (TheNextPage > bottom) {
+        bottom = TheNextPage;
+      }
+      if (TheNextColumn < left_x) {
+        left_x = TheNextColumn;
+      }
+      if (TheNextColumn + visible - 1 > right) {
+        right = TheNextColumn + visible - 1;
+      }
+      written += visible;
+    }
+    clipped += n - visible;
+    done += n;
+
+    if (n == left) {
+      TheNextColumn = TheColumnStart;
+      TheNextPage++;
+      if (TheNextPage > ThePageEnd) {
+        TheNormalFlag = 0;
+      }
+    } else {
+      TheNextColumn += n;
+    }
+  }
+  TheStats.fast += done;
+
+  if (written && TheSurface.changed) {
+    (*TheSurface.changed)(left_x, top, right - left_x + 1, bottom - top + 1, written);
+  }
+  if (clipped) {
+    mprintstr(PSTR("EMU: wrong pixels: "));
+    mprint_uintd(clipped, 0);
+    mprint(MStringNewLine);
+  }
+}
+
+void s95513_write_words(uint32_t *pixels, uint32_t first, uint32_t count, void *context)
+{
+  uint32_t i;
+  const uint16_t *const data = (const uint16_t *)context + first;
+
+  for (i = 0; i < count; ++i) {
+    pixels[i] = s95513_to_color(data[i]);
+  }
+}
+
+void s95513_write_const(uint32_t *pixels, uint32_t first, uint32_t count, void *context)
+{
+  uint32_t i;
+  TConstContext *const constContext = (TConstContext *)context;
+
+  /* The rows of a window are the same, copy the previous one */
+  if (constContext->row && constContext->count >= count) {
+    memcpy(pixels, constContext->row, count*sizeof (uint32_t));
+  } else {
+    for (i = 0; i < count; ++i) {
+      pixels[i] = constContext->color;
+    }
+  }
+  constContext->row = pixels;
+  constContext->count = count;
+}
+
+void s95513_write_bitmap(uint32_t *pixels, uint32_t first, uint32_t count, void *context)
+{
+  uint8_t byte;
+  uint8_t mask;
+  const TBitmapContext *const bitmapContext = (const TBitmapContext *)context;
+  const uint8_t *data = bitmapContext->data + (first >> 3);
+  uint32_t *const end = pixels + count;
+
+  /* The segment might start in the middle of a byte */
+  mask = (uint8_t)(1u << (first & 7));
+  byte = *data++;
+  while (pixels < end) {
+    *pixels++ = (byte & mask) ? bitmapContext->onColor : bitmapContext->offColor;
+    mask <<= 1;
+    if (!mask && pixels < end) {
+      mask = UINT8_C(0x01);
+      byte = *data++;
+    }
+  }
+}
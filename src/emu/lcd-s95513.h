@@ -0,0 +1,125 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Alexander Chumakov
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef MCODE_LCD_S95513_H
+#define MCODE_LCD_S95513_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * The LCD RAM the emulated controller draws to
+ */
+typedef struct {
+  uint32_t *pixels;                     /**< The RGB32 pixels, row by row */
+  uint32_t stride;                      /**< The distance between the rows, in pixels */
+  uint16_t width;
+  uint16_t height;
+  /** Notify about the changed area, \c count pixels were written inside */
+  void (*changed)(uint16_t x, uint16_t y, uint16_t width, uint16_t height, uint32_t count);
+  /** Set the first LCD RAM row shown on top */
+  void (*scroll)(uint16_t position);
+} MS95513Surface;
+
+/**
+ * The decoder statistics
+ */
+typedef struct {
+  uint32_t commands;                    /**< The command bytes */
+  uint32_t data;                        /**< The data bytes and words */
+  uint32_t fast;                        /**< The data words drawn by the fast path */
+} MS95513Stats;
+
+/**
+ * Set the LCD RAM to draw to, \c NULL to drop the pixels
+ * @note The surface is copied, should be set again after the LCD RAM is reallocated;
+ *       the scroll position is reset
+ */
+void s95513_set_surface(const MS95513Surface *surface);
+/**
+ * Enable or disable the fast path of the bulk writes, for comparing with the
+ * word-by-word decoding
+ */
+void s95513_set_fast(bool enabled);
+/**
+ * Reset the controller state, the LCD RAM is not changed
+ */
+void s95513_reset(void);
+
+/**
+ * Handle a command byte
+ */
+void s95513_cmd(uint8_t cmd);
+/**
+ * Handle a data byte
+ */
+void s95513_data_byte(uint8_t byte);
+/**
+ * Handle a data word
+ */
+void s95513_data_word(uint16_t word);
+
+/**
+ * Handle \c count data words, same as \c s95513_data_word for each one
+ */
+void s95513_data_words(const uint16_t *data, uint32_t count);
+/**
+ * Handle \c count copies of the data word
+ */
+void s95513_data_const(uint16_t word, uint32_t count);
+/**
+ * Handle a 1bpp bitmap, 1 data word per bit
+ * @param[in] data The bitmap, the least significant bit of a byte goes first
+ * @param[in] count The number of bits
+ * @param[in] offValue The data word for the cleared bits
+ * @param[in] onValue The data word for the set bits
+ */
+void s95513_data_bitmap(const uint8_t *data, uint32_t count, uint16_t offValue, uint16_t onValue);
+
+/**
+ * Get the decoder statistics
+ */
+MS95513Stats *s95513_stats(void);
+
+/**
+ * Get the CRC-32 of the shown frame, the LCD RAM rows from the scroll position
+ * @note Same as the CRC-32 of the \c s95513_snapshot file
+ */
+uint32_t s95513_frame_crc(void);
+/**
+ * Write the shown frame to a file: the raw RGB32 pixels, row by row, no header
+ * @return The success status
+ */
+bool s95513_snapshot(const char *path);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* MCODE_LCD_S95513_H */
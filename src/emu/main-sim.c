@@ -24,6 +24,7 @@
 
 #include "mcode-config.h"
 
+#include "mpdu.h"
 #include "mtick.h"
 #include "hw-uart.h"
 #include "mstring.h"
@@ -31,7 +32,11 @@
 #include "cmd-engine.h"
 #include "line-editor-uart.h"
 
+#include <poll.h>
+#include <time.h>
+#include <ctype.h>
 #include <stdio.h>
+#include <signal.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
@@ -43,31 +48,155 @@
 #include <fcntl.h>
 #include <errno.h>
 
-static bool TheRunRequest = false;
-
-static int TheInPipe = 0;
-static int TheOutPipe = 0;
-
-static pthread_t TheReadThread = 0;
-static pthread_t TheWriteThread = 0;
-
-static char TheInBuffer[256] = {0};
-static char TheOutBuffer[1024] = {0};
+/** The number of SMS the simulated modem can store */
+#define SIM_MAILBOX_SIZE (128)
+/** The number of the latency samples kept for the percentiles */
+#define SIM_LATENCY_SAMPLES (65536)
+/** The longest time the I/O loop sleeps, in milli-seconds */
+#define SIM_POLL_PERIOD (100)
+
+/** The backlog SMS are sent from the phone number the firmware accepts programs from */
+#ifdef MCODE_DEFAULT_PHONE_NUMBER
+#define SIM_BACKLOG_PHONE MCODE_DEFAULT_PHONE_NUMBER_STR
+#else /* MCODE_DEFAULT_PHONE_NUMBER */
+#define SIM_BACKLOG_PHONE "+70001112233"
+#endif /* MCODE_DEFAULT_PHONE_NUMBER */
+
+typedef struct {
+  bool used;
+  bool read;
+  char phone[MCODE_PDU_ADDRESS_LENGTH]; /**< The phone number */
+  char body[MCODE_PDU_MAX_SEPTETS + 1]; /**< The SMS body */
+} TSimSms;
+
+/**
+ * The statistics of the firmware under test
+ */
+typedef struct {
+  uint64_t startedAt;                   /**< The time the first command is received at */
+  uint64_t lastAt;                      /**< The time the last command is received at */
+  uint32_t commands;                    /**< The number of the received commands */
+  uint32_t errors;                      /**< The number of the injected errors */
+  uint64_t bytesIn;                     /**< The number of bytes received from the firmware */
+  uint64_t bytesOut;                    /**< The number of bytes sent to the firmware */
+  uint32_t samples;                     /**< The number of the latency samples */
+  uint32_t latency[SIM_LATENCY_SAMPLES];/**< The firmware reaction times, in micro-seconds */
+} TSimStats;
+
+/**
+ * The default scenario, the modem boot sequence
+ */
+static const char *const TheDefaultScenario[] = {
+  "sleep 1000", "urc RDY",
+  "sleep 1000", "urc +CFUN: 1",
+  "sleep 1000", "urc +CPIN: READY",
+  "sleep 1000", "urc Call Ready",
+  "sleep 1000", "urc SMS Ready",
+};
+
+static volatile bool TheRunRequest = false;
+
+static int TheInPipe = -1;
+static int TheOutPipe = -1;
+
+static pthread_t TheIoThread = 0;
+
+static int TheBacklog = 0;
+static int TheSmsSent = 0;
+static bool ThePduMode = false;
+static char TheInPipeName[64] = "/var/tmp/mcode-to-sim";
+static char TheOutPipeName[64] = "/var/tmp/sim-to-mcode";
+static TSimSms TheMailbox[SIM_MAILBOX_SIZE];
+
+static char **TheScenario = NULL;
+static size_t TheScenarioLength = 0;
+static size_t TheScenarioIndex = 0;
+static uint64_t TheScenarioAt = 0;      /**< The time of the next scenario step, '0' if waiting */
+
+static uint32_t TheLatency = 0;         /**< The modem latency, in micro-seconds */
+static int TheErrorRate = 0;            /**< The percentage of the failed commands */
+static char TheErrorPrefix[32] = {0};   /**< The failed commands prefix, all commands if empty */
+static unsigned int TheErrorSeed = 1;
+
+static TSimStats TheStats;
+static bool TheReplied = false;         /**< All the output is sent after the last command */
+static uint64_t TheRepliedAt = 0;       /**< The time the last output byte is sent at */
+static uint64_t TheHoldUntil = 0;       /**< The output is held till this time, the modem latency */
+
+static char TheInBuffer[1024] = {0};
+static char TheOutBuffer[128 * 1024] = {0};
 static size_t TheInBufferWrIndex = 0;
 static size_t TheOutBufferRdIndex = 0;
 static size_t TheOutBufferWrIndex = 0;
 
-static void *sim_read_thread(void *args);
-static void *sim_write_thread(void *args);
+static void *sim_io_thread(void *args);
+static void sim_io_read(void);
+static void sim_io_write(void);
+static uint64_t sim_now(void);
+static void sim_signal(int signal);
 
 static void sim_send(const char *rsp);
 static void sim_handle_command(const char *cmd);
 
+static bool sim_scenario_load(const char *name);
+static void sim_scenario_add(const char *line);
+static void sim_scenario_run(void);
+static bool sim_scenario_exec(const char *line);
+
+static void sim_stats_dump(void);
+static int sim_stats_compare(const void *a, const void *b);
+
 static void sim_dump(const char *str);
+static void sim_hex16(char *out, const char *str);
+static size_t sim_pdu(char *out, size_t length, const TSimSms *sms);
+static int sim_mailbox_add(const char *phone, const char *body, bool read);
+static void sim_mailbox_backlog(int count, const char *phone, const char *body);
+static void sim_mailbox_list(void);
+static void sim_mailbox_read(int index);
+static void sim_mailbox_delete(int index, int flag);
 
 int main(int argc, char **argv)
 {
   int res;
+  size_t i;
+  char line[32];
+  const char *scenario = NULL;
+
+  /* '-b <count>' fills the simulated modem with a backlog of <count> unread SMS,
+     '-p <port>' attaches the simulator to the extra GSM port <port> of the emulator,
+     '-s <file>' runs the scenario from <file> instead of the default boot sequence */
+  while (-1 != (res = getopt(argc, argv, "b:p:s:"))) {
+    if ('b' == res) {
+      TheBacklog = atoi(optarg);
+    } else if ('p' == res && atoi(optarg) > 0) {
+      snprintf(TheInPipeName, sizeof (TheInPipeName), "/var/tmp/mcode-to-sim-%d", atoi(optarg));
+      snprintf(TheOutPipeName, sizeof (TheOutPipeName), "/var/tmp/sim-to-mcode-%d", atoi(optarg));
+    } else if ('s' == res) {
+      scenario = optarg;
+    } else {
+      fprintf(stderr, "Usage: %s [-b <backlog>] [-p <port>] [-s <scenario>]\n", argv[0]);
+      exit(1);
+    }
+  }
+
+  if (scenario) {
+    if (!sim_scenario_load(scenario)) {
+      fprintf(stderr, "Error: cannot load the scenario: \"%s\"\n", scenario);
+      exit(1);
+    }
+  } else {
+    for (i = 0; i < sizeof (TheDefaultScenario)/sizeof (*TheDefaultScenario); ++i) {
+      sim_scenario_add(TheDefaultScenario[i]);
+    }
+  }
+  if (TheBacklog) {
+    snprintf(line, sizeof (line), "sms %d", TheBacklog);
+    sim_scenario_add("sleep 1000");
+    sim_scenario_add(line);
+  }
+
+  sim_mailbox_add("+98875310123", "Test SMS\nLine 2;\n+cmgr=\"hello\"", true);
+  sim_mailbox_add("+98875310123", "Test SMS\nLine 2;\n+cmgr=\"hello\"", false);
 
   /* first, init the scheduler */
   scheduler_init();
@@ -81,32 +210,16 @@ int main(int argc, char **argv)
   /* start the command engine */
   cmd_engine_start();
 
+  /* Ctrl+C stops the run, the statistics is printed on exit */
+  signal(SIGINT, sim_signal);
+  signal(SIGPIPE, SIG_IGN);
+
   TheRunRequest = true;
-  res = pthread_create(&TheReadThread, NULL, sim_read_thread, NULL);
-  if (-1 == res) exit(1);
-  res = pthread_create(&TheWriteThread, NULL, sim_write_thread, NULL);
-  if (-1 == res) exit(1);
+  res = pthread_create(&TheIoThread, NULL, sim_io_thread, NULL);
+  if (res) exit(1);
 
-  /*
-  READY event
-  Full-functionality event
-  PIN-READY event
-  Call-READY event
-  SMS-READY event
-  */
-  sleep(1);
-  sim_send("RDY\r\n");
-  sleep(1);
-  sim_send("+CFUN: 1\r\n");
-  sleep(1);
-  sim_send("+CPIN: READY\r\n");
-  sleep(1);
-  sim_send("Call Ready\r\n");
-  sleep(1);
-  sim_send("SMS Ready\r\n");
-
-  pthread_join(TheReadThread, NULL);
-  pthread_join(TheWriteThread, NULL);
+  pthread_join(TheIoThread, NULL);
+  sim_stats_dump();
 
   cmd_engine_deinit();
   line_editor_uart_deinit();
@@ -114,112 +227,498 @@ int main(int argc, char **argv)
   mtick_deinit();
   scheduler_deinit();
 
+  for (i = 0; i < TheScenarioLength; ++i) {
+    free(TheScenario[i]);
+  }
+  free(TheScenario);
+
   return 0;
 }
 
-void *sim_read_thread(void *args)
+void *sim_io_thread(void *args)
 {
   int res;
-  char ch;
+  int timeout;
+  uint64_t now;
+  uint64_t next;
+  struct pollfd fds[2];
 
-  res = mkfifo("/var/tmp/mcode-to-sim", S_IRUSR | S_IWUSR);
+  res = mkfifo(TheInPipeName, S_IRUSR | S_IWUSR);
+  if (-1 == res && EEXIST != errno) exit(1);
+  res = mkfifo(TheOutPipeName, S_IRUSR | S_IWUSR);
   if (-1 == res && EEXIST != errno) exit(1);
 
-  TheInPipe = open("/var/tmp/mcode-to-sim", O_RDONLY | O_NONBLOCK);
+  TheInPipe = open(TheInPipeName, O_RDONLY | O_NONBLOCK);
   if (-1 == TheInPipe) exit(1);
 
+  TheScenarioAt = sim_now();
   while (TheRunRequest) {
-    res = read(TheInPipe, &ch, 1);
-    if (1 == res) {
-      if ('\r' != ch) {
-        TheInBuffer[TheInBufferWrIndex] = ch;
-        ++TheInBufferWrIndex;
-        continue;
+    /* The write side can only be opened when the firmware is reading */
+    if (-1 == TheOutPipe) {
+      TheOutPipe = open(TheOutPipeName, O_WRONLY | O_NONBLOCK);
+    }
+
+    now = sim_now();
+    if (TheScenarioAt && now >= TheScenarioAt) {
+      sim_scenario_run();
+    }
+
+    /* Sleep till the next scenario step, the end of the modem latency or the I/O */
+    next = now + SIM_POLL_PERIOD * 1000;
+    if (TheScenarioAt && TheScenarioAt < next) {
+      next = TheScenarioAt;
+    }
+    fds[0].fd = TheInPipe;
+    fds[0].events = POLLIN;
+    fds[1].fd = TheOutPipe;
+    fds[1].events = 0;
+    if (TheOutBufferRdIndex != TheOutBufferWrIndex) {
+      if (TheHoldUntil > now) {
+        next = (TheHoldUntil < next) ? TheHoldUntil : next;
+      } else {
+        fds[1].events = POLLOUT;
       }
-      TheInBuffer[TheInBufferWrIndex] = 0;
-      sim_handle_command(TheInBuffer);
-      TheInBufferWrIndex = 0;
-    } else if (-1 == res && EAGAIN != errno) {
-      fprintf(stderr, "Error: %d, %d\n", res, errno);
     }
+    timeout = (next > now) ? (int)((next - now + 999) / 1000) : 0;
 
-    usleep(10000);
+    res = poll(fds, 2, timeout);
+    if (res < 0) {
+      if (EINTR != errno) {
+        fprintf(stderr, "Error: poll: %d\n", errno);
+        break;
+      }
+      continue;
+    }
+    if (fds[0].revents & POLLIN) {
+      sim_io_read();
+    }
+    if (fds[1].revents & POLLOUT) {
+      sim_io_write();
+    }
+    if ((fds[0].revents & POLLHUP) && !(fds[0].revents & POLLIN)) {
+      /* No writers, do not spin on the hang-up */
+      usleep(SIM_POLL_PERIOD * 1000);
+    }
   }
 
   close(TheInPipe);
-
-  return 0;
+  if (-1 != TheOutPipe) {
+    close(TheOutPipe);
+  }
+  return NULL;
 }
 
-void *sim_write_thread(void *args)
+void sim_io_read(void)
 {
-  int res;
-
-  res = mkfifo("/var/tmp/sim-to-mcode", S_IRUSR | S_IWUSR);
-  if (-1 == res && EEXIST != errno) exit(1);
+  char ch;
+  ssize_t i;
+  ssize_t res;
+  char buffer[4096];
 
-  TheOutPipe = open("/var/tmp/sim-to-mcode", O_WRONLY | O_NONBLOCK);
+  res = read(TheInPipe, buffer, sizeof (buffer));
+  if (-1 == res && EAGAIN != errno) {
+    fprintf(stderr, "Error: %d, %d\n", (int)res, errno);
+  }
 
-  char ch;
-  while (TheRunRequest) {
-    if (TheOutBufferWrIndex != TheOutBufferRdIndex) {
-      if (TheOutBufferRdIndex == sizeof (TheOutBuffer)) {
-        TheOutBufferRdIndex = 0;
+  for (i = 0; i < res; ++i) {
+    ch = buffer[i];
+    if ('\r' != ch) {
+      if (TheInBufferWrIndex < sizeof (TheInBuffer) - 1) {
+        TheInBuffer[TheInBufferWrIndex] = ch;
+        ++TheInBufferWrIndex;
       }
-
-      ch = TheOutBuffer[TheOutBufferRdIndex];
-      TheOutBuffer[TheOutBufferRdIndex] = 0;
-      ++TheOutBufferRdIndex;
-      write(TheOutPipe, &ch, 1);
+      continue;
     }
+    TheInBuffer[TheInBufferWrIndex] = 0;
+    sim_handle_command(TheInBuffer);
+    TheInBufferWrIndex = 0;
+  }
+  if (res > 0) {
+    TheStats.bytesIn += res;
+  }
+}
+
+void sim_io_write(void)
+{
+  ssize_t res;
 
-    usleep(1000);
+  if (-1 == TheOutPipe) {
+    return;
   }
 
-  close(TheOutPipe);
-  return NULL;
+  res = write(TheOutPipe, TheOutBuffer + TheOutBufferRdIndex, TheOutBufferWrIndex - TheOutBufferRdIndex);
+  if (res <= 0) {
+    return;
+  }
+
+  TheStats.bytesOut += res;
+  TheOutBufferRdIndex += res;
+  if (TheOutBufferRdIndex == TheOutBufferWrIndex) {
+    /* Everything is sent, the firmware reaction time is measured from now */
+    TheOutBufferRdIndex = 0;
+    TheOutBufferWrIndex = 0;
+    TheReplied = true;
+    TheRepliedAt = sim_now();
+  }
+}
+
+uint64_t sim_now(void)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+void sim_signal(int signal)
+{
+  TheRunRequest = false;
 }
 
 void sim_send(const char *rsp)
 {
-  char ch;
+  struct pollfd fd;
+  const size_t length = strlen(rsp);
 
   fprintf(stdout, "<<< \"");
   sim_dump(rsp);
   fprintf(stdout, "\"\n");
-  while ((ch = *rsp++)) {
-    if (TheOutBufferWrIndex == sizeof (TheOutBuffer)) {
-      TheOutBufferWrIndex = 0;
+  while (TheOutBufferWrIndex + length > sizeof (TheOutBuffer)) {
+    /* The output buffer is full, wait for the firmware to drain it */
+    fd.fd = TheOutPipe;
+    fd.events = POLLOUT;
+    if (!TheRunRequest || -1 == TheOutPipe || poll(&fd, 1, SIM_POLL_PERIOD) < 0) {
+      return;
     }
-    TheOutBuffer[TheOutBufferWrIndex] = ch;
-    ++TheOutBufferWrIndex;
+    sim_io_write();
   }
+  memcpy(TheOutBuffer + TheOutBufferWrIndex, rsp, length);
+  TheOutBufferWrIndex += length;
 }
 
 void sim_handle_command(const char *cmd)
 {
+  int index;
+  int flag;
+  size_t length;
+  char rsp[32];
+  MPduSms sms;
+  const uint64_t now = sim_now();
+
   fprintf(stdout, ">>> \"");
   sim_dump(cmd);
   fprintf(stdout, "\"\n");
-  if (!strcasecmp(cmd, "AT")) {
+
+  /* The command is the firmware reaction to the last output */
+  if (!TheStats.commands++) {
+    TheStats.startedAt = now;
+  }
+  TheStats.lastAt = now;
+  if (TheReplied && TheStats.samples < SIM_LATENCY_SAMPLES) {
+    TheStats.latency[TheStats.samples++] = (uint32_t)(now - TheRepliedAt);
+  }
+  TheReplied = false;
+  /* The response is sent after the modem latency */
+  TheHoldUntil = now + TheLatency;
+
+  length = strlen(cmd);
+  if (TheErrorRate && !strncasecmp(cmd, TheErrorPrefix, strlen(TheErrorPrefix)) &&
+      rand_r(&TheErrorSeed) % 100 < TheErrorRate) {
+    ++TheStats.errors;
+    sim_send("ERROR\r\n");
+  } else if (!strcasecmp(cmd, "AT")) {
+    sim_send("OK\r\n");
+  } else if (1 == sscanf(cmd, "AT+CMGF=%d", &flag) && (0 == flag || 1 == flag)) {
+    ThePduMode = !flag;
     sim_send("OK\r\n");
-  } else if (!strcasecmp(cmd, "AT+CMGS=\"002B00370030003000300031003100310032003200330033\"")) {
+  } else if (!strncasecmp(cmd, "AT+CMGS=", 8) && ('"' == cmd[8]) == !ThePduMode) {
     sim_send("> ");
-  } else if (!strcmp(cmd, "00680065006C006C006F\x1a")) {
-    sim_send("+CMGS: 2\r\n");
-    usleep(10000);
+  } else if (length && '\x1a' == cmd[length - 1]) {
+    if (ThePduMode && pdu_decode(cmd, length - 1, &sms)) {
+      fprintf(stdout, "--- SMS to %s: \"", sms.address);
+      sim_dump(sms.text);
+      fprintf(stdout, "\"\n");
+    }
+    snprintf(rsp, sizeof (rsp), "+CMGS: %d\r\n", ++TheSmsSent);
+    sim_send(rsp);
     sim_send("OK\r\n");
-  } else if (!strcasecmp(cmd, "AT+CMGR=1")) {
-    sim_send("+CMGR: \"REC READ\",\"002B00390038003800370035003300310030003100320033\",\"\",\"20/01/08,10:27:04+12\"\r\n");
-    usleep(10000);
-    sim_send("005400650073007400200053004D0053000A004C0069006E006500200032003B000A002B0063006D00670072003D002200680065006C006C006F0022\r\n");
-  } else if (!strcasecmp(cmd, "AT+CMGR=2")) {
-    sim_send("+CMGR: \"REC UNREAD\",\"002B00390038003800370035003300310030003100320033\",\"\",\"20/01/08,10:27:04+12\"\r\n");
-    usleep(10000);
-    sim_send("005400650073007400200053004D0053000A004C0069006E006500200032003B000A002B0063006D00670072003D002200680065006C006C006F0022\r\n");
+  } else if (1 == sscanf(cmd, "AT+CMGR=%d", &index)) {
+    sim_mailbox_read(index);
+  } else if (!strcasecmp(cmd, "AT+CMGL=\"REC UNREAD\"") || !strcasecmp(cmd, "AT+CMGL=0")) {
+    sim_mailbox_list();
+  } else if (2 == sscanf(cmd, "AT+CMGD=%d,%d", &index, &flag)) {
+    sim_mailbox_delete(index, flag);
+  } else {
+    sim_send("ERROR\r\n");
+  }
+}
+
+bool sim_scenario_load(const char *name)
+{
+  size_t length;
+  char line[512];
+  FILE *const file = fopen(name, "r");
+
+  if (!file) {
+    return false;
+  }
+
+  /* One step per line, the empty lines and the comments starting with '#' are skipped */
+  while (fgets(line, sizeof (line), file)) {
+    length = strlen(line);
+    while (length && isspace((unsigned char)line[length - 1])) {
+      line[--length] = 0;
+    }
+    if (length && '#' != *line) {
+      sim_scenario_add(line);
+    }
+  }
+
+  fclose(file);
+  return true;
+}
+
+void sim_scenario_add(const char *line)
+{
+  TheScenario = realloc(TheScenario, (TheScenarioLength + 1) * sizeof (*TheScenario));
+  if (!TheScenario) exit(1);
+  TheScenario[TheScenarioLength++] = strdup(line);
+}
+
+void sim_scenario_run(void)
+{
+  /* Execute the scenario steps till the next 'sleep' */
+  TheScenarioAt = 0;
+  while (!TheScenarioAt && TheScenarioIndex < TheScenarioLength) {
+    if (!sim_scenario_exec(TheScenario[TheScenarioIndex++])) {
+      fprintf(stdout, "--- Wrong scenario step: \"%s\"\n", TheScenario[TheScenarioIndex - 1]);
+    }
+  }
+}
+
+bool sim_scenario_exec(const char *line)
+{
+  int value;
+  int count;
+  char text[256];
+  char phone[MCODE_PDU_ADDRESS_LENGTH];
+
+  /*
+   * The scenario steps:
+   * 'sleep <ms>' - wait before the next step;
+   * 'urc <text>' - send the unsolicited result code <text>;
+   * 'sms <count> [<phone> [<body>]]' - the burst of <count> incoming SMS;
+   * 'latency <ms>' - the modem latency before each response;
+   * 'error <percent> [<prefix>]' - fail the commands starting with <prefix>, '0' disables;
+   * 'stats' - print the statistics;
+   * 'quit' - exit the simulator.
+   */
+  if (1 == sscanf(line, "sleep %d", &value) && value >= 0) {
+    TheScenarioAt = sim_now() + (uint64_t)value * 1000;
+  } else if (!strncmp(line, "urc ", 4)) {
+    snprintf(text, sizeof (text), "%s\r\n", line + 4);
+    sim_send(text);
+  } else if ((count = sscanf(line, "sms %d %23s %255[^\n]", &value, phone, text)) >= 1 && value > 0) {
+    sim_mailbox_backlog(value, (count > 1) ? phone : SIM_BACKLOG_PHONE, (count > 2) ? text : NULL);
+  } else if (1 == sscanf(line, "latency %d", &value) && value >= 0) {
+    TheLatency = (uint32_t)value * 1000;
+  } else if (1 == sscanf(line, "error %d", &value) && value >= 0 && value <= 100) {
+    TheErrorRate = value;
+    *TheErrorPrefix = 0;
+    sscanf(line, "error %*d %31s", TheErrorPrefix);
+  } else if (!strcmp(line, "stats")) {
+    sim_stats_dump();
+  } else if (!strcmp(line, "quit")) {
+    TheRunRequest = false;
   } else {
+    return false;
+  }
+
+  return true;
+}
+
+void sim_stats_dump(void)
+{
+  uint32_t *sorted;
+  const uint32_t samples = TheStats.samples;
+  const double elapsed = (TheStats.lastAt - TheStats.startedAt) / 1000000.0;
+
+  fprintf(stdout, "--- Commands: %u, errors injected: %u, bytes in: %llu, bytes out: %llu\n",
+          TheStats.commands, TheStats.errors,
+          (unsigned long long)TheStats.bytesIn, (unsigned long long)TheStats.bytesOut);
+  if (elapsed > 0) {
+    fprintf(stdout, "--- Throughput: %.1f commands/s, %.1f bytes/s in, %.1f bytes/s out\n",
+            TheStats.commands / elapsed, TheStats.bytesIn / elapsed, TheStats.bytesOut / elapsed);
+  }
+  if (!samples) {
+    return;
+  }
+
+  /* The nearest-rank percentiles of the firmware reaction time */
+  sorted = malloc(samples * sizeof (*sorted));
+  if (!sorted) {
+    return;
+  }
+  memcpy(sorted, TheStats.latency, samples * sizeof (*sorted));
+  qsort(sorted, samples, sizeof (*sorted), sim_stats_compare);
+  fprintf(stdout, "--- Latency, us: p50: %u, p90: %u, p99: %u, max: %u, samples: %u\n",
+          sorted[(samples - 1) * 50 / 100], sorted[(samples - 1) * 90 / 100],
+          sorted[(samples - 1) * 99 / 100], sorted[samples - 1], samples);
+  free(sorted);
+}
+
+int sim_stats_compare(const void *a, const void *b)
+{
+  const uint32_t x = *(const uint32_t *)a;
+  const uint32_t y = *(const uint32_t *)b;
+
+  return (x > y) - (x < y);
+}
+
+void sim_hex16(char *out, const char *str)
+{
+  char ch;
+
+  while ((ch = *str++)) {
+    out += sprintf(out, "%04X", (unsigned int)(unsigned char)ch);
+  }
+  *out = 0;
+}
+
+int sim_mailbox_add(const char *phone, const char *body, bool read)
+{
+  int i;
+  TSimSms *sms;
+
+  /* The SMS indexes start with '1' */
+  for (i = 1; i < SIM_MAILBOX_SIZE; ++i) {
+    sms = TheMailbox + i;
+    if (!sms->used) {
+      sms->used = true;
+      sms->read = read;
+      strncpy(sms->phone, phone, sizeof (sms->phone) - 1);
+      strncpy(sms->body, body, sizeof (sms->body) - 1);
+      return i;
+    }
+  }
+
+  return -1;
+}
+
+void sim_mailbox_backlog(int count, const char *phone, const char *body)
+{
+  int i;
+  int index;
+  char text[32];
+  char rsp[32];
+
+  fprintf(stdout, "--- Burst of %d SMS\n", count);
+  for (i = 0; i < count; ++i) {
+    if (!body) {
+      snprintf(text, sizeof (text), "\"SMS %d\"", i);
+    }
+    index = sim_mailbox_add(phone, body ? body : text, false);
+    if (index < 0) {
+      fprintf(stdout, "--- Mailbox is full\n");
+      break;
+    }
+    snprintf(rsp, sizeof (rsp), "+CMTI: \"SM\",%d\r\n", index);
+    sim_send(rsp);
+  }
+}
+
+void sim_mailbox_read(int index)
+{
+  char header[256];
+  char phone[4 * MCODE_PDU_ADDRESS_LENGTH];
+  char body[2 * MCODE_PDU_MAX_LENGTH + 1];
+  TSimSms *sms = TheMailbox + index;
+
+  if (index < 0 || index >= SIM_MAILBOX_SIZE || !sms->used) {
     sim_send("ERROR\r\n");
+    return;
   }
+
+  if (ThePduMode) {
+    snprintf(header, sizeof (header), "+CMGR: %d,,%d\r\n",
+             sms->read ? 1 : 0, (int)sim_pdu(body, sizeof (body), sms));
+  } else {
+    sim_hex16(phone, sms->phone);
+    sim_hex16(body, sms->body);
+    snprintf(header, sizeof (header), "+CMGR: \"%s\",\"%s\",\"\",\"20/01/08,10:27:04+12\"\r\n",
+             sms->read ? "REC READ" : "REC UNREAD", phone);
+  }
+  sim_send(header);
+  sim_send(body);
+  sim_send("\r\n");
+  sim_send("OK\r\n");
+  sms->read = true;
+}
+
+void sim_mailbox_list(void)
+{
+  int i;
+  int count = 0;
+  char header[256];
+  char phone[4 * MCODE_PDU_ADDRESS_LENGTH];
+  char body[2 * MCODE_PDU_MAX_LENGTH + 1];
+  TSimSms *sms;
+
+  for (i = 1; i < SIM_MAILBOX_SIZE; ++i) {
+    sms = TheMailbox + i;
+    if (!sms->used || sms->read) {
+      continue;
+    }
+    if (ThePduMode) {
+      snprintf(header, sizeof (header), "+CMGL: %d,0,,%d\r\n", i, (int)sim_pdu(body, sizeof (body), sms));
+    } else {
+      sim_hex16(phone, sms->phone);
+      sim_hex16(body, sms->body);
+      snprintf(header, sizeof (header), "+CMGL: %d,\"REC UNREAD\",\"%s\",\"\",\"20/01/08,10:27:04+12\"\r\n",
+               i, phone);
+    }
+    sim_send(header);
+    sim_send(body);
+    sim_send("\r\n");
+    sms->read = true;
+    ++count;
+  }
+  sim_send("OK\r\n");
+  fprintf(stdout, "--- Listed %d SMS\n", count);
+}
+
+void sim_mailbox_delete(int index, int flag)
+{
+  int i;
+  int count = 0;
+
+  for (i = 1; i < SIM_MAILBOX_SIZE; ++i) {
+    /* Flag '0' deletes the SMS at 'index', '1' - all read SMS, '4' - all SMS */
+    if (TheMailbox[i].used && ((!flag && i == index) ||
+                               (1 == flag && TheMailbox[i].read) || 4 == flag)) {
+      TheMailbox[i].used = false;
+      ++count;
+    }
+  }
+  sim_send("OK\r\n");
+  fprintf(stdout, "--- Deleted %d SMS\n", count);
+}
+
+size_t sim_pdu(char *out, size_t length, const TSimSms *sms)
+{
+  /* Received on 20/01/08,10:27:04+12, in semi-octets */
+  static const uint8_t timestamp[7] = { 0x02, 0x10, 0x80, 0x01, 0x72, 0x40, 0x21 };
+  MPduSms pdu;
+
+  memset(&pdu, 0, sizeof (pdu));
+  pdu.type = MPduTypeDeliver;
+  pdu.length = strlen(sms->body);
+  pdu.dcs = pdu_text_dcs(sms->body, pdu.length);
+  memcpy(pdu.timestamp, timestamp, sizeof (timestamp));
+  strcpy(pdu.address, sms->phone);
+  strcpy(pdu.text, sms->body);
+
+  return pdu_encode(&pdu, out, length);
 }
 
 void sim_dump(const char *str)
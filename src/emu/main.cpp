@@ -31,7 +31,10 @@
 #include "console.h"
 #include "hw-uart.h"
 #include "hw-leds.h"
+#include "hw-rtc.h"
+#include "hw-twi.h"
 #include "scheduler.h"
+#include "twi-queue.h"
 #include "cmd-engine.h"
 #include "gsm-engine.h"
 #include "line-editor-uart.h"
@@ -39,18 +42,28 @@
 #include <QDebug>
 #include <stdio.h>
 #include <signal.h>
+#include <string.h>
 #include <QStringList>
 #include <QApplication>
 
 static uint16_t TheWidth = 240;
 static uint16_t TheHeight = 320;
+static uint16_t TheFrameRate = 60;
+static bool TheHeadless = false;
 
 static void main_at_exit (void);
 static void main_sigint_handler (int signo);
 
 int main(int argc, char **argv)
 {
-  QApplication app(argc, argv);
+  int i;
+  // The GUI is selected before Qt connects to the display
+  for (i = 1; i < argc; ++i) {
+    if (!strcmp(argv[i], "-n")) {
+      TheHeadless = true;
+    }
+  }
+  QApplication app(argc, argv, !TheHeadless);
   const QStringList &arguments = QCoreApplication::arguments();
   // Parsing arguments
   const int sizeIndex = arguments.indexOf("-s");
@@ -68,7 +81,16 @@ int main(int argc, char **argv)
       }
     }
   }
-  qDebug() << "MAIN: LCD resolution: (" << TheWidth << "X" << TheHeight << ")";
+  const int rateIndex = arguments.indexOf("-f");
+  if (rateIndex >= 0 && argc >= rateIndex + 2) {
+    bool ok = false;
+    const uint proposedRate = arguments[rateIndex + 1].toUInt(&ok);
+    if (ok && proposedRate && proposedRate <= 1000) {
+      TheFrameRate = proposedRate;
+    }
+  }
+  qDebug() << "MAIN: LCD resolution: (" << TheWidth << "X" << TheHeight << "), frame rate:" << TheFrameRate
+           << (TheHeadless ? ", headless" : "");
 
   /* override the signal handler */
   if (SIG_ERR == signal(SIGINT, main_sigint_handler)) {
@@ -86,6 +108,15 @@ int main(int argc, char **argv)
   lcd_init(TheWidth, TheHeight);
   /* init LEDs */
   leds_init();
+#ifdef MCODE_TWI
+  /* The emulated TWI devices */
+  twi_init();
+  twi_queue_init();
+#endif /* MCODE_TWI */
+#ifdef MCODE_RTC
+  mtime_init();
+  rtc_alarm_init();
+#endif /* MCODE_RTC */
   /* init the line editor and the command engine */
   line_editor_uart_init();
   cmd_engine_init();
@@ -110,6 +141,14 @@ int main(int argc, char **argv)
 
   cmd_engine_deinit();
   line_editor_uart_deinit();
+#ifdef MCODE_RTC
+  rtc_alarm_deinit();
+  mtime_deinit();
+#endif /* MCODE_RTC */
+#ifdef MCODE_TWI
+  twi_queue_deinit();
+  twi_deinit();
+#endif /* MCODE_TWI */
   lcd_deinit();
   mtimer_deinit();
   mtick_deinit();
@@ -147,3 +186,13 @@ uint16_t main_base_height(void)
 {
   return TheHeight;
 }
+
+uint16_t main_frame_rate(void)
+{
+  return TheFrameRate;
+}
+
+bool main_headless(void)
+{
+  return TheHeadless;
+}
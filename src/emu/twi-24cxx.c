@@ -0,0 +1,150 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Alexander Chumakov
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "twi-24cxx.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static bool twi_24cxx_write(MTwiDevice *device, uint8_t length, const uint8_t *data);
+static bool twi_24cxx_read(MTwiDevice *device, uint8_t length, uint8_t *data);
+static bool twi_24cxx_busy(MTwi24cxx *eeprom);
+
+bool twi_24cxx_init(MTwi24cxx *eeprom, uint8_t addr, uint32_t size, uint16_t pageSize)
+{
+  memset(eeprom, 0, sizeof (*eeprom));
+  if ((size & (size - 1)) || (pageSize & (pageSize - 1)) || !pageSize || pageSize > size ||
+      size < 128 || (size > 256 && size < 4096) || size > 65536) {
+    /* Not supported geometry */
+    return false;
+  }
+
+  eeprom->data = (uint8_t *)malloc(size);
+  eeprom->pageWrites = (uint32_t *)calloc(size/pageSize, sizeof (uint32_t));
+  if (!eeprom->data || !eeprom->pageWrites) {
+    twi_24cxx_deinit(eeprom);
+    return false;
+  }
+  memset(eeprom->data, 0xff, size);
+
+  eeprom->size = size;
+  eeprom->pageSize = pageSize;
+  eeprom->writeCycle = TWI_24CXX_WRITE_CYCLE;
+  eeprom->device.name = "24Cxx";
+  eeprom->device.addr = (addr & 0xfeu);
+  eeprom->device.write = twi_24cxx_write;
+  eeprom->device.read = twi_24cxx_read;
+  return true;
+}
+
+void twi_24cxx_deinit(MTwi24cxx *eeprom)
+{
+  free(eeprom->data);
+  free(eeprom->pageWrites);
+  eeprom->data = NULL;
+  eeprom->pageWrites = NULL;
+}
+
+void twi_24cxx_stats_reset(MTwi24cxx *eeprom)
+{
+  memset(&eeprom->stats, 0, sizeof (eeprom->stats));
+  memset(eeprom->pageWrites, 0, (eeprom->size/eeprom->pageSize)*sizeof (uint32_t));
+}
+
+bool twi_24cxx_write(MTwiDevice *device, uint8_t length, const uint8_t *data)
+{
+  uint32_t page;
+  uint32_t offset;
+  uint32_t written;
+  MTwi24cxx *const eeprom = (MTwi24cxx *)device;
+  const uint8_t addressLength = (eeprom->size > 256) ? 2 : 1;
+
+  if (twi_24cxx_busy(eeprom)) {
+    return false;
+  }
+  if (length < addressLength) {
+    /* Stopped before the address is complete, nothing changes */
+    return true;
+  }
+
+  if (2 == addressLength) {
+    eeprom->pointer = (((uint32_t)data[0] << 8) | data[1]) & (eeprom->size - 1);
+  } else {
+    eeprom->pointer = data[0] & (eeprom->size - 1);
+  }
+  data += addressLength;
+  length -= addressLength;
+  if (!length) {
+    /* The address for the next read */
+    return true;
+  }
+
+  /* The address counter rolls over within the page */
+  page = eeprom->pointer & ~(uint32_t)(eeprom->pageSize - 1);
+  offset = eeprom->pointer & (eeprom->pageSize - 1);
+  if (length > eeprom->pageSize - offset) {
+    eeprom->stats.wrapped += length - (eeprom->pageSize - offset);
+  }
+  for (written = 0; written < length; ++written) {
+    eeprom->data[page + offset] = data[written];
+    offset = (offset + 1) & (eeprom->pageSize - 1);
+  }
+  eeprom->pointer = page + offset;
+
+  /* The page is programmed after the stop condition */
+  page /= eeprom->pageSize;
+  ++eeprom->stats.writeCycles;
+  if (++eeprom->pageWrites[page] > eeprom->stats.maxWear) {
+    eeprom->stats.maxWear = eeprom->pageWrites[page];
+  }
+  eeprom->busyUntil = twi_bus_now() + eeprom->writeCycle;
+  return true;
+}
+
+bool twi_24cxx_read(MTwiDevice *device, uint8_t length, uint8_t *data)
+{
+  MTwi24cxx *const eeprom = (MTwi24cxx *)device;
+
+  if (twi_24cxx_busy(eeprom)) {
+    return false;
+  }
+
+  /* The sequential read rolls over to the memory start */
+  while (length--) {
+    *data++ = eeprom->data[eeprom->pointer];
+    eeprom->pointer = (eeprom->pointer + 1) & (eeprom->size - 1);
+  }
+  return true;
+}
+
+bool twi_24cxx_busy(MTwi24cxx *eeprom)
+{
+  if (twi_bus_now() < eeprom->busyUntil) {
+    /* No ACK during the write cycle, the acknowledge polling */
+    ++eeprom->stats.busyNacks;
+    return true;
+  }
+  return false;
+}
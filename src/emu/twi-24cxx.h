@@ -0,0 +1,93 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Alexander Chumakov
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef MCODE_TWI_24CXX_H
+#define MCODE_TWI_24CXX_H
+
+#include "twi-bus.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** The 24Cxx TWI address with A0-A2 pulled up, as on the DS3231 modules */
+#define TWI_24CXX_ADDRESS (0xaeu)
+/** The default write cycle time, in micro-seconds */
+#define TWI_24CXX_WRITE_CYCLE (5000u)
+
+/**
+ * The 24Cxx wear statistics
+ */
+typedef struct {
+  uint32_t writeCycles;                 /**< The page programming cycles */
+  uint32_t wrapped;                     /**< The bytes rolled over to the page start */
+  uint32_t busyNacks;                   /**< The transfers NACK-ed during a write cycle */
+  uint32_t maxWear;                     /**< The largest number of the write cycles of a page */
+} MTwi24cxxStats;
+
+/**
+ * The 24Cxx EEPROM model
+ * @note The parts above 2KB use 2 address bytes; the parts with the block select bits
+ *       in the device address (24C04-24C16) are not supported
+ */
+typedef struct {
+  MTwiDevice device;                    /**< Should be the first member */
+  uint32_t size;                        /**< The size in bytes, a power of 2 */
+  uint16_t pageSize;                    /**< The page size in bytes, a power of 2 */
+  uint32_t writeCycle;                  /**< The write cycle time, in micro-seconds */
+  uint32_t pointer;                     /**< The address counter */
+  uint64_t busyUntil;                   /**< The end of the write cycle, the bus time */
+  uint8_t *data;
+  uint32_t *pageWrites;                 /**< The write cycles of each page */
+  MTwi24cxxStats stats;
+} MTwi24cxx;
+
+/**
+ * Initialize the EEPROM model, erased to 0xff
+ * @param[in] eeprom The model to initialize
+ * @param[in] addr The device address
+ * @param[in] size The EEPROM size in bytes, 128..256 or 4096..65536
+ * @param[in] pageSize The page size in bytes
+ * @return The success status, \c false if the geometry is not supported
+ */
+bool twi_24cxx_init(MTwi24cxx *eeprom, uint8_t addr, uint32_t size, uint16_t pageSize);
+/**
+ * Release the EEPROM memory, the model should be detached from the bus
+ */
+void twi_24cxx_deinit(MTwi24cxx *eeprom);
+
+/**
+ * Reset the wear statistics
+ */
+void twi_24cxx_stats_reset(MTwi24cxx *eeprom);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* MCODE_TWI_24CXX_H */
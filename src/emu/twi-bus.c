@@ -0,0 +1,191 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Alexander Chumakov
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "twi-bus.h"
+
+#include <time.h>
+#include <string.h>
+
+static MTwiDevice *twi_bus_route(uint8_t addr);
+static uint64_t twi_bus_monotonic(void);
+
+static MTwiBusStats TheStats;
+static MTwiDevice *TheDevices[TWI_BUS_DEVICES];
+static twi_bus_clock TheClock = twi_bus_monotonic;
+
+void twi_bus_init(void)
+{
+  memset(TheDevices, 0, sizeof (TheDevices));
+  TheClock = twi_bus_monotonic;
+  twi_bus_stats_reset();
+}
+
+void twi_bus_deinit(void)
+{
+  memset(TheDevices, 0, sizeof (TheDevices));
+}
+
+bool twi_bus_attach(MTwiDevice *device)
+{
+  uint8_t i;
+
+  if (twi_bus_route(device->addr)) {
+    /* The address is taken */
+    return false;
+  }
+
+  for (i = 0; i < TWI_BUS_DEVICES; ++i) {
+    if (!TheDevices[i]) {
+      memset(&device->stats, 0, sizeof (device->stats));
+      TheDevices[i] = device;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void twi_bus_detach(MTwiDevice *device)
+{
+  uint8_t i;
+
+  for (i = 0; i < TWI_BUS_DEVICES; ++i) {
+    if (device == TheDevices[i]) {
+      TheDevices[i] = NULL;
+    }
+  }
+}
+
+MTwiDevice *twi_bus_device(uint8_t index)
+{
+  return (index < TWI_BUS_DEVICES) ? TheDevices[index] : NULL;
+}
+
+bool twi_bus_write(uint8_t addr, uint8_t length, const uint8_t *data)
+{
+  bool ack;
+  MTwiDevice *const device = twi_bus_route(addr);
+  const uint32_t time = twi_bus_transfer_time(length);
+
+  ++TheStats.transfers;
+  TheStats.busTime += time;
+  if (!device) {
+    /* Nobody ACKs the address, the transfer stops after it */
+    ++TheStats.unrouted;
+    return false;
+  }
+
+  ack = (*device->write)(device, length, data);
+  device->stats.busTime += time;
+  if (ack) {
+    ++device->stats.writes;
+    device->stats.bytesWritten += length;
+  } else {
+    ++device->stats.nacks;
+  }
+  return ack;
+}
+
+bool twi_bus_read(uint8_t addr, uint8_t length, uint8_t *data)
+{
+  bool ack;
+  MTwiDevice *const device = twi_bus_route(addr);
+  const uint32_t time = twi_bus_transfer_time(length);
+
+  ++TheStats.transfers;
+  TheStats.busTime += time;
+  if (!device) {
+    ++TheStats.unrouted;
+    return false;
+  }
+
+  ack = (*device->read)(device, length, data);
+  device->stats.busTime += time;
+  if (ack) {
+    ++device->stats.reads;
+    device->stats.bytesRead += length;
+  } else {
+    ++device->stats.nacks;
+  }
+  return ack;
+}
+
+uint32_t twi_bus_transfer_time(uint8_t length)
+{
+  /* 9 clocks per byte (with the ACK bit), 1 clock for each of the start/stop conditions */
+  const uint32_t clocks = 9u*(1u + length) + 2u;
+
+  return (uint32_t)(((uint64_t)clocks*1000000u + TWI_BUS_FREQUENCY - 1)/TWI_BUS_FREQUENCY);
+}
+
+uint64_t twi_bus_now(void)
+{
+  return (*TheClock)();
+}
+
+void twi_bus_set_clock(twi_bus_clock clock)
+{
+  TheClock = clock ? clock : twi_bus_monotonic;
+}
+
+const MTwiBusStats *twi_bus_stats(void)
+{
+  return &TheStats;
+}
+
+void twi_bus_stats_reset(void)
+{
+  uint8_t i;
+
+  memset(&TheStats, 0, sizeof (TheStats));
+  TheStats.since = twi_bus_now();
+  for (i = 0; i < TWI_BUS_DEVICES; ++i) {
+    if (TheDevices[i]) {
+      memset(&TheDevices[i]->stats, 0, sizeof (TheDevices[i]->stats));
+    }
+  }
+}
+
+MTwiDevice *twi_bus_route(uint8_t addr)
+{
+  uint8_t i;
+
+  addr &= 0xfeu;
+  for (i = 0; i < TWI_BUS_DEVICES; ++i) {
+    if (TheDevices[i] && addr == TheDevices[i]->addr) {
+      return TheDevices[i];
+    }
+  }
+
+  return NULL;
+}
+
+uint64_t twi_bus_monotonic(void)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec*1000000u + (uint64_t)now.tv_nsec/1000u;
+}
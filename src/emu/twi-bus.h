@@ -0,0 +1,141 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Alexander Chumakov
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef MCODE_TWI_BUS_H
+#define MCODE_TWI_BUS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** The number of the devices on the emulated bus */
+#define TWI_BUS_DEVICES (8)
+/** The emulated bus frequency, in Hz */
+#define TWI_BUS_FREQUENCY (100000u)
+
+typedef struct MTwiDevice MTwiDevice;
+
+/**
+ * The time source of the emulated bus and the device models
+ * @return The current time, in micro-seconds
+ */
+typedef uint64_t (*twi_bus_clock)(void);
+
+/**
+ * The per-device transfer statistics
+ */
+typedef struct {
+  uint32_t writes;                      /**< The ACK-ed write transfers */
+  uint32_t reads;                       /**< The ACK-ed read transfers */
+  uint32_t nacks;                       /**< The transfers NACK-ed by the device */
+  uint64_t bytesWritten;
+  uint64_t bytesRead;
+  uint64_t busTime;                     /**< The bus time of the device transfers, in micro-seconds */
+} MTwiDeviceStats;
+
+/**
+ * The bus statistics
+ */
+typedef struct {
+  uint32_t transfers;                   /**< All the transfers, including the NACK-ed ones */
+  uint32_t unrouted;                    /**< The transfers to the addresses without a device */
+  uint64_t busTime;                     /**< The bus time of all the transfers, in micro-seconds */
+  uint64_t since;                       /**< The time the statistics are collected since */
+} MTwiBusStats;
+
+/**
+ * The emulated TWI device, the model handles the transfers routed to \c addr
+ */
+struct MTwiDevice {
+  const char *name;
+  uint8_t addr;                         /**< The device address, the R/W bit is 0 */
+  /** Handle the write transfer, return \c false to NACK it */
+  bool (*write)(MTwiDevice *device, uint8_t length, const uint8_t *data);
+  /** Fill \c data with \c length bytes, return \c false to NACK the transfer */
+  bool (*read)(MTwiDevice *device, uint8_t length, uint8_t *data);
+  MTwiDeviceStats stats;
+};
+
+/**
+ * Initialize the bus, no devices attached, the monotonic clock is used
+ */
+void twi_bus_init(void);
+void twi_bus_deinit(void);
+
+/**
+ * Attach the device model to the bus
+ * @return The success status, \c false if the address is taken or there is no room
+ */
+bool twi_bus_attach(MTwiDevice *device);
+void twi_bus_detach(MTwiDevice *device);
+/**
+ * Get the device at \c index, \c NULL if there is none
+ */
+MTwiDevice *twi_bus_device(uint8_t index);
+
+/**
+ * Route the write transfer to the device at \c addr
+ * @return The ACK status, \c false if there is no device or it NACKs
+ */
+bool twi_bus_write(uint8_t addr, uint8_t length, const uint8_t *data);
+/**
+ * Route the read transfer to the device at \c addr
+ * @return The ACK status, \c data is not changed on NACK
+ */
+bool twi_bus_read(uint8_t addr, uint8_t length, uint8_t *data);
+
+/**
+ * Get the bus time of the transfer: the start, the address byte, \c length data bytes
+ * and the stop, in micro-seconds
+ */
+uint32_t twi_bus_transfer_time(uint8_t length);
+
+/**
+ * Get the current bus time, in micro-seconds
+ */
+uint64_t twi_bus_now(void);
+/**
+ * Replace the time source, \c NULL restores the monotonic clock
+ */
+void twi_bus_set_clock(twi_bus_clock clock);
+
+/**
+ * Get the bus statistics, the bus utilisation is
+ * \c busTime/(twi_bus_now() - since)
+ */
+const MTwiBusStats *twi_bus_stats(void);
+/**
+ * Reset the bus and all the device statistics
+ */
+void twi_bus_stats_reset(void);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* MCODE_TWI_BUS_H */
@@ -0,0 +1,301 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Alexander Chumakov
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "twi-ds3231.h"
+
+#include <time.h>
+#include <string.h>
+
+/** The register map */
+#define DS3231_REG_SECONDS (0x00u)
+#define DS3231_REG_DAY (0x03u)
+#define DS3231_REG_YEAR (0x06u)
+#define DS3231_REG_ALARM1 (0x07u)
+#define DS3231_REG_ALARM2 (0x0bu)
+#define DS3231_REG_CONTROL (0x0eu)
+#define DS3231_REG_STATUS (0x0fu)
+#define DS3231_REG_TEMPERATURE (0x11u)
+#define DS3231_REGISTERS (0x13u)
+
+/** The control register bits */
+#define DS3231_A1IE (0x01u)
+#define DS3231_A2IE (0x02u)
+#define DS3231_INTCN (0x04u)
+#define DS3231_CONV (0x20u)
+/** The status register bits */
+#define DS3231_A1F (0x01u)
+#define DS3231_A2F (0x02u)
+#define DS3231_EN32KHZ (0x08u)
+#define DS3231_OSF (0x80u)
+
+/** The longest time gap checked for the alarms, in seconds */
+#define DS3231_ALARM_WINDOW (7*86400)
+
+static uint8_t ThePointer;
+static uint8_t TheRegisters[DS3231_REGISTERS];
+static int64_t TheOffset;               /**< The emulated time minus the bus time, in micro-seconds */
+static int64_t TheChecked;              /**< The last second checked for the alarms */
+static uint8_t TheWeekOffset;           /**< Maps the days since 1-Jan-1970 to the day register */
+static int16_t TheTemperature;
+static MTwiDevice TheDevice;
+
+static bool twi_ds3231_write(MTwiDevice *device, uint8_t length, const uint8_t *data);
+static bool twi_ds3231_read(MTwiDevice *device, uint8_t length, uint8_t *data);
+static int64_t twi_ds3231_seconds(void);
+static void twi_ds3231_latch(void);
+static void twi_ds3231_store(uint8_t reg, uint8_t value);
+static int64_t twi_ds3231_parse(void);
+static uint8_t twi_ds3231_day(int64_t seconds);
+static uint8_t twi_ds3231_hours(uint8_t reg);
+static bool twi_ds3231_match(const uint8_t *alarm, const struct tm *tm, uint8_t day);
+static uint8_t bcd(uint8_t value);
+static uint8_t from_bcd(uint8_t value);
+
+MTwiDevice *twi_ds3231_init(void)
+{
+  time_t now;
+  struct tm tm;
+
+  ThePointer = 0;
+  memset(TheRegisters, 0, sizeof (TheRegisters));
+  TheRegisters[DS3231_REG_CONTROL] = DS3231_INTCN | 0x18u;
+  TheRegisters[DS3231_REG_STATUS] = DS3231_OSF | DS3231_EN32KHZ;
+  TheTemperature = 25*4;
+
+  /* The local time, in the UTC arithmetic */
+  now = time(NULL);
+  localtime_r(&now, &tm);
+  /* 1-Jan-1970 is Thursday, the day register counts from Monday */
+  TheWeekOffset = 3;
+  twi_ds3231_set_time((int64_t)now + tm.tm_gmtoff);
+
+  TheDevice.name = "DS3231";
+  TheDevice.addr = TWI_DS3231_ADDRESS;
+  TheDevice.write = twi_ds3231_write;
+  TheDevice.read = twi_ds3231_read;
+  return &TheDevice;
+}
+
+void twi_ds3231_set_time(int64_t seconds)
+{
+  /* Setting the seconds resets the sub-second countdown */
+  TheOffset = seconds*1000000 - (int64_t)twi_bus_now();
+  TheChecked = seconds;
+  twi_ds3231_latch();
+}
+
+void twi_ds3231_update(void)
+{
+  time_t t;
+  struct tm tm;
+  int64_t second;
+  uint8_t alarm2[4];
+  const int64_t now = twi_ds3231_seconds();
+
+  if (now < TheChecked || now - TheChecked > DS3231_ALARM_WINDOW) {
+    /* The time is set, nothing to catch up */
+    TheChecked = (now < TheChecked) ? now : now - DS3231_ALARM_WINDOW;
+  }
+
+  for (second = TheChecked + 1; second <= now; ++second) {
+    t = (time_t)second;
+    gmtime_r(&t, &tm);
+    if (twi_ds3231_match(TheRegisters + DS3231_REG_ALARM1, &tm, twi_ds3231_day(second))) {
+      TheRegisters[DS3231_REG_STATUS] |= DS3231_A1F;
+    }
+    /* The alarm 2 has no seconds, it matches at 00 */
+    alarm2[0] = 0x80u;
+    memcpy(alarm2 + 1, TheRegisters + DS3231_REG_ALARM2, 3);
+    if (!tm.tm_sec && twi_ds3231_match(alarm2, &tm, twi_ds3231_day(second))) {
+      TheRegisters[DS3231_REG_STATUS] |= DS3231_A2F;
+    }
+  }
+  TheChecked = now;
+}
+
+bool twi_ds3231_interrupt(void)
+{
+  const uint8_t control = TheRegisters[DS3231_REG_CONTROL];
+  const uint8_t status = TheRegisters[DS3231_REG_STATUS];
+
+  return (control & DS3231_INTCN) && (control & status & (DS3231_A1IE | DS3231_A2IE));
+}
+
+void twi_ds3231_set_temperature(int16_t quarters)
+{
+  TheTemperature = quarters;
+}
+
+bool twi_ds3231_write(MTwiDevice *device, uint8_t length, const uint8_t *data)
+{
+  bool time = false;
+
+  if (!length) {
+    return true;
+  }
+
+  twi_ds3231_update();
+  twi_ds3231_latch();
+  ThePointer = (*data++ % DS3231_REGISTERS);
+  while (--length) {
+    time = time || ThePointer <= DS3231_REG_YEAR;
+    twi_ds3231_store(ThePointer, *data++);
+    ThePointer = (ThePointer + 1) % DS3231_REGISTERS;
+  }
+
+  if (time) {
+    const int64_t seconds = twi_ds3231_parse();
+    const uint8_t day = TheRegisters[DS3231_REG_DAY] & 0x07u;
+    /* The day register counts on from the written value */
+    TheWeekOffset = 0;
+    TheWeekOffset = (uint8_t)((day + 7u - twi_ds3231_day(seconds)) % 7u);
+    twi_ds3231_set_time(seconds);
+  }
+  return true;
+}
+
+bool twi_ds3231_read(MTwiDevice *device, uint8_t length, uint8_t *data)
+{
+  /* The time registers are copied to the read buffer once per transfer */
+  twi_ds3231_update();
+  twi_ds3231_latch();
+  while (length--) {
+    *data++ = TheRegisters[ThePointer];
+    ThePointer = (ThePointer + 1) % DS3231_REGISTERS;
+  }
+  return true;
+}
+
+int64_t twi_ds3231_seconds(void)
+{
+  const int64_t now = TheOffset + (int64_t)twi_bus_now();
+
+  return (now >= 0) ? now/1000000 : -((999999 - now)/1000000);
+}
+
+void twi_ds3231_latch(void)
+{
+  struct tm tm;
+  const int64_t seconds = twi_ds3231_seconds();
+  const time_t t = (time_t)seconds;
+  const uint8_t hours = TheRegisters[DS3231_REG_SECONDS + 2];
+  uint8_t *const regs = TheRegisters;
+
+  gmtime_r(&t, &tm);
+  regs[0] = bcd(tm.tm_sec);
+  regs[1] = bcd(tm.tm_min);
+  if (hours & 0x40u) {
+    /* The 12-hour mode is kept */
+    const uint8_t hour12 = (tm.tm_hour % 12) ? (tm.tm_hour % 12) : 12;
+    regs[2] = 0x40u | ((tm.tm_hour >= 12) ? 0x20u : 0x00u) | bcd(hour12);
+  } else {
+    regs[2] = bcd(tm.tm_hour);
+  }
+  regs[3] = twi_ds3231_day(seconds);
+  regs[4] = bcd(tm.tm_mday);
+  regs[5] = bcd(tm.tm_mon + 1) | ((tm.tm_year >= 200) ? 0x80u : 0x00u);
+  regs[6] = bcd(tm.tm_year % 100);
+
+  regs[DS3231_REG_TEMPERATURE] = (uint8_t)((TheTemperature & 0x3ff) >> 2);
+  regs[DS3231_REG_TEMPERATURE + 1] = (uint8_t)((TheTemperature & 0x03) << 6);
+}
+
+void twi_ds3231_store(uint8_t reg, uint8_t value)
+{
+  if (DS3231_REG_STATUS == reg) {
+    /* The flags are only cleared, the 32kHz output is controlled */
+    TheRegisters[reg] = (TheRegisters[reg] & value & (DS3231_OSF | DS3231_A1F | DS3231_A2F)) |
+      (value & DS3231_EN32KHZ);
+  } else if (DS3231_REG_CONTROL == reg) {
+    /* The conversion completes at once */
+    TheRegisters[reg] = (value & ~DS3231_CONV);
+  } else if (reg < DS3231_REG_TEMPERATURE) {
+    TheRegisters[reg] = value;
+  }
+}
+
+int64_t twi_ds3231_parse(void)
+{
+  struct tm tm;
+  const uint8_t *const regs = TheRegisters;
+
+  memset(&tm, 0, sizeof (tm));
+  tm.tm_sec = from_bcd(regs[0] & 0x7fu);
+  tm.tm_min = from_bcd(regs[1] & 0x7fu);
+  tm.tm_hour = twi_ds3231_hours(regs[2]);
+  tm.tm_mday = from_bcd(regs[4] & 0x3fu);
+  tm.tm_mon = from_bcd(regs[5] & 0x1fu) - 1;
+  tm.tm_year = 100 + from_bcd(regs[6]) + ((regs[5] & 0x80u) ? 100 : 0);
+  return (int64_t)timegm(&tm);
+}
+
+uint8_t twi_ds3231_day(int64_t seconds)
+{
+  const int64_t days = (seconds >= 0) ? seconds/86400 : -((86399 - seconds)/86400);
+  const int64_t week = (days + TheWeekOffset) % 7;
+
+  return (uint8_t)((week < 0 ? week + 7 : week) + 1);
+}
+
+uint8_t twi_ds3231_hours(uint8_t reg)
+{
+  if (reg & 0x40u) {
+    /* 12-hour mode, bit 5 is PM */
+    return (from_bcd(reg & 0x1fu) % 12) + ((reg & 0x20u) ? 12 : 0);
+  }
+  return from_bcd(reg & 0x3fu);
+}
+
+bool twi_ds3231_match(const uint8_t *alarm, const struct tm *tm, uint8_t day)
+{
+  /* The fields with the mask bit (bit 7) set are ignored; seconds, minutes, hours, day/date */
+  if (!(alarm[0] & 0x80u) && from_bcd(alarm[0] & 0x7fu) != tm->tm_sec) {
+    return false;
+  }
+  if (!(alarm[1] & 0x80u) && from_bcd(alarm[1] & 0x7fu) != tm->tm_min) {
+    return false;
+  }
+  if (!(alarm[2] & 0x80u) && twi_ds3231_hours(alarm[2] & 0x7fu) != tm->tm_hour) {
+    return false;
+  }
+  if (!(alarm[3] & 0x80u)) {
+    if (alarm[3] & 0x40u) {
+      /* Day of week */
+      return (alarm[3] & 0x0fu) == day;
+    }
+    return from_bcd(alarm[3] & 0x3fu) == tm->tm_mday;
+  }
+  return true;
+}
+
+uint8_t bcd(uint8_t value)
+{
+  return (uint8_t)(((value/10) << 4) | (value % 10));
+}
+
+uint8_t from_bcd(uint8_t value)
+{
+  return (uint8_t)(10*(value >> 4) + (value & 0x0fu));
+}
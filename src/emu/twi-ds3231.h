@@ -0,0 +1,74 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Alexander Chumakov
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef MCODE_TWI_DS3231_H
+#define MCODE_TWI_DS3231_H
+
+#include "twi-bus.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** The DS3231 TWI address */
+#define TWI_DS3231_ADDRESS (0xd0u)
+
+/**
+ * Initialize the DS3231 model: the time registers follow the bus clock, starting from
+ * the host local time; the oscillator-stop flag is set, as after the power-up
+ * @return The device to attach to the bus
+ * @note The year is 2000 + the year register, +100 if the century bit is set, the bit
+ *       toggles when the year register overflows, as in the chip
+ */
+MTwiDevice *twi_ds3231_init(void);
+
+/**
+ * Set the emulated time, in seconds since 1-Jan-1970, in the same time zone as
+ * the time registers
+ */
+void twi_ds3231_set_time(int64_t seconds);
+/**
+ * Advance the emulated time to the bus clock and set the alarm flags
+ * @note Called on each transfer, should be called periodically to update the INT pin
+ */
+void twi_ds3231_update(void);
+/**
+ * Get the INT/SQW pin state, \c true if the interrupt is asserted (the pin is low)
+ */
+bool twi_ds3231_interrupt(void);
+
+/**
+ * Set the temperature, in 0.25 degrees Celsius
+ */
+void twi_ds3231_set_temperature(int16_t quarters);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* MCODE_TWI_DS3231_H */
@@ -27,6 +27,14 @@
 
 #include <stdint.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 const uint8_t *mcode_fonts_get_char_bitmap (uint8_t code);
 
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
 #endif /* MCODE_FONTS_H */
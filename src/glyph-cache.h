@@ -0,0 +1,93 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Alexander Chumakov
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef MCODE_GLYPH_CACHE_H
+#define MCODE_GLYPH_CACHE_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * The glyph cache statistics
+ */
+typedef struct {
+  uint32_t hits;                        /**< The glyphs found in the cache */
+  uint32_t misses;                      /**< The glyphs expanded from the font */
+} MGlyphCacheStats;
+
+/**
+ * Get the 8x8 glyph of a character expanded to RGB565 words
+ * @param[in] code The character, the ones missing in the font are shown as spaces
+ * @param[in] offValue The background color
+ * @param[in] onValue The foreground color
+ * @return 64 words, row by row; valid until \c MCODE_GLYPH_CACHE_SIZE other glyphs
+ *         are requested or the color pair changes
+ * @note The cache keeps the glyphs for a single color pair, switching to another
+ *       pair drops all the cached glyphs; the least recently used glyph is evicted
+ */
+const uint16_t *glyph_cache_get(uint8_t code, uint16_t offValue, uint16_t onValue);
+
+/**
+ * Get the cached glyph of a character, neither the cache nor its statistics are updated
+ * @param[in] code The character, the ones missing in the font are shown as spaces
+ * @param[in] offValue The background color
+ * @param[in] onValue The foreground color
+ * @return 64 words, row by row, or NULL if the glyph is not cached for the color pair
+ */
+const uint16_t *glyph_cache_find(uint8_t code, uint16_t offValue, uint16_t onValue);
+
+/**
+ * Load the glyphs of a run of characters to the cache
+ * @note At most \c MCODE_GLYPH_CACHE_SIZE different glyphs of the run are loaded,
+ *       none of them is evicted by the others, so, \c glyph_cache_find does not
+ *       miss them till the cache is used again
+ */
+void glyph_cache_prefetch(const char *text, uint8_t length, uint16_t offValue, uint16_t onValue);
+
+/**
+ * Write a run of characters from the cache, see \c lcd_write_text
+ * @note The glyph rows are sent in blocks by \c lcd_write_words, the glyphs
+ *       not fitting the cache are expanded from the font on each row
+ */
+void glyph_cache_write_text(uint8_t cmd, const char *text, uint8_t length, uint16_t offValue, uint16_t onValue);
+
+/**
+ * Drop all the cached glyphs
+ */
+void glyph_cache_reset(void);
+
+/**
+ * Get the glyph cache statistics
+ */
+MGlyphCacheStats *glyph_cache_stats(void);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* MCODE_GLYPH_CACHE_H */
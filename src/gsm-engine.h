@@ -26,6 +26,8 @@
 #define MCODE_GSM_ENGINE_H
 
 
+#include <stddef.h>
+#include <stdint.h>
 #include <stdbool.h>
 
 #ifdef __cplusplus
@@ -46,8 +48,136 @@ typedef enum {
  */
 typedef void (*gsm_callback)(MGsmEvent type, const char *from, const char *body);
 
+typedef enum {
+  MGsmResultOk,
+  MGsmResultError,
+  MGsmResultTimeout,
+} MGsmResult;
+
+typedef enum {
+  MGsmExpectOk,     /**< The command completes on 'OK' or 'ERROR' */
+  MGsmExpectPrompt, /**< The command completes on the '> ' prompt */
+} MGsmExpect;
+
+/** The maximum length of the SMS body, including the end-of-string marker */
+#define MCODE_SMS_MAX_LENGTH (161)
+/** The maximum length of the SMS body sent in UCS2 text mode, including the end-of-string marker */
+#define MCODE_SMS_UCS2_MAX_LENGTH (71)
+/** The maximum length of the SMS address, including the end-of-string marker */
+#define MCODE_GSM_ADDRESS_MAX_LENGTH (24)
+#define MCODE_GSM_CMD_DATA_LENGTH (MCODE_GSM_ADDRESS_MAX_LENGTH + MCODE_SMS_MAX_LENGTH)
+
+/** The string variable for the address of the SMS being handled by the engine */
+#define MCODE_GSM_VAR_ADDRESS (3)
+/** The string variables for the SMS program, a reassembled concatenated SMS fits them */
+#define MCODE_GSM_VAR_PROGRAM (4)
+#define MCODE_GSM_VAR_PROGRAM_COUNT (5)
+/** The string variables for the program output, the linked parts of the reply */
+#define MCODE_GSM_VAR_OUTPUT (9)
+#define MCODE_GSM_VAR_OUTPUT_COUNT (5)
+
+#ifndef MCODE_GSM_QUEUE_LENGTH
+/** Default number of entries in the AT command queue */
+#define MCODE_GSM_QUEUE_LENGTH (4)
+#endif /* MCODE_GSM_QUEUE_LENGTH */
+
+#ifndef MCODE_GSM_BATCH_LENGTH
+/** The size of the buffer for the SMS programs collected while listing a batch */
+#define MCODE_GSM_BATCH_LENGTH (1024)
+#endif /* MCODE_GSM_BATCH_LENGTH */
+
+#ifndef MCODE_GSM_INSTANCES
+/** The maximum number of GSM engine instances, including the default one */
+#define MCODE_GSM_INSTANCES (4)
+#endif /* MCODE_GSM_INSTANCES */
+
+typedef struct _gsm_engine gsm_engine_t;
+
+/**
+ * Callback for the completion of a queued AT command
+ * @param[in] engine The GSM engine instance the command is completed on
+ * @param[in] result The command result
+ */
+typedef void (*gsm_cmd_done)(gsm_engine_t *engine, MGsmResult result);
+
+/**
+ * The transport for talking to a GSM module, usually a UART
+ */
+typedef struct {
+  void (*write_char)(void *ctx, char ch); /**< Write a character to the GSM module */
+  void *ctx;                              /**< The context passed to \c write_char */
+} MGsmTransport;
+
+/**
+ * The AT command queue entry, private to the GSM engine
+ */
+typedef struct {
+  uint8_t type;       /**< The command type */
+  uint8_t part;       /**< The 1-based part number of a concatenated SMS, '0' for a single SMS */
+  uint8_t parts;      /**< The number of parts of a concatenated SMS */
+  uint8_t ref;        /**< The reference of a concatenated SMS */
+  uint32_t timeout;   /**< The timeout in milliseconds, counted from sending the command */
+  uint64_t queued;    /**< The time the command has been queued at */
+  gsm_cmd_done done;  /**< The optional completion callback */
+  /** The AT command, or "<address>\0<body>" for SMS entries */
+  char data[MCODE_GSM_CMD_DATA_LENGTH];
+} MGsmCmd;
+
+/** Number of buckets in the AT command queue histograms */
+#define MCODE_GSM_HIST_BUCKETS (16)
+
+/**
+ * The AT command queue statistics
+ * @note Histogram bucket 'N' counts values in [2^(N-1), 2^N) milli-seconds,
+ *       bucket '0' counts zero values, the last bucket counts all the longer values
+ */
+typedef struct {
+  uint8_t depth;                         /**< The current queue depth */
+  uint8_t maxDepth;                      /**< The maximum queue depth */
+  uint32_t queued;                       /**< The number of queued commands */
+  uint32_t rejected;                     /**< The number of rejected commands, the queue was full */
+  uint32_t timeouts;                     /**< The number of commands completed on timeout */
+  uint16_t wait[MCODE_GSM_HIST_BUCKETS]; /**< The time spent in the queue before sending */
+  uint16_t rtt[MCODE_GSM_HIST_BUCKETS];  /**< The time from sending to the final result */
+} MGsmQueueStats;
+
+/**
+ * The GSM engine instance, bound to a single GSM module
+ * @note The fields are private to the GSM engine, the structure is public
+ *       only for allocating the instances statically
+ */
+struct _gsm_engine {
+  const MGsmTransport *transport;       /**< The transport to the GSM module */
+  gsm_callback callback;                /**< The GSM events callback */
+  uint8_t state;                        /**< The modem state */
+  uint8_t flags;                        /**< The modem ready flags */
+  bool pduMode;                         /**< The modem is switched to PDU mode */
+  uint8_t smsRef;                       /**< The reference of the last concatenated SMS sent */
+  char msg[MCODE_SMS_MAX_LENGTH];       /**< The body of the SMS being sent */
+  /* The SMS program engine state */
+  uint8_t engineState;                  /**< The SMS program engine state */
+  bool kicked;                          /**< The engine step is scheduled */
+  bool listRequest;                     /**< All unread SMS should be listed */
+  bool listBody;                        /**< The next listed line is the SMS body */
+  uint16_t batchCount;                  /**< The number of programs executed in the batch */
+  uint16_t batchSkipped;                /**< The number of programs not fitting the batch buffer */
+  uint16_t batchLength;                 /**< The length of the collected programs */
+  char batch[MCODE_GSM_BATCH_LENGTH];   /**< The collected programs, each one zero-terminated */
+  uint32_t engineIndex;                 /**< The index of the SMS being handled */
+  uint64_t startedAt;                   /**< The time the SMS handling has started at */
+  /* The AT command queue */
+  uint8_t cmdHead;                      /**< The index of the first queued command */
+  uint8_t cmdCount;                     /**< The number of queued commands */
+  bool cmdActive;                       /**< The first queued command is sent */
+  uint64_t cmdSentAt;                   /**< The time the first queued command is sent at */
+  uint64_t cmdDeadline;                 /**< The time the first queued command times out at */
+  MGsmCmd cmds[MCODE_GSM_QUEUE_LENGTH]; /**< The queued commands */
+  MGsmQueueStats stats;                 /**< The queue statistics */
+};
+
 /**
  * Initialize the GSM engine
+ * @note This initializes the default GSM engine instance, bound to UART2
  */
 void gsm_init(void);
 /**
@@ -87,9 +217,34 @@ void gsm_power(bool on);
  * Send AT-command to the GSM module
  * @param[in] cmd The AT command to be sent
  * @return Success of operation
+ * @note If the GSM module is busy, the command is queued
  */
 bool gsm_send_cmd(const char *cmd);
 
+/**
+ * Queue an AT command for sending to the GSM module
+ * @param[in] cmd The AT command to be sent, it may include escape sequences and variables,
+ *                they are expanded when the command is queued
+ * @param[in] expect The final result that completes the command
+ * @param[in] timeout The timeout in milli-seconds, counted from sending the command
+ * @param[in] done The optional completion callback
+ * @return \c true if the command is queued, \c false if the GSM module is not ready
+ *         or the queue is full
+ * @note The queued commands are sent back to back, as soon as the previous one completes
+ */
+bool gsm_queue_cmd(const char *cmd, MGsmExpect expect, uint32_t timeout, gsm_cmd_done done);
+
+/**
+ * Get the AT command queue statistics
+ * @return The pointer to the statistics data
+ */
+const MGsmQueueStats *gsm_queue_stats(void);
+
+/**
+ * Reset the AT command queue statistics
+ */
+void gsm_queue_stats_reset(void);
+
 /**
  * Send an AT command to GSM module
  * @param[in] cmd The AT command to be sent, it may include escape sequences
@@ -108,14 +263,75 @@ void gsm_send_cmd_raw(const char *cmd);
  * @param[in] address The phone number for sending SMS
  * @param[in] body The SMS body to be sent
  * @return Success of operation
+ * @note The SMS is queued to the next ready GSM engine instance in round-robin order,
+ *       skipping the instances with the full queues
+ * @note In PDU mode, a long body is split into the linked parts of a concatenated SMS,
+ *       all of them are queued back to back; in text mode, the body is truncated
  */
 bool gsm_send_sms(const char *address, const char *body);
 
+/**
+ * Initialize a GSM engine instance and bind it to a transport
+ * @param[in] engine The GSM engine instance to be initialized
+ * @param[in] transport The transport to the GSM module
+ * @return \c true on success, \c false if there is no room for more instances
+ * @note The received data is passed to the instance with \c gsm_engine_input
+ */
+bool gsm_engine_init(gsm_engine_t *engine, const MGsmTransport *transport);
+
+/**
+ * Deinitialize a GSM engine instance
+ * @param[in] engine The GSM engine instance to be deinitialized
+ */
+void gsm_engine_deinit(gsm_engine_t *engine);
+
+/**
+ * Get a GSM engine instance
+ * @param[in] index The instance index, '0' is the default instance
+ * @return The GSM engine instance or \c NULL if there is no such instance
+ */
+gsm_engine_t *gsm_engine_at(uint8_t index);
+
+/**
+ * Handle the line received from the GSM module
+ * @param[in] engine The GSM engine instance the line is received for
+ * @param[in] data The received line
+ * @param[in] length The length of the received line
+ */
+void gsm_engine_input(gsm_engine_t *engine, const char *data, size_t length);
+
+/**
+ * Queue an AT command for sending to the GSM module of an instance
+ * @see gsm_queue_cmd
+ */
+bool gsm_engine_queue_cmd(gsm_engine_t *engine, const char *cmd, MGsmExpect expect,
+                          uint32_t timeout, gsm_cmd_done done);
+
+/**
+ * Send an SMS with 'body' to 'address' with the GSM module of an instance
+ * @see gsm_send_sms
+ */
+bool gsm_engine_send_sms(gsm_engine_t *engine, const char *address, const char *body);
+
+/**
+ * Get the AT command queue statistics of an instance
+ * @param[in] engine The GSM engine instance
+ * @return The pointer to the statistics data
+ */
+const MGsmQueueStats *gsm_engine_queue_stats(gsm_engine_t *engine);
+
+/**
+ * Reset the AT command queue statistics of an instance
+ * @param[in] engine The GSM engine instance
+ */
+void gsm_engine_queue_stats_reset(gsm_engine_t *engine);
+
 /**
  * Read and print in console the content of a recieved SMS
  * @param[in] index The index of the SMS to read
  * @return The success status, \c true on success
- * @note The SMS should be encoded in UCS2 (AT+CSCS="UCS2")
+ * @note In text mode, the SMS should be encoded in UCS2 (AT+CSCS="UCS2"),
+ *       in PDU mode, any alphabet is decoded
  */
 bool gsm_read_sms(int index);
 
@@ -0,0 +1,204 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Alexander Chumakov
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "lcd-mocks.h"
+
+#include "hw-lcd.h"
+#include "hw-spi.h"
+
+namespace {
+uint16_t TheWidth = 0;
+uint16_t TheHeight = 0;
+bool TheData = false;
+bool TheSelected = false;
+size_t TheBytes = 0;
+size_t TheTransactions = 0;
+size_t TheAddressChanges = 0;
+size_t TheUnselected = 0;
+std::vector<uint8_t> TheStream;
+uint8_t TheCommand = 0;
+std::vector<uint8_t> TheParams;
+std::vector<uint8_t> TheCommands;
+std::vector<uint16_t> TheWords;
+std::vector<uint16_t> TheFramebuffer;
+/* The window and the RAM write position */
+uint16_t TheColStart = 0;
+uint16_t TheColEnd = 0;
+uint16_t TheRowStart = 0;
+uint16_t TheRowEnd = 0;
+uint16_t TheColumn = 0;
+uint16_t TheRow = 0;
+
+uint16_t param(size_t index)
+{
+  return (uint16_t)((TheParams[index] << 8) | TheParams[index + 1]);
+}
+
+void write_pixel(uint16_t word)
+{
+  TheWords.push_back(word);
+  if (TheColumn < TheWidth && TheRow < TheHeight) {
+    TheFramebuffer[TheRow * TheWidth + TheColumn] = word;
+  }
+  if (++TheColumn > TheColEnd) {
+    TheColumn = TheColStart;
+    if (++TheRow > TheRowEnd) {
+      TheRow = TheRowStart;
+    }
+  }
+}
+
+void handle_data(uint8_t byte)
+{
+  TheParams.push_back(byte);
+  if (0x2A == TheCommand && 4 == TheParams.size()) {
+    TheColStart = param(0);
+    TheColEnd = param(2);
+  } else if (0x2B == TheCommand && 4 == TheParams.size()) {
+    TheRowStart = param(0);
+    TheRowEnd = param(2);
+  } else if ((0x2C == TheCommand || 0x3C == TheCommand) && 2 == TheParams.size()) {
+    write_pixel(param(0));
+    TheParams.clear();
+  }
+}
+}
+
+void MLcdMock::reset(uint16_t width, uint16_t height)
+{
+  TheWidth = width;
+  TheHeight = height;
+  TheBytes = 0;
+  TheCommand = 0;
+  TheUnselected = 0;
+  TheParams.clear();
+  TheFramebuffer.assign(width * height, 0);
+  clear();
+}
+
+size_t MLcdMock::bytes()
+{
+  return TheBytes;
+}
+
+const std::vector<uint8_t> &MLcdMock::stream()
+{
+  return TheStream;
+}
+
+size_t MLcdMock::transactions()
+{
+  return TheTransactions;
+}
+
+size_t MLcdMock::addressChanges()
+{
+  return TheAddressChanges;
+}
+
+size_t MLcdMock::unselected()
+{
+  return TheUnselected;
+}
+
+const std::vector<uint8_t> &MLcdMock::commands()
+{
+  return TheCommands;
+}
+
+const std::vector<uint16_t> &MLcdMock::words()
+{
+  return TheWords;
+}
+
+const std::vector<uint16_t> &MLcdMock::framebuffer()
+{
+  return TheFramebuffer;
+}
+
+void MLcdMock::clear()
+{
+  TheWords.clear();
+  TheStream.clear();
+  TheCommands.clear();
+  TheTransactions = 0;
+  TheAddressChanges = 0;
+}
+
+extern "C" void spi_set_cs(bool selected)
+{
+  TheTransactions += (selected && !TheSelected);
+  TheSelected = selected;
+}
+
+extern "C" void lcd_set_address(bool a0)
+{
+  TheAddressChanges += (a0 != TheData);
+  TheData = a0;
+}
+
+extern "C" uint8_t spi_transfer(uint8_t data)
+{
+  ++TheBytes;
+  TheUnselected += !TheSelected;
+  TheStream.push_back(data);
+  if (TheData) {
+    handle_data(data);
+  } else {
+    TheCommand = data;
+    TheCommands.push_back(data);
+    TheParams.clear();
+    if (0x2C == data) {
+      TheRow = TheRowStart;
+      TheColumn = TheColStart;
+    }
+  }
+  return 0xFF;
+}
+
+extern "C" void spi_transfer_block(const uint8_t *data, uint16_t length)
+{
+  while (length--) {
+    spi_transfer(*data++);
+  }
+}
+
+extern "C" void spi_transfer_repeat(uint16_t word, uint16_t count)
+{
+  while (count--) {
+    spi_transfer(word >> 8);
+    spi_transfer(word);
+  }
+}
+
+extern "C" uint16_t lcd_get_width(void)
+{
+  return TheWidth;
+}
+
+extern "C" uint16_t lcd_get_height(void)
+{
+  return TheHeight;
+}
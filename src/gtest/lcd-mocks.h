@@ -0,0 +1,63 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Alexander Chumakov
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef MCODE_LCD_MOCKS_H
+#define MCODE_LCD_MOCKS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+/**
+ * The SPI LCD model: the SPI traffic from 'hw-lcd-spi.c' is recorded and decoded,
+ * the RAM writes update the framebuffer
+ */
+class MLcdMock
+{
+public:
+  /** Reset the model, the framebuffer is cleared */
+  static void reset(uint16_t width, uint16_t height);
+
+  /** The number of the bytes transferred by SPI, both commands and data */
+  static size_t bytes();
+  /** The bytes transferred by SPI since the last \c clear */
+  static const std::vector<uint8_t> &stream();
+  /** The number of the chip select assertions since the last \c clear */
+  static size_t transactions();
+  /** The number of the D/C line changes since the last \c clear */
+  static size_t addressChanges();
+  /** The number of the bytes sent without the chip select, should be 0 */
+  static size_t unselected();
+  /** The commands sent to the LCD */
+  static const std::vector<uint8_t> &commands();
+  /** The words written to the LCD RAM */
+  static const std::vector<uint16_t> &words();
+  /** The LCD RAM, row by row, the scroll position is not applied */
+  static const std::vector<uint16_t> &framebuffer();
+  /** Forget the collected commands, words and transactions, the framebuffer is kept */
+  static void clear();
+};
+
+#endif /* MCODE_LCD_MOCKS_H */
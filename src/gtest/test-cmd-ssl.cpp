@@ -0,0 +1,139 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Alexander Chumakov
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "mvars.h"
+#include "mstatus.h"
+#include "wrap-mocks.h"
+#include "cmd-engine.h"
+#include "line-editor-uart.h"
+
+#include <string>
+#include <string.h>
+#include <gtest/gtest.h>
+
+using namespace testing;
+
+class CmdSsl : public Test
+{
+protected:
+  void SetUp() override {
+    line_editor_uart_init();
+    line_editor_reset();
+    cmd_engine_start();
+    mcode_errno_set(ESuccess);
+    collected_text_reset();
+  }
+  void TearDown() override {
+    line_editor_reset();
+    line_editor_uart_set_callback(NULL);
+    collected_text_reset();
+  }
+
+  static void input(const std::string &data) {
+    uart_input(data.data(), data.size());
+  }
+  /** The output after the command echo */
+  static std::string output() {
+    const std::string text(collected_text());
+    const size_t pos = text.find("\r\n");
+    return (std::string::npos == pos) ? text : text.substr(pos + 2);
+  }
+};
+
+TEST_F(CmdSsl, String)
+{
+  input("sha \"abc\"\r");
+  ASSERT_EQ(output(), "BA7816BF8F01CFEA414140DE5DAE2223B00361A396177A9CB410FF61F20015AD\r\n# ");
+}
+
+TEST_F(CmdSsl, ConcatenatedParts)
+{
+  // "abc" split between a literal and a string variable
+  size_t length;
+  char *const var = mvar_str(1, 1, &length);
+  ASSERT_NE(var, nullptr);
+  strcpy(var, "bc");
+
+  input("sha \"a\" s1\r");
+  ASSERT_EQ(output(), "BA7816BF8F01CFEA414140DE5DAE2223B00361A396177A9CB410FF61F20015AD\r\n# ");
+  memset(var, 0, length);
+}
+
+TEST_F(CmdSsl, WrongArgumentsNegative)
+{
+  input("sha\r");
+  ASSERT_EQ(mcode_errno(), EArgument);
+  mcode_errno_set(ESuccess);
+  input("sha i1\r");
+  ASSERT_EQ(mcode_errno(), EArgument);
+  mcode_errno_set(ESuccess);
+  input("sha uart 3 \"a\"\r");
+  ASSERT_EQ(mcode_errno(), EArgument);
+  mcode_errno_set(ESuccess);
+  input("hmac 5 \"a\"\r");
+  ASSERT_EQ(mcode_errno(), EArgument);
+}
+
+TEST_F(CmdSsl, UartLength)
+{
+  // The new-line after the command is skipped, the data is taken as is, Ctrl-D as well
+  input("sha \"a\" uart 3\r\n");
+  ASSERT_EQ(output(), "");
+  input("b\004c");
+  ASSERT_EQ(output(), "2E74D67F07E5903FCEF72272BCA99C7ED14BC30BF9334B95F1BF75787C4C736A\r\n# ");
+
+  // The line editor is back
+  collected_text_reset();
+  input("sha \"abc\"\r");
+  ASSERT_EQ(output(), "BA7816BF8F01CFEA414140DE5DAE2223B00361A396177A9CB410FF61F20015AD\r\n# ");
+}
+
+TEST_F(CmdSsl, UartTillCtrlD)
+{
+  input("sha uart\r");
+  ASSERT_EQ(output(), "Send data, Ctrl-D to finish\r\n");
+  collected_text_reset();
+
+  std::string data;
+  size_t i;
+  for (i = 0; i < 1000; ++i) {
+    data += "abc";
+  }
+  input(data);
+  input("\004");
+  ASSERT_STREQ(collected_text(), "328DE8F1895F8BB09F6E6B4C2012EF2B2A6F067CD002794B750AA040A6F6D8BD\r\n# ");
+}
+
+TEST_F(CmdSsl, Hmac)
+{
+  // RFC 4231, test case 2
+  input("hmac \"Jefe\" \"what do ya want for nothing?\"\r");
+  ASSERT_EQ(output(), "5BDCC146BF60754E6A042426089575C75A003F089D2739839DEC58B964EC3843\r\n# ");
+
+  // The same with the data from UART
+  collected_text_reset();
+  input("hmac \"Jefe\" \"what do \" uart 20\rya want for nothing?");
+  ASSERT_EQ(output(), "5BDCC146BF60754E6A042426089575C75A003F089D2739839DEC58B964EC3843\r\n# ");
+}
@@ -0,0 +1,151 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Alexander Chumakov
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "console.h"
+#include "hw-lcd.h"
+#include "lcd-mocks.h"
+
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+
+using namespace testing;
+
+class Console : public Test
+{
+protected:
+  static void SetUpTestCase() {
+    MLcdMock::reset(320, 240);
+    console_init();
+  }
+
+  void SetUp() override {
+    start(true);
+  }
+  void TearDown() override {
+    console_set_shadow(true);
+  }
+
+  /** Start from the empty screen, with or without the shadow buffer */
+  static void start(bool shadow) {
+    MLcdMock::reset(320, 240);
+    ASSERT_EQ(console_set_shadow(shadow), shadow);
+    console_set_color(0xFFFF);
+    console_set_bg_color(0x0000);
+    console_clear_screen();
+    MLcdMock::clear();
+  }
+
+  static void write(const std::string &text) {
+    console_write_string(text.c_str());
+  }
+
+  /** Log lines of different length, the screen is updated after every 10 lines */
+  static void scrolling_log() {
+    for (int i = 0; i < 200; ++i) {
+      write("log line #" + std::to_string(i) + ": " + std::string((i * 7) % 30, 'a' + i % 26) + "\r\n");
+      if (!(i % 10)) {
+        console_flush();
+      }
+    }
+    console_flush();
+  }
+};
+
+TEST_F(Console, ScrollingLogBytes)
+{
+  start(false);
+  const size_t clearBytes = MLcdMock::bytes();
+  scrolling_log();
+  const size_t directBytes = MLcdMock::bytes() - clearBytes;
+  const std::vector<uint16_t> direct = MLcdMock::framebuffer();
+
+  start(true);
+  scrolling_log();
+  const size_t shadowBytes = MLcdMock::bytes() - clearBytes;
+
+  std::cout << "Bytes sent to LCD, direct: " << directBytes << ", shadow buffer: " << shadowBytes << std::endl;
+  ASSERT_EQ(MLcdMock::framebuffer(), direct);
+  // The unchanged cells, e.g. the common prefixes of the lines, are not drawn
+  ASSERT_LT(shadowBytes * 3, directBytes * 2);
+}
+
+TEST_F(Console, UnchangedWritesDropped)
+{
+  write("hello");
+  console_flush();
+  MLcdMock::clear();
+
+  write("\033[0;0Hhello");
+  console_flush();
+  ASSERT_TRUE(MLcdMock::commands().empty());
+
+  // A single changed cell is drawn
+  write("\033[0;0Hjello");
+  console_flush();
+  ASSERT_EQ(MLcdMock::commands(), std::vector<uint8_t>({0x2A, 0x2B, 0x2C}));
+  ASSERT_EQ(MLcdMock::words().size(), 64);
+}
+
+TEST_F(Console, InvalidatedByDirectDrawing)
+{
+  write("hello");
+  console_flush();
+
+  // The text is overdrawn bypassing the console, e.g. with a test image
+  lcd_cls(0xF800);
+  console_invalidate();
+  MLcdMock::clear();
+
+  // The unchanged text is drawn again
+  write("\033[0;0Hhello");
+  console_flush();
+  ASSERT_EQ(MLcdMock::commands(), std::vector<uint8_t>({0x2A, 0x2B, 0x2C}));
+  ASSERT_EQ(MLcdMock::words().size(), 5 * 64);
+}
+
+TEST_F(Console, DirtyCellsMerged)
+{
+  // A window per text line
+  write("abc\r\nxyz");
+  console_flush();
+  ASSERT_EQ(MLcdMock::commands(), std::vector<uint8_t>({0x2A, 0x2B, 0x2C, 0x2A, 0x2B, 0x2C}));
+  ASSERT_EQ(MLcdMock::words().size(), 6 * 64);
+  MLcdMock::clear();
+
+  // The colors are changed within the line, the spaces keep the background only
+  write("\r\n1\033[31m2 \033[m3");
+  console_flush();
+  ASSERT_EQ(MLcdMock::commands(), std::vector<uint8_t>({0x2A, 0x2B, 0x2C, 0x2A, 0x2B, 0x2C, 0x2A, 0x2B, 0x2C}));
+  ASSERT_EQ(MLcdMock::words().size(), 3 * 64);
+}
+
+TEST_F(Console, NothingDrawnBeforeFlush)
+{
+  write("line 1\r\nline 2\r\n\033[2K");
+  ASSERT_TRUE(MLcdMock::commands().empty());
+  console_flush();
+  ASSERT_FALSE(MLcdMock::commands().empty());
+}
@@ -0,0 +1,182 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Alexander Chumakov
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "fonts.h"
+#include "lcd-mocks.h"
+#include "glyph-cache.h"
+#include "mcode-config.h"
+
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+
+using namespace testing;
+
+class GlyphCache : public Test
+{
+protected:
+  void SetUp() override {
+    glyph_cache_reset();
+    glyph_cache_stats()->hits = 0;
+    glyph_cache_stats()->misses = 0;
+    MLcdMock::reset(320, 240);
+  }
+
+  /** The reference: the glyph expanded bit by bit */
+  static std::vector<uint16_t> expand(uint8_t code, uint16_t offValue, uint16_t onValue) {
+    std::vector<uint16_t> words;
+    const uint8_t *const pData = mcode_fonts_get_char_bitmap(code);
+    for (int i = 0; i < 64; ++i) {
+      words.push_back(((pData[i >> 3] >> (i & 7)) & 1) ? onValue : offValue);
+    }
+    return words;
+  }
+
+  static std::vector<uint16_t> get(uint8_t code, uint16_t offValue = 0x0000, uint16_t onValue = 0xFFFF) {
+    const uint16_t *const words = glyph_cache_get(code, offValue, onValue);
+    return std::vector<uint16_t>(words, words + 64);
+  }
+
+  static uint32_t hits() { return glyph_cache_stats()->hits; }
+  static uint32_t misses() { return glyph_cache_stats()->misses; }
+};
+
+TEST_F(GlyphCache, ExpandsFont)
+{
+  ASSERT_EQ(get('A', 0x1234, 0xABCD), expand('A', 0x1234, 0xABCD));
+  ASSERT_EQ(get('~', 0x0000, 0xF800), expand('~', 0x0000, 0xF800));
+  ASSERT_EQ(misses(), 2);
+  ASSERT_EQ(get('A', 0x1234, 0xABCD), expand('A', 0x1234, 0xABCD));
+  ASSERT_EQ(hits(), 0);
+  ASSERT_EQ(misses(), 3);
+}
+
+TEST_F(GlyphCache, LeastRecentlyUsedEvicted)
+{
+  ASSERT_EQ(MCODE_GLYPH_CACHE_SIZE, 4);
+
+  const uint16_t *const glyphA = glyph_cache_get('A', 0, 0xFFFF);
+  get('B');
+  get('C');
+  get('D');
+  ASSERT_EQ(misses(), 4);
+
+  // 'A' is used again, so, 'B' is the oldest one
+  ASSERT_EQ(glyph_cache_get('A', 0, 0xFFFF), glyphA);
+  get('E');
+  ASSERT_EQ(hits(), 1);
+  ASSERT_EQ(misses(), 5);
+
+  ASSERT_EQ(glyph_cache_get('A', 0, 0xFFFF), glyphA);
+  get('D');
+  get('E');
+  ASSERT_EQ(hits(), 4);
+  ASSERT_EQ(get('B'), expand('B', 0, 0xFFFF));
+  ASSERT_EQ(misses(), 6);
+
+  // 'C' has been evicted by 'B'
+  get('C');
+  ASSERT_EQ(misses(), 7);
+}
+
+TEST_F(GlyphCache, ColorChangeDropsGlyphs)
+{
+  get('A', 0x0000, 0xFFFF);
+  get('A', 0x0000, 0xFFFF);
+  ASSERT_EQ(hits(), 1);
+
+  ASSERT_EQ(get('A', 0x001F, 0xFFFF), expand('A', 0x001F, 0xFFFF));
+  ASSERT_EQ(get('A', 0x0000, 0xFFFF), expand('A', 0x0000, 0xFFFF));
+  ASSERT_EQ(hits(), 1);
+  ASSERT_EQ(misses(), 3);
+}
+
+TEST_F(GlyphCache, MissingCodesNegative)
+{
+  ASSERT_EQ(get(0), expand(' ', 0, 0xFFFF));
+  ASSERT_EQ(get(200), expand(' ', 0, 0xFFFF));
+  ASSERT_EQ(get(' '), expand(' ', 0, 0xFFFF));
+  ASSERT_EQ(hits(), 2);
+}
+
+TEST_F(GlyphCache, WriteText)
+{
+  // The run is longer than the cache, the glyphs are evicted while it is written
+  const std::string text = "Hello, world!";
+  glyph_cache_write_text(0x2C, text.data(), text.size(), 0x0000, 0x07E0);
+
+  std::vector<uint16_t> expected;
+  for (int row = 0; row < 8; ++row) {
+    for (char ch : text) {
+      const std::vector<uint16_t> glyph = expand(ch, 0x0000, 0x07E0);
+      expected.insert(expected.end(), glyph.begin() + row * 8, glyph.begin() + row * 8 + 8);
+    }
+  }
+  ASSERT_EQ(MLcdMock::commands(), std::vector<uint8_t>({0x2C}));
+  ASSERT_EQ(MLcdMock::words(), expected);
+  ASSERT_EQ(MLcdMock::bytes(), 1 + 2 * expected.size());
+}
+
+TEST_F(GlyphCache, LongRunNoThrashing)
+{
+  // More different glyphs than the cache keeps, each one is expanded at most once
+  const std::string text = "abcdefghijklmnopqrstuvwxyz";
+  ASSERT_GT(text.size(), MCODE_GLYPH_CACHE_SIZE);
+  glyph_cache_write_text(0x2C, text.data(), text.size(), 0x0000, 0x07E0);
+  ASSERT_LE(misses(), text.size());
+  ASSERT_EQ(misses(), MCODE_GLYPH_CACHE_SIZE);
+  ASSERT_EQ(hits(), 0);
+
+  std::vector<uint16_t> expected;
+  for (int row = 0; row < 8; ++row) {
+    for (char ch : text) {
+      const std::vector<uint16_t> glyph = expand(ch, 0x0000, 0x07E0);
+      expected.insert(expected.end(), glyph.begin() + row * 8, glyph.begin() + row * 8 + 8);
+    }
+  }
+  ASSERT_EQ(MLcdMock::words(), expected);
+
+  // The repeated glyphs of the run are loaded once
+  glyph_cache_reset();
+  glyph_cache_stats()->misses = 0;
+  glyph_cache_prefetch("abababcdcdcd", 12, 0x0000, 0x07E0);
+  ASSERT_EQ(misses(), 4);
+  ASSERT_NE(glyph_cache_find('a', 0x0000, 0x07E0), nullptr);
+  ASSERT_EQ(glyph_cache_find('a', 0x0000, 0xFFFF), nullptr);
+  ASSERT_EQ(glyph_cache_find('e', 0x0000, 0x07E0), nullptr);
+}
+
+TEST_F(GlyphCache, WriteTextHitsPerGlyph)
+{
+  // A single lookup per character of the run, not per glyph row
+  const std::string text = "abab";
+  glyph_cache_write_text(0x2C, text.data(), text.size(), 0x0000, 0x07E0);
+  ASSERT_EQ(misses(), 2);
+  ASSERT_EQ(hits(), 2);
+
+  glyph_cache_write_text(0x2C, text.data(), text.size(), 0x0000, 0x07E0);
+  ASSERT_EQ(misses(), 2);
+  ASSERT_EQ(hits(), 6);
+}
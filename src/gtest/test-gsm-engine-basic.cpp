@@ -24,6 +24,8 @@
 
 #include "gsm-engine.h"
 
+#include "mpdu.h"
+#include "mtick.h"
 #include "mvars.h"
 #include "hw-uart.h"
 #include "mstatus.h"
@@ -32,7 +34,8 @@
 
 #include <gtest/gtest.h>
 
-#define MCODE_SMS_MAX_LENGTH (140)
+#include <chrono>
+#include <string>
 
 extern "C" {
 typedef enum {
@@ -42,6 +45,7 @@ typedef enum {
   EGsmStateSendingSmsAddress,
   EGsmStateReadingSmsBody,
   EGsmStateReadingSmsHeader,
+  EGsmStateListingSms,
 } TGsmState;
 
 typedef enum {
@@ -80,24 +84,27 @@ typedef enum {
   EEngineExecSmsDone,
   EEngineSendSms,
   EEngineSendSmsDone,
+  EEngineListSms,
+  EEngineListSmsDone,
+  EEngineDeleteSms,
 } TEngineState;
 
+bool gsm_engine_task(void);
 bool gsm_periodic_task(void);
-void gsm_sms_send_body(void);
+bool gsm_queue_timeout_task(void);
+void gsm_sms_send_body(gsm_engine_t *engine);
 void gsm_prepare_response(void);
 void gsm_uart2_handler(const char *data, size_t length);
-void gsm_handle_new_sms(const char *args, size_t length);
-void gsm_read_sms_handle_body(const char *data, size_t length);
-void gsm_read_sms_handle_header(const char *data, size_t length);
-void gsm_read_sms_handle_response(const char *data, size_t length);
+void gsm_handle_new_sms(gsm_engine_t *engine, const char *args, size_t length);
+void gsm_read_sms_handle_body(gsm_engine_t *engine, const char *data, size_t length);
+void gsm_read_sms_handle_header(gsm_engine_t *engine, const char *data, size_t length);
+void gsm_read_sms_handle_response(gsm_engine_t *engine, const char *data, size_t length);
 const char *gsm_parse_response(const char *rsp, TAtCmdId *id, const char **args);
+bool gsm_pdu_store(const char *pdu, size_t length, uint8_t address, uint8_t text, uint8_t count);
+void gsm_concat_expire(uint64_t now);
 }
 
-extern "C" uint32_t TheEngineIndex;
-extern "C" uint32_t TheEngineState;
-extern "C" TGsmState TheGsmState;
-extern "C" TGsmStateFlags TheGsmFlags;
-extern "C" char TheMsgBuffer[MCODE_SMS_MAX_LENGTH];
+extern "C" gsm_engine_t TheGsm;
 
 static bool TheHwGsmInitSent = false;
 static bool TheLastPowerRequest = false;
@@ -112,8 +119,8 @@ protected:
     TheLastPowerRequest = false;
     gsm_init();
     gsm_set_callback(gsm_callback);
-    TheGsmState = EGsmStateIdle;
-    TheGsmFlags = EGsmStateFlagAtReady;
+    TheGsm.state = EGsmStateIdle;
+    TheGsm.flags = EGsmStateFlagAtReady;
     collected_text_reset();
     collected_text2_reset();
     collected_alt_text_reset();
@@ -158,8 +165,8 @@ protected:
     str = mvar_str(1, 2, &length);
     memset(str, 0, length);
     gsm_init();
-    TheGsmState = EGsmStateIdle;
-    TheGsmFlags = EGsmStateFlagAtReady;
+    TheGsm.state = EGsmStateIdle;
+    TheGsm.flags = EGsmStateFlagAtReady;
     // Define the default handler
     io_ostream_handler_push(alt_uart_write_char);
   }
@@ -181,13 +188,13 @@ protected:
     return strlen(body_var_str());
   }
   const char *phone_var2_str() {
-    return mvar_str(3, 1, NULL);
+    return mvar_str(MCODE_GSM_VAR_ADDRESS, 1, NULL);
   }
   size_t phone_var2_length() {
     return strlen(phone_var2_str());
   }
   const char *body_var2_str() {
-    return mvar_str(4, 2, NULL);
+    return mvar_str(MCODE_GSM_VAR_PROGRAM, MCODE_GSM_VAR_PROGRAM_COUNT, NULL);
   }
   size_t body_var2_length() {
     return strlen(body_var2_str());
@@ -205,10 +212,10 @@ TEST_F(SmsReadHandling, GsmReadSmsHandleHeader)
   const char header[] = "+CMGR: \"REC READ\",\"002B00390038003800370035003300310030003100320033\",\"\",\"20/01/08,10:25:13+12\"";
   size_t length = sizeof (header) - 1;
 
-  TheGsmState = EGsmStateReadingSmsHeader;
-  gsm_read_sms_handle_header(header, length);
+  TheGsm.state = EGsmStateReadingSmsHeader;
+  gsm_read_sms_handle_header(&TheGsm, header, length);
 
-  ASSERT_EQ(TheGsmState, EGsmStateReadingSmsBody);
+  ASSERT_EQ(TheGsm.state, EGsmStateReadingSmsBody);
   ASSERT_EQ(phone_var_length(), 12);
   ASSERT_STREQ(phone_var_str(), "+98875310123");
 }
@@ -219,10 +226,10 @@ TEST_F(SmsReadHandling, GsmReadSmsHandleHeaderWrongSignNegative)
   const char header[] = "-CMGR: \"REC READ\",\"002B00390038003800370035003300310030003100320033\",\"\",\"20/01/08,10:25:13+12\"";
   size_t length = sizeof (header) - 1;
 
-  TheGsmState = EGsmStateReadingSmsHeader;
-  gsm_read_sms_handle_header(header, length);
+  TheGsm.state = EGsmStateReadingSmsHeader;
+  gsm_read_sms_handle_header(&TheGsm, header, length);
 
-  ASSERT_EQ(TheGsmState, EGsmStateIdle);
+  ASSERT_EQ(TheGsm.state, EGsmStateIdle);
 }
 
 TEST_F(SmsReadHandling, GsmReadSmsHandleHeaderWrongSyntaxNegative)
@@ -231,10 +238,10 @@ TEST_F(SmsReadHandling, GsmReadSmsHandleHeaderWrongSyntaxNegative)
   const char header[] = "+\"CMGR\": \"REC READ\",\"002B00390038003800370035003300310030003100320033\",\"\",\"20/01/08,10:25:13+12\"";
   size_t length = sizeof (header) - 1;
 
-  TheGsmState = EGsmStateReadingSmsHeader;
-  gsm_read_sms_handle_header(header, length);
+  TheGsm.state = EGsmStateReadingSmsHeader;
+  gsm_read_sms_handle_header(&TheGsm, header, length);
 
-  ASSERT_EQ(TheGsmState, EGsmStateIdle);
+  ASSERT_EQ(TheGsm.state, EGsmStateIdle);
 }
 
 TEST_F(SmsReadHandling, GsmReadSmsHandleHeaderWrongSeparatorNegative)
@@ -243,10 +250,10 @@ TEST_F(SmsReadHandling, GsmReadSmsHandleHeaderWrongSeparatorNegative)
   const char header[] = "+CMGR; \"REC READ\",\"002B00390038003800370035003300310030003100320033\",\"\",\"20/01/08,10:25:13+12\"";
   size_t length = sizeof (header) - 1;
 
-  TheGsmState = EGsmStateReadingSmsHeader;
-  gsm_read_sms_handle_header(header, length);
+  TheGsm.state = EGsmStateReadingSmsHeader;
+  gsm_read_sms_handle_header(&TheGsm, header, length);
 
-  ASSERT_EQ(TheGsmState, EGsmStateIdle);
+  ASSERT_EQ(TheGsm.state, EGsmStateIdle);
 }
 
 TEST_F(SmsReadHandling, GsmReadSmsHandleHeaderNoSpaceNegative)
@@ -255,10 +262,10 @@ TEST_F(SmsReadHandling, GsmReadSmsHandleHeaderNoSpaceNegative)
   const char header[] = "+CMGR:\"REC READ\",\"002B00390038003800370035003300310030003100320033\",\"\",\"20/01/08,10:25:13+12\"";
   size_t length = sizeof (header) - 1;
 
-  TheGsmState = EGsmStateReadingSmsHeader;
-  gsm_read_sms_handle_header(header, length);
+  TheGsm.state = EGsmStateReadingSmsHeader;
+  gsm_read_sms_handle_header(&TheGsm, header, length);
 
-  ASSERT_EQ(TheGsmState, EGsmStateIdle);
+  ASSERT_EQ(TheGsm.state, EGsmStateIdle);
 }
 
 TEST_F(SmsReadHandling, GsmReadSmsResponseHandleHeader)
@@ -267,10 +274,10 @@ TEST_F(SmsReadHandling, GsmReadSmsResponseHandleHeader)
   const char header[] = "+CMGR: \"REC READ\",\"002B00390038003800370035003300310030003100320033\",\"\",\"20/01/08,10:25:13+12\"";
   size_t length = sizeof (header) - 1;
 
-  TheGsmState = EGsmStateReadingSmsHeader;
-  gsm_read_sms_handle_response(header, length);
+  TheGsm.state = EGsmStateReadingSmsHeader;
+  gsm_read_sms_handle_response(&TheGsm, header, length);
 
-  ASSERT_EQ(TheGsmState, EGsmStateReadingSmsBody);
+  ASSERT_EQ(TheGsm.state, EGsmStateReadingSmsBody);
   ASSERT_EQ(phone_var_length(), 12);
   ASSERT_STREQ(phone_var_str(), "+98875310123");
 }
@@ -281,10 +288,10 @@ TEST_F(SmsReadHandling, GsmReadSmsUart2ResponseHandleHeader)
   const char header[] = "+CMGR: \"REC READ\",\"002B00390038003800370035003300310030003100320033\",\"\",\"20/01/08,10:25:13+12\"";
   size_t length = sizeof (header) - 1;
 
-  TheGsmState = EGsmStateReadingSmsHeader;
+  TheGsm.state = EGsmStateReadingSmsHeader;
   gsm_uart2_handler(header, length);
 
-  ASSERT_EQ(TheGsmState, EGsmStateReadingSmsBody);
+  ASSERT_EQ(TheGsm.state, EGsmStateReadingSmsBody);
   ASSERT_EQ(phone_var_length(), 12);
   ASSERT_STREQ(phone_var_str(), "+98875310123");
 }
@@ -295,10 +302,10 @@ TEST_F(SmsReadHandling, GsmReadSmsUart2ResponseHandleHeaderStatusAsIdNegative)
   const char header[] = "+CMGR: REC READ,\"002B00390038003800370035003300310030003100320033\",\"\",\"20/01/08,10:25:13+12\"";
   size_t length = sizeof (header) - 1;
 
-  TheGsmState = EGsmStateReadingSmsHeader;
+  TheGsm.state = EGsmStateReadingSmsHeader;
   gsm_uart2_handler(header, length);
 
-  ASSERT_EQ(TheGsmState, EGsmStateIdle);
+  ASSERT_EQ(TheGsm.state, EGsmStateIdle);
 }
 
 TEST_F(SmsReadHandling, GsmReadSmsUart2ResponseHandleHeaderPhoneAsNumberNegative)
@@ -307,10 +314,10 @@ TEST_F(SmsReadHandling, GsmReadSmsUart2ResponseHandleHeaderPhoneAsNumberNegative
   const char header[] = "+CMGR: \"REC READ\",70001112233,\"\",\"20/01/08,10:25:13+12\"";
   size_t length = sizeof (header) - 1;
 
-  TheGsmState = EGsmStateReadingSmsHeader;
+  TheGsm.state = EGsmStateReadingSmsHeader;
   gsm_uart2_handler(header, length);
 
-  ASSERT_EQ(TheGsmState, EGsmStateIdle);
+  ASSERT_EQ(TheGsm.state, EGsmStateIdle);
 }
 
 TEST_F(SmsReadHandling, GsmReadSmsHandleBody)
@@ -319,10 +326,10 @@ TEST_F(SmsReadHandling, GsmReadSmsHandleBody)
   const char header[] = "005400650073007400200053004D0053003A00200061006200630064";
   size_t length = sizeof (header) - 1;
 
-  TheGsmState = EGsmStateReadingSmsBody;
-  gsm_read_sms_handle_body(header, length);
+  TheGsm.state = EGsmStateReadingSmsBody;
+  gsm_read_sms_handle_body(&TheGsm, header, length);
 
-  ASSERT_EQ(TheGsmState, EGsmStateIdle);
+  ASSERT_EQ(TheGsm.state, EGsmStateSendingAtCmd);
   ASSERT_EQ(body_var_length(), 14);
   ASSERT_STREQ(body_var_str(), "Test SMS: abcd");
 }
@@ -333,10 +340,10 @@ TEST_F(SmsReadHandling, GsmReadSmsResponseHandleBody)
   const char header[] = "005400650073007400200053004D0053003A00200061006200630064";
   size_t length = sizeof (header) - 1;
 
-  TheGsmState = EGsmStateReadingSmsBody;
-  gsm_read_sms_handle_response(header, length);
+  TheGsm.state = EGsmStateReadingSmsBody;
+  gsm_read_sms_handle_response(&TheGsm, header, length);
 
-  ASSERT_EQ(TheGsmState, EGsmStateIdle);
+  ASSERT_EQ(TheGsm.state, EGsmStateSendingAtCmd);
   ASSERT_EQ(body_var_length(), 14);
   ASSERT_STREQ(body_var_str(), "Test SMS: abcd");
 }
@@ -347,10 +354,10 @@ TEST_F(SmsReadHandling, GsmReadUart2ResponseHandleBody)
   const char header[] = "005400650073007400200053004D0053003A00200061006200630064";
   size_t length = sizeof (header) - 1;
 
-  TheGsmState = EGsmStateReadingSmsBody;
+  TheGsm.state = EGsmStateReadingSmsBody;
   gsm_uart2_handler(header, length);
 
-  ASSERT_EQ(TheGsmState, EGsmStateIdle);
+  ASSERT_EQ(TheGsm.state, EGsmStateSendingAtCmd);
   ASSERT_EQ(body_var_length(), 14);
   ASSERT_STREQ(body_var_str(), "Test SMS: abcd");
 }
@@ -361,16 +368,563 @@ TEST_F(SmsReadHandling, GsmReadUart2ResponseHandleBodyWithEngineRequest)
   const char header[] = "005400650073007400200053004D0053003A00200061006200630064";
   size_t length = sizeof (header) - 1;
 
-  TheEngineState = EEngineReadSms;
-  TheGsmState = EGsmStateReadingSmsBody;
+  TheGsm.engineState = EEngineReadSms;
+  TheGsm.state = EGsmStateReadingSmsBody;
   gsm_uart2_handler(header, length);
 
-  ASSERT_EQ(TheEngineState, EEngineReadSmsDone);
-  ASSERT_EQ(TheGsmState, EGsmStateIdle);
+  ASSERT_EQ(TheGsm.engineState, EEngineReadSmsDone);
+  ASSERT_EQ(TheGsm.state, EGsmStateSendingAtCmd);
   ASSERT_EQ(body_var2_length(), 14);
   ASSERT_STREQ(body_var2_str(), "Test SMS: abcd");
 }
 
+TEST_F(SmsReadHandling, GsmNewSmsIndicationKicksEngine)
+{
+  const char indication[] = "+CMTI: \"SM\",3";
+
+  mvar_nvm_set(0, 0);
+  mvar_nvm_set(1, 0);
+  TheGsm.engineState = EEngineIdle;
+  TheGsm.kicked = false;
+  gsm_uart2_handler(indication, sizeof (indication) - 1);
+
+  ASSERT_TRUE(TheGsm.kicked);
+  ASSERT_EQ(mvar_nvm_get(0), 1u << 3);
+  ASSERT_EQ(collected_text2_length(), 0);
+
+  gsm_engine_task();
+  ASSERT_FALSE(TheGsm.kicked);
+  ASSERT_EQ(TheGsm.engineState, EEngineReadSms);
+  ASSERT_EQ(TheGsm.engineIndex, 3);
+  ASSERT_STREQ(collected_text2(), "AT+CMGR=3\r");
+}
+
+TEST_F(SmsReadHandling, GsmNewSmsEventDrivenFlow)
+{
+  const char indication[] = "+CMTI: \"SM\",2";
+  const char header[] = "+CMGR: \"REC UNREAD\",\"002B00370030003000300031003100310032003200330033\",\"\",\"20/01/08,10:25:13+12\"";
+  const char body[] = "0022006800690022";
+
+  mcode_phone_set("+70001112233");
+  TheGsm.flags = EGsmStateFlagAllReady;
+  mvar_nvm_set(0, 0);
+  mvar_nvm_set(1, 0);
+  TheGsm.engineState = EEngineIdle;
+  TheGsm.kicked = false;
+  gsm_uart2_handler(indication, sizeof (indication) - 1);
+  gsm_engine_task();
+  ASSERT_STREQ(collected_text2(), "AT+CMGR=2\r");
+
+  // The SMS is read, the engine is kicked by the 'OK' completion
+  gsm_uart2_handler(header, sizeof (header) - 1);
+  gsm_uart2_handler(body, sizeof (body) - 1);
+  gsm_uart2_handler("OK", 2);
+  ASSERT_EQ(TheGsm.engineState, EEngineReadSmsDone);
+  ASSERT_TRUE(TheGsm.kicked);
+
+  // Execute the program, the NVM flag is reset
+  gsm_engine_task();
+  ASSERT_EQ(TheGsm.engineState, EEngineExecSmsDone);
+  ASSERT_EQ(mvar_nvm_get(0), 0);
+  ASSERT_TRUE(TheGsm.kicked);
+
+  // Send the response
+  collected_text2_reset();
+  gsm_engine_task();
+  ASSERT_EQ(TheGsm.engineState, EEngineSendSms);
+  ASSERT_STREQ(collected_text2(), "AT+CMGS=\"002B00370030003000300031003100310032003200330033\"\r");
+
+  collected_text2_reset();
+  gsm_uart2_handler("> ", 2);
+  ASSERT_STREQ(collected_text2(), "00680069000A\x1a\r");
+  gsm_uart2_handler("+CMGS: 1", 8);
+  gsm_uart2_handler("OK", 2);
+  ASSERT_EQ(TheGsm.engineState, EEngineSendSmsDone);
+  ASSERT_TRUE(TheGsm.kicked);
+
+  gsm_engine_task();
+  ASSERT_EQ(TheGsm.engineState, EEngineIdle);
+  ASSERT_EQ(TheGsm.state, EGsmStateIdle);
+}
+
+TEST_F(SmsReadHandling, GsmPduModeSwitch)
+{
+  TheGsm.flags = EGsmStateFlagAtReady;
+  gsm_uart2_handler("SMS Ready", 9);
+  ASSERT_STREQ(collected_text2(), "AT+CMGF=0\r");
+  ASSERT_FALSE(TheGsm.pduMode);
+
+  gsm_uart2_handler("OK", 2);
+  ASSERT_TRUE(TheGsm.pduMode);
+
+  // The GSM module restarts in text mode
+  gsm_uart2_handler("RDY", 3);
+  ASSERT_FALSE(TheGsm.pduMode);
+
+  // The text mode stays, if the GSM module rejects PDU mode
+  collected_text2_reset();
+  gsm_uart2_handler("SMS Ready", 9);
+  ASSERT_STREQ(collected_text2(), "AT+CMGF=0\r");
+  gsm_uart2_handler("ERROR", 5);
+  ASSERT_FALSE(TheGsm.pduMode);
+}
+
+TEST_F(SmsReadHandling, GsmPduEventDrivenFlow)
+{
+  const char indication[] = "+CMTI: \"SM\",2";
+  const char header[] = "+CMGR: 0,,23";
+  const char body[] = "00040B910700112132F30000021080017240210422745A04";
+
+  mcode_phone_set("+70001112233");
+  TheGsm.flags = EGsmStateFlagAllReady;
+  TheGsm.pduMode = true;
+  mvar_nvm_set(0, 0);
+  mvar_nvm_set(1, 0);
+  TheGsm.engineState = EEngineIdle;
+  gsm_uart2_handler(indication, sizeof (indication) - 1);
+  gsm_engine_task();
+  ASSERT_STREQ(collected_text2(), "AT+CMGR=2\r");
+
+  // The address and the program come in the PDU
+  gsm_uart2_handler(header, sizeof (header) - 1);
+  gsm_uart2_handler(body, sizeof (body) - 1);
+  gsm_uart2_handler("OK", 2);
+  ASSERT_EQ(TheGsm.engineState, EEngineReadSmsDone);
+  ASSERT_STREQ(mvar_str(MCODE_GSM_VAR_ADDRESS, 1, NULL), "+70001112233");
+  ASSERT_STREQ(mvar_str(MCODE_GSM_VAR_PROGRAM, MCODE_GSM_VAR_PROGRAM_COUNT, NULL), "\"hi\"");
+
+  gsm_engine_task();
+  ASSERT_EQ(TheGsm.engineState, EEngineExecSmsDone);
+
+  // The response goes in GSM 7-bit alphabet, the command takes the TPDU length
+  collected_text2_reset();
+  gsm_engine_task();
+  ASSERT_EQ(TheGsm.engineState, EEngineSendSms);
+  ASSERT_STREQ(collected_text2(), "AT+CMGS=16\r");
+
+  collected_text2_reset();
+  gsm_uart2_handler("> ", 2);
+  ASSERT_STREQ(collected_text2(), "0001000B910700112132F3000003E8B402\x1a\r");
+  gsm_uart2_handler("+CMGS: 1", 8);
+  gsm_uart2_handler("OK", 2);
+  ASSERT_EQ(TheGsm.engineState, EEngineSendSmsDone);
+}
+
+TEST_F(SmsReadHandling, GsmPduReadBrokenSms)
+{
+  TheGsm.pduMode = true;
+  TheGsm.state = EGsmStateReadingSmsHeader;
+  mvar_putch_config(0, 1);
+  io_ostream_handler_push(mvar_putch);
+  mprintstr("+70001112233");
+  io_ostream_handler_pop();
+
+  // The SMS with the broken PDU is skipped, as no phone matches
+  gsm_read_sms_handle_response(&TheGsm, "+CMGR: 0,,23", 12);
+  ASSERT_EQ(TheGsm.state, EGsmStateReadingSmsBody);
+  gsm_read_sms_handle_response(&TheGsm, "00040B91070011", 14);
+  ASSERT_EQ(TheGsm.state, EGsmStateSendingAtCmd);
+  ASSERT_STREQ(phone_var_str(), "");
+  ASSERT_STREQ(body_var_str(), "");
+}
+
+TEST_F(SmsReadHandling, GsmPduBatch)
+{
+  const char body1[] = "00040B910700112132F300000210800172402103A2B008";
+  const char body2[] = "00040B918978350121F30000021080017240210322BC08";
+
+  mcode_phone_set("+70001112233");
+  TheGsm.flags = EGsmStateFlagAllReady;
+  TheGsm.pduMode = true;
+  mvar_nvm_set(0, (1u << 1) | (1u << 2));
+  mvar_nvm_set(1, 0);
+  TheGsm.engineState = EEngineIdle;
+  gsm_engine_task();
+  ASSERT_EQ(TheGsm.engineState, EEngineListSms);
+  ASSERT_STREQ(collected_text2(), "AT+CMGL=0\r");
+
+  gsm_uart2_handler("+CMGL: 1,0,,22", 14);
+  gsm_uart2_handler(body1, sizeof (body1) - 1);
+  gsm_uart2_handler("+CMGL: 2,0,,22", 14);
+  gsm_uart2_handler(body2, sizeof (body2) - 1);
+  gsm_uart2_handler("OK", 2);
+  ASSERT_EQ(TheGsm.engineState, EEngineListSmsDone);
+  gsm_engine_task();
+  ASSERT_EQ(TheGsm.engineState, EEngineDeleteSms);
+  ASSERT_STREQ(mvar_str(MCODE_GSM_VAR_OUTPUT, MCODE_GSM_VAR_OUTPUT_COUNT, NULL), "a\r\n");
+}
+
+static std::string concat_part(const char *text, uint16_t ref, uint8_t total, uint8_t seq)
+{
+  MPduSms sms;
+  char pdu[2*MCODE_PDU_MAX_LENGTH + 1];
+
+  memset(&sms, 0, sizeof (sms));
+  sms.type = MPduTypeDeliver;
+  sms.dcs = MPduDcs7bit;
+  sms.concatRef = ref;
+  sms.concatTotal = total;
+  sms.concatSeq = seq;
+  strcpy(sms.address, "+70001112233");
+  strcpy(sms.text, text);
+  sms.length = strlen(text);
+  EXPECT_NE(pdu_encode(&sms, pdu, sizeof (pdu)), 0u);
+  return pdu;
+}
+
+TEST_F(SmsReadHandling, GsmPduConcatBatch)
+{
+  const std::string part1 = concat_part("\"a", 0x42, 2, 1);
+  const std::string part2 = concat_part("b\"", 0x42, 2, 2);
+  const std::string other = concat_part("\"x", 0x43, 2, 1);
+
+  mcode_phone_set("+70001112233");
+  TheGsm.flags = EGsmStateFlagAllReady;
+  TheGsm.pduMode = true;
+  mvar_nvm_set(0, (1u << 1) | (1u << 2) | (1u << 3));
+  mvar_nvm_set(1, 0);
+  TheGsm.engineState = EEngineIdle;
+  gsm_engine_task();
+  ASSERT_EQ(TheGsm.engineState, EEngineListSms);
+
+  // The parts come out of order, interleaved with a part of another SMS
+  gsm_uart2_handler("+CMGL: 1,0,,20", 14);
+  gsm_uart2_handler(part2.c_str(), part2.size());
+  ASSERT_STREQ(mvar_str(MCODE_GSM_VAR_PROGRAM, MCODE_GSM_VAR_PROGRAM_COUNT, NULL), "");
+  gsm_uart2_handler("+CMGL: 2,0,,20", 14);
+  gsm_uart2_handler(other.c_str(), other.size());
+  gsm_uart2_handler("+CMGL: 3,0,,20", 14);
+  gsm_uart2_handler(part1.c_str(), part1.size());
+  ASSERT_STREQ(mvar_str(MCODE_GSM_VAR_PROGRAM, MCODE_GSM_VAR_PROGRAM_COUNT, NULL), "\"ab\"");
+  gsm_uart2_handler("OK", 2);
+  ASSERT_EQ(TheGsm.engineState, EEngineListSmsDone);
+  gsm_engine_task();
+  ASSERT_STREQ(mvar_str(MCODE_GSM_VAR_OUTPUT, MCODE_GSM_VAR_OUTPUT_COUNT, NULL), "ab\r\n");
+}
+
+TEST_F(SmsReadHandling, GsmPduConcatExpire)
+{
+  const std::string part1 = concat_part("\"a", 0x44, 2, 1);
+  const std::string part2 = concat_part("b\"", 0x44, 2, 2);
+
+  ASSERT_FALSE(gsm_pdu_store(part1.c_str(), part1.size(), MCODE_GSM_VAR_ADDRESS, MCODE_GSM_VAR_PROGRAM, MCODE_GSM_VAR_PROGRAM_COUNT));
+  gsm_concat_expire(mtick_count());
+  ASSERT_TRUE(gsm_pdu_store(part2.c_str(), part2.size(), MCODE_GSM_VAR_ADDRESS, MCODE_GSM_VAR_PROGRAM, MCODE_GSM_VAR_PROGRAM_COUNT));
+  ASSERT_STREQ(mvar_str(MCODE_GSM_VAR_PROGRAM, MCODE_GSM_VAR_PROGRAM_COUNT, NULL), "\"ab\"");
+
+  // The first part is dropped after the timeout, the second one cannot complete the SMS
+  ASSERT_FALSE(gsm_pdu_store(part1.c_str(), part1.size(), MCODE_GSM_VAR_ADDRESS, MCODE_GSM_VAR_PROGRAM, MCODE_GSM_VAR_PROGRAM_COUNT));
+  gsm_concat_expire(mtick_count() + 300000);
+  ASSERT_FALSE(gsm_pdu_store(part2.c_str(), part2.size(), MCODE_GSM_VAR_ADDRESS, MCODE_GSM_VAR_PROGRAM, MCODE_GSM_VAR_PROGRAM_COUNT));
+  ASSERT_STREQ(mvar_str(MCODE_GSM_VAR_PROGRAM, MCODE_GSM_VAR_PROGRAM_COUNT, NULL), "");
+  gsm_concat_expire(mtick_count() + 300000);
+
+  // Broken concatenation headers are not collected
+  const std::string broken = concat_part("a", 0x45, 2, 3);
+  ASSERT_FALSE(gsm_pdu_store(broken.c_str(), broken.size(), MCODE_GSM_VAR_ADDRESS, MCODE_GSM_VAR_PROGRAM, MCODE_GSM_VAR_PROGRAM_COUNT));
+}
+
+TEST_F(SmsReadHandling, GsmPduConcatLongProgram)
+{
+  const std::string text1 = "\"" + std::string(99, 'a');
+  const std::string text2(100, 'b');
+  const std::string text3 = std::string(99, 'c') + "\"";
+  const std::string part1 = concat_part(text1.c_str(), 0x46, 3, 1);
+  const std::string part2 = concat_part(text2.c_str(), 0x46, 3, 2);
+  const std::string part3 = concat_part(text3.c_str(), 0x46, 3, 3);
+
+  mcode_phone_set("+70001112233");
+  TheGsm.flags = EGsmStateFlagAllReady;
+  TheGsm.pduMode = true;
+  mvar_nvm_set(0, (1u << 1) | (1u << 2) | (1u << 3));
+  mvar_nvm_set(1, 0);
+  TheGsm.engineState = EEngineIdle;
+  gsm_engine_task();
+  ASSERT_EQ(TheGsm.engineState, EEngineListSms);
+
+  // The program of 300 characters is kept whole
+  gsm_uart2_handler("+CMGL: 1,0,,120", 15);
+  gsm_uart2_handler(part1.c_str(), part1.size());
+  gsm_uart2_handler("+CMGL: 2,0,,120", 15);
+  gsm_uart2_handler(part2.c_str(), part2.size());
+  gsm_uart2_handler("+CMGL: 3,0,,120", 15);
+  gsm_uart2_handler(part3.c_str(), part3.size());
+  ASSERT_STREQ(mvar_str(MCODE_GSM_VAR_PROGRAM, MCODE_GSM_VAR_PROGRAM_COUNT, NULL), (text1 + text2 + text3).c_str());
+  gsm_uart2_handler("OK", 2);
+  ASSERT_EQ(TheGsm.engineState, EEngineListSmsDone);
+  gsm_engine_task();
+  ASSERT_EQ(TheGsm.batchCount, 1);
+  ASSERT_STREQ(mvar_str(MCODE_GSM_VAR_OUTPUT, MCODE_GSM_VAR_OUTPUT_COUNT, NULL),
+               (std::string(99, 'a') + text2 + std::string(99, 'c') + "\r\n").c_str());
+
+  // The reply of 299 characters goes in 2 linked parts
+  gsm_uart2_handler("OK", 2);
+  gsm_engine_task();
+  ASSERT_EQ(TheGsm.engineState, EEngineSendSms);
+  ASSERT_EQ(TheGsm.cmdCount, 2);
+}
+
+TEST_F(SmsReadHandling, GsmPduConcatTooLongNegative)
+{
+  const std::string text(130, 'a');
+  std::string part;
+  uint8_t i;
+
+  mcode_phone_set("+70001112233");
+  TheGsm.flags = EGsmStateFlagAllReady;
+  TheGsm.pduMode = true;
+  mvar_nvm_set(0, (1u << 1) | (1u << 2));
+  mvar_nvm_set(1, 0);
+  TheGsm.engineState = EEngineIdle;
+  gsm_engine_task();
+  ASSERT_EQ(TheGsm.engineState, EEngineListSms);
+
+  // The program of 650 characters does not fit the variables, it is dropped
+  for (i = 1; i <= 5; ++i) {
+    part = concat_part(text.c_str(), 0x47, 5, i);
+    gsm_uart2_handler("+CMGL: 1,0,,140", 15);
+    gsm_uart2_handler(part.c_str(), part.size());
+  }
+  gsm_uart2_handler("OK", 2);
+  ASSERT_EQ(TheGsm.engineState, EEngineListSmsDone);
+  ASSERT_EQ(TheGsm.batchSkipped, 1);
+  gsm_engine_task();
+  ASSERT_EQ(TheGsm.batchCount, 0);
+  ASSERT_STREQ(mvar_str(MCODE_GSM_VAR_OUTPUT, MCODE_GSM_VAR_OUTPUT_COUNT, NULL), "SMS too long\r\n");
+
+  // The user read stores the text in 's1:2', the longer text is dropped
+  const std::string part1 = concat_part(text.c_str(), 0x48, 2, 1);
+  const std::string part2 = concat_part(text.c_str(), 0x48, 2, 2);
+  ASSERT_FALSE(gsm_pdu_store(part1.c_str(), part1.size(), 0, 1, 2));
+  ASSERT_FALSE(gsm_pdu_store(part2.c_str(), part2.size(), 0, 1, 2));
+  ASSERT_STREQ(body_var_str(), "");
+}
+
+TEST_F(SmsReadHandling, GsmNewSmsReadErrorSkipsMessage)
+{
+  mvar_nvm_set(0, 1u << 5);
+  mvar_nvm_set(1, 0);
+  TheGsm.engineState = EEngineIdle;
+  gsm_engine_task();
+  ASSERT_EQ(TheGsm.engineState, EEngineReadSms);
+
+  TheGsm.kicked = false;
+  gsm_uart2_handler("ERROR", 5);
+  ASSERT_EQ(TheGsm.engineState, EEngineIdle);
+  ASSERT_EQ(mvar_nvm_get(0), 0);
+  ASSERT_TRUE(TheGsm.kicked);
+}
+
+TEST_F(SmsReadHandling, GsmNewSmsBatch)
+{
+  const char header1[] = "+CMGL: 1,\"REC UNREAD\",\"002B00370030003000300031003100310032003200330033\",\"\",\"20/01/08,10:25:13+12\"";
+  const char header2[] = "+CMGL: 2,\"REC UNREAD\",\"002B00390038003800370035003300310030003100320033\",\"\",\"20/01/08,10:25:14+12\"";
+  const char header3[] = "+CMGL: 5,\"REC UNREAD\",\"002B00370030003000300031003100310032003200330033\",\"\",\"20/01/08,10:25:15+12\"";
+  const char indication[] = "+CMTI: \"SM\",7";
+
+  mcode_phone_set("+70001112233");
+  TheGsm.flags = EGsmStateFlagAllReady;
+  mvar_nvm_set(0, (1u << 1) | (1u << 5));
+  mvar_nvm_set(1, 0);
+  TheGsm.engineState = EEngineIdle;
+  gsm_engine_task();
+  ASSERT_EQ(TheGsm.engineState, EEngineListSms);
+  ASSERT_EQ(TheGsm.state, EGsmStateListingSms);
+  ASSERT_STREQ(collected_text2(), "AT+CMGL=\"REC UNREAD\"\r");
+  ASSERT_EQ(mvar_nvm_get(0), 0);
+
+  // Programs are collected while listing, the one from an unknown phone is skipped
+  gsm_uart2_handler(header1, sizeof (header1) - 1);
+  gsm_uart2_handler("00220061002200", 12);
+  gsm_uart2_handler(header2, sizeof (header2) - 1);
+  gsm_uart2_handler("00220078002200", 12);
+  gsm_uart2_handler(indication, sizeof (indication) - 1);
+  gsm_uart2_handler(header3, sizeof (header3) - 1);
+  gsm_uart2_handler("00220062002200", 12);
+  ASSERT_EQ(TheGsm.engineState, EEngineListSms);
+  ASSERT_EQ(mvar_nvm_get(0), 1u << 7);
+
+  TheGsm.kicked = false;
+  gsm_uart2_handler("OK", 2);
+  ASSERT_EQ(TheGsm.engineState, EEngineListSmsDone);
+  ASSERT_EQ(TheGsm.state, EGsmStateIdle);
+  ASSERT_TRUE(TheGsm.kicked);
+  ASSERT_STREQ(mvar_str(MCODE_GSM_VAR_OUTPUT, MCODE_GSM_VAR_OUTPUT_COUNT, NULL), "");
+
+  // Execute the collected programs outside the UART handler, delete all read SMS in bulk
+  collected_text2_reset();
+  gsm_engine_task();
+  ASSERT_EQ(TheGsm.engineState, EEngineDeleteSms);
+  ASSERT_EQ(TheGsm.batchCount, 2);
+  ASSERT_STREQ(mvar_str(MCODE_GSM_VAR_OUTPUT, MCODE_GSM_VAR_OUTPUT_COUNT, NULL), "a\r\nb\r\n");
+  ASSERT_STREQ(collected_text2(), "AT+CMGD=1,1\r");
+  gsm_uart2_handler("OK", 2);
+  ASSERT_EQ(TheGsm.engineState, EEngineExecSmsDone);
+
+  // Send the collected output in a single SMS
+  collected_text2_reset();
+  gsm_engine_task();
+  ASSERT_EQ(TheGsm.engineState, EEngineSendSms);
+  ASSERT_STREQ(collected_text2(), "AT+CMGS=\"002B00370030003000300031003100310032003200330033\"\r");
+}
+
+TEST_F(SmsReadHandling, GsmNewSmsBatchForeignLast)
+{
+  const char header1[] = "+CMGL: 1,\"REC UNREAD\",\"002B00370030003000300031003100310032003200330033\",\"\",\"20/01/08,10:25:13+12\"";
+  const char header2[] = "+CMGL: 2,\"REC UNREAD\",\"002B00390038003800370035003300310030003100320033\",\"\",\"20/01/08,10:25:14+12\"";
+
+  mcode_phone_set("+70001112233");
+  TheGsm.flags = EGsmStateFlagAllReady;
+  mvar_nvm_set(0, (1u << 1) | (1u << 2));
+  mvar_nvm_set(1, 0);
+  TheGsm.engineState = EEngineIdle;
+  gsm_engine_task();
+  ASSERT_EQ(TheGsm.engineState, EEngineListSms);
+
+  // The last listed SMS comes from a foreign phone
+  gsm_uart2_handler(header1, sizeof (header1) - 1);
+  gsm_uart2_handler("00220061002200", 12);
+  gsm_uart2_handler(header2, sizeof (header2) - 1);
+  gsm_uart2_handler("00220078002200", 12);
+  gsm_uart2_handler("OK", 2);
+  ASSERT_EQ(TheGsm.engineState, EEngineListSmsDone);
+  ASSERT_STREQ(mvar_str(MCODE_GSM_VAR_ADDRESS, 1, NULL), "+98875310123");
+
+  gsm_engine_task();
+  ASSERT_EQ(TheGsm.engineState, EEngineDeleteSms);
+  gsm_uart2_handler("OK", 2);
+  ASSERT_EQ(TheGsm.engineState, EEngineExecSmsDone);
+
+  // The output goes to the owner, not to the last sender
+  collected_text2_reset();
+  gsm_engine_task();
+  ASSERT_EQ(TheGsm.engineState, EEngineSendSms);
+  ASSERT_STREQ(collected_text2(), "AT+CMGS=\"002B00370030003000300031003100310032003200330033\"\r");
+}
+
+TEST_F(SmsReadHandling, GsmNewSmsBatchOverflow)
+{
+  const char header[] = "+CMGL: 1,\"REC UNREAD\",\"002B00370030003000300031003100310032003200330033\",\"\",\"20/01/08,10:25:13+12\"";
+  const size_t count = MCODE_GSM_BATCH_LENGTH/4 + 1;
+  size_t i;
+
+  mcode_phone_set("+70001112233");
+  TheGsm.flags = EGsmStateFlagAllReady;
+  mvar_nvm_set(0, (1u << 1) | (1u << 2));
+  mvar_nvm_set(1, 0);
+  TheGsm.engineState = EEngineIdle;
+  gsm_engine_task();
+  ASSERT_EQ(TheGsm.engineState, EEngineListSms);
+
+  // Each '"a"' program takes 4 bytes, the last one does not fit the buffer
+  for (i = 0; i < count; ++i) {
+    gsm_uart2_handler(header, sizeof (header) - 1);
+    gsm_uart2_handler("00220061002200", 12);
+  }
+  gsm_uart2_handler("OK", 2);
+  ASSERT_EQ(TheGsm.batchSkipped, 1);
+
+  gsm_engine_task();
+  ASSERT_EQ(TheGsm.engineState, EEngineDeleteSms);
+  ASSERT_EQ(TheGsm.batchCount, count - 1);
+  ASSERT_EQ(TheGsm.batchLength, 0);
+}
+
+TEST_F(SmsReadHandling, GsmNewSmsBatchError)
+{
+  mvar_nvm_set(0, (1u << 1) | (1u << 2));
+  mvar_nvm_set(1, 0);
+  TheGsm.engineState = EEngineIdle;
+  gsm_engine_task();
+  ASSERT_EQ(TheGsm.engineState, EEngineListSms);
+
+  gsm_uart2_handler("ERROR", 5);
+  ASSERT_EQ(TheGsm.engineState, EEngineIdle);
+  ASSERT_EQ(TheGsm.state, EGsmStateIdle);
+
+  // The periodic task retries listing
+  collected_text2_reset();
+  gsm_periodic_task();
+  ASSERT_EQ(TheGsm.engineState, EEngineListSms);
+  ASSERT_STREQ(collected_text2(), "AT+CMGL=\"REC UNREAD\"\r");
+}
+
+TEST_F(GsmBasic, SendSmsConcatenated)
+{
+  MPduSms sms;
+  const std::string body(200, 'x');
+
+  TheGsm.flags = EGsmStateFlagAllReady;
+  TheGsm.pduMode = true;
+  gsm_queue_stats_reset();
+  ASSERT_TRUE(gsm_send_sms("+70001112233", body.c_str()));
+  ASSERT_EQ(TheGsm.cmdCount, 2);
+  ASSERT_STREQ(collected_text2(), "AT+CMGS=153\r");
+
+  // Both parts are linked by the same reference, sent back to back
+  collected_text2_reset();
+  gsm_uart2_handler("> ", 2);
+  std::string pdu = collected_text2();
+  ASSERT_TRUE(pdu_decode(pdu.c_str(), pdu.size() - 2, &sms));
+  ASSERT_EQ(sms.concatTotal, 2);
+  ASSERT_EQ(sms.concatSeq, 1);
+  ASSERT_EQ(sms.length, 153);
+  const uint16_t ref = sms.concatRef;
+
+  collected_text2_reset();
+  gsm_uart2_handler("+CMGS: 1", 8);
+  gsm_uart2_handler("OK", 2);
+  ASSERT_EQ(TheGsm.cmdCount, 1);
+  ASSERT_STREQ(collected_text2(), "AT+CMGS=61\r");
+  collected_text2_reset();
+  gsm_uart2_handler("> ", 2);
+  pdu = collected_text2();
+  ASSERT_TRUE(pdu_decode(pdu.c_str(), pdu.size() - 2, &sms));
+  ASSERT_EQ(sms.concatRef, ref);
+  ASSERT_EQ(sms.concatSeq, 2);
+  ASSERT_EQ(sms.length, 47);
+  gsm_uart2_handler("+CMGS: 2", 8);
+  gsm_uart2_handler("OK", 2);
+  ASSERT_EQ(TheGsm.cmdCount, 0);
+  ASSERT_EQ(gsm_queue_stats()->queued, 2);
+}
+
+TEST_F(GsmBasic, SendSmsConcatenatedQueueFullNegative)
+{
+  const std::string body(200, 'x');
+
+  TheGsm.flags = EGsmStateFlagAllReady;
+  TheGsm.pduMode = true;
+  gsm_queue_stats_reset();
+  ASSERT_TRUE(gsm_send_cmd("AT"));
+  ASSERT_TRUE(gsm_send_cmd("AT"));
+  ASSERT_TRUE(gsm_send_cmd("AT"));
+
+  // None of the parts are queued, if all of them do not fit
+  ASSERT_FALSE(gsm_send_sms("+70001112233", body.c_str()));
+  ASSERT_EQ(TheGsm.cmdCount, 3);
+  ASSERT_EQ(gsm_queue_stats()->rejected, 1);
+
+  // The text mode truncates the body to a single SMS, 70 UCS2 characters
+  TheGsm.pduMode = false;
+  ASSERT_TRUE(gsm_send_sms("+70001112233", body.c_str()));
+  ASSERT_EQ(TheGsm.cmdCount, 4);
+  ASSERT_EQ(strlen(TheGsm.cmds[(TheGsm.cmdHead + 3) % MCODE_GSM_QUEUE_LENGTH].data + strlen("+70001112233") + 1), 70u);
+}
+
+TEST_F(GsmBasic, SendSmsConcatenatedTruncated)
+{
+  const std::string body(700, 'x');
+
+  TheGsm.flags = EGsmStateFlagAllReady;
+  TheGsm.pduMode = true;
+
+  // The body longer than the queue holds is truncated to the queue length
+  ASSERT_TRUE(gsm_send_sms("+70001112233", body.c_str()));
+  ASSERT_EQ(TheGsm.cmdCount, MCODE_GSM_QUEUE_LENGTH);
+  ASSERT_EQ(TheGsm.cmds[(TheGsm.cmdHead + MCODE_GSM_QUEUE_LENGTH - 1) % MCODE_GSM_QUEUE_LENGTH].parts, MCODE_GSM_QUEUE_LENGTH);
+}
+
 TEST_F(GsmBasic, DoubleInit)
 {
   gsm_init();
@@ -410,7 +964,7 @@ TEST_F(GsmBasic, SendCmd)
 
 TEST_F(GsmBasic, SendCmdWrongStateNegative)
 {
-  TheGsmState = EGsmStateNull;
+  TheGsm.state = EGsmStateNull;
   bool res = gsm_send_cmd("AT");
 
   ASSERT_FALSE(res);
@@ -418,12 +972,97 @@ TEST_F(GsmBasic, SendCmdWrongStateNegative)
 
 TEST_F(GsmBasic, SendCmdWrongFlagsNegative)
 {
-  TheGsmFlags = (TGsmStateFlags)(~EGsmStateFlagAtReady);
+  TheGsm.flags = (uint8_t)(~EGsmStateFlagAtReady);
   bool res = gsm_send_cmd("AT");
 
   ASSERT_FALSE(res);
 }
 
+TEST_F(GsmBasic, SendCmdQueued)
+{
+  ASSERT_TRUE(gsm_send_cmd("AT"));
+  ASSERT_TRUE(gsm_send_cmd("AT+CBC"));
+  ASSERT_TRUE(gsm_send_cmd("AT+CSQ"));
+
+  ASSERT_STREQ(collected_text2(), "AT\r");
+  ASSERT_EQ(gsm_queue_stats()->depth, 3);
+
+  /* The next command is sent as soon as the previous one completes */
+  gsm_uart2_handler("OK", 2);
+  ASSERT_STREQ(collected_text2(), "AT\rAT+CBC\r");
+  gsm_uart2_handler("ERROR", 5);
+  ASSERT_STREQ(collected_text2(), "AT\rAT+CBC\rAT+CSQ\r");
+  gsm_uart2_handler("OK", 2);
+  ASSERT_EQ(TheGsm.state, EGsmStateIdle);
+  ASSERT_EQ(gsm_queue_stats()->depth, 0);
+}
+
+TEST_F(GsmBasic, SendCmdQueueFullNegative)
+{
+  int i;
+
+  gsm_queue_stats_reset();
+  for (i = 0; i < 4; ++i) {
+    ASSERT_TRUE(gsm_send_cmd("AT"));
+  }
+  ASSERT_FALSE(gsm_send_cmd("AT"));
+
+  const MGsmQueueStats *const stats = gsm_queue_stats();
+  ASSERT_EQ(stats->depth, 4);
+  ASSERT_EQ(stats->maxDepth, 4);
+  ASSERT_EQ(stats->queued, 4);
+  ASSERT_EQ(stats->rejected, 1);
+}
+
+static MGsmResult TheLastResult = MGsmResultOk;
+static int TheDoneCount = 0;
+
+static void gsm_cmd_done_handler(gsm_engine_t *engine, MGsmResult result)
+{
+  TheLastResult = result;
+  ++TheDoneCount;
+}
+
+TEST_F(GsmBasic, QueueCmdCompletion)
+{
+  TheDoneCount = 0;
+  ASSERT_TRUE(gsm_queue_cmd("AT", MGsmExpectOk, 1000, gsm_cmd_done_handler));
+  gsm_uart2_handler("ERROR", 5);
+
+  ASSERT_EQ(TheDoneCount, 1);
+  ASSERT_EQ(TheLastResult, MGsmResultError);
+}
+
+TEST_F(GsmBasic, QueueCmdPrompt)
+{
+  TheDoneCount = 0;
+  ASSERT_TRUE(gsm_queue_cmd("AT+CMGS=1", MGsmExpectPrompt, 1000, gsm_cmd_done_handler));
+  ASSERT_EQ(TheGsm.state, EGsmStateSendingSmsAddress);
+  gsm_uart2_handler("> ", 2);
+
+  ASSERT_EQ(TheDoneCount, 1);
+  ASSERT_EQ(TheLastResult, MGsmResultOk);
+  ASSERT_EQ(TheGsm.state, EGsmStateIdle);
+  ASSERT_STREQ(collected_text2(), "AT+CMGS=1\r");
+}
+
+TEST_F(GsmBasic, QueueCmdTimeout)
+{
+  TheDoneCount = 0;
+  gsm_queue_stats_reset();
+  ASSERT_TRUE(gsm_queue_cmd("AT", MGsmExpectOk, 1000, gsm_cmd_done_handler));
+  ASSERT_TRUE(gsm_queue_cmd("AT+CBC", MGsmExpectOk, 1000, NULL));
+
+  /* Expire the deadline */
+  TheGsm.cmdDeadline = 0;
+  gsm_queue_timeout_task();
+
+  ASSERT_EQ(TheDoneCount, 1);
+  ASSERT_EQ(TheLastResult, MGsmResultTimeout);
+  ASSERT_EQ(gsm_queue_stats()->timeouts, 1);
+  ASSERT_STREQ(collected_text2(), "AT\rAT+CBC\r");
+}
+
 TEST_F(GsmBasic, SendCmdRaw)
 {
   gsm_send_cmd_raw("ATD");
@@ -441,9 +1080,19 @@ TEST_F(SmsReadHandling, GsmReadSmsPositive)
   ASSERT_STREQ(collected_text2(), "AT+CMGR=7\r");
 }
 
+TEST_F(SmsReadHandling, GsmReadSmsQueued)
+{
+  TheGsm.state = EGsmStateReadingSmsHeader;
+  const bool res = gsm_read_sms(7);
+
+  ASSERT_TRUE(res);
+  ASSERT_EQ(collected_text2_length(), 0);
+  ASSERT_EQ(gsm_queue_stats()->depth, 1);
+}
+
 TEST_F(SmsReadHandling, GsmReadSmsNegative)
 {
-  TheGsmState = EGsmStateReadingSmsHeader;
+  TheGsm.state = EGsmStateNull;
   const bool res = gsm_read_sms(7);
 
   ASSERT_FALSE(res);
@@ -451,22 +1100,123 @@ TEST_F(SmsReadHandling, GsmReadSmsNegative)
 
 TEST_F(SmsReadHandling, GsmSendSmsPositive)
 {
-  TheGsmState = EGsmStateIdle;
-  TheGsmFlags = (TGsmStateFlags)(EGsmStateFlagAtReady |
+  TheGsm.state = EGsmStateIdle;
+  TheGsm.flags = (TGsmStateFlags)(EGsmStateFlagAtReady |
                                  EGsmStateFlagSmsReady | EGsmStateFlagPinReady);
 
   bool res = gsm_send_sms("+70001112233", "ABCD");
   ASSERT_TRUE(res);
-  ASSERT_STREQ(TheMsgBuffer, "ABCD");
+  ASSERT_STREQ(TheGsm.msg, "ABCD");
   ASSERT_EQ(collected_text2_length(), 59);
-  ASSERT_EQ(TheGsmState, EGsmStateSendingSmsAddress);
+  ASSERT_EQ(TheGsm.state, EGsmStateSendingSmsAddress);
+  ASSERT_STREQ(collected_text2(), "AT+CMGS=\"002B00370030003000300031003100310032003200330033\"\r");
+}
+
+TEST_F(SmsReadHandling, GsmSendSmsAfterCmd)
+{
+  TheGsm.state = EGsmStateIdle;
+  TheGsm.flags = (TGsmStateFlags)(EGsmStateFlagAtReady |
+                                 EGsmStateFlagSmsReady | EGsmStateFlagPinReady);
+
+  ASSERT_TRUE(gsm_send_cmd("AT+CBC"));
+  ASSERT_TRUE(gsm_send_sms("+70001112233", "ABCD"));
+  ASSERT_STREQ(collected_text2(), "AT+CBC\r");
+
+  gsm_uart2_handler("+CBC: 0,85,4100\r\n\r\nOK", 23);
+  ASSERT_EQ(TheGsm.state, EGsmStateSendingSmsAddress);
+  ASSERT_STREQ(collected_text2(), "AT+CBC\r"
+               "AT+CMGS=\"002B00370030003000300031003100310032003200330033\"\r");
+
+  gsm_uart2_handler("> ", 2);
+  gsm_uart2_handler("+CMGS: 5", 8);
+  ASSERT_EQ(TheGsm.state, EGsmStateSendingAtCmd);
+  gsm_uart2_handler("OK", 2);
+  ASSERT_EQ(TheGsm.state, EGsmStateIdle);
+  ASSERT_EQ(gsm_queue_stats()->depth, 0);
+}
+
+static std::string TheSecondText;
+
+static void second_write_char(void *ctx, char ch)
+{
+  static_cast<std::string *>(ctx)->push_back(ch);
+}
+
+static const MGsmTransport TheSecondTransport = { second_write_char, &TheSecondText };
+
+TEST_F(SmsReadHandling, GsmSecondInstance)
+{
+  gsm_engine_t second;
+
+  TheSecondText.clear();
+  ASSERT_TRUE(gsm_engine_init(&second, &TheSecondTransport));
+  ASSERT_EQ(gsm_engine_at(0), &TheGsm);
+  ASSERT_EQ(gsm_engine_at(1), &second);
+
+  // Not ready before 'RDY'
+  ASSERT_FALSE(gsm_engine_queue_cmd(&second, "AT", MGsmExpectOk, 1000, NULL));
+  gsm_engine_input(&second, "RDY", 3);
+  ASSERT_TRUE(gsm_engine_queue_cmd(&second, "AT+CBC", MGsmExpectOk, 1000, NULL));
+  ASSERT_EQ(TheSecondText, "AT+CBC\r");
+  ASSERT_EQ(collected_text2_length(), 0);
+
+  // The instances do not share the state
+  ASSERT_TRUE(gsm_send_cmd("AT"));
+  ASSERT_STREQ(collected_text2(), "AT\r");
+  gsm_engine_input(&second, "OK", 2);
+  ASSERT_EQ(gsm_engine_queue_stats(&second)->depth, 0);
+  ASSERT_EQ(gsm_queue_stats()->depth, 1);
+
+  // The SMS programs are accepted by the default instance only
+  mvar_nvm_set(0, 0);
+  mvar_nvm_set(1, 0);
+  gsm_engine_input(&second, "+CMTI: \"SM\",3", 13);
+  ASSERT_EQ(mvar_nvm_get(0), 0);
+
+  gsm_engine_deinit(&second);
+  ASSERT_EQ(gsm_engine_at(1), nullptr);
+}
+
+TEST_F(SmsReadHandling, GsmSendSmsRoundRobin)
+{
+  gsm_engine_t second;
+  const uint8_t ready = EGsmStateFlagAtReady | EGsmStateFlagSmsReady | EGsmStateFlagPinReady;
+
+  TheSecondText.clear();
+  ASSERT_TRUE(gsm_engine_init(&second, &TheSecondTransport));
+  second.state = EGsmStateIdle;
+  second.flags = ready;
+  TheGsm.flags = ready;
+
+  // The SMS are spread over both instances
+  ASSERT_TRUE(gsm_send_sms("+70001112233", "A"));
+  ASSERT_TRUE(gsm_send_sms("+70001112233", "B"));
+  ASSERT_EQ(gsm_queue_stats()->depth, 1);
+  ASSERT_EQ(gsm_engine_queue_stats(&second)->depth, 1);
   ASSERT_STREQ(collected_text2(), "AT+CMGS=\"002B00370030003000300031003100310032003200330033\"\r");
+  ASSERT_EQ(TheSecondText, "AT+CMGS=\"002B00370030003000300031003100310032003200330033\"\r");
+
+  // The instance that is not ready is skipped
+  second.flags = EGsmStateFlagAtReady;
+  ASSERT_TRUE(gsm_send_sms("+70001112233", "C"));
+  ASSERT_TRUE(gsm_send_sms("+70001112233", "D"));
+  ASSERT_EQ(gsm_queue_stats()->depth, 3);
+  ASSERT_EQ(gsm_engine_queue_stats(&second)->depth, 1);
+
+  // The timeouts are checked for all the instances
+  second.cmdDeadline = 0;
+  gsm_queue_timeout_task();
+  ASSERT_EQ(gsm_engine_queue_stats(&second)->depth, 0);
+  ASSERT_EQ(gsm_engine_queue_stats(&second)->timeouts, 1);
+  ASSERT_EQ(gsm_queue_stats()->depth, 3);
+
+  gsm_engine_deinit(&second);
 }
 
 TEST_F(SmsReadHandling, GsmSendSmsWrongStateNegative)
 {
-  TheGsmState = EGsmStateNull;
-  TheGsmFlags = (TGsmStateFlags)(EGsmStateFlagAtReady |
+  TheGsm.state = EGsmStateNull;
+  TheGsm.flags = (TGsmStateFlags)(EGsmStateFlagAtReady |
                                  EGsmStateFlagSmsReady | EGsmStateFlagPinReady);
 
   bool res = gsm_send_sms("+70001112233", "ABCD");
@@ -475,8 +1225,8 @@ TEST_F(SmsReadHandling, GsmSendSmsWrongStateNegative)
 
 TEST_F(SmsReadHandling, GsmSendSmsWrongFlagsNegative)
 {
-  TheGsmState = EGsmStateIdle;
-  TheGsmFlags = (TGsmStateFlags)(EGsmStateFlagAtReady | EGsmStateFlagSmsReady);
+  TheGsm.state = EGsmStateIdle;
+  TheGsm.flags = (TGsmStateFlags)(EGsmStateFlagAtReady | EGsmStateFlagSmsReady);
 
   bool res = gsm_send_sms("+70001112233", "ABCD");
   ASSERT_FALSE(res);
@@ -484,102 +1234,102 @@ TEST_F(SmsReadHandling, GsmSendSmsWrongFlagsNegative)
 
 TEST_F(SmsReadHandling, GsmSendSmsBodyPositive)
 {
-  memset(TheMsgBuffer, 0, sizeof (TheMsgBuffer));
-  strcpy(TheMsgBuffer, "ABCD");
+  memset(TheGsm.msg, 0, sizeof (TheGsm.msg));
+  strcpy(TheGsm.msg, "ABCD");
 
-  gsm_sms_send_body();
+  gsm_sms_send_body(&TheGsm);
 
   ASSERT_EQ(collected_text2_length(), 18);
-  ASSERT_EQ(TheGsmState, EGsmStateIdle);
+  ASSERT_EQ(TheGsm.state, EGsmStateIdle);
   ASSERT_STREQ(collected_text2(), "0041004200430044\x1a\r");
 }
 
 TEST_F(SmsReadHandling, GsmSendModemRspNull)
 {
-  TheGsmState = EGsmStateIdle;
+  TheGsm.state = EGsmStateIdle;
 
   gsm_uart2_handler(NULL, 0);
 
-  ASSERT_EQ(TheGsmState, EGsmStateIdle);
+  ASSERT_EQ(TheGsm.state, EGsmStateIdle);
 }
 
 TEST_F(SmsReadHandling, GsmSendModemRspEmpty)
 {
-  TheGsmState = EGsmStateIdle;
+  TheGsm.state = EGsmStateIdle;
 
   gsm_uart2_handler("", 0);
 
-  ASSERT_EQ(TheGsmState, EGsmStateIdle);
+  ASSERT_EQ(TheGsm.state, EGsmStateIdle);
 }
 
 TEST_F(SmsReadHandling, GsmSendModemRspOk)
 {
-  TheGsmState = EGsmStateSendingAtCmd;
+  TheGsm.state = EGsmStateSendingAtCmd;
 
   gsm_uart2_handler("OK", 2);
 
-  ASSERT_EQ(TheGsmState, EGsmStateIdle);
+  ASSERT_EQ(TheGsm.state, EGsmStateIdle);
 }
 
 TEST_F(SmsReadHandling, GsmSendModemRspError)
 {
-  TheGsmState = EGsmStateSendingAtCmd;
+  TheGsm.state = EGsmStateSendingAtCmd;
 
   gsm_uart2_handler("ERROR", 5);
 
-  ASSERT_EQ(TheGsmState, EGsmStateIdle);
+  ASSERT_EQ(TheGsm.state, EGsmStateIdle);
 }
 
 TEST_F(SmsReadHandling, GsmSendModemRspReady)
 {
-  TheGsmState = EGsmStateNull;
-  TheGsmFlags = EGsmStateFlagNone;
+  TheGsm.state = EGsmStateNull;
+  TheGsm.flags = EGsmStateFlagNone;
 
   gsm_uart2_handler("RDY", 3);
 
-  ASSERT_EQ(TheGsmFlags&EGsmStateFlagAtReady, EGsmStateFlagAtReady);
-  ASSERT_EQ(TheGsmState, EGsmStateIdle);
+  ASSERT_EQ(TheGsm.flags&EGsmStateFlagAtReady, EGsmStateFlagAtReady);
+  ASSERT_EQ(TheGsm.state, EGsmStateIdle);
 }
 
 TEST_F(SmsReadHandling, GsmSendModemRspSmsReady)
 {
-  TheGsmFlags = EGsmStateFlagNone;
+  TheGsm.flags = EGsmStateFlagNone;
 
   gsm_uart2_handler("SMS Ready", 9);
 
-  ASSERT_EQ(TheGsmFlags&EGsmStateFlagSmsReady, EGsmStateFlagSmsReady);
+  ASSERT_EQ(TheGsm.flags&EGsmStateFlagSmsReady, EGsmStateFlagSmsReady);
 }
 
 TEST_F(SmsReadHandling, GsmSendModemRspCallReady)
 {
-  TheGsmFlags = EGsmStateFlagNone;
+  TheGsm.flags = EGsmStateFlagNone;
 
   gsm_uart2_handler("Call Ready", 10);
 
-  ASSERT_EQ(TheGsmFlags&EGsmStateFlagCallReady, EGsmStateFlagCallReady);
+  ASSERT_EQ(TheGsm.flags&EGsmStateFlagCallReady, EGsmStateFlagCallReady);
 }
 
 TEST_F(SmsReadHandling, GsmSendModemRspPinReady)
 {
-  TheGsmFlags = EGsmStateFlagNone;
+  TheGsm.flags = EGsmStateFlagNone;
 
   gsm_uart2_handler("+CPIN: READY", 12);
 
-  ASSERT_EQ(TheGsmFlags&EGsmStateFlagPinReady, EGsmStateFlagPinReady);
+  ASSERT_EQ(TheGsm.flags&EGsmStateFlagPinReady, EGsmStateFlagPinReady);
 }
 
 TEST_F(SmsReadHandling, GsmSendModemRspPinNotReady)
 {
-  TheGsmFlags = EGsmStateFlagAllReady;
+  TheGsm.flags = EGsmStateFlagAllReady;
 
   gsm_uart2_handler("+CPIN: NOT READY", 16);
 
-  ASSERT_EQ(TheGsmFlags, EGsmStateFlagAtReady);
+  ASSERT_EQ(TheGsm.flags, EGsmStateFlagAtReady);
 }
 
 TEST_F(SmsReadHandling, GsmSendModemRspFullFunc)
 {
-  TheGsmFlags = EGsmStateFlagNone;
+  TheGsm.flags = EGsmStateFlagNone;
 
   gsm_uart2_handler("+CFUN: 1", 8);
 }
@@ -601,11 +1351,11 @@ TEST_F(SmsReadHandling, GsmSendModemRspSmsSent)
 
 TEST_F(SmsReadHandling, GsmSendModemRspSmsSentWithEngineRequest)
 {
-  TheEngineState = EEngineSendSms;
+  TheGsm.engineState = EEngineSendSms;
 
   gsm_uart2_handler("+CMGS: 5", 8);
 
-  ASSERT_EQ(TheEngineState, EEngineSendSmsDone);
+  ASSERT_EQ(TheGsm.engineState, EEngineSendSmsDone);
 }
 
 TEST_F(SmsReadHandling, GsmSendModemRspSmsSentNoInfo)
@@ -615,99 +1365,99 @@ TEST_F(SmsReadHandling, GsmSendModemRspSmsSentNoInfo)
 
 TEST_F(SmsReadHandling, GsmSendModemRspReadyForBody)
 {
-  memset(TheMsgBuffer, 0, sizeof (TheMsgBuffer));
-  strcpy(TheMsgBuffer, "ABCD");
+  memset(TheGsm.msg, 0, sizeof (TheGsm.msg));
+  strcpy(TheGsm.msg, "ABCD");
 
-  TheGsmState = EGsmStateSendingSmsAddress;
+  TheGsm.state = EGsmStateSendingSmsAddress;
   gsm_uart2_handler("> ", 2);
 
   ASSERT_EQ(collected_text2_length(), 18);
-  ASSERT_EQ(TheGsmState, EGsmStateSendingAtCmd);
+  ASSERT_EQ(TheGsm.state, EGsmStateSendingAtCmd);
   ASSERT_STREQ(collected_text2(), "0041004200430044\x1a\r");
 }
 
 TEST_F(SmsReadHandling, GsmSendModemRspReadyForBodyNegative)
 {
-  memset(TheMsgBuffer, 0, sizeof (TheMsgBuffer));
-  strcpy(TheMsgBuffer, "ABCD");
+  memset(TheGsm.msg, 0, sizeof (TheGsm.msg));
+  strcpy(TheGsm.msg, "ABCD");
 
-  TheGsmState = EGsmStateIdle;
+  TheGsm.state = EGsmStateIdle;
   gsm_uart2_handler("> ", 2);
 
-  ASSERT_EQ(TheGsmState, EGsmStateIdle);
+  ASSERT_EQ(TheGsm.state, EGsmStateIdle);
 }
 
 TEST_F(SmsReadHandling, GsmSendModemRspUnknownReponse)
 {
-  TheGsmState = EGsmStateIdle;
+  TheGsm.state = EGsmStateIdle;
 
   gsm_uart2_handler("AT+CUNKNOWN", 11);
 
-  ASSERT_EQ(TheGsmState, EGsmStateIdle);
+  ASSERT_EQ(TheGsm.state, EGsmStateIdle);
 }
 
 TEST_F(SmsReadHandling, GsmSendModemRspNewSmsIndication)
 {
-  TheGsmState = EGsmStateIdle;
+  TheGsm.state = EGsmStateIdle;
   mcode_errno_set(ESuccess);
 
   gsm_uart2_handler("+CMTI: \"SM\",3", 13);
 
   ASSERT_EQ(mcode_errno(), ESuccess);
-  ASSERT_EQ(TheGsmState, EGsmStateIdle);
+  ASSERT_EQ(TheGsm.state, EGsmStateIdle);
 }
 
 TEST_F(SmsReadHandling, GsmSendModemRspNewSmsIndicationStorageAsIdNegative)
 {
-  TheGsmState = EGsmStateIdle;
+  TheGsm.state = EGsmStateIdle;
   mcode_errno_set(ESuccess);
 
   gsm_uart2_handler("+CMTI: SM,3", 11);
 
   ASSERT_EQ(mcode_errno(), EGeneral);
-  ASSERT_EQ(TheGsmState, EGsmStateIdle);
+  ASSERT_EQ(TheGsm.state, EGsmStateIdle);
 }
 
 TEST_F(SmsReadHandling, GsmSendModemRspNewSmsIndicationWrongSeparatorNegative)
 {
-  TheGsmState = EGsmStateIdle;
+  TheGsm.state = EGsmStateIdle;
   mcode_errno_set(ESuccess);
 
   gsm_uart2_handler("+CMTI: \"SM\".3", 13);
 
   ASSERT_EQ(mcode_errno(), EGeneral);
-  ASSERT_EQ(TheGsmState, EGsmStateIdle);
+  ASSERT_EQ(TheGsm.state, EGsmStateIdle);
 }
 
 TEST_F(SmsReadHandling, GsmSendModemRspNewSmsIndicationStringIndexNegative)
 {
-  TheGsmState = EGsmStateIdle;
+  TheGsm.state = EGsmStateIdle;
   mcode_errno_set(ESuccess);
 
   gsm_uart2_handler("+CMTI: \"SM\",\"3\"", 15);
 
   ASSERT_EQ(mcode_errno(), EGeneral);
-  ASSERT_EQ(TheGsmState, EGsmStateIdle);
+  ASSERT_EQ(TheGsm.state, EGsmStateIdle);
 }
 
 TEST_F(SmsReadHandling, GsmSendModemRspNewSmsIndicationExtraParamNegative)
 {
-  TheGsmState = EGsmStateIdle;
+  TheGsm.state = EGsmStateIdle;
   mcode_errno_set(ESuccess);
 
   gsm_uart2_handler("+CMTI: \"SM\",3,0", 15);
 
   ASSERT_EQ(mcode_errno(), EGeneral);
-  ASSERT_EQ(TheGsmState, EGsmStateIdle);
+  ASSERT_EQ(TheGsm.state, EGsmStateIdle);
 }
 
 TEST_F(SmsReadHandling, GsmSendModemRspNewSmsIndicationNoInfo)
 {
-  TheGsmState = EGsmStateIdle;
+  TheGsm.state = EGsmStateIdle;
 
   gsm_uart2_handler("+CMTI", 5);
 
-  ASSERT_EQ(TheGsmState, EGsmStateIdle);
+  ASSERT_EQ(TheGsm.state, EGsmStateIdle);
 }
 
 TEST_F(SmsReadHandling, GsmParseReponseNullReponse)
@@ -716,11 +1466,93 @@ TEST_F(SmsReadHandling, GsmParseReponseNullReponse)
   gsm_parse_response(NULL, &cmd_id, NULL);
 }
 
+/* Modem trace recorded with the simulator */
+static const char TheModemTrace[] =
+  "RDY\n"
+  "+CFUN: 1\n"
+  "+CPIN: READY\n"
+  "Call Ready\n"
+  "SMS Ready\n"
+  "\n"
+  "+CMTI: \"SM\",3\n"
+  "+CMGR: \"REC READ\",\"002B0039\",\"\",\"20/01/08,10:25:13+12\"\n"
+  "0041\n"
+  "OK\n"
+  "> \n"
+  "+CMGS: 12\n"
+  "+CBC: 0,85,4100\n"
+  "+CPIN: NOT READY\n"
+  "+CFUN: 0\n"
+  "+CMG\n"
+  "+CUSD: 0\n"
+  "ERROR";
+
+TEST_F(SmsReadHandling, GsmParseReponseTrace)
+{
+  const TAtCmdId expected[] = {
+    EAtCmdIdReady, EAtCmdIdFullFunc, EAtCmdIdPinReady, EAtCmdIdCallReady,
+    EAtCmdIdSmsReady, EAtCmdIdEmpty, EAtCmdIdSmsIndication, EAtCmdIdSmsRead,
+    EAtCmdIdUnknown, EAtCmdIdOk, EAtCmdIdSmsReadyForBody, EAtCmdIdSmsSent,
+    EAtCmdIdBatteryLevel, EAtCmdIdPinNotReady, EAtCmdIdUnknown, EAtCmdIdUnknown,
+    EAtCmdIdUnknown, EAtCmdIdError,
+  };
+
+  size_t i = 0;
+  TAtCmdId id;
+  const char *args;
+  const char *next = TheModemTrace;
+  while (next) {
+    next = gsm_parse_response(next, &id, &args);
+    ASSERT_LT(i, sizeof (expected)/sizeof (*expected));
+    ASSERT_EQ(id, expected[i]) << "line #" << i;
+    if (EAtCmdIdSmsSent == id) {
+      ASSERT_EQ(strncmp(args, "12", 2), 0);
+    } else if (EAtCmdIdSmsIndication == id) {
+      ASSERT_EQ(strncmp(args, "\"SM\",3", 6), 0);
+    }
+    ++i;
+  }
+  ASSERT_EQ(i, sizeof (expected)/sizeof (*expected));
+}
+
+TEST(GsmParseResponse, Throughput)
+{
+  // Not a pass/fail check, reports lines/s for the modem trace
+  static const size_t TheTotal = 4*1024*1024;
+  size_t lines;
+  TAtCmdId id;
+  const char *args;
+  const char *next;
+
+  const auto start = std::chrono::steady_clock::now();
+  for (lines = 0; lines < TheTotal; ) {
+    for (next = TheModemTrace; next; ++lines) {
+      next = gsm_parse_response(next, &id, &args);
+    }
+  }
+  const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  printf("GSM responses: %8.1f Mlines/s\n", lines / elapsed.count() / 1e6);
+}
+
+TEST_F(SmsReadHandling, GsmParseReponseFullMatchNoArgs)
+{
+  TAtCmdId id;
+  const char *args = "";
+
+  ASSERT_EQ(gsm_parse_response("+CMTI", &id, &args), (const char *)NULL);
+  ASSERT_EQ(id, EAtCmdIdSmsIndication);
+  ASSERT_EQ(args, (const char *)NULL);
+  gsm_parse_response("OKAY", &id, &args);
+  ASSERT_EQ(id, EAtCmdIdUnknown);
+  gsm_parse_response("+CMGSX: 1", &id, &args);
+  ASSERT_EQ(id, EAtCmdIdUnknown);
+}
+
 TEST_F(SmsReadHandling, EngineIdle)
 {
   mvar_nvm_set(0, 0);
   mvar_nvm_set(1, 0);
-  TheEngineState = EEngineIdle;
+  TheGsm.engineState = EEngineIdle;
   bool res = gsm_periodic_task();
   ASSERT_TRUE(res);
 }
@@ -729,7 +1561,7 @@ TEST_F(SmsReadHandling, EngineReadSmsDone)
 {
   mvar_nvm_set(0, 0);
   mvar_nvm_set(1, 0);
-  TheEngineState = EEngineReadSmsDone;
+  TheGsm.engineState = EEngineReadSmsDone;
   bool res = gsm_periodic_task();
   ASSERT_TRUE(res);
 }
@@ -738,7 +1570,7 @@ TEST_F(SmsReadHandling, EngineReadSms)
 {
   mvar_nvm_set(0, 0);
   mvar_nvm_set(1, 0);
-  TheEngineState = EEngineReadSms;
+  TheGsm.engineState = EEngineReadSms;
   bool res = gsm_periodic_task();
   ASSERT_TRUE(res);
 }
@@ -747,7 +1579,7 @@ TEST_F(SmsReadHandling, EngineExecSmsDone)
 {
   mvar_nvm_set(0, 0);
   mvar_nvm_set(1, 0);
-  TheEngineState = EEngineExecSmsDone;
+  TheGsm.engineState = EEngineExecSmsDone;
   bool res = gsm_periodic_task();
   ASSERT_TRUE(res);
 }
@@ -756,7 +1588,7 @@ TEST_F(SmsReadHandling, EngineExecSms)
 {
   mvar_nvm_set(0, 0);
   mvar_nvm_set(1, 0);
-  TheEngineState = EEngineExecSms;
+  TheGsm.engineState = EEngineExecSms;
   bool res = gsm_periodic_task();
   ASSERT_TRUE(res);
 }
@@ -765,7 +1597,7 @@ TEST_F(SmsReadHandling, EngineSendSmsDone)
 {
   mvar_nvm_set(0, 0);
   mvar_nvm_set(1, 0);
-  TheEngineState = EEngineSendSmsDone;
+  TheGsm.engineState = EEngineSendSmsDone;
   bool res = gsm_periodic_task();
   ASSERT_TRUE(res);
 }
@@ -774,18 +1606,18 @@ TEST_F(SmsReadHandling, EngineSendSms)
 {
   mvar_nvm_set(0, 0);
   mvar_nvm_set(1, 0);
-  TheEngineState = EEngineSendSms;
+  TheGsm.engineState = EEngineSendSms;
   bool res = gsm_periodic_task();
   ASSERT_TRUE(res);
 }
 
 TEST_F(SmsReadHandling, PrepareReponse)
 {
-  char *str = mvar_str(6, 2, NULL);
+  char *str = mvar_str(MCODE_GSM_VAR_OUTPUT, MCODE_GSM_VAR_OUTPUT_COUNT, NULL);
   strcpy(str, "OK\r\n");
   gsm_prepare_response();
 
-  ASSERT_STREQ(mvar_str(6, 2, NULL), "OK\n");
+  ASSERT_STREQ(mvar_str(MCODE_GSM_VAR_OUTPUT, MCODE_GSM_VAR_OUTPUT_COUNT, NULL), "OK\n");
 }
 
 void hw_gsm_init(void)
@@ -793,6 +1625,10 @@ void hw_gsm_init(void)
   TheHwGsmInitSent = true;
 }
 
+void hw_gsm_deinit(void)
+{
+}
+
 void hw_gsm_power(bool on)
 {
   TheLastPowerRequest = on;
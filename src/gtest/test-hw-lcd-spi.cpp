@@ -0,0 +1,149 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Alexander Chumakov
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "fonts.h"
+#include "hw-lcd.h"
+#include "lcd-mocks.h"
+#include "glyph-cache.h"
+
+#include <vector>
+#include <gtest/gtest.h>
+
+using namespace testing;
+
+class HwLcdSpi : public Test
+{
+protected:
+  void SetUp() override {
+    glyph_cache_reset();
+    MLcdMock::reset(320, 240);
+    // Start from the command mode, as after 'lcd_write_cmd'
+    lcd_write_cmd(0x00);
+    MLcdMock::clear();
+  }
+
+  void TearDown() override {
+    ASSERT_EQ(MLcdMock::unselected(), 0);
+  }
+
+  /** The expected SPI bytes: the command and the words, MSB first */
+  static std::vector<uint8_t> expected(uint8_t cmd, const std::vector<uint16_t> &words) {
+    std::vector<uint8_t> bytes(1, cmd);
+    for (uint16_t word : words) {
+      bytes.push_back(word >> 8);
+      bytes.push_back(word);
+    }
+    return bytes;
+  }
+};
+
+TEST_F(HwLcdSpi, ConstWordsSingleTransaction)
+{
+  lcd_write_const_words(0x2C, 0xABCD, 10000);
+
+  ASSERT_EQ(MLcdMock::stream(), expected(0x2C, std::vector<uint16_t>(10000, 0xABCD)));
+  ASSERT_EQ(MLcdMock::transactions(), 1);
+  ASSERT_EQ(MLcdMock::addressChanges(), 1);
+}
+
+TEST_F(HwLcdSpi, ConstWordsFullScreen)
+{
+  // More than a single chunk between the watchdog notifications
+  lcd_cls(0x1234);
+
+  ASSERT_EQ(MLcdMock::commands(), std::vector<uint8_t>({0x2A, 0x2B, 0x2C}));
+  ASSERT_EQ(MLcdMock::words(), std::vector<uint16_t>(320*240, 0x1234));
+  ASSERT_EQ(MLcdMock::framebuffer(), std::vector<uint16_t>(320*240, 0x1234));
+  // The window setup and the fill, 1 transaction each
+  ASSERT_EQ(MLcdMock::transactions(), 3);
+}
+
+TEST_F(HwLcdSpi, BitmapBytes)
+{
+  const uint8_t bitmap[] = { 0x05, 0x80 };
+  lcd_write_bitmap(0x2C, sizeof (bitmap), bitmap, 0x0000, 0xF81F);
+
+  ASSERT_EQ(MLcdMock::stream(), expected(0x2C, {
+    0xF81F, 0x0000, 0xF81F, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,
+    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0xF81F,
+  }));
+  ASSERT_EQ(MLcdMock::transactions(), 1);
+  ASSERT_EQ(MLcdMock::addressChanges(), 1);
+}
+
+TEST_F(HwLcdSpi, TextRun)
+{
+  const char text[] = "Hi!";
+  std::vector<uint16_t> words;
+  for (int row = 0; row < 8; ++row) {
+    for (int i = 0; i < 3; ++i) {
+      const uint8_t bits = mcode_fonts_get_char_bitmap(text[i])[row];
+      for (int bit = 0; bit < 8; ++bit) {
+        words.push_back(((bits >> bit) & 1) ? 0xFFFF : 0x001F);
+      }
+    }
+  }
+
+  lcd_write_text(0x2C, text, 3, 0x001F, 0xFFFF);
+  ASSERT_EQ(MLcdMock::stream(), expected(0x2C, words));
+  ASSERT_EQ(MLcdMock::transactions(), 1);
+  ASSERT_EQ(MLcdMock::addressChanges(), 1);
+}
+
+TEST_F(HwLcdSpi, TextLongRun)
+{
+  const char text[] = "The quick brown fox jumps over the lazy dog";
+  const size_t length = sizeof (text) - 1;
+  std::vector<uint16_t> words;
+  for (int row = 0; row < 8; ++row) {
+    for (size_t i = 0; i < length; ++i) {
+      const uint8_t bits = mcode_fonts_get_char_bitmap(text[i])[row];
+      for (int bit = 0; bit < 8; ++bit) {
+        words.push_back(((bits >> bit) & 1) ? 0xFFFF : 0x001F);
+      }
+    }
+  }
+
+  // The run is longer than the cache, the glyphs are not evicted row by row
+  glyph_cache_stats()->misses = 0;
+  lcd_write_text(0x2C, text, length, 0x001F, 0xFFFF);
+  ASSERT_EQ(MLcdMock::stream(), expected(0x2C, words));
+  ASSERT_LE(glyph_cache_stats()->misses, length);
+  ASSERT_EQ(MLcdMock::transactions(), 1);
+}
+
+TEST_F(HwLcdSpi, WordsBlock)
+{
+  std::vector<uint16_t> words;
+  for (int i = 0; i < 37; ++i) {
+    words.push_back(0x0101 * i);
+  }
+
+  lcd_write_cmd(0x2C);
+  lcd_write_words(words.data(), words.size());
+  ASSERT_EQ(MLcdMock::stream(), expected(0x2C, words));
+  ASSERT_EQ(MLcdMock::transactions(), 2);
+  ASSERT_EQ(MLcdMock::addressChanges(), 1);
+}
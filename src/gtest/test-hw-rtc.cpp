@@ -0,0 +1,139 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Alexander Chumakov
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "hw-rtc.h"
+
+#include <time.h>
+#include <gtest/gtest.h>
+
+using namespace testing;
+
+namespace {
+/** 1-Jan-2001, 0:00:00 in UNIX time */
+const time_t KInitialTime = 978307200;
+const uint32_t KSecondsInDay = 86400;
+}
+
+TEST(HwRtc, KnownDates)
+{
+  MDate date;
+  MTime time;
+
+  rtc_get_date(0, &date);
+  ASSERT_EQ(date.year, 2001);
+  ASSERT_EQ(date.month, 1);
+  ASSERT_EQ(date.day, 1);
+  ASSERT_EQ(date.dayOfWeek, 1);
+  ASSERT_EQ(date.dayOfYear, 1);
+
+  // 19-Sep-2017, 23:41:59, Tuesday
+  rtc_get_date(527557319, &date);
+  rtc_get_time(527557319, &time);
+  ASSERT_EQ(date.year, 2017);
+  ASSERT_EQ(date.month, 9);
+  ASSERT_EQ(date.day, 19);
+  ASSERT_EQ(date.dayOfWeek, 2);
+  ASSERT_EQ(date.dayOfYear, 262);
+  ASSERT_EQ(rtc_to_mtime(&date, &time), 527557319u);
+
+  // 29-Feb and 31-Dec of a leap year
+  rtc_get_date(rtc_days_from_civil(2024, 2, 29) * KSecondsInDay, &date);
+  ASSERT_EQ(date.month, 2);
+  ASSERT_EQ(date.day, 29);
+  ASSERT_EQ(date.dayOfYear, 60);
+  rtc_get_date(rtc_days_from_civil(2024, 12, 31) * KSecondsInDay + KSecondsInDay - 1, &date);
+  ASSERT_EQ(date.year, 2024);
+  ASSERT_EQ(date.dayOfYear, 366);
+}
+
+TEST(HwRtc, EveryDayMatchesLibc)
+{
+  // Each day from 1-Jan-2001 to 31-Dec-2199, 2100 is not a leap year
+  const uint32_t end = rtc_days_from_civil(2200, 1, 1);
+  uint32_t days;
+  ASSERT_EQ(end, 72683u);
+
+  for (days = 0; days < end; ++days) {
+    struct tm tm;
+    MDate date;
+    const time_t expected = KInitialTime + (time_t)days * KSecondsInDay;
+    ASSERT_NE(gmtime_r(&expected, &tm), nullptr);
+
+    rtc_civil_from_days(days, &date);
+    ASSERT_EQ(date.year, tm.tm_year + 1900) << "Day: " << days;
+    ASSERT_EQ(date.month, tm.tm_mon + 1) << "Day: " << days;
+    ASSERT_EQ(date.day, tm.tm_mday) << "Day: " << days;
+    ASSERT_EQ(date.dayOfWeek, tm.tm_wday ? tm.tm_wday : 7) << "Day: " << days;
+    ASSERT_EQ(date.dayOfYear, tm.tm_yday + 1) << "Day: " << days;
+    ASSERT_EQ(rtc_day_of_year(date.year, date.month, date.day), tm.tm_yday + 1) << "Day: " << days;
+
+    struct tm civil = {};
+    civil.tm_year = date.year - 1900;
+    civil.tm_mon = date.month - 1;
+    civil.tm_mday = date.day;
+    ASSERT_EQ(timegm(&civil), expected) << "Day: " << days;
+    ASSERT_EQ(rtc_days_from_civil(date.year, date.month, date.day), days) << "Day: " << days;
+  }
+}
+
+TEST(HwRtc, SecondsRoundTrip)
+{
+  // The whole 32-bit range up to 2136, the day cache is hit and missed in turns
+  uint64_t mtime;
+  for (mtime = 0; mtime < 0xffffffffull; mtime += 21601) {
+    struct tm tm;
+    MDate date;
+    MTime time;
+    const time_t expected = KInitialTime + (time_t)mtime;
+    ASSERT_NE(gmtime_r(&expected, &tm), nullptr);
+    if (tm.tm_year + 1900 > 2136) {
+      break;
+    }
+
+    rtc_get_date((uint32_t)mtime, &date);
+    rtc_get_time((uint32_t)mtime, &time);
+    ASSERT_EQ(date.year, tm.tm_year + 1900) << "Time: " << mtime;
+    ASSERT_EQ(date.month, tm.tm_mon + 1) << "Time: " << mtime;
+    ASSERT_EQ(date.day, tm.tm_mday) << "Time: " << mtime;
+    ASSERT_EQ(time.hours, tm.tm_hour) << "Time: " << mtime;
+    ASSERT_EQ(rtc_to_mtime(&date, &time), mtime) << "Time: " << mtime;
+  }
+  ASSERT_GT(mtime, 0xf0000000ull);
+}
+
+TEST(HwRtc, OutOfRangeNegative)
+{
+  MTime time = {};
+  MDate date = {};
+
+  date.year = 2000;
+  date.month = 12;
+  date.day = 31;
+  ASSERT_EQ(rtc_to_mtime(&date, &time), 0u);
+  date.year = 2137;
+  date.month = 1;
+  date.day = 1;
+  ASSERT_EQ(rtc_to_mtime(&date, &time), 0u);
+}
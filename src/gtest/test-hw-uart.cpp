@@ -24,7 +24,11 @@
 
 #include "hw-uart.h"
 
+#include <deque>
+#include <random>
+#include <string>
 #include <string.h>
+#include <functional>
 #include <gtest/gtest.h>
 
 using namespace testing;
@@ -250,3 +254,226 @@ TEST_F(HwUart2, uart2_receiver)
   ASSERT_EQ(_buffer_length, 3);
   ASSERT_STREQ(_buffer, ">OK");
 }
+
+class HwUart2Lines : public Test
+{
+protected:
+  struct Line {
+    std::string text;
+    uint8_t flags;
+  };
+
+  void SetUp() override {
+    _lines.clear();
+    _hook = nullptr;
+    hw_uart_init();
+    hw_uart2_set_callback(uart_handler);
+  }
+  void TearDown() override {
+    // Leave the reader empty for the next test
+    drain();
+    hw_uart_deinit();
+  }
+
+  static void uart_handler(const char *data, size_t length) {
+    // The slice is NUL-terminated in place
+    EXPECT_EQ(data[length], 0);
+    _lines.push_back({std::string(data, length), uart2_line_flags()});
+    if (_hook) {
+      _hook(data, length);
+    }
+  }
+
+  /** Simulate the ISR receiving the line */
+  static void receive(const std::string &line) {
+    for (const char ch : line) {
+      uart2_handle_new_sample(ch);
+    }
+    uart2_handle_new_sample('\r');
+    uart2_handle_new_sample('\n');
+  }
+
+  static void drain() {
+    size_t i;
+    for (i = 0; i < 8; ++i) {
+      uart2_report_new_sample();
+    }
+  }
+
+  static std::deque<Line> _lines;
+  static std::function<void(const char *, size_t)> _hook;
+};
+std::deque<HwUart2Lines::Line> HwUart2Lines::_lines;
+std::function<void(const char *, size_t)> HwUart2Lines::_hook;
+
+TEST_F(HwUart2Lines, SliceSurvivesIsrData)
+{
+  receive("+CMGL: 1,\"REC UNREAD\"");
+  receive("first");
+
+  // The ISR keeps receiving while the main loop handles the line, the line is not changed
+  _hook = [](const char *data, size_t length) {
+    const std::string before(data, length);
+    _hook = nullptr;
+    receive(std::string(300, 'x'));
+    uart2_handle_new_sample('>');
+    uart2_handle_new_sample(' ');
+    ASSERT_EQ(std::string(data, length), before);
+    ASSERT_EQ(data[length], 0);
+  };
+  uart2_report_new_sample();
+  ASSERT_EQ(_lines.size(), 1);
+  ASSERT_EQ(_lines[0].text, "+CMGL: 1,\"REC UNREAD\"");
+  ASSERT_EQ(_lines[0].flags, 0);
+
+  drain();
+  ASSERT_EQ(_lines.size(), 4);
+  ASSERT_EQ(_lines[1].text, "first");
+  ASSERT_EQ(_lines[2].text, std::string(300, 'x'));
+  ASSERT_EQ(_lines[3].text, "> ");
+}
+
+TEST_F(HwUart2Lines, WrapAround)
+{
+  size_t i;
+  std::string line;
+
+  // The lines cross the ring end many times, each one is reported in a single piece
+  for (i = 0; i < 64; ++i) {
+    line = std::string(100 + i * 5, (char)('a' + i % 26));
+    receive(line);
+    uart2_report_new_sample();
+    ASSERT_EQ(_lines.size(), 1);
+    ASSERT_EQ(_lines[0].text, line);
+    ASSERT_EQ(_lines[0].flags, 0);
+    _lines.clear();
+  }
+}
+
+TEST_F(HwUart2Lines, TruncatedLine)
+{
+  const std::string line(600, 'L');
+
+  receive(line);
+  receive("OK");
+  drain();
+  ASSERT_EQ(_lines.size(), 2);
+  ASSERT_EQ(_lines[0].text, line.substr(0, 511));
+  ASSERT_EQ(_lines[0].flags, MUartLineTruncated);
+  ASSERT_EQ(_lines[1].text, "OK");
+  ASSERT_EQ(_lines[1].flags, 0);
+}
+
+TEST_F(HwUart2Lines, OverrunNegative)
+{
+  // No free descriptors, the 5th line is dropped, the next line reports it
+  receive("1");
+  receive("2");
+  receive("3");
+  receive("4");
+  receive("5");
+  uart2_report_new_sample();
+  receive("6");
+  drain();
+  ASSERT_EQ(_lines.size(), 5);
+  ASSERT_EQ(_lines[3].text, "4");
+  ASSERT_EQ(_lines[3].flags, 0);
+  ASSERT_EQ(_lines[4].text, "6");
+  ASSERT_EQ(_lines[4].flags, MUartLineOverrun);
+  _lines.clear();
+
+  // No room in the ring, the 3rd line loses its end
+  receive(std::string(400, 'a'));
+  receive(std::string(400, 'b'));
+  receive(std::string(400, 'c'));
+  uart2_report_new_sample();
+  receive("OK");
+  drain();
+  ASSERT_EQ(_lines.size(), 4);
+  ASSERT_EQ(_lines[0].flags, 0);
+  ASSERT_EQ(_lines[1].flags, 0);
+  ASSERT_EQ(_lines[2].flags, MUartLineOverrun | MUartLineTruncated);
+  ASSERT_LT(_lines[2].text.size(), 400);
+  ASSERT_EQ(_lines[2].text, std::string(_lines[2].text.size(), 'c'));
+  ASSERT_EQ(_lines[3].text, "OK");
+  ASSERT_EQ(_lines[3].flags, 0);
+}
+
+TEST_F(HwUart2Lines, RandomInterleaving)
+{
+  size_t i;
+  size_t sent = 0;
+  std::mt19937 random(2020);
+  std::deque<std::string> expected;
+  std::string stream;
+  size_t position = 0;
+
+  // The stream of the random lines, some of them are too long
+  for (i = 0; i < 500; ++i) {
+    std::string line(random() % 40 ? random() % 120 : random() % 700, 0);
+    for (char &ch : line) {
+      ch = (char)('0' + random() % 64);
+    }
+    if (line.size() && '>' == line[0]) {
+      line[0] = '<';
+    }
+    expected.push_back(line);
+    stream += line + "\r\n";
+  }
+
+  // The ISR delivers the random bursts, both between and during the reports
+  auto isr = [&]() {
+    const size_t burst = random() % 150;
+    for (i = 0; i < burst && position < stream.size(); ++i) {
+      uart2_handle_new_sample(stream[position++]);
+    }
+  };
+  _hook = [&](const char *, size_t) {
+    if (random() % 2) {
+      isr();
+    }
+  };
+  while (position < stream.size()) {
+    isr();
+    uart2_report_new_sample();
+    if (!(random() % 3)) {
+      uart2_report_new_sample();
+    }
+  }
+  _hook = nullptr;
+  // The last line reports the loss of the lines before it, if any
+  drain();
+  receive("END");
+  expected.push_back("END");
+  drain();
+
+  // Every line is received intact, or its loss is reported
+  size_t lost = 0;
+  auto matches = [](const Line &line, const std::string &text) {
+    return (line.flags & MUartLineTruncated) ?
+      (line.text.size() < text.size() && !text.compare(0, line.text.size(), line.text)) :
+      line.text == text;
+  };
+  for (const Line &line : _lines) {
+    if (line.flags & MUartLineOverrun) {
+      // Some lines before this one might be lost
+      while (!expected.empty() && !matches(line, expected.front())) {
+        expected.pop_front();
+        ++lost;
+      }
+    }
+    ASSERT_FALSE(expected.empty());
+    if (line.flags & MUartLineTruncated) {
+      ASSERT_LT(line.text.size(), expected.front().size());
+      ASSERT_EQ(expected.front().compare(0, line.text.size(), line.text), 0);
+    } else {
+      ASSERT_EQ(line.text, expected.front());
+    }
+    expected.pop_front();
+    ++sent;
+  }
+  ASSERT_TRUE(expected.empty());
+  ASSERT_EQ(sent + lost, 501);
+  ASSERT_GT(sent, lost);
+  ASSERT_GT(lost, 0);
+}
@@ -0,0 +1,231 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Alexander Chumakov
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "hw-usart-tx.h"
+
+#include <random>
+#include <string>
+#include <string.h>
+#include <gtest/gtest.h>
+
+using namespace testing;
+
+/**
+ * The mocked USART transmitter: the data register takes a byte after a few polls,
+ * the DMA transfer completes after a few polls
+ */
+class MockUsart
+{
+public:
+  explicit MockUsart(bool dma) {
+    regs.tx_ready = tx_ready;
+    regs.tx_write = tx_write;
+    regs.tx_irq = tx_irq;
+    regs.dma_start = dma ? dma_start : NULL;
+    regs.dma_done = dma ? dma_done : NULL;
+    regs.ctx = this;
+  }
+
+  /** Let the hardware run for \c steps polls, the pending interrupts are handled */
+  void run(MUsartTx *tx, size_t steps) {
+    while (steps--) {
+      tick();
+      if (irq && (regs.dma_start ? dmaComplete : !busy)) {
+        inIsr = true;
+        usart_tx_isr(tx);
+        inIsr = false;
+      }
+    }
+  }
+
+  /** Run till all the queued data is sent and the last byte is shifted out */
+  void drain(MUsartTx *tx) {
+    size_t steps = 0;
+    while (mring_count(&tx->ring) && steps++ < 100000) {
+      run(tx, 1);
+    }
+    run(tx, delay + 1);
+  }
+
+  /** Let the hardware move on */
+  void tick() {
+    if (busy) {
+      --busy;
+    }
+    if (dmaData && !busy) {
+      sent.append(dmaData, dmaLength);
+      dmaData = NULL;
+      dmaComplete = true;
+    }
+  }
+
+  MUsartRegs regs;
+  std::string sent;
+  bool irq = false;
+  bool inIsr = false;
+  size_t busy = 0;
+  size_t delay = 3;
+  size_t transfers = 0;
+  size_t violations = 0;
+  const char *dmaData = NULL;
+  size_t dmaLength = 0;
+  bool dmaComplete = false;
+
+private:
+  static MockUsart *self(void *ctx) {
+    return static_cast<MockUsart *>(ctx);
+  }
+  static bool tx_ready(void *ctx) {
+    MockUsart *const usart = self(ctx);
+    usart->tick();
+    return !usart->busy;
+  }
+  static void tx_write(void *ctx, uint8_t data) {
+    MockUsart *const usart = self(ctx);
+    // The thread context may send the data only with the interrupt disabled
+    usart->violations += (usart->busy || (!usart->inIsr && usart->irq));
+    usart->sent.push_back((char)data);
+    usart->busy = usart->delay;
+  }
+  static void tx_irq(void *ctx, bool enable) {
+    self(ctx)->irq = enable;
+  }
+  static void dma_start(void *ctx, const char *data, size_t length) {
+    MockUsart *const usart = self(ctx);
+    usart->violations += (usart->dmaData || (!usart->inIsr && usart->irq) || !length);
+    usart->dmaData = data;
+    usart->dmaLength = length;
+    usart->busy = usart->delay;
+    ++usart->transfers;
+  }
+  static bool dma_done(void *ctx) {
+    MockUsart *const usart = self(ctx);
+    usart->tick();
+    const bool done = usart->dmaComplete;
+    usart->dmaComplete = false;
+    return done;
+  }
+};
+
+class UsartTx : public TestWithParam<bool>
+{
+protected:
+  UsartTx() : _usart(GetParam()) {
+  }
+  void SetUp() override {
+    ASSERT_TRUE(usart_tx_init(&_tx, &_usart.regs, _buffer, sizeof (_buffer)));
+  }
+  void TearDown() override {
+    ASSERT_EQ(_usart.violations, 0);
+  }
+
+  MockUsart _usart;
+  MUsartTx _tx;
+  char _buffer[16];
+};
+
+TEST_P(UsartTx, WriteReturnsImmediately)
+{
+  usart_tx_write(&_tx, "AT+CMGF=0\r", 10);
+  usart_tx_write_char(&_tx, '\n');
+
+  // Nothing is waited for, the interrupt sends the data
+  ASSERT_EQ(_tx.stalls, 0);
+  ASSERT_TRUE(_usart.irq);
+  ASSERT_LE(_usart.sent.size(), 1);
+  _usart.drain(&_tx);
+  ASSERT_EQ(_usart.sent, "AT+CMGF=0\r\n");
+  ASSERT_EQ(mring_count(&_tx.ring), 0);
+  if (!GetParam()) {
+    // No more TXE interrupts with the empty ring
+    ASSERT_FALSE(_usart.irq);
+  }
+}
+
+TEST_P(UsartTx, FullRingFallsBackToPolling)
+{
+  std::string data;
+  size_t i;
+
+  for (i = 0; i < 100; ++i) {
+    data.push_back((char)('A' + i % 26));
+  }
+
+  // No interrupts are handled, the writer drains the ring itself
+  usart_tx_write(&_tx, data.data(), data.size());
+  ASSERT_GT(_tx.stalls, 0);
+  ASSERT_TRUE(_usart.irq);
+  ASSERT_LE(mring_count(&_tx.ring), sizeof (_buffer));
+
+  usart_tx_flush(&_tx);
+  _usart.drain(&_tx);
+  ASSERT_EQ(_usart.sent, data);
+}
+
+TEST_P(UsartTx, Flush)
+{
+  usart_tx_write(&_tx, "0123456789", 10);
+  usart_tx_flush(&_tx);
+  ASSERT_EQ(mring_count(&_tx.ring), 0);
+  ASSERT_EQ(_tx.dmaLength, 0);
+  ASSERT_EQ(_usart.sent, "0123456789");
+}
+
+TEST_P(UsartTx, RandomInterleaving)
+{
+  size_t i;
+  size_t length;
+  std::string expected;
+  std::mt19937 random(2020);
+  char data[40];
+
+  // The writes interleave with the interrupts at random points
+  for (i = 0; i < 2000; ++i) {
+    length = random() % sizeof (data);
+    for (size_t j = 0; j < length; ++j) {
+      data[j] = (char)(' ' + (expected.size() + j) % 95);
+    }
+    _usart.delay = random() % 4;
+    usart_tx_write(&_tx, data, length);
+    expected.append(data, length);
+    _usart.run(&_tx, random() % 8);
+  }
+  _usart.drain(&_tx);
+  usart_tx_flush(&_tx);
+
+  ASSERT_EQ(_usart.sent, expected);
+  ASSERT_GT(_tx.stalls, 0);
+  if (GetParam()) {
+    // The wrapped data is sent in 2 transfers
+    ASSERT_GT(_usart.transfers, 1);
+  }
+}
+
+// The interrupt-driven and the DMA transmitters
+INSTANTIATE_TEST_CASE_P(
+  Modes,
+  UsartTx,
+  Values(false, true)
+);
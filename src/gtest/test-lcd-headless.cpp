@@ -0,0 +1,188 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Alexander Chumakov
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "fonts.h"
+#include "wrap-mocks.h"
+#include "emu/lcd-s95513.h"
+#include "emu/lcd-headless.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <gtest/gtest.h>
+
+using namespace testing;
+
+namespace {
+const uint16_t KWidth = 60;
+const uint16_t KHeight = 40;
+/** The CRC-32 of the test picture, not scrolled, same as zlib crc32 of the snapshot */
+const uint32_t KGoldenCrc = 0x3E0D8C9E;
+}
+
+class LcdHeadless : public Test
+{
+protected:
+  void SetUp() override {
+    s95513_reset();
+    ASSERT_TRUE(lcd_headless_init(KWidth, KHeight));
+  }
+
+  void TearDown() override {
+    lcd_headless_deinit();
+    s95513_reset();
+  }
+
+  static void address(uint8_t cmd, uint16_t start, uint16_t end) {
+    s95513_cmd(cmd);
+    s95513_data_byte(start >> 8);
+    s95513_data_byte(start);
+    s95513_data_byte(end >> 8);
+    s95513_data_byte(end);
+  }
+
+  static void scroll(uint16_t position) {
+    s95513_cmd(0x37);
+    s95513_data_byte(position >> 8);
+    s95513_data_byte(position);
+  }
+
+  /** The test picture: a blue background and a line of text */
+  static void draw() {
+    const char text[] = "mcode";
+    address(0x2A, 0, KWidth - 1);
+    address(0x2B, 0, KHeight - 1);
+    s95513_cmd(0x2C);
+    s95513_data_const(0x001F, KWidth*KHeight);
+
+    address(0x2A, 4, 4 + 8*5 - 1);
+    address(0x2B, 16, 23);
+    s95513_cmd(0x2C);
+    for (int row = 0; row < 8; ++row) {
+      for (int i = 0; i < 5; ++i) {
+        s95513_data_bitmap(mcode_fonts_get_char_bitmap(text[i]) + row, 8, 0x001F, 0xFFE0);
+      }
+    }
+  }
+
+  static const uint32_t *row(uint16_t index) {
+    const MLcdHeadlessHeader *const header = lcd_headless_header();
+    return reinterpret_cast<const uint32_t *>(header + 1) + index*header->stride;
+  }
+};
+
+TEST_F(LcdHeadless, Header)
+{
+  const MLcdHeadlessHeader *const header = lcd_headless_header();
+  ASSERT_NE(header, nullptr);
+  ASSERT_EQ(header->magic, LCD_HEADLESS_MAGIC);
+  ASSERT_EQ(header->width, KWidth);
+  ASSERT_EQ(header->height, KHeight);
+  ASSERT_EQ(header->stride, 64);
+  ASSERT_FALSE(header->on);
+  ASSERT_EQ(row(KHeight - 1)[KWidth - 1], 0xFF000000u);
+
+  const uint32_t sequence = header->sequence;
+  draw();
+  ASSERT_GT(header->sequence, sequence);
+  ASSERT_EQ(row(0)[0], 0xFF0000F8u);
+  ASSERT_EQ(lcd_headless_take_pixels(), KWidth*KHeight + 8*5*8);
+  ASSERT_EQ(lcd_headless_take_pixels(), 0);
+
+  lcd_headless_turn(true);
+  ASSERT_TRUE(header->on);
+}
+
+TEST_F(LcdHeadless, GoldenFrame)
+{
+  draw();
+  ASSERT_EQ(s95513_frame_crc(), KGoldenCrc);
+
+  // The scroll position row is shown on top, a full turn shows the same frame
+  scroll(8);
+  ASSERT_EQ(lcd_headless_header()->scroll, 8);
+  ASSERT_NE(s95513_frame_crc(), KGoldenCrc);
+  scroll(KHeight);
+  ASSERT_EQ(lcd_headless_header()->scroll, 0);
+  ASSERT_EQ(s95513_frame_crc(), KGoldenCrc);
+
+  // Same frame again, drawn on a reset LCD
+  lcd_headless_reset();
+  ASSERT_NE(s95513_frame_crc(), KGoldenCrc);
+  draw();
+  ASSERT_EQ(s95513_frame_crc(), KGoldenCrc);
+}
+
+TEST_F(LcdHeadless, Snapshot)
+{
+  char path[] = "/tmp/mcode-snapshot-XXXXXX";
+  const int fd = mkstemp(path);
+  ASSERT_GE(fd, 0);
+  close(fd);
+
+  draw();
+  scroll(30);
+  ASSERT_TRUE(s95513_snapshot(path));
+
+  std::vector<uint32_t> pixels(KWidth*KHeight + 1);
+  FILE *const file = fopen(path, "rb");
+  ASSERT_NE(file, nullptr);
+  ASSERT_EQ(fread(pixels.data(), sizeof (uint32_t), pixels.size(), file), KWidth*KHeight);
+  fclose(file);
+  unlink(path);
+
+  // The rows in the shown order
+  for (uint16_t y = 0; y < KHeight; ++y) {
+    ASSERT_EQ(memcmp(pixels.data() + y*KWidth, row((y + 30) % KHeight), KWidth*sizeof (uint32_t)), 0)
+      << "row: " << y;
+  }
+  ASSERT_FALSE(s95513_snapshot("/nonexistent/snapshot"));
+}
+
+TEST_F(LcdHeadless, SharedMemory)
+{
+  const std::string name = lcd_headless_name();
+  const size_t size = sizeof (MLcdHeadlessHeader) + 64*KHeight*sizeof (uint32_t);
+
+  // Another process would see the same LCD RAM
+  const int fd = shm_open(name.c_str(), O_RDONLY, 0);
+  ASSERT_GE(fd, 0);
+  void *const memory = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  ASSERT_NE(memory, MAP_FAILED);
+
+  draw();
+  const MLcdHeadlessHeader *const header = static_cast<const MLcdHeadlessHeader *>(memory);
+  ASSERT_EQ(header->magic, LCD_HEADLESS_MAGIC);
+  ASSERT_EQ(header->sequence, lcd_headless_header()->sequence);
+  ASSERT_EQ(memcmp(header + 1, row(0), 64*KHeight*sizeof (uint32_t)), 0);
+  munmap(memory, size);
+
+  // The segment is removed on exit
+  lcd_headless_deinit();
+  ASSERT_LT(shm_open(name.c_str(), O_RDONLY, 0), 0);
+  ASSERT_EQ(errno, ENOENT);
+}
@@ -0,0 +1,282 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Alexander Chumakov
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "wrap-mocks.h"
+#include "emu/lcd-s95513.h"
+
+#include <random>
+#include <vector>
+#include <functional>
+#include <gtest/gtest.h>
+
+using namespace testing;
+
+namespace {
+/** The LCD RAM, narrower than the rows to test the stride and the clipping */
+const uint16_t KWidth = 96;
+const uint16_t KHeight = 64;
+const uint32_t KStride = 100;
+
+uint32_t TheChanged = 0;
+uint16_t TheScroll = 0;
+uint16_t TheTop = 0;
+uint16_t TheLeft = 0;
+uint16_t TheRight = 0;
+uint16_t TheBottom = 0;
+std::vector<uint32_t> TheFramebuffer;
+
+void changed(uint16_t x, uint16_t y, uint16_t width, uint16_t height, uint32_t count)
+{
+  TheChanged += count;
+  TheTop = std::min(TheTop, y);
+  TheLeft = std::min(TheLeft, x);
+  TheRight = std::max<uint16_t>(TheRight, x + width);
+  TheBottom = std::max<uint16_t>(TheBottom, y + height);
+}
+
+void scroll(uint16_t position)
+{
+  TheScroll = position;
+}
+
+/** Drops the diagnostic messages for the out-of-range pixels */
+class TSilentUart : public MHwInterface
+{
+public:
+  void uart_write_char(char ch) override {}
+  void uart2_write_char(char ch) override {}
+};
+}
+
+class S95513 : public Test
+{
+protected:
+  /** The LCD RAM state after a command stream */
+  struct TResult {
+    uint64_t hash;
+    uint32_t changed;
+    uint16_t scroll;
+    uint32_t data;
+    uint32_t fast;
+    uint16_t dirty[4];
+  };
+
+  void SetUp() override {
+    MS95513Surface surface;
+
+    surface.pixels = nullptr;
+    surface.stride = KStride;
+    surface.width = KWidth;
+    surface.height = KHeight;
+    surface.changed = changed;
+    surface.scroll = scroll;
+    TheFramebuffer.assign(KStride*KHeight, 0);
+    surface.pixels = TheFramebuffer.data();
+    s95513_set_surface(&surface);
+  }
+
+  void TearDown() override {
+    s95513_set_fast(true);
+    s95513_reset();
+  }
+
+  /** Run the stream from the reset state on the cleared LCD RAM */
+  static TResult run(const std::function<void ()> &stream, bool fast) {
+    TResult result;
+
+    s95513_reset();
+    s95513_set_fast(fast);
+    memset(s95513_stats(), 0, sizeof (MS95513Stats));
+    std::fill(TheFramebuffer.begin(), TheFramebuffer.end(), 0);
+    TheChanged = 0;
+    TheScroll = 0;
+    TheTop = TheLeft = UINT16_MAX;
+    TheRight = TheBottom = 0;
+
+    stream();
+
+    // FNV-1a over the pixels
+    result.hash = UINT64_C(14695981039346656037);
+    for (uint32_t pixel : TheFramebuffer) {
+      result.hash = (result.hash ^ pixel) * UINT64_C(1099511628211);
+    }
+    result.changed = TheChanged;
+    result.scroll = TheScroll;
+    result.data = s95513_stats()->data;
+    result.fast = s95513_stats()->fast;
+    result.dirty[0] = TheLeft;
+    result.dirty[1] = TheTop;
+    result.dirty[2] = TheRight;
+    result.dirty[3] = TheBottom;
+    return result;
+  }
+
+  static void address(uint8_t cmd, uint16_t start, uint16_t end) {
+    s95513_cmd(cmd);
+    s95513_data_byte(start >> 8);
+    s95513_data_byte(start);
+    s95513_data_byte(end >> 8);
+    s95513_data_byte(end);
+  }
+
+  static uint32_t pixel(uint16_t x, uint16_t y) {
+    return TheFramebuffer[y*KStride + x];
+  }
+
+  TSilentUart _uart;
+};
+
+TEST_F(S95513, ConstFill)
+{
+  const TResult result = run([]() {
+    address(0x2A, 10, 12);
+    address(0x2B, 20, 21);
+    s95513_cmd(0x2C);
+    s95513_data_const(0xF800, 6);
+    // The window is full, the rest is dropped
+    s95513_data_const(0x07E0, 10);
+  }, true);
+
+  // The address bytes and all the words are counted
+  ASSERT_EQ(result.data, 8 + 16);
+  ASSERT_EQ(result.fast, 6);
+  ASSERT_EQ(result.changed, 6);
+  ASSERT_EQ(pixel(10, 20), 0xFFF80000u);
+  ASSERT_EQ(pixel(12, 21), 0xFFF80000u);
+  ASSERT_EQ(pixel(13, 21), 0u);
+  ASSERT_EQ(pixel(10, 22), 0u);
+  ASSERT_EQ(std::vector<uint16_t>(result.dirty, result.dirty + 4),
+            std::vector<uint16_t>({10, 20, 13, 22}));
+}
+
+TEST_F(S95513, BitmapRowsContinue)
+{
+  // 12 pixels wide window, the bytes of the bitmap span the rows
+  const uint8_t bitmap[] = { 0x81, 0xFF, 0x00 };
+  const TResult result = run([&bitmap]() {
+    address(0x2A, 0, 11);
+    address(0x2B, 0, 1);
+    s95513_cmd(0x2C);
+    s95513_data_bitmap(bitmap, 20, 0x0000, 0xFFFF);
+  }, true);
+
+  ASSERT_EQ(result.changed, 20);
+  ASSERT_EQ(pixel(0, 0), 0xFFF8FCF8u);
+  ASSERT_EQ(pixel(1, 0), 0xFF000000u);
+  ASSERT_EQ(pixel(7, 0), 0xFFF8FCF8u);
+  ASSERT_EQ(pixel(8, 0), 0xFFF8FCF8u);
+  ASSERT_EQ(pixel(11, 0), 0xFFF8FCF8u);
+  ASSERT_EQ(pixel(0, 1), 0xFFF8FCF8u);
+  ASSERT_EQ(pixel(3, 1), 0xFFF8FCF8u);
+  ASSERT_EQ(pixel(4, 1), 0xFF000000u);
+  ASSERT_EQ(pixel(8, 1), 0u);
+}
+
+TEST_F(S95513, FastMatchesSlowRandomized)
+{
+  uint32_t fastWords = 0;
+  std::mt19937 random(20201024);
+
+  for (int iteration = 0; iteration < 64; ++iteration) {
+    // A random command stream, the addresses are partly out of the LCD RAM
+    std::vector<std::function<void ()> > steps;
+    const int count = 1 + random() % 24;
+    for (int i = 0; i < count; ++i) {
+      const uint16_t start = random() % 128;
+      // Mostly the windows growing to the right and down, sometimes the reversed ones
+      const uint16_t end = (random() % 8) ? (start + random() % 64) :
+        ((random() % 4) ? (random() % 128) : UINT16_MAX);
+      const uint32_t length = random() % 3000;
+      const uint16_t word = random();
+      std::vector<uint16_t> words(length);
+      std::vector<uint8_t> bits(length/8 + 1);
+      for (uint16_t &value : words) {
+        value = random();
+      }
+      for (uint8_t &value : bits) {
+        value = random();
+      }
+
+      switch (random() % 8) {
+      case 0:
+        steps.push_back([=]() { address(0x2A, start, end); });
+        break;
+      case 1:
+        steps.push_back([=]() { address(0x2B, start, end); });
+        break;
+      case 2:
+        steps.push_back([=]() {
+          s95513_cmd(0x37);
+          s95513_data_byte(start >> 8);
+          s95513_data_byte(start);
+        });
+        break;
+      case 3:
+        steps.push_back([=]() { s95513_cmd(0x2C); });
+        break;
+      case 4:
+        steps.push_back([=]() { s95513_data_const(word, length); });
+        break;
+      case 5:
+        steps.push_back([=]() {
+          s95513_cmd(0x2C);
+          s95513_data_words(words.data(), length);
+        });
+        break;
+      case 6:
+        steps.push_back([=]() {
+          s95513_cmd(0x2C);
+          s95513_data_bitmap(bits.data(), length, word, ~word);
+        });
+        break;
+      default:
+        // The data is buffered, never gets to the LCD RAM
+        steps.push_back([=]() {
+          s95513_cmd(0x3C);
+          s95513_data_const(word, length % 32);
+        });
+        break;
+      }
+    }
+    const auto stream = [&steps]() {
+      for (const auto &step : steps) {
+        step();
+      }
+    };
+
+    const TResult slow = run(stream, false);
+    const TResult fast = run(stream, true);
+    ASSERT_EQ(slow.fast, 0);
+    fastWords += fast.fast;
+    ASSERT_EQ(fast.hash, slow.hash) << "iteration: " << iteration;
+    ASSERT_EQ(fast.changed, slow.changed) << "iteration: " << iteration;
+    ASSERT_EQ(fast.scroll, slow.scroll) << "iteration: " << iteration;
+    ASSERT_EQ(fast.data, slow.data) << "iteration: " << iteration;
+    ASSERT_EQ(std::vector<uint16_t>(fast.dirty, fast.dirty + 4),
+              std::vector<uint16_t>(slow.dirty, slow.dirty + 4)) << "iteration: " << iteration;
+  }
+  // The streams do reach the fast path
+  ASSERT_GT(fastWords, 50000);
+}
@@ -0,0 +1,147 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Alexander Chumakov
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "mstatus.h"
+#include "wrap-mocks.h"
+#include "cmd-engine.h"
+#include "line-editor-uart.h"
+
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+
+using namespace testing;
+
+class LineEditor : public Test
+{
+protected:
+  void SetUp() override {
+    _lines.clear();
+    line_editor_uart_init();
+    line_editor_reset();
+    line_editor_uart_set_callback(on_line);
+    collected_text_reset();
+  }
+  void TearDown() override {
+    line_editor_set_paste(false);
+    line_editor_reset();
+    line_editor_uart_set_callback(NULL);
+    collected_text_reset();
+  }
+
+  /** Similar to the command engine, the prompt is requested after each line */
+  static void on_line(const char *line) {
+    _lines.push_back(line);
+    line_editor_uart_start();
+  }
+
+  static void input(const std::string &data) {
+    uart_input(data.data(), data.size());
+  }
+
+  static std::vector<std::string> _lines;
+};
+std::vector<std::string> LineEditor::_lines;
+
+TEST_F(LineEditor, TypedLine)
+{
+  // The cursor keys are ignored
+  input("ab\033[Dc\r");
+  ASSERT_EQ(_lines.size(), 1);
+  ASSERT_EQ(_lines[0], "abc");
+  ASSERT_STREQ(collected_text(), "abc\r\n# ");
+}
+
+TEST_F(LineEditor, BracketedPaste)
+{
+  input("\033[200~echo 1\r\nline 2\nthird");
+  // Nothing is echoed or executed till the paste is complete
+  ASSERT_TRUE(line_editor_paste());
+  ASSERT_TRUE(_lines.empty());
+  ASSERT_EQ(collected_text_length(), 0);
+
+  input("\033[201~");
+  ASSERT_FALSE(line_editor_paste());
+  ASSERT_EQ(_lines, std::vector<std::string>({"echo 1", "line 2", "third"}));
+  // One echo per line, a single prompt at the end
+  ASSERT_STREQ(collected_text(), "echo 1\r\nline 2\r\nthird\r\n# ");
+}
+
+TEST_F(LineEditor, ExplicitPaste)
+{
+  line_editor_set_echo(false);
+  line_editor_set_paste(true);
+  input("1\r\n\r\n2\r\n\004");
+  line_editor_set_echo(true);
+  ASSERT_FALSE(line_editor_paste());
+  ASSERT_EQ(_lines, std::vector<std::string>({"1", "", "2"}));
+  ASSERT_STREQ(collected_text(), "# ");
+}
+
+TEST_F(LineEditor, PasteCommand)
+{
+  // The mode is entered by the typed command, it is not a part of the script
+  cmd_engine_start();
+  mcode_errno_set(ESuccess);
+  input("paste\r");
+  ASSERT_TRUE(line_editor_paste());
+  collected_text_reset();
+
+  input("\"one\"\r\n\"two\"\r\n\004");
+  ASSERT_FALSE(line_editor_paste());
+  ASSERT_EQ(mcode_errno(), ESuccess);
+  // One echo per line, the first line does not start with the command text
+  ASSERT_STREQ(collected_text(), "\"one\"\r\none\r\n\"two\"\r\ntwo\r\n# ");
+}
+
+TEST_F(LineEditor, LongScript)
+{
+  size_t i;
+  std::string script;
+  std::vector<std::string> expected;
+
+  // The script is much longer than the queue, no line is lost
+  line_editor_set_echo(false);
+  for (i = 0; i < 200; ++i) {
+    expected.push_back("line " + std::to_string(i) + std::string(i % 50, '.'));
+    script += expected.back() + "\r\n";
+  }
+  input("\033[200~" + script);
+  ASSERT_FALSE(_lines.empty());
+  ASSERT_LT(_lines.size(), expected.size());
+  input("\033[201~");
+  line_editor_set_echo(true);
+  ASSERT_EQ(_lines, expected);
+}
+
+TEST_F(LineEditor, TooLongLineNegative)
+{
+  // The line is never truncated, it is dropped and reported
+  line_editor_set_echo(false);
+  input("\033[200~first\n" + std::string(1000, 'x') + "\nlast\033[201~");
+  line_editor_set_echo(true);
+  ASSERT_EQ(_lines, std::vector<std::string>({"first", "last"}));
+  ASSERT_STREQ(collected_text(), "Too long lines dropped: 1\r\n# ");
+}
@@ -0,0 +1,288 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Alexander Chumakov
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "mpdu.h"
+
+#include <gtest/gtest.h>
+
+#include <string>
+
+using namespace testing;
+
+class MPduBasic : public Test
+{
+protected:
+  void SetUp() override {
+    memset(&_sms, 0, sizeof (_sms));
+    memset(_pdu, 0, sizeof (_pdu));
+  }
+  void TearDown() override {
+  }
+  void set_text(const std::string &text, uint8_t dcs) {
+    _sms.dcs = dcs;
+    _sms.length = text.length();
+    memcpy(_sms.text, text.c_str(), text.length() + 1);
+  }
+
+  MPduSms _sms;
+  char _pdu[2 * MCODE_PDU_MAX_LENGTH + 1];
+};
+
+TEST_F(MPduBasic, Pack7bit)
+{
+  const uint8_t text[] = { 'h', 'e', 'l', 'l', 'o', 'h', 'e', 'l', 'l', 'o' };
+  const uint8_t packed[] = { 0xE8, 0x32, 0x9B, 0xFD, 0x46, 0x97, 0xD9, 0xEC, 0x37 };
+  uint8_t out[16] = { 0 };
+
+  ASSERT_EQ(pdu_pack_7bit(text, sizeof (text), out), sizeof (packed));
+  ASSERT_EQ(memcmp(out, packed, sizeof (packed)), 0);
+  // The empty input
+  ASSERT_EQ(pdu_pack_7bit(text, 0, out), 0u);
+}
+
+TEST_F(MPduBasic, Unpack7bit)
+{
+  const uint8_t packed[] = { 0xE8, 0x32, 0x9B, 0xFD, 0x46, 0x97, 0xD9, 0xEC, 0x37 };
+  uint8_t out[16] = { 0 };
+
+  pdu_unpack_7bit(packed, 10, out);
+  ASSERT_EQ(memcmp(out, "hellohello", 10), 0);
+}
+
+TEST_F(MPduBasic, Pack7bitAllLengths)
+{
+  size_t i;
+  size_t count;
+  uint8_t septets[MCODE_PDU_MAX_SEPTETS];
+  uint8_t unpacked[MCODE_PDU_MAX_SEPTETS];
+  uint8_t packed[MCODE_PDU_MAX_OCTETS];
+
+  for (i = 0; i < sizeof (septets); ++i) {
+    septets[i] = (i * 37 + 11) & 0x7F;
+  }
+  for (count = 0; count <= sizeof (septets); ++count) {
+    memset(unpacked, 0xFF, sizeof (unpacked));
+    ASSERT_EQ(pdu_pack_7bit(septets, count, packed), (count * 7 + 7) / 8) << "count: " << count;
+    pdu_unpack_7bit(packed, count, unpacked);
+    ASSERT_EQ(memcmp(septets, unpacked, count), 0) << "count: " << count;
+    if (count < sizeof (unpacked)) {
+      ASSERT_EQ(unpacked[count], 0xFF) << "count: " << count;
+    }
+  }
+}
+
+TEST_F(MPduBasic, TextDcs)
+{
+  ASSERT_EQ(pdu_text_dcs("send-info 1532, \"done\", 84", 26), MPduDcs7bit);
+  ASSERT_EQ(pdu_text_dcs("[a]{b}~|^\\@$_\r\n", 15), MPduDcs7bit);
+  ASSERT_EQ(pdu_text_dcs("a`b", 3), MPduDcsUcs2);
+  ASSERT_EQ(pdu_text_dcs("a\tb", 3), MPduDcsUcs2);
+  ASSERT_EQ(pdu_text_dcs("", 0), MPduDcs7bit);
+}
+
+TEST_F(MPduBasic, TextFit)
+{
+  const std::string plain(200, 'a');
+  const std::string ext(200, '[');
+
+  ASSERT_EQ(pdu_text_fit(plain.c_str(), plain.length(), MPduDcs7bit, false), 160u);
+  ASSERT_EQ(pdu_text_fit(plain.c_str(), plain.length(), MPduDcs7bit, true), 153u);
+  ASSERT_EQ(pdu_text_fit(plain.c_str(), plain.length(), MPduDcsUcs2, false), 70u);
+  ASSERT_EQ(pdu_text_fit(plain.c_str(), plain.length(), MPduDcsUcs2, true), 67u);
+  ASSERT_EQ(pdu_text_fit(plain.c_str(), plain.length(), MPduDcs8bit, false), 140u);
+  ASSERT_EQ(pdu_text_fit(ext.c_str(), ext.length(), MPduDcs7bit, false), 80u);
+  ASSERT_EQ(pdu_text_fit(plain.c_str(), 10, MPduDcs7bit, false), 10u);
+}
+
+TEST_F(MPduBasic, EncodeSubmit)
+{
+  _sms.type = MPduTypeSubmit;
+  strcpy(_sms.address, "+46708251358");
+  set_text("hellohello", MPduDcs7bit);
+
+  ASSERT_EQ(pdu_encode(&_sms, _pdu, sizeof (_pdu)), 22u);
+  ASSERT_STREQ(_pdu, "0001000B916407281553F800000AE8329BFD4697D9EC37");
+}
+
+TEST_F(MPduBasic, EncodeSubmitSmsc)
+{
+  _sms.type = MPduTypeSubmit;
+  strcpy(_sms.smsc, "+31624000000");
+  strcpy(_sms.address, "12345");
+  set_text("A", MPduDcs7bit);
+
+  ASSERT_EQ(pdu_encode(&_sms, _pdu, sizeof (_pdu)), 11u);
+  ASSERT_STREQ(_pdu, "07911326040000F0" "010005812143F500000141");
+}
+
+TEST_F(MPduBasic, EncodeErrors)
+{
+  _sms.type = MPduTypeSubmit;
+  set_text("hello", MPduDcs7bit);
+
+  // No address
+  ASSERT_EQ(pdu_encode(&_sms, _pdu, sizeof (_pdu)), 0u);
+  // Not a phone number
+  strcpy(_sms.address, "+7000abc");
+  ASSERT_EQ(pdu_encode(&_sms, _pdu, sizeof (_pdu)), 0u);
+  // Too small output buffer
+  strcpy(_sms.address, "+70001112233");
+  ASSERT_EQ(pdu_encode(&_sms, _pdu, 20), 0u);
+}
+
+TEST_F(MPduBasic, DecodeDeliver)
+{
+  const char pdu[] = "07911326040000F0040B911346610089F60000208062917314080CC8F71D14969741F977FD07";
+  const uint8_t timestamp[7] = { 0x20, 0x80, 0x62, 0x91, 0x73, 0x14, 0x08 };
+
+  ASSERT_TRUE(pdu_decode(pdu, strlen(pdu), &_sms));
+  ASSERT_EQ(_sms.type, MPduTypeDeliver);
+  ASSERT_EQ(_sms.dcs, MPduDcs7bit);
+  ASSERT_EQ(_sms.concatTotal, 0);
+  ASSERT_STREQ(_sms.smsc, "+31624000000");
+  ASSERT_STREQ(_sms.address, "+31641600986");
+  ASSERT_EQ(memcmp(_sms.timestamp, timestamp, sizeof (timestamp)), 0);
+  ASSERT_EQ(_sms.length, 12);
+  ASSERT_STREQ(_sms.text, "How are you?");
+}
+
+TEST_F(MPduBasic, DecodeAlphanumericAddress)
+{
+  // The originating address "Test" is GSM 7-bit packed, 7 semi-octets
+  const char pdu[] = "000407D0D4F29C0E0000021080017240210141";
+
+  ASSERT_TRUE(pdu_decode(pdu, strlen(pdu), &_sms));
+  ASSERT_STREQ(_sms.address, "Test");
+  ASSERT_STREQ(_sms.text, "A");
+}
+
+TEST_F(MPduBasic, DecodeErrors)
+{
+  const char pdu[] = "07911326040000F0040B911346610089F60000208062917314080CC8F71D14969741F977FD07";
+
+  // Odd length
+  ASSERT_FALSE(pdu_decode(pdu, strlen(pdu) - 1, &_sms));
+  // Invalid character
+  ASSERT_FALSE(pdu_decode("0X", 2, &_sms));
+  // Truncated user data
+  ASSERT_FALSE(pdu_decode(pdu, strlen(pdu) - 2, &_sms));
+  // Truncated header
+  ASSERT_FALSE(pdu_decode(pdu, 30, &_sms));
+  // Empty
+  ASSERT_FALSE(pdu_decode("", 0, &_sms));
+  // Not SMS-DELIVER or SMS-SUBMIT
+  ASSERT_FALSE(pdu_decode("0002", 4, &_sms));
+}
+
+TEST_F(MPduBasic, RoundTripExtensionTable)
+{
+  MPduSms decoded;
+  const std::string text("[a]{b}~|^\\ \f@$_\r\n");
+
+  _sms.type = MPduTypeSubmit;
+  strcpy(_sms.address, "+70001112233");
+  set_text(text, pdu_text_dcs(text.c_str(), text.length()));
+  ASSERT_EQ(_sms.dcs, MPduDcs7bit);
+
+  ASSERT_NE(pdu_encode(&_sms, _pdu, sizeof (_pdu)), 0u);
+  ASSERT_TRUE(pdu_decode(_pdu, strlen(_pdu), &decoded));
+  ASSERT_EQ(decoded.type, MPduTypeSubmit);
+  ASSERT_STREQ(decoded.address, "+70001112233");
+  ASSERT_STREQ(decoded.text, text.c_str());
+}
+
+TEST_F(MPduBasic, RoundTripUcs2)
+{
+  MPduSms decoded;
+  const std::string text("`backticks` need UCS2");
+
+  _sms.type = MPduTypeDeliver;
+  strcpy(_sms.address, "+70001112233");
+  set_text(text, pdu_text_dcs(text.c_str(), text.length()));
+  ASSERT_EQ(_sms.dcs, MPduDcsUcs2);
+
+  // 1 + 8 + 1 + 1 + 7 + 1 + 2*21
+  ASSERT_EQ(pdu_encode(&_sms, _pdu, sizeof (_pdu)), 61u);
+  ASSERT_TRUE(pdu_decode(_pdu, strlen(_pdu), &decoded));
+  ASSERT_EQ(decoded.type, MPduTypeDeliver);
+  ASSERT_EQ(decoded.dcs, MPduDcsUcs2);
+  ASSERT_STREQ(decoded.text, text.c_str());
+}
+
+TEST_F(MPduBasic, RoundTripFullSms)
+{
+  MPduSms decoded;
+  const std::string text(200, 'x');
+
+  _sms.type = MPduTypeSubmit;
+  strcpy(_sms.address, "+70001112233");
+  set_text(text.substr(0, 160), MPduDcs7bit);
+
+  // A single SMS holds 160 characters in 140 octets
+  ASSERT_EQ(pdu_encode(&_sms, _pdu, sizeof (_pdu)), 13u + 140u);
+  ASSERT_TRUE(pdu_decode(_pdu, strlen(_pdu), &decoded));
+  ASSERT_EQ(decoded.length, 160);
+  ASSERT_STREQ(decoded.text, text.substr(0, 160).c_str());
+}
+
+TEST_F(MPduBasic, RoundTripConcatenated)
+{
+  MPduSms decoded;
+  const std::string text(200, 'y');
+
+  _sms.type = MPduTypeSubmit;
+  _sms.concatRef = 0x42;
+  _sms.concatTotal = 2;
+  _sms.concatSeq = 1;
+  strcpy(_sms.address, "+70001112233");
+  set_text(text.substr(0, 160), MPduDcs7bit);
+
+  // Only 153 characters fit, the header takes 7 septets
+  ASSERT_EQ(pdu_encode(&_sms, _pdu, sizeof (_pdu)), 13u + 140u);
+  ASSERT_TRUE(pdu_decode(_pdu, strlen(_pdu), &decoded));
+  ASSERT_EQ(decoded.concatRef, 0x42);
+  ASSERT_EQ(decoded.concatTotal, 2);
+  ASSERT_EQ(decoded.concatSeq, 1);
+  ASSERT_EQ(decoded.length, 153);
+  ASSERT_STREQ(decoded.text, text.substr(0, 153).c_str());
+
+  // UCS2 with the header
+  set_text(text.substr(0, 80), MPduDcsUcs2);
+  ASSERT_EQ(pdu_encode(&_sms, _pdu, sizeof (_pdu)), 13u + 140u);
+  ASSERT_TRUE(pdu_decode(_pdu, strlen(_pdu), &decoded));
+  ASSERT_EQ(decoded.concatSeq, 1);
+  ASSERT_EQ(decoded.length, 67);
+}
+
+TEST_F(MPduBasic, DecodeConcatenated16bitReference)
+{
+  // UDH: 16-bit reference 0x1234, part 3 of 3, followed by "Hi" in UCS2
+  const char pdu[] = "00440B910700112132F30008021080017240210B" "06080412340303" "00480069";
+
+  ASSERT_TRUE(pdu_decode(pdu, strlen(pdu), &_sms));
+  ASSERT_EQ(_sms.concatRef, 0x1234);
+  ASSERT_EQ(_sms.concatTotal, 3);
+  ASSERT_EQ(_sms.concatSeq, 3);
+  ASSERT_STREQ(_sms.text, "Hi");
+}
@@ -0,0 +1,216 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Alexander Chumakov
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "mring.h"
+
+#include <thread>
+#include <string.h>
+#include <gtest/gtest.h>
+
+using namespace testing;
+
+/** The number of bytes passed through the ring in the stress tests */
+static const size_t TheStressLength = 1024*1024;
+
+class MRingBasic : public Test
+{
+protected:
+  void SetUp() override {
+    memset(_buffer, 0, sizeof (_buffer));
+    ASSERT_TRUE(mring_init(&_ring, _buffer, sizeof (_buffer)));
+  }
+
+  static char pattern(size_t index) {
+    return (char)((index * 31) ^ (index >> 8));
+  }
+
+  MRing _ring;
+  char _buffer[16];
+};
+
+TEST_F(MRingBasic, InitNonPowerOf2Negative)
+{
+  MRing ring;
+  char buffer[12];
+
+  ASSERT_FALSE(mring_init(&ring, buffer, 0));
+  ASSERT_FALSE(mring_init(&ring, buffer, 12));
+  ASSERT_TRUE(mring_init(&ring, buffer, 8));
+  ASSERT_EQ(mring_room(&ring), 8);
+}
+
+TEST_F(MRingBasic, PushPop)
+{
+  char data[16];
+
+  ASSERT_EQ(mring_count(&_ring), 0);
+  ASSERT_EQ(mring_room(&_ring), 16);
+  ASSERT_EQ(mring_pop(&_ring, data, sizeof (data)), 0);
+
+  ASSERT_EQ(mring_push(&_ring, "hello", 5, NULL), 5);
+  ASSERT_TRUE(mring_put(&_ring, '!'));
+  ASSERT_EQ(mring_count(&_ring), 6);
+  ASSERT_EQ(mring_room(&_ring), 10);
+
+  // Batch pop, limited by the output size
+  ASSERT_EQ(mring_pop(&_ring, data, 4), 4);
+  ASSERT_EQ(std::string(data, 4), "hell");
+  ASSERT_EQ(mring_pop(&_ring, data, sizeof (data)), 2);
+  ASSERT_EQ(std::string(data, 2), "o!");
+  ASSERT_EQ(mring_count(&_ring), 0);
+  ASSERT_EQ(_ring.dropped, 0);
+}
+
+TEST_F(MRingBasic, FullDropsAndCounts)
+{
+  char data[32];
+
+  // The full capacity is usable
+  ASSERT_EQ(mring_push(&_ring, "0123456789abcdefXYZ", 19, NULL), 16);
+  ASSERT_EQ(_ring.dropped, 3);
+  ASSERT_EQ(mring_room(&_ring), 0);
+  ASSERT_FALSE(mring_put(&_ring, 'x'));
+  ASSERT_EQ(_ring.dropped, 4);
+
+  // Nothing is overwritten
+  ASSERT_EQ(mring_pop(&_ring, data, sizeof (data)), 16);
+  ASSERT_EQ(std::string(data, 16), "0123456789abcdef");
+}
+
+TEST_F(MRingBasic, WrapAround)
+{
+  char data[16];
+  const char *chunk;
+
+  ASSERT_EQ(mring_push(&_ring, "0123456789ab", 12, NULL), 12);
+  ASSERT_EQ(mring_pop(&_ring, data, 10), 10);
+  ASSERT_EQ(mring_push(&_ring, "ABCDEFGHIJ", 10, NULL), 10);
+
+  // The peek returns the contiguous part only, up to the buffer end
+  ASSERT_EQ(mring_peek(&_ring, &chunk), 6);
+  ASSERT_EQ(std::string(chunk, 6), "abABCD");
+  mring_consume(&_ring, 6);
+  ASSERT_EQ(mring_peek(&_ring, &chunk), 6);
+  ASSERT_EQ(std::string(chunk, 6), "EFGHIJ");
+  mring_consume(&_ring, 6);
+  ASSERT_EQ(mring_peek(&_ring, &chunk), 0);
+
+  // The batch pop joins both parts
+  ASSERT_EQ(mring_push(&_ring, "0123456789abcdef", 16, NULL), 16);
+  ASSERT_EQ(mring_pop(&_ring, data, sizeof (data)), 16);
+  ASSERT_EQ(std::string(data, 16), "0123456789abcdef");
+}
+
+TEST_F(MRingBasic, Drained)
+{
+  bool drained = false;
+  char data[16];
+
+  ASSERT_EQ(mring_push(&_ring, "ab", 2, &drained), 2);
+  ASSERT_TRUE(drained);
+  ASSERT_EQ(mring_push(&_ring, "cd", 2, &drained), 2);
+  ASSERT_FALSE(drained);
+  ASSERT_EQ(mring_pop(&_ring, data, sizeof (data)), 4);
+  ASSERT_EQ(mring_push(&_ring, "ef", 2, &drained), 2);
+  ASSERT_TRUE(drained);
+
+  // Nothing pushed to the full ring, no reason to wake the consumer up
+  ASSERT_EQ(mring_push(&_ring, "0123456789abcdef", 16, &drained), 14);
+  ASSERT_FALSE(drained);
+  ASSERT_EQ(mring_push(&_ring, "x", 1, &drained), 0);
+  ASSERT_FALSE(drained);
+}
+
+TEST_F(MRingBasic, StressLossless)
+{
+  // The producer retries until everything is pushed, the data should arrive intact
+  std::thread producer([this]() {
+    char chunk[7];
+    size_t i;
+    size_t sent = 0;
+    while (sent < TheStressLength) {
+      const size_t length = std::min(sizeof (chunk) - (sent % 5), TheStressLength - sent);
+      for (i = 0; i < length; ++i) {
+        chunk[i] = pattern(sent + i);
+      }
+      const size_t pushed = mring_push(&_ring, chunk, length, NULL);
+      if (!pushed) {
+        // Let the consumer run on a single CPU
+        std::this_thread::yield();
+      }
+      sent += pushed;
+    }
+  });
+
+  char data[11];
+  size_t i;
+  size_t length;
+  size_t received = 0;
+  size_t mismatches = 0;
+  while (received < TheStressLength) {
+    length = mring_pop(&_ring, data, sizeof (data) - (received % 3));
+    if (!length) {
+      std::this_thread::yield();
+    }
+    for (i = 0; i < length; ++i) {
+      mismatches += (data[i] != pattern(received + i));
+    }
+    received += length;
+  }
+  producer.join();
+
+  ASSERT_EQ(received, TheStressLength);
+  ASSERT_EQ(mismatches, 0);
+  ASSERT_EQ(mring_count(&_ring), 0);
+}
+
+TEST_F(MRingBasic, StressLossy)
+{
+  // The producer never waits, all the bytes are either received or counted as dropped
+  std::atomic<bool> done(false);
+  std::thread producer([this, &done]() {
+    size_t i;
+    for (i = 0; i < TheStressLength; ++i) {
+      if (!mring_put(&_ring, pattern(i)) && !(i % 64)) {
+        std::this_thread::yield();
+      }
+    }
+    done = true;
+  });
+
+  size_t length;
+  size_t received = 0;
+  const char *chunk;
+  while (!done || mring_count(&_ring)) {
+    length = mring_peek(&_ring, &chunk);
+    if (!length) {
+      std::this_thread::yield();
+    }
+    mring_consume(&_ring, length);
+    received += length;
+  }
+  producer.join();
+
+  ASSERT_EQ(received + _ring.dropped, TheStressLength);
+}
@@ -0,0 +1,209 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Alexander Chumakov
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "sha256.h"
+
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <gtest/gtest.h>
+
+using namespace testing;
+
+namespace {
+
+std::string to_hex(const uint8_t *md)
+{
+  int i;
+  char buffer[2*MD_LENGTH_SHA256 + 1];
+
+  for (i = 0; i < MD_LENGTH_SHA256; ++i) {
+    snprintf(buffer + 2*i, 3, "%02x", md[i]);
+  }
+  return buffer;
+}
+
+std::string digest(const std::string &data)
+{
+  uint8_t md[MD_LENGTH_SHA256];
+
+  sha256(data.data(), (int)data.size(), md);
+  return to_hex(md);
+}
+
+}
+
+/** Runs every case with the portable code and, if available, with the SHA extension */
+class Sha256 : public TestWithParam<bool>
+{
+protected:
+  void SetUp() override {
+    _was = sha256_set_accelerated(GetParam());
+    if (GetParam() && !sha256_accelerated()) {
+      GTEST_SKIP() << "No SHA extension in this CPU";
+    }
+  }
+  void TearDown() override {
+    sha256_set_accelerated(_was);
+  }
+
+  bool _was;
+};
+
+TEST_P(Sha256, NistVectors)
+{
+  // FIPS 180-2, appendix B and the short messages
+  ASSERT_EQ(digest(""), "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+  ASSERT_EQ(digest("abc"), "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+  ASSERT_EQ(digest("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq"),
+            "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1");
+  ASSERT_EQ(digest("abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmnhijklmno"
+                   "ijklmnopjklmnopqklmnopqrlmnopqrsmnopqrstnopqrstu"),
+            "cf5b16a778af8380036ce59e7b0492370b249b11e8f07a51afac45037afee9d1");
+  ASSERT_EQ(digest(std::string(1000000, 'a')),
+            "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0");
+}
+
+TEST_P(Sha256, PaddingBoundaries)
+{
+  // The length field fits the last block up to 55 bytes, 56..63 need an extra block
+  ASSERT_EQ(digest(std::string(55, 'a')), "9f4390f8d30c2dd92ec9f095b65e2b9ae9b0a925a5258e241c9f1e910f734318");
+  ASSERT_EQ(digest(std::string(56, 'a')), "b35439a4ac6f0948b6d6f9e3c6af0f5f590ce20f1bde7090ef7970686ec6738a");
+  ASSERT_EQ(digest(std::string(64, 'a')), "ffe054fe7ae0cb6dc65c3af9b61d5209f439851db43d0ba5997337df154668eb");
+}
+
+TEST_P(Sha256, SplitUpdates)
+{
+  // Any split of the message gives the same digest as the single update
+  std::mt19937 rng(GetParam() ? 46 : 64);
+  std::vector<uint8_t> data(8192);
+  for (auto &byte : data) {
+    byte = (uint8_t)rng();
+  }
+  uint8_t expected[MD_LENGTH_SHA256];
+  sha256(data.data(), (int)data.size(), expected);
+
+  int iteration;
+  for (iteration = 0; iteration < 64; ++iteration) {
+    SHA256_CTX ctx;
+    size_t offset = 0;
+    uint8_t md[MD_LENGTH_SHA256];
+
+    librock_SHA256_Init(&ctx);
+    while (offset < data.size()) {
+      const size_t length = std::min<size_t>(rng() % 300, data.size() - offset);
+      ASSERT_EQ(librock_SHA256_Update(&ctx, data.data() + offset, (int)length), 1);
+      offset += length;
+    }
+    librock_SHA256_StoreFinal(md, &ctx);
+    ASSERT_EQ(to_hex(md), to_hex(expected)) << "Iteration: " << iteration;
+  }
+}
+
+TEST_P(Sha256, HmacVectors)
+{
+  // RFC 4231, test cases 1, 2 and 6 (the key is longer than the block)
+  uint8_t md[MD_LENGTH_SHA256];
+  const std::string key1(20, '\x0b');
+  hmac_sha256(key1.data(), (int)key1.size(), "Hi There", 8, md);
+  ASSERT_EQ(to_hex(md), "b0344c61d8db38535ca8afceaf0bf12b881dc200c9833da726e9376c2e32cff7");
+
+  const std::string data2("what do ya want for nothing?");
+  hmac_sha256("Jefe", 4, data2.data(), (int)data2.size(), md);
+  ASSERT_EQ(to_hex(md), "5bdcc146bf60754e6a042426089575c75a003f089d2739839dec58b964ec3843");
+
+  // The incremental updates
+  HMAC_SHA256_CTX ctx;
+  const std::string key6(131, '\xaa');
+  const std::string data6("Test Using Larger Than Block-Size Key - Hash Key First");
+  hmac_sha256_init(&ctx, key6.data(), (int)key6.size());
+  hmac_sha256_update(&ctx, data6.data(), 5);
+  hmac_sha256_update(&ctx, data6.data() + 5, (int)data6.size() - 5);
+  hmac_sha256_final(md, &ctx);
+  ASSERT_EQ(to_hex(md), "60e431591ee0b67f0d8a26aacbf5b77f8e0bc6213728c5140546040f0ee37f54");
+}
+
+INSTANTIATE_TEST_CASE_P(
+  Paths, Sha256, Values(false, true),
+  [](const TestParamInfo<bool> &info) { return info.param ? "Hardware" : "Portable"; }
+);
+
+TEST(Sha256Paths, SameDigests)
+{
+  // Unaligned data of any length, both paths should agree
+  std::mt19937 rng(256);
+  std::vector<uint8_t> data(4096 + 1);
+  for (auto &byte : data) {
+    byte = (uint8_t)rng();
+  }
+
+  const bool was = sha256_set_accelerated(true);
+  size_t length;
+  for (length = 0; length < 4096; length += 1 + (length >> 4)) {
+    uint8_t portable[MD_LENGTH_SHA256];
+    uint8_t hardware[MD_LENGTH_SHA256];
+
+    sha256_set_accelerated(false);
+    sha256(data.data() + 1, (int)length, portable);
+    sha256_set_accelerated(true);
+    sha256(data.data() + 1, (int)length, hardware);
+    ASSERT_EQ(to_hex(portable), to_hex(hardware)) << "Length: " << length;
+  }
+  sha256_set_accelerated(was);
+}
+
+TEST(Sha256Paths, Throughput)
+{
+  // Not a pass/fail check, reports MB/s for the message sizes from 1 byte to 1 MiB
+  static const size_t TheTotal = 4*1024*1024;
+  std::vector<uint8_t> data(1024*1024, 0x5a);
+  uint8_t md[MD_LENGTH_SHA256];
+
+  const bool was = sha256_accelerated();
+  int hardware;
+  for (hardware = 0; hardware < 2; ++hardware) {
+    sha256_set_accelerated(hardware);
+    if (hardware && !sha256_accelerated()) {
+      break;
+    }
+
+    size_t size;
+    for (size = 1; size <= data.size(); size *= 16) {
+      size_t done;
+      size_t blocks;
+      // The short messages still take at least 1 block each
+      const auto start = std::chrono::steady_clock::now();
+      for (done = blocks = 0; blocks < TheTotal; done += size, blocks += std::max<size_t>(size, 64)) {
+        sha256(data.data(), (int)size, md);
+      }
+      const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+      printf("SHA-256 %-8s %8zu bytes: %8.1f MB/s\n",
+             hardware ? "hardware" : "portable", size, done / elapsed.count() / 1e6);
+    }
+  }
+  sha256_set_accelerated(was);
+}
@@ -0,0 +1,368 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Alexander Chumakov
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "emu/twi-bus.h"
+#include "emu/twi-24cxx.h"
+#include "emu/twi-ds3231.h"
+
+#include "hw-rtc.h"
+#include "twi-queue.h"
+#include "twi-mocks.h"
+
+#include <vector>
+#include <gtest/gtest.h>
+
+using namespace testing;
+
+namespace {
+/** 31-Dec-2099, 23:59:30 in UNIX time */
+const int64_t KEndOfCentury = 4102444770;
+}
+
+class TwiEmu : public Test
+{
+protected:
+  void SetUp() override {
+    _now = 1000000;
+    twi_bus_init();
+    twi_bus_set_clock(now);
+    twi_bus_stats_reset();
+    ASSERT_TRUE(twi_bus_attach(twi_ds3231_init()));
+    ASSERT_TRUE(twi_24cxx_init(&_eeprom, TWI_24CXX_ADDRESS, 4096, 32));
+    ASSERT_TRUE(twi_bus_attach(&_eeprom.device));
+  }
+  void TearDown() override {
+    twi_bus_deinit();
+    twi_24cxx_deinit(&_eeprom);
+    twi_bus_set_clock(NULL);
+  }
+
+  static uint64_t now(void) {
+    return _now;
+  }
+  static void advance(uint64_t us) {
+    _now += us;
+  }
+
+  static std::vector<uint8_t> read(uint8_t addr, uint8_t reg, uint8_t length) {
+    std::vector<uint8_t> data(length);
+    EXPECT_TRUE(twi_bus_write(addr, 1, &reg));
+    EXPECT_TRUE(twi_bus_read(addr, length, data.data()));
+    return data;
+  }
+  static void write(uint8_t addr, const std::vector<uint8_t> &data) {
+    ASSERT_TRUE(twi_bus_write(addr, data.size(), data.data()));
+  }
+
+  static uint64_t _now;
+  MTwi24cxx _eeprom;
+};
+
+uint64_t TwiEmu::_now = 0;
+
+TEST_F(TwiEmu, RoutesByAddress)
+{
+  uint8_t byte = 0;
+  MTwiDevice other = _eeprom.device;
+
+  // Nobody at 0x40, the second device at the taken address is rejected
+  ASSERT_FALSE(twi_bus_write(0x40u, 1, &byte));
+  ASSERT_FALSE(twi_bus_read(0x41u, 1, &byte));
+  ASSERT_EQ(twi_bus_stats()->unrouted, 2u);
+  ASSERT_FALSE(twi_bus_attach(&other));
+
+  // The R/W bit is ignored
+  ASSERT_TRUE(twi_bus_read(TWI_DS3231_ADDRESS | 1u, 1, &byte));
+  ASSERT_EQ(twi_bus_device(0)->stats.reads, 1u);
+
+  twi_bus_detach(&_eeprom.device);
+  ASSERT_FALSE(twi_bus_read(TWI_24CXX_ADDRESS, 1, &byte));
+  ASSERT_EQ(twi_bus_device(1), nullptr);
+}
+
+TEST_F(TwiEmu, BusTimeAndStats)
+{
+  // 100kHz: (9 bits per byte + start + stop), 10us per bit
+  ASSERT_EQ(twi_bus_transfer_time(0), 110u);
+  ASSERT_EQ(twi_bus_transfer_time(1), 200u);
+  ASSERT_EQ(twi_bus_transfer_time(32), 2990u);
+
+  read(TWI_DS3231_ADDRESS, 0x00u, 7);
+  write(TWI_24CXX_ADDRESS, { 0x00u, 0x10u, 0x55u });
+
+  const MTwiDeviceStats &rtc = twi_bus_device(0)->stats;
+  ASSERT_EQ(rtc.writes, 1u);
+  ASSERT_EQ(rtc.reads, 1u);
+  ASSERT_EQ(rtc.bytesWritten, 1u);
+  ASSERT_EQ(rtc.bytesRead, 7u);
+  ASSERT_EQ(rtc.busTime, 200u + 740u);
+  ASSERT_EQ(_eeprom.device.stats.bytesWritten, 3u);
+  ASSERT_EQ(twi_bus_stats()->transfers, 3u);
+  ASSERT_EQ(twi_bus_stats()->busTime, 200u + 740u + 380u);
+
+  // The utilisation is measured since the reset
+  advance(10000);
+  twi_bus_stats_reset();
+  ASSERT_EQ(twi_bus_stats()->since, _now);
+  ASSERT_EQ(twi_bus_device(0)->stats.reads, 0u);
+}
+
+TEST_F(TwiEmu, Ds3231TimeRunsAndOverflows)
+{
+  // 31-Dec-2099, 23:59:30, Thursday (4)
+  write(TWI_DS3231_ADDRESS, { 0x00u, 0x30u, 0x59u, 0x23u, 0x04u, 0x31u, 0x12u, 0x99u });
+  ASSERT_EQ(read(TWI_DS3231_ADDRESS, 0x00u, 7),
+            std::vector<uint8_t>({ 0x30u, 0x59u, 0x23u, 0x04u, 0x31u, 0x12u, 0x99u }));
+
+  // The century bit toggles, the day of week counts on
+  advance(30500000);
+  ASSERT_EQ(read(TWI_DS3231_ADDRESS, 0x00u, 7),
+            std::vector<uint8_t>({ 0x00u, 0x00u, 0x00u, 0x05u, 0x01u, 0x81u, 0x00u }));
+
+  // The 12-hour mode: 11:59:59 PM, then 12 AM
+  write(TWI_DS3231_ADDRESS, { 0x00u, 0x59u, 0x59u, 0x71u });
+  advance(1000000);
+  ASSERT_EQ(read(TWI_DS3231_ADDRESS, 0x00u, 3), std::vector<uint8_t>({ 0x00u, 0x00u, 0x52u }));
+
+  // The register pointer wraps after the temperature
+  ASSERT_EQ(read(TWI_DS3231_ADDRESS, 0x12u, 2)[1], 0x00u);
+}
+
+TEST_F(TwiEmu, Ds3231Alarms)
+{
+  twi_ds3231_set_time(KEndOfCentury);
+  // Alarm 1 at xx:59:32, alarm 2 every minute, both interrupts enabled, clear OSF
+  write(TWI_DS3231_ADDRESS, { 0x07u, 0x32u, 0x59u, 0x80u, 0x80u, 0x80u, 0x80u, 0x80u, 0x07u, 0x08u });
+  ASSERT_FALSE(twi_ds3231_interrupt());
+
+  advance(1000000);
+  twi_ds3231_update();
+  ASSERT_FALSE(twi_ds3231_interrupt());
+  advance(1000000);
+  twi_ds3231_update();
+  ASSERT_TRUE(twi_ds3231_interrupt());
+  ASSERT_EQ(read(TWI_DS3231_ADDRESS, 0x0fu, 1)[0], 0x09u);
+
+  // The flags are cleared by writing 0, the set bits are kept
+  write(TWI_DS3231_ADDRESS, { 0x0fu, 0x8bu });
+  ASSERT_EQ(read(TWI_DS3231_ADDRESS, 0x0fu, 1)[0], 0x09u);
+  write(TWI_DS3231_ADDRESS, { 0x0fu, 0x08u });
+  ASSERT_FALSE(twi_ds3231_interrupt());
+
+  // The alarm 2 at the minute start, the missed seconds are checked as well
+  advance(60000000);
+  twi_ds3231_update();
+  ASSERT_EQ(read(TWI_DS3231_ADDRESS, 0x0fu, 1)[0], 0x0au);
+
+  // No interrupts with INTCN cleared
+  write(TWI_DS3231_ADDRESS, { 0x0eu, 0x03u });
+  ASSERT_FALSE(twi_ds3231_interrupt());
+}
+
+TEST_F(TwiEmu, Ds3231Temperature)
+{
+  twi_ds3231_set_temperature(-41);
+  ASSERT_EQ(read(TWI_DS3231_ADDRESS, 0x11u, 2), std::vector<uint8_t>({ 0xf5u, 0xc0u }));
+  twi_ds3231_set_temperature(102);
+  ASSERT_EQ(read(TWI_DS3231_ADDRESS, 0x11u, 2), std::vector<uint8_t>({ 0x19u, 0x80u }));
+
+  // Read-only
+  write(TWI_DS3231_ADDRESS, { 0x11u, 0x00u });
+  ASSERT_EQ(read(TWI_DS3231_ADDRESS, 0x11u, 1)[0], 0x19u);
+}
+
+TEST_F(TwiEmu, EepromPageWriteWraps)
+{
+  uint8_t data[4];
+  const uint8_t address[] = { 0x00u, 0x1eu };
+
+  // 4 bytes at 0x1e: 2 of them roll over to the page start
+  write(TWI_24CXX_ADDRESS, { 0x00u, 0x1eu, 0x01u, 0x02u, 0x03u, 0x04u });
+  ASSERT_EQ(_eeprom.stats.wrapped, 2u);
+  ASSERT_EQ(_eeprom.data[0x1e], 0x01u);
+  ASSERT_EQ(_eeprom.data[0x1f], 0x02u);
+  ASSERT_EQ(_eeprom.data[0x00], 0x03u);
+  ASSERT_EQ(_eeprom.data[0x01], 0x04u);
+  ASSERT_EQ(_eeprom.data[0x20], 0xffu);
+
+  // No ACK during the write cycle
+  ASSERT_FALSE(twi_bus_write(TWI_24CXX_ADDRESS, sizeof (address), address));
+  advance(TWI_24CXX_WRITE_CYCLE - 1);
+  ASSERT_FALSE(twi_bus_read(TWI_24CXX_ADDRESS, sizeof (data), data));
+  ASSERT_EQ(_eeprom.stats.busyNacks, 2u);
+  ASSERT_EQ(_eeprom.device.stats.nacks, 2u);
+  advance(1);
+  ASSERT_TRUE(twi_bus_write(TWI_24CXX_ADDRESS, sizeof (address), address));
+  ASSERT_TRUE(twi_bus_read(TWI_24CXX_ADDRESS, sizeof (data), data));
+
+  // The sequential read crosses the page boundary
+  ASSERT_EQ(std::vector<uint8_t>(data, data + 4), std::vector<uint8_t>({ 0x01u, 0x02u, 0xffu, 0xffu }));
+}
+
+TEST_F(TwiEmu, EepromReadRollsOver)
+{
+  uint8_t data[4];
+  _eeprom.data[0x0ffe] = 0x11u;
+  _eeprom.data[0x0000] = 0x22u;
+
+  // The unused address bits are ignored
+  write(TWI_24CXX_ADDRESS, { 0xffu, 0xfeu });
+  ASSERT_TRUE(twi_bus_read(TWI_24CXX_ADDRESS, sizeof (data), data));
+  ASSERT_EQ(std::vector<uint8_t>(data, data + 4), std::vector<uint8_t>({ 0x11u, 0xffu, 0x22u, 0xffu }));
+  // The address only, no write cycle
+  ASSERT_EQ(_eeprom.stats.writeCycles, 0u);
+}
+
+TEST_F(TwiEmu, EepromWear)
+{
+  int i;
+  for (i = 0; i < 10; ++i) {
+    write(TWI_24CXX_ADDRESS, { 0x00u, (uint8_t)i, (uint8_t)i });
+    advance(TWI_24CXX_WRITE_CYCLE);
+  }
+  write(TWI_24CXX_ADDRESS, { 0x01u, 0x00u, 0xaau });
+
+  ASSERT_EQ(_eeprom.stats.writeCycles, 11u);
+  ASSERT_EQ(_eeprom.stats.maxWear, 10u);
+  ASSERT_EQ(_eeprom.pageWrites[0], 10u);
+  ASSERT_EQ(_eeprom.pageWrites[8], 1u);
+
+  twi_24cxx_stats_reset(&_eeprom);
+  ASSERT_EQ(_eeprom.stats.maxWear, 0u);
+  ASSERT_EQ(_eeprom.pageWrites[0], 0u);
+}
+
+TEST_F(TwiEmu, EepromGeometry)
+{
+  MTwi24cxx eeprom;
+
+  // 24C04..24C16 select the blocks with the address bits
+  ASSERT_FALSE(twi_24cxx_init(&eeprom, 0xa0u, 1024, 16));
+  ASSERT_FALSE(twi_24cxx_init(&eeprom, 0xa0u, 4096, 48));
+
+  // 24C02: a single address byte
+  ASSERT_TRUE(twi_24cxx_init(&eeprom, 0xa0u, 256, 8));
+  ASSERT_TRUE(twi_bus_attach(&eeprom.device));
+  write(0xa0u, { 0xfeu, 0x01u, 0x02u, 0x03u });
+  ASSERT_EQ(eeprom.data[0xfe], 0x01u);
+  ASSERT_EQ(eeprom.data[0xf8], 0x03u);
+  twi_bus_detach(&eeprom.device);
+  twi_24cxx_deinit(&eeprom);
+}
+
+class TwiEmuRtc : public TwiEmu
+{
+protected:
+  void SetUp() override {
+    TwiEmu::SetUp();
+    // The DS3231 driver over the TWI queue, the TWI mock forwards to the emulated bus
+    MTwiMock::reset();
+    MTwiMock::routeToBus(true);
+    twi_queue_init();
+    mtime_init();
+    _success = false;
+  }
+  void TearDown() override {
+    MTwiMock::reset();
+    MTwiMock::release();
+    TwiEmu::TearDown();
+  }
+
+  static void done(bool success) {
+    _success = success;
+  }
+  static void date_ready(bool success, const MDate *date) {
+    _success = success;
+    _date = *date;
+  }
+
+  static bool _success;
+  static MDate _date;
+};
+
+bool TwiEmuRtc::_success = false;
+MDate TwiEmuRtc::_date;
+
+TEST_F(TwiEmuRtc, DriverOverModel)
+{
+  // 28-Feb-2024, Wednesday, 23:59:59
+  mtime_set_date(2024, 2, 28, 3, done);
+  ASSERT_TRUE(_success);
+  mtime_set_time(23, 59, 59, done);
+  ASSERT_TRUE(_success);
+
+  advance(1000000);
+  mtime_get_date(date_ready);
+  ASSERT_TRUE(_success);
+  ASSERT_EQ(_date.year, 2024);
+  ASSERT_EQ(_date.month, 2);
+  ASSERT_EQ(_date.day, 29);
+  ASSERT_EQ(_date.dayOfWeek, 4);
+  ASSERT_EQ(_date.dayOfYear, 60);
+
+  // The alarm registers are programmed
+  mtime_set_alarm(7, 30, 15, done);
+  ASSERT_TRUE(_success);
+  ASSERT_EQ(read(TWI_DS3231_ADDRESS, 0x07u, 4), std::vector<uint8_t>({ 0x15u, 0x30u, 0x07u, 0x80u }));
+}
+
+TEST_F(TwiEmuRtc, EepromConsecutiveWrites)
+{
+  const uint8_t first[] = { 0x00u, 0x00u, 0x01u, 0x02u, 0x03u, 0x04u };
+  const uint8_t second[] = { 0x00u, 0x20u, 0x05u, 0x06u, 0x07u, 0x08u };
+  const uint8_t third[] = { 0x00u, 0x40u, 0x09u };
+  const uint8_t address[] = { 0x00u, 0x20u };
+  static std::vector<uint8_t> data;
+
+  // The bus time runs with the retry timers
+  twi_bus_set_clock(MTwiMock::now);
+
+  // The next write starts in the write cycle of the previous one, it is repeated after the cycle
+  const MTwiTransaction write1 = { TWI_24CXX_ADDRESS, sizeof (first), 0, MCODE_TWI_RETRIES, first, NULL };
+  const MTwiTransaction write2 = { TWI_24CXX_ADDRESS, sizeof (second), 0, MCODE_TWI_RETRIES, second, NULL };
+  const MTwiTransaction write3 = { TWI_24CXX_ADDRESS, sizeof (third), 0, MCODE_TWI_RETRIES, third, NULL };
+  ASSERT_TRUE(twi_queue_submit(&write1));
+  ASSERT_TRUE(twi_queue_submit(&write2));
+  ASSERT_TRUE(twi_queue_submit(&write3));
+  ASSERT_TRUE(twi_queue_busy());
+  MTwiMock::drain();
+  ASSERT_FALSE(twi_queue_busy());
+  ASSERT_EQ(twi_queue_stats()->completed, 3u);
+  ASSERT_EQ(twi_queue_stats()->failed, 0u);
+  ASSERT_EQ(twi_queue_stats()->retries, 2u);
+  ASSERT_EQ(_eeprom.stats.busyNacks, 2u);
+  ASSERT_EQ(_eeprom.stats.writeCycles, 3u);
+
+  // The read right after the write waits for the write cycle too
+  const MTwiTransaction read = { TWI_24CXX_ADDRESS, sizeof (address), 4, MCODE_TWI_RETRIES, address,
+    [](bool success, uint8_t length, const uint8_t *bytes) { data.assign(bytes, bytes + length); } };
+  data.clear();
+  ASSERT_TRUE(twi_queue_submit(&read));
+  MTwiMock::drain();
+  ASSERT_EQ(data, std::vector<uint8_t>({ 0x05u, 0x06u, 0x07u, 0x08u }));
+  ASSERT_EQ(_eeprom.data[0x03], 0x04u);
+  ASSERT_EQ(_eeprom.data[0x40], 0x09u);
+  ASSERT_EQ(twi_queue_stats()->retries, 3u);
+}
@@ -0,0 +1,309 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Alexander Chumakov
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "twi-queue.h"
+
+#include "hw-rtc.h"
+#include "twi-mocks.h"
+
+#include <vector>
+#include <string.h>
+#include <gtest/gtest.h>
+
+using namespace testing;
+
+namespace {
+/** The DS3231 and the external EEPROM addresses */
+const uint8_t KRtc = 0xd0u;
+const uint8_t KEeprom = 0xaeu;
+}
+
+class TwiQueue : public Test
+{
+protected:
+  void SetUp() override {
+    MTwiMock::reset();
+    MTwiMock::addDevice(KRtc);
+    MTwiMock::addDevice(KEeprom);
+    twi_queue_init();
+    _results.clear();
+    _data.clear();
+    _resubmit = false;
+  }
+  void TearDown() override {
+    MTwiMock::drain();
+    ASSERT_FALSE(twi_queue_busy());
+    ASSERT_EQ(MTwiMock::collisions(), 0u);
+    twi_queue_deinit();
+    MTwiMock::release();
+  }
+
+  static MTwiTransaction transaction(uint8_t addr, uint8_t writeLength, const uint8_t *writeData,
+                                     uint8_t readLength, mcode_read_ready callback = done) {
+    MTwiTransaction transaction;
+    transaction.addr = addr;
+    transaction.writeLength = writeLength;
+    transaction.readLength = readLength;
+    transaction.retries = MCODE_TWI_RETRIES;
+    transaction.writeData = writeData;
+    transaction.callback = callback;
+    return transaction;
+  }
+
+  static void done(bool success, uint8_t length, const uint8_t *data) {
+    _results.push_back(success);
+    _data.push_back(std::vector<uint8_t>(data, data + length));
+    if (_resubmit) {
+      // Queue the next one from the completion callback
+      static const uint8_t address = 0x02u;
+      _resubmit = false;
+      const MTwiTransaction next = transaction(KRtc, 1, &address, 1);
+      ASSERT_TRUE(twi_queue_submit(&next));
+    }
+  }
+
+  static std::vector<bool> _results;
+  static std::vector<std::vector<uint8_t>> _data;
+  static bool _resubmit;
+};
+
+std::vector<bool> TwiQueue::_results;
+std::vector<std::vector<uint8_t>> TwiQueue::_data;
+bool TwiQueue::_resubmit = false;
+
+TEST_F(TwiQueue, TransactionsInOrder)
+{
+  const uint8_t write[] = { 0x00u, 0x10u, 0x55u };
+  const uint8_t address = 0x10u;
+  MTwiMock::setDelay(3);
+
+  const MTwiTransaction first = transaction(KEeprom, sizeof (write), write, 0);
+  const MTwiTransaction second = transaction(KRtc, 1, &address, 2);
+  const MTwiTransaction third = transaction(KEeprom, 0, NULL, 1);
+  ASSERT_TRUE(twi_queue_submit(&first));
+  ASSERT_TRUE(twi_queue_submit(&second));
+  ASSERT_TRUE(twi_queue_submit(&third));
+  ASSERT_TRUE(twi_queue_busy());
+
+  // Only the first one is on the bus
+  MTwiMock::tick();
+  ASSERT_EQ(MTwiMock::transfers().size(), 0u);
+  MTwiMock::drain();
+
+  const std::vector<MTwiMock::Transfer> &transfers = MTwiMock::transfers();
+  ASSERT_EQ(transfers.size(), 4u);
+  ASSERT_EQ(transfers[0].addr, KEeprom);
+  ASSERT_FALSE(transfers[0].read);
+  ASSERT_EQ(transfers[1].addr, KRtc);
+  ASSERT_FALSE(transfers[1].read);
+  ASSERT_EQ(transfers[2].addr, KRtc);
+  ASSERT_TRUE(transfers[2].read);
+  ASSERT_EQ(transfers[3].addr, KEeprom);
+  ASSERT_TRUE(transfers[3].read);
+
+  ASSERT_EQ(_results, std::vector<bool>({ true, true, true }));
+  ASSERT_EQ(_data[0].size(), 0u);
+  ASSERT_EQ(_data[1].size(), 2u);
+  // The EEPROM pointer is left after the written byte
+  ASSERT_EQ(_data[2].size(), 1u);
+  ASSERT_EQ(twi_queue_stats()->completed, 3u);
+}
+
+TEST_F(TwiQueue, WriteThenRead)
+{
+  uint8_t *const registers = MTwiMock::registers(KRtc);
+  registers[0x05] = 0x12u;
+  registers[0x06] = 0x34u;
+  registers[0x07] = 0x56u;
+  const uint8_t address = 0x05u;
+
+  const MTwiTransaction request = transaction(KRtc, 1, &address, 3);
+  ASSERT_TRUE(twi_queue_submit(&request));
+  ASSERT_EQ(_data.size(), 1u);
+  ASSERT_EQ(_data[0], std::vector<uint8_t>({ 0x12u, 0x34u, 0x56u }));
+
+  // The synchronous form, completed in place by the mock
+  uint8_t data[2] = { 0 };
+  ASSERT_TRUE(twi_queue_transfer_sync(KRtc, 1, &address, 2, data));
+  ASSERT_EQ(data[0], 0x12u);
+  ASSERT_EQ(data[1], 0x34u);
+  ASSERT_FALSE(twi_queue_transfer_sync(0x40u, 1, &address, 2, data));
+}
+
+TEST_F(TwiQueue, RetryOnNack)
+{
+  const uint8_t address = 0x00u;
+  MTwiMock::setDelay(2);
+  MTwiMock::setNacks(KRtc, 2);
+
+  const MTwiTransaction request = transaction(KRtc, 1, &address, 1);
+  ASSERT_TRUE(twi_queue_submit(&request));
+  MTwiMock::drain();
+
+  // 2 NACK-ed writes, then the whole transaction succeeds
+  ASSERT_EQ(MTwiMock::transfers().size(), 4u);
+  ASSERT_FALSE(MTwiMock::transfers()[0].success);
+  ASSERT_FALSE(MTwiMock::transfers()[1].success);
+  ASSERT_TRUE(MTwiMock::transfers()[2].success);
+  ASSERT_TRUE(MTwiMock::transfers()[3].read);
+  ASSERT_EQ(_results, std::vector<bool>({ true }));
+  ASSERT_EQ(twi_queue_stats()->retries, 2u);
+  ASSERT_EQ(twi_queue_stats()->failed, 0u);
+  // Each retry waits for the timer
+  ASSERT_EQ(MTwiMock::now(), 2000u*MCODE_TWI_RETRY_DELAY);
+}
+
+TEST_F(TwiQueue, FailAfterRetries)
+{
+  const uint8_t address = 0x00u;
+  MTwiMock::setDelay(1);
+  MTwiMock::setNacks(KEeprom, 100);
+
+  MTwiTransaction failing = transaction(KEeprom, 1, &address, 1);
+  failing.retries = 2;
+  const MTwiTransaction next = transaction(KRtc, 1, &address, 1);
+  ASSERT_TRUE(twi_queue_submit(&failing));
+  ASSERT_TRUE(twi_queue_submit(&next));
+  MTwiMock::drain();
+
+  // The failed one does not block the queue
+  ASSERT_EQ(_results, std::vector<bool>({ false, true }));
+  ASSERT_EQ(_data[0].size(), 0u);
+  ASSERT_EQ(MTwiMock::transfers().size(), 5u);
+  ASSERT_EQ(twi_queue_stats()->retries, 2u);
+  ASSERT_EQ(twi_queue_stats()->failed, 1u);
+  ASSERT_EQ(twi_queue_stats()->completed, 1u);
+}
+
+TEST_F(TwiQueue, FullQueueRejects)
+{
+  const uint8_t address = 0x00u;
+  MTwiMock::setDelay(1);
+
+  int i;
+  const MTwiTransaction request = transaction(KRtc, 1, &address, 1);
+  for (i = 0; i < MCODE_TWI_QUEUE_LENGTH; ++i) {
+    ASSERT_TRUE(twi_queue_submit(&request));
+  }
+  ASSERT_FALSE(twi_queue_submit(&request));
+  ASSERT_EQ(twi_queue_stats()->rejected, 1u);
+
+  // Nothing to transfer
+  MTwiMock::drain();
+  const MTwiTransaction empty = transaction(KRtc, 0, NULL, 0);
+  ASSERT_FALSE(twi_queue_submit(&empty));
+  ASSERT_EQ(twi_queue_stats()->rejected, 2u);
+  ASSERT_EQ(_results.size(), (size_t)MCODE_TWI_QUEUE_LENGTH);
+}
+
+TEST_F(TwiQueue, SubmitFromCallback)
+{
+  const uint8_t address = 0x00u;
+  MTwiMock::registers(KRtc)[0x02] = 0x23u;
+
+  _resubmit = true;
+  const MTwiTransaction request = transaction(KRtc, 1, &address, 1);
+  ASSERT_TRUE(twi_queue_submit(&request));
+  MTwiMock::drain();
+
+  ASSERT_EQ(_results, std::vector<bool>({ true, true }));
+  ASSERT_EQ(_data[1], std::vector<uint8_t>({ 0x23u }));
+}
+
+class TwiQueueRtc : public TwiQueue
+{
+protected:
+  void SetUp() override {
+    TwiQueue::SetUp();
+    mtime_init();
+    _timeResults.clear();
+    _dateResults.clear();
+  }
+
+  static void time_ready(bool success, const MTime *time) {
+    _timeResults.push_back(success);
+    if (success) {
+      _time = *time;
+    }
+  }
+  static void date_ready(bool success, const MDate *date) {
+    _dateResults.push_back(success);
+    if (success) {
+      _date = *date;
+    }
+  }
+  static void alarm_done(bool success) {
+    _alarmResult = success;
+  }
+
+  static MTime _time;
+  static MDate _date;
+  static bool _alarmResult;
+  static std::vector<bool> _timeResults;
+  static std::vector<bool> _dateResults;
+};
+
+MTime TwiQueueRtc::_time;
+MDate TwiQueueRtc::_date;
+bool TwiQueueRtc::_alarmResult = false;
+std::vector<bool> TwiQueueRtc::_timeResults;
+std::vector<bool> TwiQueueRtc::_dateResults;
+
+TEST_F(TwiQueueRtc, ConcurrentRequests)
+{
+  // 23:41:59, Tuesday, 19-Sep-2017
+  const uint8_t registers[] = { 0x59u, 0x41u, 0x23u, 0x02u, 0x19u, 0x09u, 0x17u };
+  memcpy(MTwiMock::registers(KRtc), registers, sizeof (registers));
+  MTwiMock::setDelay(5);
+
+  // The requests of different kinds share the bus, the same kind is rejected
+  mtime_get_time(time_ready);
+  mtime_get_date(date_ready);
+  mtime_set_alarm(7, 30, 0, alarm_done);
+  mtime_get_time(time_ready);
+  ASSERT_EQ(_timeResults, std::vector<bool>({ false }));
+  MTwiMock::drain();
+
+  ASSERT_EQ(_timeResults, std::vector<bool>({ false, true }));
+  ASSERT_EQ(_time.hours, 23);
+  ASSERT_EQ(_time.minutes, 41);
+  ASSERT_EQ(_time.seconds, 59);
+  ASSERT_EQ(_dateResults, std::vector<bool>({ true }));
+  ASSERT_EQ(_date.year, 2017);
+  ASSERT_EQ(_date.month, 9);
+  ASSERT_EQ(_date.day, 19);
+  ASSERT_EQ(_date.dayOfWeek, 2);
+  ASSERT_EQ(_date.dayOfYear, 262);
+  ASSERT_TRUE(_alarmResult);
+  ASSERT_EQ(MTwiMock::registers(KRtc)[0x07], 0x00u);
+  ASSERT_EQ(MTwiMock::registers(KRtc)[0x08], 0x30u);
+  ASSERT_EQ(MTwiMock::registers(KRtc)[0x09], 0x07u);
+  ASSERT_EQ(MTwiMock::registers(KRtc)[0x0a], 0x80u);
+
+  // A new request is accepted once the previous one completes
+  mtime_get_time(time_ready);
+  MTwiMock::drain();
+  ASSERT_EQ(_timeResults, std::vector<bool>({ false, true, true }));
+}
@@ -264,6 +264,7 @@ TEST_F(UtilsBasic, FromPdu7bit)
   size_t length = 0;
   bool res = from_pdu_7bit("F4F29C0E", -1, buffer, sizeof (buffer), &length);
   ASSERT_EQ(res, true);
+  ASSERT_EQ(length, 4u);
   ASSERT_STREQ(buffer, "test");
 
   memset(buffer, 0, sizeof (buffer));
@@ -281,15 +282,24 @@ TEST_F(UtilsBasic, FromPdu7bit)
   memset(buffer, 0, sizeof (buffer));
   res = from_pdu_7bit("F3B29BDC4ABBCD6F50AC3693B14022F2DB5D16B140381A", -1, buffer, sizeof (buffer), &length);
   ASSERT_EQ(res, true);
+  ASSERT_EQ(length, 26u);
   ASSERT_STREQ(buffer, "send-info 1532, \"done\", 84");
+
+  /* 7 characters fill 7 octets, the 8th septet is the padding */
+  memset(buffer, 0, sizeof (buffer));
+  res = from_pdu_7bit("E8329BFD469701", -1, buffer, sizeof (buffer), &length);
+  ASSERT_EQ(res, true);
+  ASSERT_EQ(length, 7u);
+  ASSERT_STREQ(buffer, "hellohe");
 }
-TEST_F(UtilsBasic, DISABLED_FromPdu7bit)
+
+TEST_F(UtilsBasic, FromPdu7bitShortBuffer)
 {
   char buffer[256] = { 0 };
 
   size_t length = 0;
   bool res = from_pdu_7bit("F4F29C0E", -1, buffer, 2, &length);
-  /* Failure is reported, as the 'X' char is illigal in this context */
+  /* The output is truncated, no room for the end-of-string marker */
   ASSERT_EQ(res, true);
   ASSERT_EQ(length, 2);
   ASSERT_STREQ(buffer, "te");
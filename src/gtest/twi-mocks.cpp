@@ -0,0 +1,281 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Alexander Chumakov
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "twi-mocks.h"
+
+#include "hw-twi.h"
+#include "mtimer.h"
+#include "scheduler.h"
+#include "emu/twi-bus.h"
+
+#include <map>
+#include <string.h>
+
+extern "C" void __real_mtimer_add(mcode_exec task, uint32_t start);
+
+namespace {
+struct TDevice {
+  uint8_t pointer;
+  unsigned nacks;
+  uint8_t registers[256];
+};
+
+unsigned TheDelay = 0;
+unsigned TheRemaining = 0;
+bool TheBusy = false;
+size_t TheCollisions = 0;
+bool TheRouteToBus = false;
+std::map<uint8_t, TDevice> TheDevices;
+std::vector<MTwiMock::Transfer> TheTransfers;
+/* The pending transfer */
+MTwiMock::Transfer ThePending;
+mcode_done TheWriteCallback = NULL;
+mcode_read_ready TheReadCallback = NULL;
+/* Valid in the read callback */
+uint8_t TheReadBuffer[256];
+/* The captured timers, in the order of their expiration */
+struct TTimer {
+  uint64_t expires;
+  mcode_exec task;
+};
+bool TheTimersCaptured = false;
+uint64_t TheNow = 0;
+std::vector<TTimer> TheTimers;
+
+void run_timer(void)
+{
+  const TTimer timer = TheTimers.front();
+
+  TheTimers.erase(TheTimers.begin());
+  if (timer.expires > TheNow) {
+    TheNow = timer.expires;
+  }
+  (*timer.task)();
+}
+
+/* The synchronous transfers wait in the scheduler */
+void scheduler_tick(void)
+{
+  if (TheTimersCaptured) {
+    MTwiMock::drain();
+  }
+}
+
+struct TSchedulerClient {
+  TSchedulerClient() {
+    scheduler_add(scheduler_tick);
+  }
+} TheSchedulerClient;
+
+void complete(void)
+{
+  const uint8_t addr = ThePending.addr & 0xfeu;
+  auto device = TheDevices.find(addr);
+
+  if (device == TheDevices.end() && TheRouteToBus) {
+    ThePending.success = ThePending.read ?
+      twi_bus_read(addr, ThePending.data.size(), ThePending.data.data()) :
+      twi_bus_write(addr, ThePending.data.size(), ThePending.data.data());
+  } else {
+    ThePending.success = (device != TheDevices.end() && !device->second.nacks);
+  }
+  if (device != TheDevices.end() && device->second.nacks) {
+    --device->second.nacks;
+  }
+  if (ThePending.success && device != TheDevices.end()) {
+    TDevice &dev = device->second;
+    if (ThePending.read) {
+      for (auto &byte : ThePending.data) {
+        byte = dev.registers[dev.pointer++];
+      }
+    } else if (!ThePending.data.empty()) {
+      dev.pointer = ThePending.data[0];
+      for (size_t i = 1; i < ThePending.data.size(); ++i) {
+        dev.registers[dev.pointer++] = ThePending.data[i];
+      }
+    }
+  }
+  TheTransfers.push_back(ThePending);
+  TheBusy = false;
+
+  if (ThePending.read) {
+    const mcode_read_ready callback = TheReadCallback;
+    const uint8_t length = ThePending.success ? ThePending.data.size() : 0;
+    memcpy(TheReadBuffer, ThePending.data.data(), length);
+    if (callback) {
+      (*callback)(ThePending.success, length, ThePending.success ? TheReadBuffer : NULL);
+    }
+  } else {
+    const mcode_done callback = TheWriteCallback;
+    if (callback) {
+      (*callback)(ThePending.success);
+    }
+  }
+}
+
+void start(void)
+{
+  TheBusy = true;
+  TheRemaining = TheDelay;
+  if (!TheRemaining) {
+    complete();
+  }
+}
+}
+
+void MTwiMock::reset()
+{
+  TheDelay = 0;
+  TheRemaining = 0;
+  TheBusy = false;
+  TheCollisions = 0;
+  TheRouteToBus = false;
+  TheDevices.clear();
+  TheTransfers.clear();
+  TheTimersCaptured = true;
+  TheNow = 0;
+  TheTimers.clear();
+}
+
+void MTwiMock::release()
+{
+  TheTimersCaptured = false;
+  TheTimers.clear();
+}
+
+void MTwiMock::setDelay(unsigned ticks)
+{
+  TheDelay = ticks;
+}
+
+void MTwiMock::setNacks(uint8_t addr, unsigned count)
+{
+  TheDevices[addr & 0xfeu].nacks = count;
+}
+
+void MTwiMock::addDevice(uint8_t addr)
+{
+  TDevice &device = TheDevices[addr & 0xfeu];
+  memset(&device, 0, sizeof (device));
+}
+
+uint8_t *MTwiMock::registers(uint8_t addr)
+{
+  return TheDevices[addr & 0xfeu].registers;
+}
+
+void MTwiMock::routeToBus(bool enabled)
+{
+  TheRouteToBus = enabled;
+}
+
+void MTwiMock::tick()
+{
+  if (TheBusy && !--TheRemaining) {
+    complete();
+  }
+}
+
+void MTwiMock::drain()
+{
+  while (TheBusy || !TheTimers.empty()) {
+    if (TheBusy) {
+      tick();
+    } else {
+      run_timer();
+    }
+  }
+}
+
+uint64_t MTwiMock::now()
+{
+  return TheNow;
+}
+
+bool MTwiMock::busy()
+{
+  return TheBusy;
+}
+
+const std::vector<MTwiMock::Transfer> &MTwiMock::transfers()
+{
+  return TheTransfers;
+}
+
+size_t MTwiMock::collisions()
+{
+  return TheCollisions;
+}
+
+void twi_send(uint8_t addr, uint8_t length, const uint8_t *data, mcode_done callback)
+{
+  if (TheBusy) {
+    /* Same as the AVR driver: busy, cannot handle request */
+    ++TheCollisions;
+    if (callback) {
+      (*callback)(false);
+    }
+    return;
+  }
+
+  ThePending.addr = addr;
+  ThePending.read = false;
+  ThePending.data.assign(data, data + length);
+  TheWriteCallback = callback;
+  start();
+}
+
+void twi_recv(uint8_t addr, uint8_t length, mcode_read_ready callback)
+{
+  if (TheBusy) {
+    ++TheCollisions;
+    if (callback) {
+      (*callback)(false, 0, NULL);
+    }
+    return;
+  }
+
+  ThePending.addr = addr;
+  ThePending.read = true;
+  ThePending.data.assign(length, 0);
+  TheReadCallback = callback;
+  start();
+}
+
+extern "C" void __wrap_mtimer_add(mcode_exec task, uint32_t start)
+{
+  if (!TheTimersCaptured) {
+    __real_mtimer_add(task, start);
+    return;
+  }
+
+  const TTimer timer = { TheNow + 1000u*start, task };
+  auto it = TheTimers.begin();
+  /* The timers with the same expiration run in the order they are added */
+  while (it != TheTimers.end() && it->expires <= timer.expires) {
+    ++it;
+  }
+  TheTimers.insert(it, timer);
+}
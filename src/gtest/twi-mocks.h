@@ -0,0 +1,83 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Alexander Chumakov
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef MCODE_TWI_MOCKS_H
+#define MCODE_TWI_MOCKS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+/**
+ * The TWI bus model: the transfers from 'twi-queue.c' are recorded and completed
+ * after the configured number of ticks; each device is a 256-byte register file,
+ * the first written byte sets the register pointer, which auto-increments; the other
+ * addresses may be routed to the emulated bus from 'emu/twi-bus.c'; the timers added
+ * with \c mtimer_add after \c reset are run by \c drain and by the scheduler, the bus
+ * time jumps to their expiration
+ */
+class MTwiMock
+{
+public:
+  /** The recorded transfer */
+  struct Transfer {
+    uint8_t addr;
+    bool read;
+    bool success;
+    std::vector<uint8_t> data;
+  };
+
+  /** Reset the model, the devices are cleared, no delay, no NACKs, the timers are captured */
+  static void reset();
+  /** Stop capturing the timers, the pending ones are dropped */
+  static void release();
+
+  /** The number of \c tick calls to complete a transfer, 0 completes in place */
+  static void setDelay(unsigned ticks);
+  /** NACK the next \c count transfers to \c addr */
+  static void setNacks(uint8_t addr, unsigned count);
+  /** Make \c addr respond, the unknown devices NACK */
+  static void addDevice(uint8_t addr);
+  /** The device registers */
+  static uint8_t *registers(uint8_t addr);
+  /** Route the transfers to the addresses without a mock device to the emulated bus */
+  static void routeToBus(bool enabled);
+
+  /** Advance the bus time, the pending transfer completes when its delay elapses */
+  static void tick();
+  /** Run \c tick and the expired timers till the bus is idle and no timers are pending */
+  static void drain();
+  /** The bus time in micro-seconds since \c reset, advanced by the timers only */
+  static uint64_t now();
+  /** Check if a transfer is in progress */
+  static bool busy();
+
+  /** The transfers since the last \c reset */
+  static const std::vector<Transfer> &transfers();
+  /** The transfers started while the bus was busy, should be 0 */
+  static size_t collisions();
+};
+
+#endif /* MCODE_TWI_MOCKS_H */
@@ -34,8 +34,11 @@ size_t TheCollectedText2Length = 0;
 char TheCollectedAltText[4096];
 size_t TheCollectedAltTextLength = 0;
 MHwInterface *TheMockInterface = NULL;
+hw_uart_char_event TheUartCallback = NULL;
 }
 
+extern "C" void __real_hw_uart_set_callback(hw_uart_char_event aCallback);
+
 MHwInterface::MHwInterface()
 {
   TheMockInterface = this;
@@ -64,6 +67,20 @@ extern "C" void __wrap_uart2_write_char(char ch)
   TheCollectedText2[TheCollectedText2Length++] = ch;
 }
 
+extern "C" void __wrap_hw_uart_set_callback(hw_uart_char_event aCallback)
+{
+  TheUartCallback = aCallback;
+  __real_hw_uart_set_callback(aCallback);
+}
+
+void uart_input(const char *data, size_t length)
+{
+  size_t i;
+  for (i = 0; i < length && TheUartCallback; ++i) {
+    (*TheUartCallback)(data[i]);
+  }
+}
+
 const char *collected_text(void)
 {
   return TheCollectedText;
@@ -116,3 +133,8 @@ size_t collected_alt_text_length(void)
 {
   return TheCollectedAltTextLength;
 }
+
+extern "C" void main_request_exit(void)
+{
+  /* The 'poweroff' command has nothing to stop in the tests */
+}
@@ -25,6 +25,8 @@
 #ifndef MCODE_WRAP_MOCKS_H
 #define MCODE_WRAP_MOCKS_H
 
+#include "hw-uart.h"
+
 #include <stddef.h>
 #include <gmock/gmock.h>
 
@@ -55,6 +57,15 @@ extern "C" {
  */
 void __wrap_uart_write_char(char ch);
 void __wrap_uart2_write_char(char ch);
+/**
+ * The wrapped 'hw_uart_set_callback' function, keeps the callback for \c uart_input
+ */
+void __wrap_hw_uart_set_callback(hw_uart_char_event aCallback);
+
+/**
+ * Pass the input characters to the UART callback
+ */
+void uart_input(const char *data, size_t length);
 
 void collected_text_reset(void);
 const char *collected_text(void);
@@ -51,6 +51,17 @@ void hw_i80_write_const_long (uint8_t cmd, uint16_t constValue, uint32_t length)
  */
 void hw_i80_write_bitmap(uint8_t cmd, uint16_t length, const uint8_t *pData, uint16_t offValue, uint16_t onValue);
 
+/**
+ * This function starts command 'cmd' and then writes 8 rows of 'length' 8x8 glyphs
+ * of the characters in 'text', see 'lcd_write_text'
+ */
+void hw_i80_write_text(uint8_t cmd, const char *text, uint8_t length, uint16_t offValue, uint16_t onValue);
+
+/**
+ * This function writes 'count' words of data, continues the last command
+ */
+void hw_i80_write_words(const uint16_t *data, uint16_t count);
+
 void hw_i80_reset(void);
 
 #ifdef __cplusplus
@@ -72,10 +72,62 @@ void lcd_write_const_words(uint8_t cmd, uint16_t word, uint32_t count);
 
 void lcd_write_bitmap(uint8_t cmd, uint16_t length, const uint8_t *pData, uint16_t offValue, uint16_t onValue);
 
+/**
+ * Write a run of 8x8 characters placed side by side in a single text line
+ * @param[in] cmd The RAM write command
+ * @param[in] text The characters to write, their glyphs are taken from the font
+ * @param[in] length The number of characters in \c text
+ * @note The window should be 8*length pixels wide and 8 pixels high, the glyph rows are
+ *       streamed across the run: the 1st row of all the characters, then the 2nd one, etc.
+ */
+void lcd_write_text(uint8_t cmd, const char *text, uint8_t length, uint16_t offValue, uint16_t onValue);
+
+/**
+ * Write a block of data words, continues the command sent by \c lcd_write_cmd
+ * @param[in] data The words to write
+ * @param[in] count The number of words in \c data
+ */
+void lcd_write_words(const uint16_t *data, uint16_t count);
+
 void lcd_write_cmd(uint8_t cmd);
 void lcd_write_byte(uint8_t data);
+/**
+ * Write a command with its parameter bytes, in a single transaction
+ */
+void lcd_write_data(uint8_t cmd, uint8_t length, const uint8_t *data);
 uint8_t lcd_read_byte(uint8_t cmd);
 
+/**
+ * The LCD statistics
+ */
+typedef struct {
+  uint32_t commands;                    /**< The number of the commands */
+  uint32_t data;                        /**< The number of the data transactions: bytes or words */
+  uint32_t frames;                      /**< The number of the screen repaints */
+  uint32_t pixels;                      /**< The number of the written pixels */
+  uint32_t time;                        /**< The time the counters were collected, in ms */
+} MLcdStats;
+
+/**
+ * Get the LCD statistics collected since the last reset
+ * @param[out] stats The statistics
+ * @param[in] reset Start collecting the statistics again
+ * @note Provided by the EMU LCD
+ */
+void lcd_stats(MLcdStats *stats, bool reset);
+
+/**
+ * Get the CRC-32 of the shown frame
+ * @note Provided by the EMU LCD, same as the CRC-32 of the \c lcd_snapshot file
+ */
+uint32_t lcd_frame_crc(void);
+/**
+ * Write the shown frame to a file, the raw RGB32 pixels, row by row
+ * @return The success status
+ * @note Provided by the EMU LCD
+ */
+bool lcd_snapshot(const char *path);
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
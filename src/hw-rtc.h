@@ -45,10 +45,11 @@ typedef struct {
 } MTime;
 
 typedef struct {
-  uint8_t dayOfWeek;
+  uint8_t dayOfWeek;                    /**< 1 (Monday) .. 7 (Sunday) */
   uint8_t day;
   uint8_t month;
   int16_t year;
+  uint16_t dayOfYear;                   /**< 1 (1-Jan) .. 366 */
 } MDate;
 
 typedef void (*mtime_time_ready)(bool success, const MTime *time);
@@ -96,6 +97,22 @@ void rtc_get_date(uint32_t mtime, MDate *date);
  */
 uint32_t rtc_to_mtime(const MDate *date, const MTime *time);
 
+/**
+ * Converts the date to the number of days since initial date, 1-Jan-2001
+ * @note The \c year should not be less than 2001, the result is not checked
+ */
+uint32_t rtc_days_from_civil(int16_t year, uint8_t month, uint8_t day);
+
+/**
+ * Converts the number of days since initial date to date, including the day of week/year
+ */
+void rtc_civil_from_days(uint32_t days, MDate *date);
+
+/**
+ * Get the day of year for the date, 1 for 1-Jan
+ */
+uint16_t rtc_day_of_year(int16_t year, uint8_t month, uint8_t day);
+
 #endif /* MCODE_RTC */
 
 #ifdef __cplusplus
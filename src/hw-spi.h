@@ -39,6 +39,20 @@ void spi_set_cs(bool selected);
 
 uint8_t spi_transfer(uint8_t data);
 
+/**
+ * Send a block of bytes, the received bytes are dropped
+ * @param[in] data The bytes to send
+ * @param[in] length The number of bytes in \c data
+ * @note The chip select is not changed, it is kept asserted by the caller
+ *       for the whole transaction
+ */
+void spi_transfer_block(const uint8_t *data, uint16_t length);
+/**
+ * Send a 16-bit word \c count times, the most significant byte first
+ * @note Same as \c spi_transfer_block, the chip select is not changed
+ */
+void spi_transfer_repeat(uint16_t word, uint16_t count);
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
@@ -34,6 +34,16 @@
 extern "C" {
 #endif
 
+/**
+ * The UART transport statistics
+ */
+typedef struct {
+  uint32_t rxBytes;                     /**< The number of the received bytes */
+  uint32_t txBytes;                     /**< The number of the sent bytes */
+  uint32_t rxOverruns;                  /**< The received bytes dropped, the RX buffer is full */
+  uint32_t txOverruns;                  /**< The bytes to send dropped, the TX buffer is full */
+} MUartStats;
+
 typedef void (*hw_uart_char_event)(char aChar);
 typedef void (*hw_uart_handler)(const char *data, size_t length);
 
@@ -44,9 +54,31 @@ void hw_uart_set_callback(hw_uart_char_event aCallback);
 
 void uart_write_char(char ch);
 
+/**
+ * Send all the queued UART output, including UART2, before a reset or power-off
+ * @note Provided by the targets with the buffered UART output
+ */
+void hw_uart_flush(void);
+
+/**
+ * Get the console UART statistics
+ * @note Provided by the targets with the buffered console UART input
+ */
+const MUartStats *hw_uart_stats(void);
+
 #ifdef MCODE_UART2
+/**
+ * The flags of the line received from UART2
+ */
+typedef enum {
+  MUartLineTruncated = 1,               /**< The line is too long, its end is lost */
+  MUartLineOverrun = 2,                 /**< No room for the data, some data before or in the line is lost */
+} MUartLineFlags;
+
 /**
  * Set the callback for receiving data from UART2
+ * @note The callback data points straight to the receive buffer, it is valid
+ *       and NUL-terminated till the callback returns
  */
 void hw_uart2_set_callback(hw_uart_handler cb);
 
@@ -68,6 +100,18 @@ void uart2_handle_new_sample(uint16_t data);
  */
 void uart2_report_new_sample(void);
 
+/**
+ * Get the flags of the line being reported
+ * @return MUartLineFlags, valid in the UART2 callback only
+ */
+uint8_t uart2_line_flags(void);
+
+/**
+ * Get the UART2 transport statistics
+ * @note Provided by the targets with the buffered UART2 transport
+ */
+const MUartStats *hw_uart2_stats(void);
+
 #endif /* MCODE_UART2 */
 
 #ifdef __cplusplus
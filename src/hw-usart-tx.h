@@ -0,0 +1,104 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Alexander Chumakov
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef MCODE_HW_USART_TX_H
+#define MCODE_HW_USART_TX_H
+
+#include "mring.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * The USART transmitter register access, provided by the target
+ * @note Only \c tx_irq is called from the thread context with the TX interrupt enabled,
+ *       the rest is called either from the TX interrupt or with it disabled
+ */
+typedef struct {
+  /** Check if the data register can take the next byte (TXE) */
+  bool (*tx_ready)(void *ctx);
+  /** Write the next byte to the data register */
+  void (*tx_write)(void *ctx, uint8_t data);
+  /** Enable or disable the TX interrupt: TXE, or the DMA transfer complete one */
+  void (*tx_irq)(void *ctx, bool enable);
+  /** Optional, start the DMA transfer, \c NULL for the interrupt-driven transmitter */
+  void (*dma_start)(void *ctx, const char *data, size_t length);
+  /** Optional, check if the DMA transfer is complete, clear the completion flag if it is */
+  bool (*dma_done)(void *ctx);
+  void *ctx;                            /**< The context passed to the functions above */
+} MUsartRegs;
+
+/**
+ * The USART transmitter, the data is queued to the ring and sent from the TX interrupt
+ * or by DMA, the writer waits only if the ring is full
+ * @note The fields are private to the transmitter, the structure is public
+ */
+typedef struct {
+  const MUsartRegs *regs;
+  MRing ring;
+  volatile size_t dmaLength;            /**< The length of the running DMA transfer, '0' if idle */
+  uint32_t stalls;                      /**< The number of writes waited for the room in the ring */
+} MUsartTx;
+
+/**
+ * Initialize the transmitter
+ * @param[in] tx The transmitter to initialize
+ * @param[in] regs The register access, should stay valid while \c tx is used
+ * @param[in] buffer The ring storage
+ * @param[in] capacity The size of \c buffer, should be a power of 2
+ * @return The success status, \c false if \c capacity is not a power of 2
+ */
+bool usart_tx_init(MUsartTx *tx, const MUsartRegs *regs, char *buffer, size_t capacity);
+
+/**
+ * Queue the data for sending, wait only if there is no room for it in the ring
+ * @note Should be used in the thread context only
+ */
+void usart_tx_write(MUsartTx *tx, const char *data, size_t length);
+/**
+ * Queue a single character for sending
+ */
+void usart_tx_write_char(MUsartTx *tx, char ch);
+
+/**
+ * Send all the queued data, wait till it is passed to the USART
+ */
+void usart_tx_flush(MUsartTx *tx);
+
+/**
+ * Handle the TX interrupt: the data register is empty, or the DMA transfer is complete
+ */
+void usart_tx_isr(MUsartTx *tx);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* MCODE_HW_USART_TX_H */
@@ -41,6 +41,20 @@ void line_editor_uart_set_callback (line_editor_uart_ready aCallback);
 void line_editor_reset(void);
 void line_editor_set_echo(bool enabled);
 
+/**
+ * Enter or leave the paste mode
+ * @param[in] enabled Enter the paste mode if \c true, leave it otherwise
+ * @note In the paste mode the input is queued without echo, the complete lines are
+ *       passed to the callback in bulk, when the queue is full and when the mode is left;
+ *       the mode is also entered and left by the bracketed paste markers,
+ *       or left by 'Ctrl-D'; the too long lines are dropped and reported
+ */
+void line_editor_set_paste(bool enabled);
+/**
+ * Check if the paste mode is active
+ */
+bool line_editor_paste(void);
+
 void line_editor_uart_start (void);
 #if 0
 void line_editor_uart_stop (void);
@@ -26,6 +26,7 @@
 #define MCODE_MAIN_H
 
 #include <stdint.h>
+#include <stdbool.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -35,6 +36,14 @@ void main_request_exit(void);
 
 uint16_t main_base_width(void);
 uint16_t main_base_height(void);
+/**
+ * The maximum number of the LCD repaints per second
+ */
+uint16_t main_frame_rate(void);
+/**
+ * The LCD is emulated without the GUI, in a shared memory segment
+ */
+bool main_headless(void);
 
 #ifdef __cplusplus
 } /* extern "C" */
@@ -0,0 +1,132 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Alexander Chumakov
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef MCODE_PDU_H
+#define MCODE_PDU_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** The maximum length of an address, including the end-of-string marker */
+#define MCODE_PDU_ADDRESS_LENGTH (24)
+/** The maximum number of septets in the user data of a single SMS */
+#define MCODE_PDU_MAX_SEPTETS (160)
+/** The maximum number of octets in the user data of a single SMS */
+#define MCODE_PDU_MAX_OCTETS (140)
+/** The maximum length of the PDU in octets, including the SMSC address */
+#define MCODE_PDU_MAX_LENGTH (176)
+/** The length of the user data header for concatenated SMS with 8-bit reference, in octets */
+#define MCODE_PDU_CONCAT_UDH_LENGTH (6)
+/** The maximum number of septets in a part of a concatenated SMS, next to the header */
+#define MCODE_PDU_CONCAT_SEPTETS (153)
+
+typedef enum {
+  MPduTypeDeliver = 0x00, /**< SMS-DELIVER, received by the mobile station */
+  MPduTypeSubmit = 0x01,  /**< SMS-SUBMIT, sent by the mobile station */
+} MPduType;
+
+typedef enum {
+  MPduDcs7bit = 0x00, /**< GSM 7-bit default alphabet */
+  MPduDcs8bit = 0x04, /**< 8-bit data */
+  MPduDcsUcs2 = 0x08, /**< UCS2 */
+} MPduDcs;
+
+/**
+ * The decoded SMS PDU
+ */
+typedef struct {
+  uint8_t type;                           /**< The TPDU type, MPduType */
+  uint8_t dcs;                            /**< The alphabet of the user data, MPduDcs */
+  uint8_t concatTotal;                    /**< The number of parts of a concatenated SMS, '0' for a single SMS */
+  uint8_t concatSeq;                      /**< The 1-based part number of a concatenated SMS */
+  uint16_t concatRef;                     /**< The reference of a concatenated SMS */
+  uint8_t timestamp[7];                   /**< The service centre time stamp in semi-octets, SMS-DELIVER only */
+  uint8_t length;                         /**< The number of characters in \c text */
+  char smsc[MCODE_PDU_ADDRESS_LENGTH];    /**< The SMS centre address, empty for the default one */
+  char address[MCODE_PDU_ADDRESS_LENGTH]; /**< The originating or the destination address */
+  char text[MCODE_PDU_MAX_SEPTETS + 1];   /**< The text, the characters without ASCII equivalents are replaced with '?' */
+} MPduSms;
+
+/**
+ * Pack septets, 8 septets per 7 octets
+ * @param[in] septets The septets to be packed
+ * @param[in] count The number of septets
+ * @param[out] out The packed octets, at least (count*7 + 7)/8 bytes
+ * @return The number of packed octets
+ */
+size_t pdu_pack_7bit(const uint8_t *septets, size_t count, uint8_t *out);
+/**
+ * Unpack septets, 8 septets from each 7 octets
+ * @param[in] in The packed octets, at least (count*7 + 7)/8 bytes
+ * @param[in] count The number of septets to unpack
+ * @param[out] septets The unpacked septets
+ */
+void pdu_unpack_7bit(const uint8_t *in, size_t count, uint8_t *septets);
+
+/**
+ * Select the alphabet for the text
+ * @param[in] text The text to be sent
+ * @param[in] length The text length
+ * @return \c MPduDcs7bit if all the characters are in the GSM 7-bit alphabet,
+ *         \c MPduDcsUcs2 otherwise
+ */
+uint8_t pdu_text_dcs(const char *text, size_t length);
+/**
+ * Get the number of characters that fit a single SMS
+ * @param[in] text The text to be sent
+ * @param[in] length The text length
+ * @param[in] dcs The alphabet, MPduDcs
+ * @param[in] concat The SMS is a part of a concatenated SMS, the header takes some room
+ * @return The number of characters from \c text that fit the SMS
+ */
+size_t pdu_text_fit(const char *text, size_t length, uint8_t dcs, bool concat);
+
+/**
+ * Encode the SMS as a hex string
+ * @param[in] sms The SMS to be encoded, the text not fitting the single SMS is dropped
+ * @param[out] out The hex-encoded PDU, including the SMSC address, terminated with '\0'
+ * @param[in] outMaxLength The size of \c out, (2*MCODE_PDU_MAX_LENGTH + 1) is always enough
+ * @return The TPDU length in octets, not including the SMSC address, as required
+ *         for 'AT+CMGS=<length>', or \c 0 on error
+ */
+size_t pdu_encode(const MPduSms *sms, char *out, size_t outMaxLength);
+/**
+ * Decode the hex-encoded PDU, SMS-DELIVER or SMS-SUBMIT, including the SMSC address
+ * @param[in] pdu The hex-encoded PDU
+ * @param[in] length The length of \c pdu
+ * @param[out] sms The decoded SMS
+ * @return The success status, \c true on success
+ */
+bool pdu_decode(const char *pdu, size_t length, MPduSms *sms);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* MCODE_PDU_H */
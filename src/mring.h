@@ -0,0 +1,109 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Alexander Chumakov
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef MCODE_RING_H
+#define MCODE_RING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+#include <atomic>
+typedef std::atomic<size_t> mring_index;
+extern "C" {
+#else /* __cplusplus */
+#include <stdatomic.h>
+typedef atomic_size_t mring_index;
+#endif /* __cplusplus */
+
+/**
+ * Lock-free single-producer/single-consumer byte ring
+ * @note The indexes are free-running, they are masked on access, so, the full capacity
+ *       is usable; only the producer may push, only the consumer may pop
+ */
+typedef struct {
+  mring_index head;                     /**< The write index, owned by the producer */
+  mring_index tail;                     /**< The read index, owned by the consumer */
+  size_t mask;                          /**< The capacity minus 1 */
+  uint32_t dropped;                     /**< The bytes dropped by the producer, the ring is full */
+  char *data;
+} MRing;
+
+/**
+ * Initialize the ring
+ * @param[in] ring The ring to initialize
+ * @param[in] buffer The ring storage
+ * @param[in] capacity The size of \c buffer, should be a power of 2
+ * @return The success status, \c false if \c capacity is not a power of 2
+ */
+bool mring_init(MRing *ring, char *buffer, size_t capacity);
+
+/**
+ * Get the number of bytes in the ring
+ */
+size_t mring_count(MRing *ring);
+/**
+ * Get the number of bytes that can be pushed to the ring
+ */
+size_t mring_room(MRing *ring);
+
+/**
+ * Push the bytes to the ring, the producer side
+ * @param[in] ring The ring
+ * @param[in] data The bytes to push
+ * @param[in] length The number of bytes in \c data
+ * @param[out] drained Optional, set if the consumer has taken all the data before this
+ *             push, so, it might be waiting for the new data to arrive
+ * @return The number of the pushed bytes, the rest is dropped and counted in \c dropped
+ */
+size_t mring_push(MRing *ring, const char *data, size_t length, bool *drained);
+/**
+ * Push a single byte to the ring, the producer side
+ * @return The success status, \c false if the byte is dropped
+ */
+bool mring_put(MRing *ring, char ch);
+
+/**
+ * Pop up to \c maxLength bytes from the ring, the consumer side
+ * @return The number of bytes copied to \c data
+ */
+size_t mring_pop(MRing *ring, char *data, size_t maxLength);
+/**
+ * Get the contiguous part of the ring data without copying, the consumer side
+ * @param[out] data The pointer to the first byte
+ * @return The number of bytes available at \c data, the rest of the data (if any) is
+ *         returned by the next call, after \c mring_consume
+ */
+size_t mring_peek(MRing *ring, const char **data);
+/**
+ * Release the \c length bytes returned by \c mring_peek, the consumer side
+ */
+void mring_consume(MRing *ring, size_t length);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* MCODE_RING_H */
@@ -101,6 +101,14 @@ void mvar_putch(char ch);
  */
 void mvar_putch_config(int index, int count);
 
+/**
+ * Configure the \c mvar_putch requests to append to the current string
+ * @param[in] index The start index of the output string variable for \c mvar_putch requests
+ * @param[in] count The number of blocks for the output string variables for \c mvar_putch requests
+ * @note Unlike \c mvar_putch_config, the variable buffer is not reset
+ */
+void mvar_putch_config_append(int index, int count);
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
@@ -63,17 +63,17 @@ THE SOFTWARE.
 
 #include "sha256.h"
 
-#define PRIVATE static
+#include <stddef.h>
+#include <string.h> //memset, memcpy
 
-PRIVATE byte_t mask_8bit(byte_t x)
-{
-    return x&0xff;
-}
+#define PRIVATE static
 
-PRIVATE word_t mask_32bit(word_t x)
-{
-    return x&0xffffffff;
-}
+/* The SHA extension is looked up with CPUID and used if present */
+#if defined(__x86_64__) && defined(__linux__) && defined(__GNUC__)
+#define SHA256_HW_X86 1
+#include <cpuid.h>
+#include <immintrin.h>
+#endif /* __x86_64__ && __linux__ && __GNUC__ */
 
 PRIVATE const word_t add_constant[64] = {
     0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
@@ -94,104 +94,231 @@ PRIVATE const word_t add_constant[64] = {
     0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
 };
 
-PRIVATE word_t ch(word_t x, word_t y, word_t z)
+/* word_t is exactly 32 bits, no masking is needed */
+#define rotr(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+#define ch(x, y, z) ((z) ^ ((x) & ((y) ^ (z))))
+#define maj(x, y, z) (((x) & (y)) | ((z) & ((x) | (y))))
+#define bsig0(x) (rotr(x, 2) ^ rotr(x, 13) ^ rotr(x, 22))
+#define bsig1(x) (rotr(x, 6) ^ rotr(x, 11) ^ rotr(x, 25))
+#define ssig0(x) (rotr(x, 7) ^ rotr(x, 18) ^ ((x) >> 3))
+#define ssig1(x) (rotr(x, 17) ^ rotr(x, 19) ^ ((x) >> 10))
+
+PRIVATE word_t load_be32(const unsigned char *p)
 {
-    return (x&y)^((~x)&z);
+#if defined(__GNUC__) && defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__) && !defined(__AVR__)
+    /* A single (possibly unaligned) load and a byte swap */
+    word_t x;
+    memcpy(&x, p, sizeof (x));
+    return __builtin_bswap32(x);
+#else
+    return ((word_t)p[0] << 24) | ((word_t)p[1] << 16) | ((word_t)p[2] << 8) | (word_t)p[3];
+#endif
 }
 
-PRIVATE word_t maj(word_t x, word_t y, word_t z)
+/* The message schedule is kept in a 16-word window, w[i] overwrites w[i-16] */
+#define SCHEDULE(w, i) \
+    (w[(i) & 15] += ssig1(w[((i) - 2) & 15]) + w[((i) - 7) & 15] + ssig0(w[((i) - 15) & 15]))
+
+/* A single round, the variables are rotated by the caller: the next round
+   gets (h, a, b, c, d, e, f, g) as (a, b, c, d, e, f, g, h) */
+#define ROUND(a, b, c, d, e, f, g, h, k, x) do { \
+    const word_t t1 = h + bsig1(e) + ch(e, f, g) + (k) + (x); \
+    d += t1; \
+    h = t1 + bsig0(a) + maj(a, b, c); \
+} while (0)
+
+#define ROUND8(i, x) do { \
+    ROUND(a, b, c, d, e, f, g, h, add_constant[(i) + 0], x((i) + 0)); \
+    ROUND(h, a, b, c, d, e, f, g, add_constant[(i) + 1], x((i) + 1)); \
+    ROUND(g, h, a, b, c, d, e, f, add_constant[(i) + 2], x((i) + 2)); \
+    ROUND(f, g, h, a, b, c, d, e, add_constant[(i) + 3], x((i) + 3)); \
+    ROUND(e, f, g, h, a, b, c, d, add_constant[(i) + 4], x((i) + 4)); \
+    ROUND(d, e, f, g, h, a, b, c, add_constant[(i) + 5], x((i) + 5)); \
+    ROUND(c, d, e, f, g, h, a, b, add_constant[(i) + 6], x((i) + 6)); \
+    ROUND(b, c, d, e, f, g, h, a, add_constant[(i) + 7], x((i) + 7)); \
+} while (0)
+
+PRIVATE void hash256_blocks_portable(word_t *message_digest, unsigned char const *first, size_t blocks)
 {
-    return (x&y)^(x&z)^(y&z);
+    word_t w[16];
+    unsigned i;
+    word_t a,b,c,d,e,f,g,h;
+
+    for (; blocks; --blocks, first += 64) {
+        a = message_digest[0];
+        b = message_digest[1];
+        c = message_digest[2];
+        d = message_digest[3];
+        e = message_digest[4];
+        f = message_digest[5];
+        g = message_digest[6];
+        h = message_digest[7];
+
+#ifdef __AVR__
+        /* Rolled, the unrolled rounds do not fit the flash budget */
+        for (i = 0; i < 64; ++i) {
+            word_t t;
+            if (i < 16) {
+                w[i] = load_be32(first + i*4);
+            } else {
+                SCHEDULE(w, i);
+            }
+            ROUND(a, b, c, d, e, f, g, h, add_constant[i], w[i & 15]);
+            t = h; h = g; g = f; f = e; e = d; d = c; c = b; b = a; a = t;
+        }
+#else /* __AVR__ */
+#define LOAD(i) (w[i] = load_be32(first + (i)*4))
+#define NEXT(i) SCHEDULE(w, i)
+        ROUND8(0, LOAD);
+        ROUND8(8, LOAD);
+        for (i = 16; i < 64; i += 8) {
+            ROUND8(i, NEXT);
+        }
+#undef LOAD
+#undef NEXT
+#endif /* __AVR__ */
+
+        message_digest[0] += a;
+        message_digest[1] += b;
+        message_digest[2] += c;
+        message_digest[3] += d;
+        message_digest[4] += e;
+        message_digest[5] += f;
+        message_digest[6] += g;
+        message_digest[7] += h;
+    }
 }
 
-PRIVATE word_t rotr(word_t x, unsigned n)
+#ifdef SHA256_HW_X86
+/* 4 rounds with the SHA extension, 'cur' holds the message words for the rounds;
+   the schedule for the later rounds is updated in 'next' (msg2) and 'prev' (msg1) */
+#define QUAD(k, cur, prev, next, msg1, msg2) do { \
+    __m128i msg = _mm_add_epi32(cur, _mm_loadu_si128((const __m128i *)&add_constant[4*(k)])); \
+    state1 = _mm_sha256rnds2_epu32(state1, state0, msg); \
+    if (msg2) { \
+        next = _mm_sha256msg2_epu32(_mm_add_epi32(next, _mm_alignr_epi8(cur, prev, 4)), cur); \
+    } \
+    state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(msg, 0x0e)); \
+    if (msg1) { \
+        prev = _mm_sha256msg1_epu32(prev, cur); \
+    } \
+} while (0)
+
+__attribute__((target("sha,sse4.1")))
+PRIVATE void hash256_blocks_shani(word_t *message_digest, unsigned char const *first, size_t blocks)
 {
-//  assert(n < 32);
-    return mask_32bit((x>>n)|(x<<(32-n)));
+    __m128i m0, m1, m2, m3;
+    __m128i state0, state1, tmp, abef, cdgh;
+    const __m128i swap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+    /* The extension works with the ABEF/CDGH word layout */
+    tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&message_digest[0]), 0xb1);
+    state1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&message_digest[4]), 0x1b);
+    state0 = _mm_alignr_epi8(tmp, state1, 8);
+    state1 = _mm_blend_epi16(state1, tmp, 0xf0);
+
+    for (; blocks; --blocks, first += 64) {
+        abef = state0;
+        cdgh = state1;
+
+        m0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(first + 0)), swap);
+        m1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(first + 16)), swap);
+        m2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(first + 32)), swap);
+        m3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(first + 48)), swap);
+
+        QUAD(0, m0, m3, m1, 0, 0);
+        QUAD(1, m1, m0, m2, 1, 0);
+        QUAD(2, m2, m1, m3, 1, 0);
+        QUAD(3, m3, m2, m0, 1, 1);
+        QUAD(4, m0, m3, m1, 1, 1);
+        QUAD(5, m1, m0, m2, 1, 1);
+        QUAD(6, m2, m1, m3, 1, 1);
+        QUAD(7, m3, m2, m0, 1, 1);
+        QUAD(8, m0, m3, m1, 1, 1);
+        QUAD(9, m1, m0, m2, 1, 1);
+        QUAD(10, m2, m1, m3, 1, 1);
+        QUAD(11, m3, m2, m0, 1, 1);
+        QUAD(12, m0, m3, m1, 1, 1);
+        QUAD(13, m1, m0, m2, 0, 1);
+        QUAD(14, m2, m1, m3, 0, 1);
+        QUAD(15, m3, m2, m0, 0, 0);
+
+        state0 = _mm_add_epi32(state0, abef);
+        state1 = _mm_add_epi32(state1, cdgh);
+    }
+
+    /* Back to the ABCD/EFGH layout */
+    tmp = _mm_shuffle_epi32(state0, 0x1b);
+    state1 = _mm_shuffle_epi32(state1, 0xb1);
+    _mm_storeu_si128((__m128i *)&message_digest[0], _mm_blend_epi16(tmp, state1, 0xf0));
+    _mm_storeu_si128((__m128i *)&message_digest[4], _mm_alignr_epi8(state1, tmp, 8));
 }
+#undef QUAD
+
+typedef void (*TSha256Blocks)(word_t *message_digest, unsigned char const *first, size_t blocks);
+
+/** The block function in use, selected on the first use */
+PRIVATE TSha256Blocks TheBlocks;
+/** Set if the CPU supports the SHA extension */
+PRIVATE bool TheHwSupported;
 
-PRIVATE word_t bsig0(word_t x)
+PRIVATE void sha256_select(void)
 {
-    return rotr(x, 2)^rotr(x, 13)^rotr(x, 22);
+    unsigned int eax, ebx, ecx, edx;
+
+    /* SHA in leaf 7 EBX, SSSE3 and SSE4.1 in leaf 1 ECX */
+    TheHwSupported =
+        __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & bit_SSSE3) && (ecx & bit_SSE4_1) &&
+        __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) && (ebx & bit_SHA);
+    TheBlocks = TheHwSupported ? hash256_blocks_shani : hash256_blocks_portable;
 }
 
-PRIVATE word_t bsig1(word_t x)
+PRIVATE void hash256_blocks(word_t *message_digest, unsigned char const *first, size_t blocks)
 {
-    return rotr(x, 6)^rotr(x, 11)^rotr(x, 25);
+    if (!TheBlocks) {
+        sha256_select();
+    }
+    TheBlocks(message_digest, first, blocks);
 }
 
-PRIVATE word_t shr(word_t x,unsigned n)
+bool sha256_set_accelerated(bool enable)
 {
-//  assert(n < 32);
-    return x >> n;
+    const bool was = sha256_accelerated();
+
+    TheBlocks = (enable && TheHwSupported) ? hash256_blocks_shani : hash256_blocks_portable;
+    return was;
 }
 
-PRIVATE word_t ssig0(word_t x)
+bool sha256_accelerated(void)
 {
-    return rotr(x, 7)^rotr(x, 18)^shr(x, 3);
+    if (!TheBlocks) {
+        sha256_select();
+    }
+    return TheBlocks == hash256_blocks_shani;
 }
+#else /* SHA256_HW_X86 */
+#define hash256_blocks hash256_blocks_portable
 
-PRIVATE word_t ssig1(word_t x)
+bool sha256_set_accelerated(bool enable)
 {
-    return rotr(x, 17)^rotr(x, 19)^shr(x, 10);
+    (void)enable;
+    return false;
 }
 
-PRIVATE void hash256_block(word_t *message_digest, unsigned char const *first/*, unsigned char const * last*/)
+bool sha256_accelerated(void)
 {
-    word_t w[64];
-    unsigned i;
-    word_t a,b,c,d,e,f,g,h;
-    //(all w[] are written anyway) memset(w,'\0',sizeof w);
-
-    for(i = 0; i < 16; ++i){
-        w[i] = ((word_t)(mask_8bit(*(first+i*4)))<<24)
-            |((word_t)(mask_8bit(*(first+i*4+1)))<<16)
-            |((word_t)(mask_8bit(*(first+i*4+2)))<<8)
-            |((word_t)(mask_8bit(*(first+i*4+3))));
-    }
-    for(i = 16; i < 64; ++i){
-        w[i] = mask_32bit(ssig1(w[i-2])+w[i-7]+ssig0(w[i-15])+w[i-16]);
-    }
-
-    a = *message_digest;
-    b = *(message_digest+1);
-    c = *(message_digest+2);
-    d = *(message_digest+3);
-    e = *(message_digest+4);
-    f = *(message_digest+5);
-    g = *(message_digest+6);
-    h = *(message_digest+7);
-
-    for( i = 0; i < 64; ++i){
-        word_t temp1 = h+bsig1(e)+ch(e,f,g)+add_constant[i]+w[i];
-        word_t temp2 = bsig0(a)+maj(a,b,c);
-        h = g;
-        g = f;
-        f = e;
-        e = mask_32bit(d+temp1);
-        d = c;
-        c = b;
-        b = a;
-        a = mask_32bit(temp1+temp2);
-    }
-    *message_digest += a;
-    *(message_digest+1) += b;
-    *(message_digest+2) += c;
-    *(message_digest+3) += d;
-    *(message_digest+4) += e;
-    *(message_digest+5) += f;
-    *(message_digest+6) += g;
-    *(message_digest+7) += h;
-    for(i = 0; i < 8; ++i){
-        *(message_digest+i) = mask_32bit(*(message_digest+i));
-    }
+    return false;
 }
+#endif /* SHA256_HW_X86 */
+
+#undef ROUND8
+#undef ROUND
+#undef SCHEDULE
 /**************************************************************/
 
 /**************************************************************/
 //[[librock_sha256]] By Forrest Cavalier III, MIB SOFTWARE, INC.
 /* See MIT LICENSE above for copyright and license statement.*/
-#include <string.h> //memset
 
 int librock_SHA256_Init(struct librock_SHA256_CTX *c)
 {
@@ -237,13 +364,14 @@ int librock_SHA256_Update(struct librock_SHA256_CTX *c, const void *data_, int l
     if (c->nBuffer > 0 && (len - i + c->nBuffer >= 64)) {
         memcpy(c->buffer+c->nBuffer,(char *)data_+i,64 - c->nBuffer);
         i += 64 - c->nBuffer;
-        hash256_block(c->h_, c->buffer);
+        hash256_blocks(c->h_, c->buffer, 1);
         c->nBuffer = 0;
     }
     /* If len - i >= 64, then we know c->nBuffer was set to 0, and we can work in full blocks */
-    while(len - i >= 64) { /* Do as many blocks as possible without copies */
-        hash256_block(c->h_, (unsigned char *)data_+i);
-        i += 64;
+    if (len - i >= 64) { /* Do as many blocks as possible without copies */
+        const int blocks = (len - i) / 64;
+        hash256_blocks(c->h_, (unsigned char *)data_+i, blocks);
+        i += blocks * 64;
     }
     if (len - i > 0) { /* Save partial */
         memcpy(c->buffer+c->nBuffer,(char *)data_+i,len - i);
@@ -261,7 +389,7 @@ int librock_SHA256_StoreFinal (unsigned char *md, struct librock_SHA256_CTX *c)
 
     if(c->nBuffer > 55) {
         memset(c->buffer+c->nBuffer+1,'\0', 64-c->nBuffer-1);
-        hash256_block(c->h_, c->buffer);
+        hash256_blocks(c->h_, c->buffer, 1);
         memset(c->buffer,'\0', 56);
     } else {
         memset(c->buffer+c->nBuffer+1,'\0', 56-c->nBuffer-1);
@@ -286,7 +414,7 @@ int librock_SHA256_StoreFinal (unsigned char *md, struct librock_SHA256_CTX *c)
             (*begin++) = (unsigned char)(c->data_length_digits_[i]);
         }
     }
-    hash256_block(c->h_, c->buffer);
+    hash256_blocks(c->h_, c->buffer, 1);
 
     memset(c->buffer,'\0',sizeof c->buffer); //Clear temporary buffer.
     for(i = 0; i < 8; i++) {
@@ -307,6 +435,74 @@ void sha256(const void *data, int length, uint8_t *md)
   librock_SHA256_StoreFinal(md, &ctx);
 }
 
+/**************************************************************/
+//[[HMAC-SHA256]] RFC 2104, on top of the librock_SHA256 context
+
+#define HMAC_BLOCK_LENGTH (64)
+
+void hmac_sha256_init(HMAC_SHA256_CTX *c, const void *key, int keylen)
+{
+    int i;
+    SHA256_CTX outer;
+    uint8_t pad[HMAC_BLOCK_LENGTH];
+    uint8_t hash[MD_LENGTH_SHA256];
+
+    /* The long keys are replaced with their hash */
+    if (keylen > HMAC_BLOCK_LENGTH) {
+        sha256(key, keylen, hash);
+        key = hash;
+        keylen = MD_LENGTH_SHA256;
+    }
+    memset(pad, 0, sizeof (pad));
+    memcpy(pad, key, keylen);
+
+    for (i = 0; i < HMAC_BLOCK_LENGTH; ++i) {
+        pad[i] ^= 0x36;
+    }
+    librock_SHA256_Init(&c->inner);
+    librock_SHA256_Update(&c->inner, pad, HMAC_BLOCK_LENGTH);
+
+    /* Only the state after the outer key block is kept */
+    for (i = 0; i < HMAC_BLOCK_LENGTH; ++i) {
+        pad[i] ^= 0x36 ^ 0x5c;
+    }
+    librock_SHA256_Init(&outer);
+    librock_SHA256_Update(&outer, pad, HMAC_BLOCK_LENGTH);
+    memcpy(c->outer, outer.h_, sizeof (c->outer));
+
+    memset(pad, 0, sizeof (pad));
+    memset(hash, 0, sizeof (hash));
+}
+
+void hmac_sha256_update(HMAC_SHA256_CTX *c, const void *data, int len)
+{
+    librock_SHA256_Update(&c->inner, data, len);
+}
+
+void hmac_sha256_final(uint8_t *md, HMAC_SHA256_CTX *c)
+{
+    SHA256_CTX outer;
+
+    librock_SHA256_StoreFinal(md, &c->inner);
+
+    /* Continue the outer hash after its key block */
+    librock_SHA256_Init(&outer);
+    memcpy(outer.h_, c->outer, sizeof (c->outer));
+    outer.data_length_digits_[0] = HMAC_BLOCK_LENGTH;
+    librock_SHA256_Update(&outer, md, MD_LENGTH_SHA256);
+    librock_SHA256_StoreFinal(md, &outer);
+
+    memset(c, 0, sizeof (*c));
+}
+
+void hmac_sha256(const void *key, int keylen, const void *data, int len, uint8_t *md)
+{
+    HMAC_SHA256_CTX ctx;
+    hmac_sha256_init(&ctx, key, keylen);
+    hmac_sha256_update(&ctx, data, len);
+    hmac_sha256_final(md, &ctx);
+}
+
 /**************************************************************/
 //[[Typical Example main]]  By Forrest Cavalier III, MIB SOFTWARE, INC.
 /* See MIT LICENSE above for copyright and license statement. */
@@ -75,6 +75,11 @@ THE SOFTWARE.
 #define MCODE_SECURITY_SHA256_H_
 
 #include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
 
 typedef uint32_t word_t;
 typedef uint8_t byte_t;
@@ -96,4 +101,46 @@ int librock_SHA256_StoreFinal (unsigned char *md, SHA256_CTX *c);
 
 void sha256(const void *data, int length, uint8_t *md);
 
+/**
+ * HMAC-SHA256 context, the data is hashed with the inner context as it arrives
+ */
+typedef struct {
+    SHA256_CTX inner;
+    word_t outer[8];    /**< The outer hash state after the key block */
+} HMAC_SHA256_CTX;
+
+/**
+ * Start HMAC-SHA256 calculation with \c key
+ * @note The keys longer than 64 bytes are replaced with their SHA-256 hash
+ */
+void hmac_sha256_init(HMAC_SHA256_CTX *c, const void *key, int keylen);
+/**
+ * Add \c len bytes from \c data to HMAC-SHA256 calculation
+ */
+void hmac_sha256_update(HMAC_SHA256_CTX *c, const void *data, int len);
+/**
+ * Store the MAC (32 bytes) to \c md, the context is cleared
+ */
+void hmac_sha256_final(uint8_t *md, HMAC_SHA256_CTX *c);
+/**
+ * Calculate HMAC-SHA256 of \c data in a single call
+ */
+void hmac_sha256(const void *key, int keylen, const void *data, int len, uint8_t *md);
+
+/**
+ * Check if the block transform uses the CPU SHA extension
+ * @note Only available on x86-64 Linux, the portable code is used elsewhere
+ */
+bool sha256_accelerated(void);
+/**
+ * Enable/disable the CPU SHA extension, for the tests and benchmarks
+ * @param[in] enable Use the extension if the CPU supports it
+ * @return The previous state
+ */
+bool sha256_set_accelerated(bool enable);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
 #endif /* MCODE_SECURITY_SHA256_H_ */
@@ -109,3 +109,39 @@ uint8_t spi_transfer(uint8_t data)
   const uint8_t byte = SPI_I2S_ReceiveData(SPI1);
   return byte;
 }
+
+/**
+ * Wait for the last byte to leave the shift register, drop the received bytes
+ */
+static void spi_finish_write(void)
+{
+  while (SPI_I2S_GetFlagStatus(SPI1, SPI_I2S_FLAG_TXE) == RESET) {}
+  while (SPI_I2S_GetFlagStatus(SPI1, SPI_I2S_FLAG_BSY) != RESET) {}
+  /* Clear RXNE and the overrun flag */
+  SPI_I2S_ReceiveData(SPI1);
+  SPI_I2S_GetFlagStatus(SPI1, SPI_I2S_FLAG_OVR);
+}
+
+void spi_transfer_block(const uint8_t *data, uint16_t length)
+{
+  /* The next byte is queued as soon as the data register is free */
+  while (length--) {
+    while (SPI_I2S_GetFlagStatus(SPI1, SPI_I2S_FLAG_TXE) == RESET) {}
+    SPI_I2S_SendData(SPI1, *data++);
+  }
+  spi_finish_write();
+}
+
+void spi_transfer_repeat(uint16_t word, uint16_t count)
+{
+  const uint8_t high = word >> 8;
+  const uint8_t low = word;
+
+  while (count--) {
+    while (SPI_I2S_GetFlagStatus(SPI1, SPI_I2S_FLAG_TXE) == RESET) {}
+    SPI_I2S_SendData(SPI1, high);
+    while (SPI_I2S_GetFlagStatus(SPI1, SPI_I2S_FLAG_TXE) == RESET) {}
+    SPI_I2S_SendData(SPI1, low);
+  }
+  spi_finish_write();
+}
@@ -25,6 +25,7 @@
 #include "hw-uart.h"
 
 #include "scheduler.h"
+#include "hw-usart-tx.h"
 
 #include <stm32f10x.h>
 
@@ -32,7 +33,27 @@
 #error Unsupported device
 #endif /* STM32F10X_MD || STM32F10X_HD */
 
+/** The TX ring sizes, should be a power of 2 */
+#define MCODE_UART_TX_LENGTH (256)
+#define MCODE_UART2_TX_LENGTH (512)
+
 static hw_uart_char_event TheCallback = NULL;
+
+static bool usart1_tx_ready(void *ctx);
+static void usart1_tx_write(void *ctx, uint8_t data);
+static void usart1_tx_irq(void *ctx, bool enable);
+
+static MUsartTx TheUartTx;
+static char TheUartTxBuffer[MCODE_UART_TX_LENGTH];
+/** USART1 is served by the TXE interrupt */
+static const MUsartRegs TheUartRegs = {
+  usart1_tx_ready,
+  usart1_tx_write,
+  usart1_tx_irq,
+  NULL,
+  NULL,
+  NULL,
+};
 #ifdef MCODE_UART2
 #define MCODE_UART_READ_TIMEOUT (100) /*< 100ms */
 #define UART2_READ_BUFFERS_COUNT (4)
@@ -57,6 +78,21 @@ typedef struct _TLineReaderState {
 
 volatile static TLineReaderState TheUart2State = {{0}};
 
+static void usart2_tx_irq(void *ctx, bool enable);
+static void usart2_dma_start(void *ctx, const char *data, size_t length);
+static bool usart2_dma_done(void *ctx);
+
+static MUsartTx TheUart2Tx;
+static char TheUart2TxBuffer[MCODE_UART2_TX_LENGTH];
+/** USART2 is served by DMA1 channel 7 */
+static const MUsartRegs TheUart2Regs = {
+  NULL,
+  NULL,
+  usart2_tx_irq,
+  usart2_dma_start,
+  usart2_dma_done,
+  NULL,
+};
 #endif /* MCODE_UART2 */
 
 static void hw_uart_tick(void);
@@ -91,6 +127,16 @@ void hw_uart_init (void)
   /* Start the device */
   USART_Cmd(USART1, ENABLE);
 
+  /* The TX ring, the TXE interrupt is enabled when there is data to send */
+  usart_tx_init(&TheUartTx, &TheUartRegs, TheUartTxBuffer, sizeof (TheUartTxBuffer));
+  NVIC_PriorityGroupConfig(NVIC_PriorityGroup_0);
+  NVIC_InitTypeDef nvicConfig;
+  nvicConfig.NVIC_IRQChannel = USART1_IRQn;
+  nvicConfig.NVIC_IRQChannelPreemptionPriority = 0;
+  nvicConfig.NVIC_IRQChannelSubPriority = 1;
+  nvicConfig.NVIC_IRQChannelCmd = ENABLE;
+  NVIC_Init(&nvicConfig);
+
 #ifdef MCODE_UART2
     /* Init USART2 clocks */
   RCC_APB1PeriphClockCmd(RCC_APB1Periph_USART2, ENABLE);
@@ -113,14 +159,31 @@ void hw_uart_init (void)
   USART_Cmd(USART2, ENABLE);
 
   /* Enable the USART2 Interrupt */
-  NVIC_PriorityGroupConfig(NVIC_PriorityGroup_0);
-  NVIC_InitTypeDef nvicConfig;
   nvicConfig.NVIC_IRQChannel = USART2_IRQn;
   nvicConfig.NVIC_IRQChannelSubPriority = 0;
   nvicConfig.NVIC_IRQChannelCmd = ENABLE;
   NVIC_Init(&nvicConfig);
 
   USART_ITConfig(USART2, USART_IT_RXNE, ENABLE);
+
+  /* USART2 TX DMA: DMA1 channel 7, memory to USART2_DR, byte by byte */
+  RCC_AHBPeriphClockCmd(RCC_AHBPeriph_DMA1, ENABLE);
+  DMA_InitTypeDef dmaConfig;
+  DMA_StructInit(&dmaConfig);
+  dmaConfig.DMA_PeripheralBaseAddr = (uint32_t)&USART2->DR;
+  dmaConfig.DMA_DIR = DMA_DIR_PeripheralDST;
+  dmaConfig.DMA_MemoryInc = DMA_MemoryInc_Enable;
+  dmaConfig.DMA_PeripheralDataSize = DMA_PeripheralDataSize_Byte;
+  dmaConfig.DMA_MemoryDataSize = DMA_MemoryDataSize_Byte;
+  DMA_Init(DMA1_Channel7, &dmaConfig);
+  DMA_ITConfig(DMA1_Channel7, DMA_IT_TC, ENABLE);
+  USART_DMACmd(USART2, USART_DMAReq_Tx, ENABLE);
+  usart_tx_init(&TheUart2Tx, &TheUart2Regs, TheUart2TxBuffer, sizeof (TheUart2TxBuffer));
+
+  nvicConfig.NVIC_IRQChannel = DMA1_Channel7_IRQn;
+  nvicConfig.NVIC_IRQChannelSubPriority = 2;
+  nvicConfig.NVIC_IRQChannelCmd = ENABLE;
+  NVIC_Init(&nvicConfig);
 #endif /* MCODE_UART2 */
 
   scheduler_add(hw_uart_tick);
@@ -133,17 +196,85 @@ void hw_uart_set_callback(hw_uart_char_event aCallback)
 
 void uart_write_char(char ch)
 {
-  /* Wait until USART1 DR register is empty */
-  while (USART_GetFlagStatus(USART1, USART_FLAG_TXE) == RESET);
-  USART_SendData(USART1, ch);
+  /* Queue the character, wait only if the TX ring is full */
+  usart_tx_write_char(&TheUartTx, ch);
+}
+
+void hw_uart_flush(void)
+{
+  /* The last character is sent when it leaves the shift register */
+  usart_tx_flush(&TheUartTx);
+  while (USART_GetFlagStatus(USART1, USART_FLAG_TC) == RESET) {
+  }
+#ifdef MCODE_UART2
+  usart_tx_flush(&TheUart2Tx);
+  while (USART_GetFlagStatus(USART2, USART_FLAG_TC) == RESET) {
+  }
+#endif /* MCODE_UART2 */
+}
+
+bool usart1_tx_ready(void *ctx)
+{
+  return USART_GetFlagStatus(USART1, USART_FLAG_TXE) != RESET;
+}
+
+void usart1_tx_write(void *ctx, uint8_t data)
+{
+  USART_SendData(USART1, data);
+}
+
+void usart1_tx_irq(void *ctx, bool enable)
+{
+  USART_ITConfig(USART1, USART_IT_TXE, enable ? ENABLE : DISABLE);
+}
+
+/* USART1 IRQ handler */
+void USART1_IRQHandler(void)
+{
+  if (USART_GetITStatus(USART1, USART_IT_TXE) != RESET) {
+    usart_tx_isr(&TheUartTx);
+  }
 }
 
 #ifdef MCODE_UART2
 void uart2_write_char(char ch)
 {
-  /* Wait until USART1 DR register is empty */
-  while (USART_GetFlagStatus(USART2, USART_FLAG_TXE) == RESET);
-  USART_SendData(USART2, ch);
+  /* Queue the character, wait only if the TX ring is full */
+  usart_tx_write_char(&TheUart2Tx, ch);
+}
+
+void usart2_tx_irq(void *ctx, bool enable)
+{
+  /* The channel configuration is not changed while it runs, mask the interrupt in NVIC */
+  if (enable) {
+    NVIC_EnableIRQ(DMA1_Channel7_IRQn);
+  } else {
+    NVIC_DisableIRQ(DMA1_Channel7_IRQn);
+  }
+}
+
+void usart2_dma_start(void *ctx, const char *data, size_t length)
+{
+  DMA_Cmd(DMA1_Channel7, DISABLE);
+  DMA1_Channel7->CMAR = (uint32_t)data;
+  DMA_SetCurrDataCounter(DMA1_Channel7, length);
+  DMA_Cmd(DMA1_Channel7, ENABLE);
+}
+
+bool usart2_dma_done(void *ctx)
+{
+  if (DMA_GetFlagStatus(DMA1_FLAG_TC7) == RESET) {
+    return false;
+  }
+
+  DMA_ClearFlag(DMA1_FLAG_TC7);
+  return true;
+}
+
+/* DMA1 channel 7 IRQ handler, USART2 TX transfer complete */
+void DMA1_Channel7_IRQHandler(void)
+{
+  usart_tx_isr(&TheUart2Tx);
 }
 #endif /* MCODE_UART2 */
 
@@ -26,6 +26,7 @@
 
 #include "mtick.h"
 #include "hw-leds.h"
+#include "hw-uart.h"
 #include "scheduler.h"
 
 #include <stm32f10x.h>
@@ -71,11 +72,15 @@ void system_deinit(void)
 
 void poweroff(void)
 {
+  /* The queued output is lost with the power */
+  hw_uart_flush();
   GPIO_WriteBit(GPIOB, GPIO_Pin_12, Bit_SET);
 }
 
 void reboot(void)
 {
+  /* The queued output is lost with the reset */
+  hw_uart_flush();
   NVIC_SystemReset();
 }
 
@@ -0,0 +1,122 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Alexander Chumakov
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef MCODE_TWI_QUEUE_H
+#define MCODE_TWI_QUEUE_H
+
+#include "mcode-config.h"
+
+#include "mglobal.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef MCODE_TWI
+
+#ifndef MCODE_TWI_QUEUE_LENGTH
+/** The number of the pending TWI transactions, including the active one */
+#define MCODE_TWI_QUEUE_LENGTH (4)
+#endif /* MCODE_TWI_QUEUE_LENGTH */
+
+#ifndef MCODE_TWI_RETRIES
+/** The default number of the retries, for the synchronous transfers and the drivers */
+#define MCODE_TWI_RETRIES (3)
+#endif /* MCODE_TWI_RETRIES */
+
+#ifndef MCODE_TWI_RETRY_DELAY
+/** The delay before repeating a NACK-ed transaction, in milli-seconds; longer than
+    the 5 ms write cycle of 24Cxx EEPROM, the timer tick may come up to 1 ms early */
+#define MCODE_TWI_RETRY_DELAY (6)
+#endif /* MCODE_TWI_RETRY_DELAY */
+
+/**
+ * TWI transaction: an optional write, followed by an optional read from the same device
+ * @note The write and the read are separate transfers, no other transaction is
+ *       started in between
+ */
+typedef struct {
+  uint8_t addr;                         /**< The device address, the R/W bit is ignored */
+  uint8_t writeLength;                  /**< The number of bytes to write, may be 0 */
+  uint8_t readLength;                   /**< The number of bytes to read, may be 0 */
+  uint8_t retries;                      /**< The retries of the whole transaction, if the device NACKs,
+                                             each after \c MCODE_TWI_RETRY_DELAY */
+  const uint8_t *writeData;             /**< Should be valid till the transaction completes */
+  mcode_read_ready callback;            /**< Optional, gets the read data, if any */
+} MTwiTransaction;
+
+/**
+ * The TWI queue statistics
+ */
+typedef struct {
+  uint32_t completed;                   /**< The successful transactions */
+  uint32_t failed;                      /**< The transactions failed after all the retries */
+  uint32_t retries;                     /**< The repeated attempts */
+  uint32_t rejected;                    /**< The transactions not queued, the queue is full */
+} MTwiQueueStats;
+
+/**
+ * Initialize the queue, should be called after \c twi_init
+ */
+void twi_queue_init(void);
+void twi_queue_deinit(void);
+
+/**
+ * Queue the transaction, it is started when the previous ones complete
+ * @param[in] transaction The transaction, copied to the queue
+ * @return The success status, \c false if the queue is full or the transaction is empty;
+ *         the callback is not called in this case
+ */
+bool twi_queue_submit(const MTwiTransaction *transaction);
+
+/**
+ * Queue the transaction and run the scheduler till it completes
+ * @param[out] readData Receives \c readLength bytes
+ * @return The success status
+ * @note Should not be called from the TWI queue callbacks
+ */
+bool twi_queue_transfer_sync(uint8_t addr, uint8_t writeLength, const uint8_t *writeData,
+                             uint8_t readLength, uint8_t *readData);
+
+/**
+ * Check if any transaction is queued or in progress
+ */
+bool twi_queue_busy(void);
+
+/**
+ * Get the queue statistics
+ */
+const MTwiQueueStats *twi_queue_stats(void);
+
+#endif /* MCODE_TWI */
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* MCODE_TWI_QUEUE_H */
@@ -65,6 +65,16 @@ FUNCTION ( enable_random_numbers COUNT )
   ENDIF ()
 ENDFUNCTION ( enable_random_numbers )
 
+FUNCTION ( enable_glyph_cache COUNT )
+  IF ( ${COUNT} EQUAL 0 )
+    message ( "-- No glyph cache" )
+  ELSE ()
+    message ( "-- Glyph cache: ${COUNT} glyphs" )
+    set ( MCODE_GLYPH_CACHE ON BOOL PARENT_SCOPE )
+    set ( MCODE_GLYPH_CACHE_SIZE ${COUNT} PARENT_SCOPE )
+  ENDIF ()
+ENDFUNCTION ( enable_glyph_cache )
+
 FUNCTION ( publish_phone )
   if ( NOT DEFINED MCODE_DEFAULT_PHONE_NUMBER )
     set ( MCODE_DEFAULT_PHONE_NUMBER "+70001112233" PARENT_SCOPE )